@@ -0,0 +1,379 @@
+/*  Quincy IDE for the Pawn scripting language
+ *
+ *  Copyright CompuPhase, 2009-2024
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License"); you may not
+ *  use this file except in compliance with the License. You may obtain a copy
+ *  of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS, WITHOUT
+ *  WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. See the
+ *  License for the specific language governing permissions and limitations
+ *  under the License.
+ *
+ *  Version: $Id$
+ */
+#include "wxQuincy.h"
+#include <wx/filepicker.h>
+#include <wx/spinctrl.h>
+#include <wx/textfile.h>
+#include <stdlib.h>
+#include "DeviceSimulator.h"
+#if defined __linux__
+    #include <errno.h>
+    #include <poll.h>
+    #include <pty.h>
+    #include <termios.h>
+    #include <unistd.h>
+#endif
+
+#define FRAME_MARK      0xbf
+#define MAX_PAYLOAD     (TRANSFER_BLOCKSIZE + 256)  /* data block, or start frame with a file name */
+
+static unsigned long get32(const unsigned char* buffer)
+{
+    return buffer[0] | ((unsigned long)buffer[1] << 8) | ((unsigned long)buffer[2] << 16) | ((unsigned long)buffer[3] << 24);
+}
+
+CDeviceSimulator::CDeviceSimulator(const SimulatorOptions& options)
+    : wxThread(wxTHREAD_JOINABLE), m_options(options), m_master(-1), m_slave(-1),
+      m_nakpercent(options.NakPercent), m_droppercent(options.DropPercent),
+      m_frames(0), m_naks(0), m_drops(0), m_received(0), m_budget(0),
+      m_newsize(0), m_patching(false), m_lastseq(-1), m_lasttype(0)
+{
+}
+
+CDeviceSimulator::~CDeviceSimulator()
+{
+#if defined __linux__
+    if (m_master >= 0)
+        close(m_master);
+    if (m_slave >= 0)
+        close(m_slave);
+#endif
+}
+
+/** Create() creates the pseudo-terminal and loads the script; it must be
+ *  called before the thread is run.
+ */
+bool CDeviceSimulator::Create(wxString& error)
+{
+    if (m_options.Script.length() > 0 && !LoadScript(m_options.Script, m_rules, error))
+        return false;
+#if defined __linux__
+    char name[64];
+    if (openpty(&m_master, &m_slave, name, NULL, NULL) != 0) {
+        error = "A pseudo-terminal could not be created.";
+        return false;
+    }
+    struct termios tio;
+    tcgetattr(m_slave, &tio);
+    cfmakeraw(&tio);
+    tcsetattr(m_slave, TCSANOW, &tio);
+    m_portname = name;
+    return true;
+#else
+    error = "The device simulator needs pseudo-terminals, which are not available on this system.";
+    return false;
+#endif
+}
+
+/** LoadScript() reads the rules for the simulated remote debugging target
+ *  (see the description of the class).
+ */
+bool CDeviceSimulator::LoadScript(const wxString& path, std::vector<SimulatorRule>& rules, wxString& error)
+{
+    wxTextFile file;
+    if (!file.Open(path)) {
+        error = "The script " + path + " could not be read.";
+        return false;
+    }
+    rules.clear();
+    for (size_t num = 0; num < file.GetLineCount(); num++) {
+        wxString line = file[num];
+        if (line.length() == 0 || line[0] == '#')
+            continue;
+        int sep = line.Find(" -> ");
+        if (sep == wxNOT_FOUND) {
+            error = wxString::Format("Syntax error on line %d of %s.", (int)num + 1, path.c_str());
+            return false;
+        }
+        wxString text = line.Mid(sep + 4);
+        std::string reply;
+        for (unsigned idx = 0; idx < text.length(); idx++) {
+            wxChar ch = text[idx];
+            if (ch == '\\' && idx + 1 < text.length()) {
+                ch = text[++idx];
+                if (ch == 'n') {
+                    ch = '\n';
+                } else if (ch == 'r') {
+                    ch = '\r';
+                } else if (ch == 't') {
+                    ch = '\t';
+                } else if (ch == 'x' && idx + 2 < text.length()) {
+                    unsigned long value;
+                    if (text.Mid(idx + 1, 2).ToULong(&value, 16)) {
+                        ch = (wxChar)value;
+                        idx += 2;
+                    }
+                }
+            }
+            reply += (char)ch;
+        }
+        rules.push_back(SimulatorRule(line.Left(sep), reply));
+    }
+    return true;
+}
+
+/** Throttle() waits for as long as the simulated line needs to transport the
+ *  given number of bytes; without a rate limit, it returns immediately.
+ */
+void CDeviceSimulator::Throttle(size_t size)
+{
+    if (m_options.Rate <= 0)
+        return;
+    wxLongLong now = wxGetUTCTimeUSec();
+    if (m_budget < now)
+        m_budget = now;
+    m_budget += wxLongLong(size) * 1000000 / m_options.Rate;
+    long wait = (m_budget - now).ToLong();
+    if (wait > 0)
+        wxMicroSleep(wait);
+}
+
+void CDeviceSimulator::Send(const unsigned char* data, size_t size)
+{
+#if defined __linux__
+    Throttle(size);
+    while (size > 0) {
+        ssize_t count = write(m_master, data, size);
+        if (count < 0) {
+            if (errno == EINTR)
+                continue;
+            break;
+        }
+        data += count;
+        size -= (size_t)count;
+    }
+#else
+    (void)data;
+    (void)size;
+#endif
+}
+
+void CDeviceSimulator::Reply(int type, int seq)
+{
+    unsigned char reply[4];
+    reply[0] = FRAME_MARK;
+    reply[1] = (unsigned char)type;
+    reply[2] = (unsigned char)seq;
+    reply[3] = (unsigned char)(seq >> 8);
+    Send(reply, sizeof reply);
+}
+
+/** HandleFrame() handles the frame at the start of the receive buffer, and
+ *  removes it from the buffer. It returns false if the frame is not complete.
+ */
+bool CDeviceSimulator::HandleFrame()
+{
+    if (m_rx.size() < 6)
+        return false;
+    int type = m_rx[1];
+    int seq = m_rx[2] | (m_rx[3] << 8);
+    size_t length = m_rx[4] | (m_rx[5] << 8);
+    if (length > MAX_PAYLOAD) {
+        m_rx.erase(m_rx.begin());   /* not a frame, skip the mark */
+        return true;
+    }
+    size_t total = 6 + length + 4;
+    if (m_rx.size() < total)
+        return false;
+    const unsigned char* payload = &m_rx[6];
+    bool valid = (CSerialTransfer::Crc32(0, &m_rx[1], 5 + length) == get32(&m_rx[6 + length]));
+    m_frames++;
+
+    int reply = 'A';
+    if (rand() % 100 < m_droppercent) {
+        m_drops++;
+        reply = 0;
+    } else if (!valid || rand() % 100 < m_nakpercent) {
+        if (valid)
+            m_naks++;
+        reply = 'N';
+    } else if (seq == m_lastseq && type == m_lasttype) {
+        /* the acknowledge for this frame was lost; acknowledge again, but do
+           not apply it twice */
+    } else {
+        switch (type) {
+        case 'S':
+            m_newsize = (length >= 4) ? get32(payload) : 0;
+            m_incoming.clear();
+            m_patching = false;
+            break;
+        case 'P':
+            if (!m_options.Patching || length < 8 || m_image.size() == 0
+                || CSerialTransfer::Crc32(0, &m_image[0], m_image.size()) != get32(payload + 4)) {
+                reply = 'U';
+            } else {
+                m_newsize = get32(payload);
+                m_incoming.clear();
+                m_patching = true;
+            }
+            break;
+        case 'C': {
+            unsigned long offset = (length >= 8) ? get32(payload) : 0;
+            unsigned long count = (length >= 8) ? get32(payload + 4) : 0;
+            if (!m_patching || offset > m_image.size() || count > m_image.size() - offset)
+                reply = 'N';
+            else
+                m_incoming.insert(m_incoming.end(), m_image.begin() + offset, m_image.begin() + offset + count);
+            break;
+        } /* case */
+        case 'D':
+            m_incoming.insert(m_incoming.end(), payload, payload + length);
+            break;
+        case 'E':
+            if (m_incoming.size() != m_newsize)
+                reply = 'N';
+            else if (m_patching && (length < 4 || m_incoming.size() == 0
+                                    || CSerialTransfer::Crc32(0, &m_incoming[0], m_incoming.size()) != get32(payload)))
+                reply = 'N';
+            else
+                m_image.swap(m_incoming);
+            m_incoming.clear();
+            m_patching = false;
+            break;
+        }
+        if (reply == 'A') {
+            m_lastseq = seq;
+            m_lasttype = type;
+        }
+    }
+    m_rx.erase(m_rx.begin(), m_rx.begin() + total);
+    if (reply != 0)
+        Reply(reply, seq);
+    return true;
+}
+
+/** HandleLine() sends the reply of the first rule that matches the line. */
+void CDeviceSimulator::HandleLine()
+{
+    wxString line(m_line.c_str(), wxConvISO8859_1);
+    for (unsigned idx = 0; idx < m_rules.size(); idx++) {
+        if (line.StartsWith(m_rules[idx].Expect)) {
+            const std::string& reply = m_rules[idx].Reply;
+            if (reply.length() > 0)
+                Send((const unsigned char*)reply.data(), reply.length());
+            break;
+        }
+    }
+}
+
+void CDeviceSimulator::Process(const unsigned char* data, size_t size)
+{
+    m_rx.insert(m_rx.end(), data, data + size);
+    /* the text before a frame is removed from the buffer in one go */
+    size_t pos = 0;
+    while (pos < m_rx.size()) {
+        if (m_rx[pos] == FRAME_MARK) {
+            if (pos + 1 >= m_rx.size())
+                break;      /* wait for the type */
+            int type = m_rx[pos + 1];
+            if (type == 'S' || type == 'D' || type == 'E' || type == 'P' || type == 'C') {
+                m_rx.erase(m_rx.begin(), m_rx.begin() + pos);
+                pos = 0;
+                if (!HandleFrame())
+                    return; /* wait for the rest of the frame */
+                continue;
+            }
+        }
+        unsigned char ch = m_rx[pos++];
+        if (ch == '\n' || ch == '\r') {
+            if (m_line.length() > 0)
+                HandleLine();
+            m_line.clear();
+        } else {
+            m_line += (char)ch;
+        }
+    }
+    m_rx.erase(m_rx.begin(), m_rx.begin() + pos);
+}
+
+wxThread::ExitCode CDeviceSimulator::Entry()
+{
+#if defined __linux__
+    unsigned char buffer[4096];
+    /* with a rate limit, read in portions of ~10 ms, so that replies are not
+       held back behind a large block */
+    size_t portion = sizeof buffer;
+    if (m_options.Rate > 0)
+        portion = wxMax((size_t)1, wxMin(sizeof buffer, (size_t)(m_options.Rate / 100)));
+    while (!TestDestroy()) {
+        struct pollfd fds;
+        fds.fd = m_master;
+        fds.events = POLLIN;
+        if (poll(&fds, 1, 100) <= 0)
+            continue;
+        ssize_t count = read(m_master, buffer, portion);
+        if (count <= 0) {
+            if (count < 0 && errno != EAGAIN && errno != EINTR)
+                break;
+            continue;
+        }
+        m_received += count;
+        Throttle(count);
+        Process(buffer, count);
+    }
+#endif
+    return (ExitCode)0;
+}
+
+
+/** EditSimulatorOptions() shows a dialog for the settings of the device
+ *  simulator; it returns false if the user cancels.
+ */
+bool EditSimulatorOptions(wxWindow* parent, SimulatorOptions& options)
+{
+    wxDialog dlg(parent, wxID_ANY, "Device simulator");
+    wxBoxSizer* bSizer = new wxBoxSizer(wxVERTICAL);
+    wxFlexGridSizer* fgSizer = new wxFlexGridSizer(0, 2, 4, 8);
+    fgSizer->AddGrowableCol(1);
+
+    fgSizer->Add(new wxStaticText(&dlg, wxID_ANY, "Rate (bytes/s, 0 = no limit)"), 0, wxALIGN_CENTER_VERTICAL);
+    wxSpinCtrl* ctrlRate = new wxSpinCtrl(&dlg, wxID_ANY, wxEmptyString, wxDefaultPosition, wxDefaultSize,
+                                          wxSP_ARROW_KEYS, 0, 1000000, (int)options.Rate);
+    fgSizer->Add(ctrlRate, 0, wxEXPAND);
+    fgSizer->Add(new wxStaticText(&dlg, wxID_ANY, "Negative acknowledges (%)"), 0, wxALIGN_CENTER_VERTICAL);
+    wxSpinCtrl* ctrlNak = new wxSpinCtrl(&dlg, wxID_ANY, wxEmptyString, wxDefaultPosition, wxDefaultSize,
+                                         wxSP_ARROW_KEYS, 0, 50, options.NakPercent);
+    fgSizer->Add(ctrlNak, 0, wxEXPAND);
+    fgSizer->Add(new wxStaticText(&dlg, wxID_ANY, "Lost frames (%)"), 0, wxALIGN_CENTER_VERTICAL);
+    wxSpinCtrl* ctrlDrop = new wxSpinCtrl(&dlg, wxID_ANY, wxEmptyString, wxDefaultPosition, wxDefaultSize,
+                                          wxSP_ARROW_KEYS, 0, 50, options.DropPercent);
+    fgSizer->Add(ctrlDrop, 0, wxEXPAND);
+    fgSizer->Add(new wxStaticText(&dlg, wxID_ANY, "Debug target script"), 0, wxALIGN_CENTER_VERTICAL);
+    wxFilePickerCtrl* ctrlScript = new wxFilePickerCtrl(&dlg, wxID_ANY, options.Script, "Select a script",
+                                                        "All files|*", wxDefaultPosition, wxSize(240, -1),
+                                                        wxFLP_OPEN | wxFLP_FILE_MUST_EXIST | wxFLP_USE_TEXTCTRL);
+    fgSizer->Add(ctrlScript, 0, wxEXPAND);
+    fgSizer->AddSpacer(0);
+    wxCheckBox* chkPatch = new wxCheckBox(&dlg, wxID_ANY, "Accept patches");
+    chkPatch->SetValue(options.Patching);
+    fgSizer->Add(chkPatch, 0, 0);
+    bSizer->Add(fgSizer, 1, wxEXPAND | wxALL, 8);
+    bSizer->Add(dlg.CreateStdDialogButtonSizer(wxOK | wxCANCEL), 0, wxEXPAND | wxALL, 8);
+    dlg.SetSizerAndFit(bSizer);
+    dlg.Centre();
+    if (dlg.ShowModal() != wxID_OK)
+        return false;
+
+    options.Rate = ctrlRate->GetValue();
+    options.NakPercent = ctrlNak->GetValue();
+    options.DropPercent = ctrlDrop->GetValue();
+    options.Script = ctrlScript->GetPath();
+    options.Patching = chkPatch->GetValue();
+    return true;
+}
@@ -0,0 +1,112 @@
+/*  Quincy IDE for the Pawn scripting language
+ *
+ *  Copyright CompuPhase, 2009-2024
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License"); you may not
+ *  use this file except in compliance with the License. You may obtain a copy
+ *  of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS, WITHOUT
+ *  WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. See the
+ *  License for the specific language governing permissions and limitations
+ *  under the License.
+ *
+ *  Version: $Id$
+ */
+#ifndef _DEVICESIMULATOR_H
+#define _DEVICESIMULATOR_H
+
+#include <wx/wx.h>
+#include <wx/thread.h>
+#include <atomic>
+#include <vector>
+#include "SerialTransfer.h"
+
+struct SimulatorOptions {
+    SimulatorOptions() : Rate(0), NakPercent(0), DropPercent(0), Patching(true) {}
+    long Rate;          /* bytes per second in each direction, 0 for no limit */
+    int NakPercent;     /* percentage of frames answered with a negative acknowledge */
+    int DropPercent;    /* percentage of frames that are lost (no reply) */
+    bool Patching;      /* whether the device accepts patches */
+    wxString Script;    /* rules for the remote debugging target (may be empty) */
+};
+
+struct SimulatorRule {
+    SimulatorRule(const wxString& expect, const std::string& reply) : Expect(expect), Reply(reply) {}
+    wxString Expect;    /* start of a line received from the host */
+    std::string Reply;  /* bytes to send back */
+};
+
+/* The device simulator stands in for a device on a serial port, so that the
+ * serial path (rs232.c, the native transfer and remote debugging) can be used
+ * and measured without hardware. It creates a pseudo-terminal (Linux only);
+ * the IDE opens the slave side (see GetPortName()) as if it were a serial port
+ * and the simulator serves the master side.
+ *
+ * The simulator answers the frames of the native transfer (see
+ * SerialTransfer.h) and keeps the image that it received, so that patches
+ * work too. Other data is handled line by line: a line that starts with the
+ * text of a rule gets the reply of that rule. The rules come from a script
+ * file, with a rule per line:
+ *
+ *      expect -> reply
+ *
+ * where the reply may contain the escapes \n, \r, \t, \\ and \xHH. Lines that
+ * start with '#' are comments. The rules can emulate the remote debugging
+ * target of pawndbg.
+ */
+class CDeviceSimulator : public wxThread {
+public:
+    CDeviceSimulator(const SimulatorOptions& options);
+    ~CDeviceSimulator();
+
+    bool Create(wxString& error);
+    const wxString& GetPortName() const { return m_portname; }
+
+    void SetErrors(int nakpercent, int droppercent) { m_nakpercent = nakpercent; m_droppercent = droppercent; }
+    unsigned long Frames() const { return m_frames; }
+    unsigned long Naks() const { return m_naks; }
+    unsigned long Drops() const { return m_drops; }
+    unsigned long Received() const { return m_received; }
+
+    static bool LoadScript(const wxString& path, std::vector<SimulatorRule>& rules, wxString& error);
+
+protected:
+    virtual ExitCode Entry();
+
+private:
+    void Process(const unsigned char* data, size_t size);
+    bool HandleFrame();
+    void HandleLine();
+    void Reply(int type, int seq);
+    void Send(const unsigned char* data, size_t size);
+    void Throttle(size_t size);
+
+    SimulatorOptions m_options;
+    std::vector<SimulatorRule> m_rules;
+    int m_master;
+    int m_slave;            /* kept open, so that the master does not see a hang-up between sessions */
+    wxString m_portname;
+    std::atomic<int> m_nakpercent;
+    std::atomic<int> m_droppercent;
+    std::atomic<unsigned long> m_frames;
+    std::atomic<unsigned long> m_naks;
+    std::atomic<unsigned long> m_drops;
+    std::atomic<unsigned long> m_received;
+    wxLongLong m_budget;    /* time (in microseconds) at which the simulated line is idle */
+    std::vector<unsigned char> m_rx;    /* received data that is not yet handled */
+    std::string m_line;
+    TransferImage m_image;  /* image held by the device */
+    TransferImage m_incoming;
+    unsigned long m_newsize;
+    bool m_patching;        /* incoming image is built with a patch */
+    int m_lastseq;          /* sequence number of the last frame that was applied */
+    int m_lasttype;
+};
+
+bool EditSimulatorOptions(wxWindow* parent, SimulatorOptions& options);
+
+#endif /* _DEVICESIMULATOR_H */
@@ -0,0 +1,225 @@
+/*  Quincy IDE for the Pawn scripting language
+ *
+ *  Copyright CompuPhase, 2009-2024
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License"); you may not
+ *  use this file except in compliance with the License. You may obtain a copy
+ *  of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS, WITHOUT
+ *  WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. See the
+ *  License for the specific language governing permissions and limitations
+ *  under the License.
+ *
+ *  Version: $Id$
+ */
+#include "wxQuincy.h"
+#include "ExecSession.h"
+#if defined _WIN32
+    #include <windows.h>
+#elif defined __linux__
+    #include <stdio.h>
+    #include <string.h>
+    #include <unistd.h>
+#endif
+
+ExecSession::ExecSession(const wxString& name, wxTextCtrl* output)
+    : m_name(name), m_output(output), m_process(0), m_pid(0), m_running(false), m_ended(true),
+      m_holdback(0), m_start(0), m_end(0), m_cputime(-1)
+{
+}
+
+ExecSession::~ExecSession()
+{
+    Kill();
+    Release();
+}
+
+/** Release() drops the process object of a previous run. The object must
+ *  stay until the process has ended; if it has not ended yet, it is detached
+ *  (and it deletes itself on termination).
+ */
+void ExecSession::Release()
+{
+    if (m_process) {
+        if (m_ended)
+            delete m_process;
+        else
+            m_process->Detach();
+        m_process = 0;
+    }
+}
+
+bool ExecSession::Start(wxEvtHandler* owner, const wxString& command)
+{
+    if (IsRunning())
+        return false;
+    Release();
+    m_process = new wxProcess(owner);
+    m_process->Redirect();
+    m_pid = wxExecute(command, wxEXEC_ASYNC, m_process);
+    if (m_pid <= 0) {
+        delete m_process;
+        m_process = 0;
+        m_pid = 0;
+        return false;
+    }
+    m_running = true;
+    m_ended = false;
+    m_start = wxGetLocalTimeMillis();
+    m_end = 0;
+    m_cputime = -1;
+    m_input.Empty();
+    m_holdback = 0;
+    if (m_output) {
+        m_output->Enable(true);
+        m_output->Clear();
+    }
+    return true;
+}
+
+/** Kill() stops the process. The session is no longer running on return,
+ *  but the wxEVT_END_PROCESS event for it still follows.
+ */
+void ExecSession::Kill()
+{
+    if (IsRunning()) {
+        GetCpuTime();
+        wxProcess::Kill(m_pid, wxSIGTERM);
+        wxProcess::Kill(m_pid, wxSIGKILL);
+    }
+    if (m_running) {
+        m_running = false;
+        m_end = wxGetLocalTimeMillis();
+    }
+}
+
+bool ExecSession::IsRunning() const
+{
+    return m_running && wxProcess::Exists(m_pid);
+}
+
+/** Finished() must be called when the process has ended (on the
+ *  wxEVT_END_PROCESS event), after the remaining output has been read. It
+ *  stops the clock.
+ */
+void ExecSession::Finished()
+{
+    if (m_running) {
+        m_running = false;
+        m_end = wxGetLocalTimeMillis();
+    }
+    m_ended = true;
+}
+
+void ExecSession::FlushInput()
+{
+    if (m_input.length() == 0 || !m_process)
+        return;
+    wxOutputStream* ostream = m_process->GetOutputStream();
+    if (ostream) {
+        for (unsigned idx = 0; idx < m_input.length(); idx++)
+            ostream->PutC(m_input[idx]);
+        m_input.Empty();
+    }
+}
+
+/** DrainOutput() copies the output of the process to the output pane, and
+ *  returns whether there was any. It does not block. If a prefix was set (see
+ *  SetPrefix()), lines from the debugger are filtered out.
+ */
+bool ExecSession::DrainOutput()
+{
+    if (!m_process)
+        return false;
+    wxInputStream* istream = m_process->GetInputStream();
+    if (!istream)
+        return false;
+    wxString text;
+    while (istream->CanRead()) {
+        wxChar ch = (wxChar)istream->GetC();
+        if (m_prefix.length() > 0 && ch == m_prefix[m_holdback]) {
+            if (++m_holdback == (int)m_prefix.length()) {
+                /* skip the complete command line */
+                wxString cmd;
+                do {
+                    ch = (wxChar)istream->GetC();
+                    cmd += ch;
+                } while (!istream->Eof() && ch != '\n' && (ch != ' ' || cmd.Cmp("dbg> ") != 0));
+                m_holdback = 0;
+            }
+            continue;
+        }
+        text += m_prefix.Left(m_holdback);
+        m_holdback = 0;
+        if (ch == '\b') {
+            int len = text.length();
+            if (len > 0)
+                text = text.Left(len - 1);
+        } else if (ch != EOF) {
+            text += ch;
+        }
+    }
+    if (text.IsEmpty())
+        return false;
+    if (m_output)
+        m_output->AppendText(text);
+    return true;
+}
+
+/** GetTimes() returns the wall-clock time and the CPU time of the session,
+ *  formatted for display.
+ */
+wxString ExecSession::GetTimes()
+{
+    if (m_start == 0)
+        return wxEmptyString;
+    wxLongLong stop = (m_end != 0) ? m_end : wxGetLocalTimeMillis();
+    long wall = (stop - m_start).ToLong() / 100;    /* in 0.1 seconds */
+    wxString times = wxString::Format("%ld:%02ld.%ld", wall / 600, (wall / 10) % 60, wall % 10);
+    GetCpuTime();
+    if (m_cputime >= 0)
+        times += wxString::Format(", CPU %.1f s", m_cputime / 1000.0);
+    return times;
+}
+
+long ExecSession::GetCpuTime()
+{
+    if (!m_running)
+        return m_cputime;   /* keep the last value read */
+#if defined _WIN32
+    HANDLE hProcess = OpenProcess(PROCESS_QUERY_INFORMATION, FALSE, (DWORD)m_pid);
+    if (hProcess != NULL) {
+        FILETIME created, exited, kernel, user;
+        if (GetProcessTimes(hProcess, &created, &exited, &kernel, &user)) {
+            ULONGLONG ticks = ((ULONGLONG)kernel.dwHighDateTime << 32) + kernel.dwLowDateTime
+                              + ((ULONGLONG)user.dwHighDateTime << 32) + user.dwLowDateTime;
+            m_cputime = (long)(ticks / 10000);  /* 100 ns units -> ms */
+        }
+        CloseHandle(hProcess);
+    }
+#elif defined __linux__
+    char path[64];
+    sprintf(path, "/proc/%ld/stat", m_pid);
+    FILE *fp = fopen(path, "r");
+    if (fp) {
+        char line[512];
+        if (fgets(line, sizeof line, fp)) {
+            /* skip the process name (which may contain spaces), then fields 3
+               to 13; fields 14 and 15 are the user and system time */
+            const char *ptr = strrchr(line, ')');
+            unsigned long utime, stime;
+            if (ptr && sscanf(ptr + 1, " %*c %*d %*d %*d %*d %*d %*u %*u %*u %*u %*u %lu %lu", &utime, &stime) == 2) {
+                long ticks = sysconf(_SC_CLK_TCK);
+                if (ticks > 0)
+                    m_cputime = (long)((utime + stime) * 1000 / ticks);
+            }
+        }
+        fclose(fp);
+    }
+#endif
+    return m_cputime;
+}
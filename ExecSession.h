@@ -0,0 +1,74 @@
+/*  Quincy IDE for the Pawn scripting language
+ *
+ *  Copyright CompuPhase, 2009-2024
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License"); you may not
+ *  use this file except in compliance with the License. You may obtain a copy
+ *  of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS, WITHOUT
+ *  WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. See the
+ *  License for the specific language governing permissions and limitations
+ *  under the License.
+ *
+ *  Version: $Id$
+ */
+#ifndef _EXECSESSION_H
+#define _EXECSESSION_H
+
+#include <wx/wx.h>
+#include <wx/process.h>
+
+/* An ExecSession is a run of pawnrun or pawndbg, with redirected I/O and an
+ * output pane of its own. The foreground session (the one in the "Output"
+ * tab) may be a debugging session, the output of which is parsed by the main
+ * frame; other sessions run without debugging and their output is copied to
+ * their pane as is (see DrainOutput()).
+ */
+class ExecSession {
+public:
+    ExecSession(const wxString& name, wxTextCtrl* output);
+    ~ExecSession();
+
+    bool Start(wxEvtHandler* owner, const wxString& command);
+    void Kill();
+    bool IsRunning() const;
+    void Finished();
+
+    long GetPID() const { return m_pid; }
+    wxProcess* GetProcess() const { return m_process; }
+    wxTextCtrl* GetOutput() const { return m_output; }
+    const wxString& GetName() const { return m_name; }
+
+    void SetPrefix(const wxString& prefix) { m_prefix = prefix; }
+
+    void QueueInput(const wxString& text) { m_input += text; }
+    const wxString& GetInput() const { return m_input; }
+    void ClearInput() { m_input.Empty(); }
+    void FlushInput();
+    bool DrainOutput();
+
+    wxString GetTimes();
+
+private:
+    void Release();
+    long GetCpuTime();
+
+    wxString m_name;
+    wxTextCtrl* m_output;   /* output pane (owned by the frame) */
+    wxProcess* m_process;
+    long m_pid;
+    bool m_running;         /* process was started and was not killed */
+    bool m_ended;           /* wxEVT_END_PROCESS was received for the process */
+    wxString m_prefix;      /* prefix for debugger output, to filter out */
+    int m_holdback;         /* number of characters of the prefix matched so far */
+    wxString m_input;       /* text typed in the output pane, not yet sent */
+    wxLongLong m_start;     /* time that the session started */
+    wxLongLong m_end;       /* time that the session ended, or 0 while running */
+    long m_cputime;         /* last known CPU time (in milliseconds), or -1 if unknown */
+};
+
+#endif /* _EXECSESSION_H */
@@ -22,6 +22,7 @@
 #include <cstring>
 #include <string>
 #include "HelpIndex.h"
+#include "StringPool.h"
 
 CHelpIndex::CHelpIndex()
 {
@@ -42,7 +43,7 @@ void CHelpIndex::AddFile(const char *filename, int id)
 void CHelpIndex::AddPage(const char *key, int id, int page)
 {
     CPageRef ref(id, page);
-    m_index.insert(std::make_pair(key, ref));
+    m_index.insert(std::make_pair(StringPool.Intern(key), ref));
 }
 
 bool CHelpIndex::ScanFile(const char *indexfile, int id, const char *docfile)
@@ -79,19 +80,27 @@ std::map<const char*,int> *CHelpIndex::LookUp(const char *key)
     filenames->clear();
 
     assert(key != NULL);
-    std::multimap<std::string, CPageRef>::iterator p;
-    for (p = m_index.begin(); p != m_index.end(); ++p) {
-        if (p->first.compare(key) == 0) {
-            CPageRef pr = p->second;
-            const char *name = LookUp(pr.GetId());
-            int page = pr.GetPage();
-            filenames->insert(std::pair<const char*,int>(name, page));
-        }
+    unsigned keyid = StringPool.Find(key, strlen(key));
+    if (keyid == POOL_NONE)
+        return filenames;
+    std::multimap<unsigned, CPageRef>::iterator p;
+    for (p = m_index.lower_bound(keyid); p != m_index.end() && p->first == keyid; ++p) {
+        CPageRef pr = p->second;
+        const char *name = LookUp(pr.GetId());
+        int page = pr.GetPage();
+        filenames->insert(std::pair<const char*,int>(name, page));
     }
 
     return filenames;
 }
 
+void CHelpIndex::GetKeys(std::vector<unsigned> &keys) const
+{
+    std::multimap<unsigned, CPageRef>::const_iterator p;
+    for (p = m_index.begin(); p != m_index.end(); p = m_index.upper_bound(p->first))
+        keys.push_back(p->first);
+}
+
 const char *CHelpIndex::LookUp(int id)
 {
     std::multimap<int, std::string>::iterator p;
@@ -20,6 +20,8 @@
 #define _HELPINDEX_H
 
 #include <map>
+#include <string>
+#include <vector>
 
 class CPageRef {
 public:
@@ -47,8 +49,9 @@ public:
     bool ScanFile(const char *indexfile, int id, const char *docfile = NULL);
     std::map<const char*,int> *LookUp(const char *key); // returns filename/page pairs
     const char *LookUp(int id); // returns filename
+    void GetKeys(std::vector<unsigned> &keys) const; // returns all keys (unique, as ids in the string pool)
 private:
-    std::multimap<std::string, CPageRef> m_index;
+    std::multimap<unsigned, CPageRef> m_index;  // key (id in the string pool) -> page
     std::multimap<int, std::string> m_filetable;
 };
 
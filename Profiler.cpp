@@ -0,0 +1,272 @@
+/*  Quincy IDE for the Pawn scripting language
+ *
+ *  Copyright CompuPhase, 2009-2024
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License"); you may not
+ *  use this file except in compliance with the License. You may obtain a copy
+ *  of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS, WITHOUT
+ *  WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. See the
+ *  License for the specific language governing permissions and limitations
+ *  under the License.
+ *
+ *  Version: $Id$
+ */
+#include "wxQuincy.h"
+#include <wx/ffile.h>
+#include <string.h>
+#include "Profiler.h"
+#include <amx.h>
+#include <amxdbg.h>
+
+CProfiler::CProfiler(wxEvtHandler* owner, int id, wxProcess* process, const wxString& prefix, const ProfileFunctions& functions)
+    : wxThread(wxTHREAD_JOINABLE), m_owner(owner), m_id(id), m_process(process),
+      m_prefix(prefix), m_line(-1), m_stamp(0), m_functions(functions)
+{
+}
+
+/** GetResults() copies the counts collected so far. It may be called while
+ *  the profiler runs.
+ */
+void CProfiler::GetResults(ProfileFiles& files, ProfileFunctions& functions)
+{
+    wxCriticalSectionLocker lock(m_lock);
+    files = m_files;
+    functions = m_functions;
+}
+
+void CProfiler::SendInput(const wxString& text)
+{
+    wxCriticalSectionLocker lock(m_lock);
+    m_input += text;
+}
+
+/** SameFile() returns whether a full path refers to a file name as the
+ *  debugger reports it (this may be a base name only).
+ */
+bool CProfiler::SameFile(const wxString& path, const wxString& name)
+{
+    if (path.Cmp(name) == 0)
+        return true;
+    return path.AfterLast(DIRSEP_CHAR).Cmp(name.AfterLast(DIRSEP_CHAR)) == 0;
+}
+
+wxThread::ExitCode CProfiler::Entry()
+{
+    wxASSERT(m_process);
+    wxInputStream* istream = m_process->GetInputStream();
+    if (!istream)
+        return (ExitCode)1;
+
+    m_clock.Start();
+    long lastupdate = m_clock.Time();
+    int holdback = 0;
+    bool done = false;
+    while (!done) {
+        /* after a request to stop, read the remaining output and quit */
+        if (TestDestroy())
+            done = true;
+        wxString text;
+        while (istream->CanRead()) {
+            wxChar ch = (wxChar)istream->GetC();
+            if (ch == m_prefix[holdback]) {
+                if (++holdback == (int)m_prefix.length()) {
+                    /* gobble up the complete command line, then process it */
+                    wxString cmd;
+                    do {
+                        ch = (wxChar)istream->GetC();
+                        cmd += ch;
+                    } while (!istream->Eof() && ch != '\n' && (ch != ' ' || cmd.Cmp("dbg> ") != 0));
+                    holdback = 0;
+                    HandleCommand(cmd);
+                }
+            } else {
+                /* first add any characters held back */
+                text += m_prefix.Left(holdback);
+                holdback = 0;
+                /* add the new character */
+                if (ch == '\b') {
+                    int len = text.length();
+                    if (len > 0)
+                        text = text.Left(len - 1);
+                } else if (ch != EOF) {
+                    text += ch;
+                }
+            }
+        }
+        if (!text.IsEmpty())
+            Post(PROFILE_OUTPUT, text);
+        if (m_clock.Time() - lastupdate >= PROFILE_UPDATE_INTERVAL) {
+            lastupdate = m_clock.Time();
+            Post(PROFILE_UPDATE);
+        }
+        if (!done)
+            Sleep(1);
+    }
+
+    /* the last line ran up to the end of the script */
+    if (m_line >= 0) {
+        wxCriticalSectionLocker lock(m_lock);
+        m_files[m_linefile][m_line].Time += m_clock.TimeInMicro() - m_stamp;
+    }
+    Post(PROFILE_UPDATE);
+    return (ExitCode)0;
+}
+
+void CProfiler::HandleCommand(const wxString& cmd)
+{
+    if (cmd.Left(4).Cmp("file") == 0) {
+        m_file = cmd.Mid(4);
+        m_file.Trim();
+        m_file.Trim(false);
+    } else if (cmd.Left(4).Cmp("dbg>") == 0) {
+        /* continue with the next line, and pass on any input for the script */
+        wxOutputStream* ostream = m_process->GetOutputStream();
+        if (ostream) {
+            ostream->PutC('s');
+            ostream->PutC('\r');
+            wxCriticalSectionLocker lock(m_lock);
+            for (unsigned idx = 0; idx < m_input.length(); idx++)
+                ostream->PutC(m_input[idx]);
+            m_input.Empty();
+        }
+    } else if (cmd.length() > 0 && wxIsdigit(cmd[0])) {
+        long line;
+        if (cmd.ToLong(&line))
+            Record(line - 1);
+    }
+    /* other responses (watches, info messages) are not used in profiling */
+}
+
+void CProfiler::Record(long line)
+{
+    wxLongLong stamp = m_clock.TimeInMicro();
+    wxCriticalSectionLocker lock(m_lock);
+
+    /* the time since the previous event was spent on the previous line; note
+       that the "file" event for a new file precedes the line event, so the
+       previous line must be looked up by its own file name */
+    if (m_line >= 0)
+        m_files[m_linefile][m_line].Time += stamp - m_stamp;
+    m_files[m_file][line].Hits += 1;
+    m_linefile = m_file;
+    m_line = line;
+    m_stamp = stamp;
+
+    /* track calls: a change to a function that is not the caller, is a call
+       (recursive calls are not detected) */
+    int func = FindFunction(m_file, line);
+    if (func >= 0 && (m_stack.size() == 0 || m_stack.back() != func)) {
+        if (m_stack.size() >= 2 && m_stack[m_stack.size() - 2] == func) {
+            m_stack.pop_back();
+        } else {
+            m_stack.push_back(func);
+            m_functions[func].Entries += 1;
+        }
+    }
+}
+
+int CProfiler::FindFunction(const wxString& file, long line) const
+{
+    /* the function is the one with the closest header above the line */
+    int best = -1;
+    for (unsigned idx = 0; idx < m_functions.size(); idx++) {
+        const ProfileFunction& func = m_functions[idx];
+        if (func.Line <= line && SameFile(func.File, file) && (best < 0 || func.Line > m_functions[best].Line))
+            best = idx;
+    }
+    return best;
+}
+
+void CProfiler::Post(int type, const wxString& text)
+{
+    wxThreadEvent* event = new wxThreadEvent(wxEVT_THREAD, m_id);
+    event->SetInt(type);
+    event->SetString(text);
+    wxQueueEvent(m_owner, event);
+}
+
+/* GetCell() reads a little-endian value of "size" bytes */
+static wxULongLong_t GetCell(const unsigned char* ptr, int size)
+{
+    wxULongLong_t value = 0;
+    for (int idx = size - 1; idx >= 0; idx--)
+        value = (value << 8) | ptr[idx];
+    return value;
+}
+
+/** ReadLineTable() adds an entry with zero hits for every line in the debug
+ *  information of the compiled script, so that the lines that never ran are
+ *  known too. The file names are those in the debug information, which are
+ *  the names that the debugger reports. Entries that are already in "files"
+ *  are kept.
+ */
+bool CProfiler::ReadLineTable(const wxString& amxfile, ProfileFiles& files)
+{
+    wxFFile file;
+    if (amxfile.IsEmpty() || !wxFileExists(amxfile) || !file.Open(amxfile, "rb"))
+        return false;
+    std::vector<unsigned char> buffer((size_t)file.Length());
+    if (buffer.size() < 8 || file.Read(&buffer[0], buffer.size()) != buffer.size())
+        return false;
+    file.Close();
+
+    /* the debug information follows the AMX image; the size of the addresses
+       follows from the cell size of the AMX */
+    size_t pos = (size_t)GetCell(&buffer[0], 4);
+    unsigned short magic = (unsigned short)GetCell(&buffer[4], 2);
+    int cellsize;
+    if (magic == AMX_MAGIC_16)
+        cellsize = 2;
+    else if (magic == AMX_MAGIC_32)
+        cellsize = 4;
+    else if (magic == AMX_MAGIC_64)
+        cellsize = 8;
+    else
+        return false;
+    AMX_DBG_HDR hdr;
+    if (pos > buffer.size() || buffer.size() - pos < sizeof hdr)
+        return false;
+    memcpy(&hdr, &buffer[pos], sizeof hdr);
+    if (hdr.magic != AMX_DBG_MAGIC)
+        return false;
+    pos += sizeof hdr;
+
+    /* the file table holds the start address of each file (in ascending
+       order), followed by the name */
+    std::vector< std::pair<wxULongLong_t, wxString> > filetable;
+    for (int idx = 0; idx < hdr.files; idx++) {
+        if (buffer.size() - pos < (size_t)cellsize)
+            return false;
+        wxULongLong_t address = GetCell(&buffer[pos], cellsize);
+        pos += cellsize;
+        size_t end = pos;
+        while (end < buffer.size() && buffer[end] != '\0')
+            end++;
+        if (end >= buffer.size())
+            return false;
+        filetable.push_back(std::make_pair(address, wxString::FromUTF8((const char*)&buffer[pos], end - pos)));
+        pos = end + 1;
+    }
+    if (filetable.size() == 0)
+        return false;
+
+    for (long idx = 0; idx < (long)hdr.lines; idx++) {
+        if (buffer.size() - pos < (size_t)cellsize + 4)
+            return false;
+        wxULongLong_t address = GetCell(&buffer[pos], cellsize);
+        long line = (long)(int32_t)GetCell(&buffer[pos + cellsize], 4);
+        pos += cellsize + 4;
+        unsigned fileidx = 0;
+        while (fileidx + 1 < filetable.size() && filetable[fileidx + 1].first <= address)
+            fileidx++;
+        ProfileLines& lines = files[filetable[fileidx].second];
+        if (lines.find(line) == lines.end())
+            lines[line] = ProfileLine();
+    }
+    return true;
+}
@@ -0,0 +1,99 @@
+/*  Quincy IDE for the Pawn scripting language
+ *
+ *  Copyright CompuPhase, 2009-2024
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License"); you may not
+ *  use this file except in compliance with the License. You may obtain a copy
+ *  of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS, WITHOUT
+ *  WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. See the
+ *  License for the specific language governing permissions and limitations
+ *  under the License.
+ *
+ *  Version: $Id$
+ */
+#ifndef _PROFILER_H
+#define _PROFILER_H
+
+#include <wx/wx.h>
+#include <wx/process.h>
+#include <wx/stopwatch.h>
+#include <wx/thread.h>
+#include <map>
+#include <vector>
+
+enum {
+    PROFILE_OUTPUT,     /* text that the script printed (event string) */
+    PROFILE_UPDATE,     /* new counts are available */
+};
+
+#define PROFILE_UPDATE_INTERVAL 500 /* milliseconds between PROFILE_UPDATE events */
+
+struct ProfileLine {
+    ProfileLine() : Hits(0), Time(0) {}
+    unsigned long Hits;
+    wxLongLong Time;    /* microseconds until the next line event (approximate) */
+};
+
+typedef std::map<long, ProfileLine> ProfileLines;       /* line number (0-based) -> counts */
+typedef std::map<wxString, ProfileLines> ProfileFiles;  /* file name, as the debugger reports it -> lines */
+
+struct ProfileFunction {
+    ProfileFunction(const wxString& name, const wxString& file, long line)
+        : Name(name), File(file), Line(line), Entries(0)
+        {}
+    wxString Name;
+    wxString File;      /* full path (from the symbol browser) */
+    long Line;          /* line of the function header (0-based) */
+    unsigned long Entries;
+};
+
+typedef std::vector<ProfileFunction> ProfileFunctions;
+
+/* The profiler runs the script under pawndbg and single-steps through every
+ * line; it owns the I/O of the debugger process while it runs. The time
+ * between two line events is attributed to the first line, so the times
+ * include the overhead of the debugger and are only useful for comparison.
+ */
+class CProfiler : public wxThread {
+public:
+    CProfiler(wxEvtHandler* owner, int id, wxProcess* process, const wxString& prefix, const ProfileFunctions& functions);
+
+    void GetResults(ProfileFiles& files, ProfileFunctions& functions);
+    void SendInput(const wxString& text);
+
+    static bool SameFile(const wxString& path, const wxString& name);
+    static bool ReadLineTable(const wxString& amxfile, ProfileFiles& files);
+
+protected:
+    virtual ExitCode Entry();
+
+private:
+    void HandleCommand(const wxString& cmd);
+    void Record(long line);
+    int FindFunction(const wxString& file, long line) const;
+    void Post(int type, const wxString& text = wxEmptyString);
+
+    wxEvtHandler* m_owner;
+    int m_id;
+    wxProcess* m_process;
+    wxString m_prefix;          /* prefix for debugger output (see "-term" option of pawndbg) */
+
+    wxStopWatch m_clock;
+    wxString m_file;            /* file of the current line */
+    wxString m_linefile;        /* file of m_line */
+    long m_line;                /* current line, or -1 */
+    wxLongLong m_stamp;         /* time of the line event for m_line */
+    std::vector<int> m_stack;   /* functions that were entered (approximate call stack) */
+
+    wxCriticalSection m_lock;   /* protects the fields below */
+    ProfileFiles m_files;
+    ProfileFunctions m_functions;
+    wxString m_input;           /* text typed in the output pane, to send to the script */
+};
+
+#endif /* _PROFILER_H */
@@ -20,6 +20,7 @@
 #include "wxQuincy.h"
 #include <wx/busyinfo.h>
 #include <wx/clipbrd.h>
+#include <wx/ffile.h>
 #include <wx/filename.h>
 #include <wx/mimetype.h>
 #include <wx/numdlg.h>
@@ -28,13 +29,19 @@
 #include <wx/textfile.h>
 #include <wx/tokenzr.h>
 #include <wx/html/htmprint.h>
+#include <algorithm>
+#include <limits.h>
+#include <math.h>
+#include <set>
 #include "QuincyFrame.h"
+#include "QuincyGotoPalette.h"
 #include "QuincyReplaceDlg.h"
 #include "QuincyReplacePrompt.h"
 #include "QuincySearchDlg.h"
 #include "QuincySampleBrowser.h"
 #include "QuincySettingsDlg.h"
 #include "QuincyDirPicker.h"
+#include "portscan.h"
 #include <amx.h>
 #include <amxdbg.h>
 #include "svnrev.h"
@@ -217,6 +224,8 @@ QuincyFrame::QuincyFrame(const wxString& title, const wxSize& size)
     menuEdit->AppendSeparator();
     menuEdit->Append(wxID_INDEX, MENU_ENTRY("GotoLine"));
     menuEdit->Append(IDM_GOTOSYMBOL, MENU_ENTRY("GotoSymbol"));
+    menuEdit->Append(IDM_FINDREFERENCES, MENU_ENTRY("FindReferences"));
+    menuEdit->Append(IDM_GOTOANYTHING, MENU_ENTRY("GotoAnything"));
     AppendIconItem(menuEdit, IDM_MATCHBRACE,  MENU_ENTRY("MatchBrace"), tb_bracematch);
     menuBookmarks = new wxMenu;
     menuBookmarks->Append(IDM_BOOKMARKTOGGLE, MENU_ENTRY("ToggleBookmark"));
@@ -237,6 +246,7 @@ QuincyFrame::QuincyFrame(const wxString& title, const wxSize& size)
     menuBuild = new wxMenu;
     AppendIconItem(menuBuild, IDM_COMPILE, MENU_ENTRY("Compile"), tb_compile);
     AppendIconItem(menuBuild, IDM_TRANSFER, MENU_ENTRY("Transfer"), tb_transfer);
+    menuBuild->Append(IDM_TRANSFERMULTI, MENU_ENTRY("TransferMulti"));
     menuBuild->AppendSeparator();
     AppendIconItem(menuBuild, IDM_DEBUG, MENU_ENTRY("Debug"), tb_debug);
     AppendIconItem(menuBuild, IDM_RUN, MENU_ENTRY("Run"), tb_run);
@@ -250,13 +260,21 @@ QuincyFrame::QuincyFrame(const wxString& title, const wxSize& size)
     menuBreakpoints = new wxMenu;
     AppendIconItem(menuBreakpoints, IDM_BREAKPOINTTOGGLE, MENU_ENTRY("ToggleBreakpoint"), tb_breakpoint);
     menuBreakpoints->Append(IDM_BREAKPOINTCLEAR, MENU_ENTRY("ClearBreakpoints"));
+    menuBreakpoints->Append(IDM_BREAKPOINTPROPS, MENU_ENTRY("BreakpointProperties"));
     //??? list all breakpoints
     menuBuild->Append(-1, "Breakpoints", menuBreakpoints);
+    menuBuild->Append(IDM_INSPECT, MENU_ENTRY("Inspect"));
+    menuBuild->AppendSeparator();
+    menuBuild->Append(IDM_PROFILE, MENU_ENTRY("Profile"));
+    menuBuild->Append(IDM_PROFILEEXPORT, MENU_ENTRY("ProfileExport"));
+    menuBuild->Append(IDM_PROFILECLEAR, MENU_ENTRY("ProfileClear"));
     menuBar->Append(menuBuild, "&Build/Run");
 
     menuTools = new wxMenu;
     AppendIconItem(menuTools, wxID_PROPERTIES, MENU_ENTRY("Options"), tb_settings);
     AppendIconItem(menuTools, IDM_SAMPLEBROWSER, MENU_ENTRY("SampleBrowser"), tb_pawn);
+    menuTools->AppendCheckItem(IDM_SIMULATOR, MENU_ENTRY("DeviceSimulator"));
+    menuTools->Append(IDM_SERIALBENCH, MENU_ENTRY("SerialBenchmark"));
     menuTabSpace = new wxMenu;
     menuTabSpace->Append(IDM_TABSTOSPACES, MENU_ENTRY("TabToSpace"));
     menuTabSpace->Append(IDM_INDENTSTOTABS, MENU_ENTRY("IndentToTab"));
@@ -298,6 +316,8 @@ QuincyFrame::QuincyFrame(const wxString& title, const wxSize& size)
     Connect(wxID_REPLACE, wxEVT_COMMAND_MENU_SELECTED, wxCommandEventHandler(QuincyFrame::OnReplaceDlg));
     Connect(wxID_INDEX, wxEVT_COMMAND_MENU_SELECTED, wxCommandEventHandler(QuincyFrame::OnGotoDlg));
     Connect(IDM_GOTOSYMBOL, wxEVT_COMMAND_MENU_SELECTED, wxCommandEventHandler(QuincyFrame::OnGotoSymbol));
+    Connect(IDM_FINDREFERENCES, wxEVT_COMMAND_MENU_SELECTED, wxCommandEventHandler(QuincyFrame::OnFindReferences));
+    Connect(IDM_GOTOANYTHING, wxEVT_COMMAND_MENU_SELECTED, wxCommandEventHandler(QuincyFrame::OnGotoAnything));
     Connect(IDM_BOOKMARKTOGGLE, wxEVT_COMMAND_MENU_SELECTED, wxCommandEventHandler(QuincyFrame::OnBookmarkToggle));
     Connect(IDM_BOOKMARKNEXT, wxEVT_COMMAND_MENU_SELECTED, wxCommandEventHandler(QuincyFrame::OnBookmarkNext));
     Connect(IDM_BOOKMARKPREV, wxEVT_COMMAND_MENU_SELECTED, wxCommandEventHandler(QuincyFrame::OnBookmarkPrevious));
@@ -307,6 +327,9 @@ QuincyFrame::QuincyFrame(const wxString& title, const wxSize& size)
     Connect(IDM_VIEWINDENTGUIDES, wxEVT_COMMAND_MENU_SELECTED, wxCommandEventHandler(QuincyFrame::OnViewIndentGuides));
     Connect(IDM_COMPILE, wxEVT_COMMAND_MENU_SELECTED, wxCommandEventHandler(QuincyFrame::OnCompile));
     Connect(IDM_TRANSFER, wxEVT_COMMAND_MENU_SELECTED, wxCommandEventHandler(QuincyFrame::OnTransfer));
+    Connect(IDM_TRANSFERMULTI, wxEVT_COMMAND_MENU_SELECTED, wxCommandEventHandler(QuincyFrame::OnTransferMulti));
+    Connect(IDM_SIMULATOR, wxEVT_COMMAND_MENU_SELECTED, wxCommandEventHandler(QuincyFrame::OnSimulator));
+    Connect(IDM_SERIALBENCH, wxEVT_COMMAND_MENU_SELECTED, wxCommandEventHandler(QuincyFrame::OnSerialBenchmark));
     Connect(IDM_DEBUG, wxEVT_COMMAND_MENU_SELECTED, wxCommandEventHandler(QuincyFrame::OnDebug));
     Connect(IDM_RUN, wxEVT_COMMAND_MENU_SELECTED, wxCommandEventHandler(QuincyFrame::OnRun));
     Connect(IDM_ABORT, wxEVT_COMMAND_MENU_SELECTED, wxCommandEventHandler(QuincyFrame::OnAbort));
@@ -316,6 +339,11 @@ QuincyFrame::QuincyFrame(const wxString& title, const wxSize& size)
     Connect(IDM_RUNTOCURSOR, wxEVT_COMMAND_MENU_SELECTED, wxCommandEventHandler(QuincyFrame::OnRunToCursor));
     Connect(IDM_BREAKPOINTTOGGLE, wxEVT_COMMAND_MENU_SELECTED, wxCommandEventHandler(QuincyFrame::OnBreakpointToggle));
     Connect(IDM_BREAKPOINTCLEAR, wxEVT_COMMAND_MENU_SELECTED, wxCommandEventHandler(QuincyFrame::OnBreakpointClear));
+    Connect(IDM_BREAKPOINTPROPS, wxEVT_COMMAND_MENU_SELECTED, wxCommandEventHandler(QuincyFrame::OnBreakpointProperties));
+    Connect(IDM_INSPECT, wxEVT_COMMAND_MENU_SELECTED, wxCommandEventHandler(QuincyFrame::OnInspect));
+    Connect(IDM_PROFILE, wxEVT_COMMAND_MENU_SELECTED, wxCommandEventHandler(QuincyFrame::OnProfile));
+    Connect(IDM_PROFILEEXPORT, wxEVT_COMMAND_MENU_SELECTED, wxCommandEventHandler(QuincyFrame::OnProfileExport));
+    Connect(IDM_PROFILECLEAR, wxEVT_COMMAND_MENU_SELECTED, wxCommandEventHandler(QuincyFrame::OnProfileClear));
     Connect(wxID_PROPERTIES, wxEVT_COMMAND_MENU_SELECTED, wxCommandEventHandler(QuincyFrame::OnSettings));
     Connect(IDM_SAMPLEBROWSER, wxEVT_COMMAND_MENU_SELECTED, wxCommandEventHandler(QuincyFrame::OnSampleBrowser));
     Connect(IDM_TABSTOSPACES, wxEVT_COMMAND_MENU_SELECTED, wxCommandEventHandler(QuincyFrame::OnTabsToSpaces));
@@ -345,6 +373,12 @@ QuincyFrame::QuincyFrame(const wxString& title, const wxSize& size)
     /* frame events */
     Connect(wxEVT_IDLE, wxIdleEventHandler(QuincyFrame::OnIdle));
     Connect(wxEVT_END_PROCESS, wxProcessEventHandler(QuincyFrame::OnTerminateApp));
+    Connect(IDM_PROFILE, wxEVT_THREAD, wxThreadEventHandler(QuincyFrame::OnProfileEvent));
+    Connect(IDM_TRANSFER, wxEVT_THREAD, wxThreadEventHandler(QuincyFrame::OnTransferEvent));
+    Connect(IDM_TRANSFERMULTI, wxEVT_THREAD, wxThreadEventHandler(QuincyFrame::OnDeviceTransferEvent));
+    Connect(IDM_SERIALBENCH, wxEVT_THREAD, wxThreadEventHandler(QuincyFrame::OnBenchmarkEvent));
+    Connect(IDM_INDEXER, wxEVT_THREAD, wxThreadEventHandler(QuincyFrame::OnIndexerEvent));
+    Connect(IDM_REPORTLOADER, wxEVT_THREAD, wxThreadEventHandler(QuincyFrame::OnReportLoaderEvent));
 
     /* add a status bar */
     CreateStatusBar(2);
@@ -449,6 +483,7 @@ QuincyFrame::QuincyFrame(const wxString& title, const wxSize& size)
     BrowserTree = new wxTreeCtrl(PaneTab, wxID_ANY, wxDefaultPosition, wxDefaultSize, wxTR_HAS_BUTTONS|wxTR_FULL_ROW_HIGHLIGHT|wxTR_HIDE_ROOT|wxTR_NO_LINES|wxTR_SINGLE|wxTR_DEFAULT_STYLE);
     BrowserTree->SetFont(font);
     BrowserTree->Connect(wxEVT_COMMAND_TREE_ITEM_ACTIVATED, wxTreeEventHandler(QuincyFrame::OnSymbolSelect), NULL, this);
+    BrowserTree->Connect(wxEVT_COMMAND_TREE_ITEM_EXPANDING, wxTreeEventHandler(QuincyFrame::OnSymbolExpanding), NULL, this);
     PaneTab->AddPage(BrowserTree, "Symbols", false); /* TAB_SYMBOLS */
     WatchLog = new wxListView(PaneTab, wxID_ANY, wxDefaultPosition, wxDefaultSize, wxLC_REPORT | wxLC_SINGLE_SEL | wxLC_EDIT_LABELS);
     WatchLog->SetFont(font);
@@ -464,6 +499,17 @@ QuincyFrame::QuincyFrame(const wxString& title, const wxSize& size)
     Terminal->SetFont(font);
     Terminal->Connect(wxEVT_CHAR, wxKeyEventHandler(QuincyFrame::OnTerminalChar), NULL, this);
     PaneTab->AddPage(Terminal, "Output", false);   /* TAB_OUTPUT */
+    InspectTree = new wxTreeCtrl(PaneTab, wxID_ANY, wxDefaultPosition, wxDefaultSize, wxTR_HAS_BUTTONS|wxTR_FULL_ROW_HIGHLIGHT|wxTR_HIDE_ROOT|wxTR_NO_LINES|wxTR_SINGLE|wxTR_DEFAULT_STYLE);
+    InspectTree->SetFont(font);
+    InspectTree->AddRoot("Inspect");
+    InspectTree->Connect(wxEVT_COMMAND_TREE_ITEM_EXPANDING, wxTreeEventHandler(QuincyFrame::OnInspectExpanding), NULL, this);
+    InspectTree->Connect(wxEVT_COMMAND_TREE_ITEM_ACTIVATED, wxTreeEventHandler(QuincyFrame::OnInspectActivated), NULL, this);
+    InspectTree->Connect(wxEVT_COMMAND_TREE_KEY_DOWN, wxTreeEventHandler(QuincyFrame::OnInspectKeyDown), NULL, this);
+    PaneTab->AddPage(InspectTree, "Inspect", false);   /* TAB_INSPECT */
+    Inspector.SetControl(InspectTree);
+    InspectScanTime = 0;
+    Monitor = new SerialMonitor(PaneTab, font);
+    PaneTab->AddPage(Monitor, "Monitor", false);   /* TAB_MONITOR */
     PaneTab->Layout();
     bSizerPane->Add(PaneTab, 1, wxEXPAND | wxBOTTOM, 5);
     pnlPane->SetSizer(bSizerPane);
@@ -496,6 +542,20 @@ QuincyFrame::QuincyFrame(const wxString& title, const wxSize& size)
     Timer = new wxTimer(this, IDM_TIMER);
     wxASSERT(Timer);
     Connect(IDM_TIMER, wxEVT_TIMER, wxTimerEventHandler(QuincyFrame::OnTimer));
+    SessionTimer = new wxTimer(this, IDM_SESSIONTIMER);
+    Connect(IDM_SESSIONTIMER, wxEVT_TIMER, wxTimerEventHandler(QuincyFrame::OnSessionTimer));
+
+    /* start collecting the serial ports in the background */
+    EnumeratePortsWatch();
+
+    /* start the indexer for the symbol list (the files are queued when the
+       session is loaded) */
+    Indexer = new CSourceIndexer(this, IDM_INDEXER);
+    if (Indexer->Create() != wxTHREAD_NO_ERROR || Indexer->Run() != wxTHREAD_NO_ERROR) {
+        delete Indexer;
+        Indexer = NULL;
+    }
+    ReportLoader = new CReportLoader(this, IDM_REPORTLOADER);
 
     /* see whether there are initial files to load */
     RectSelectChkSum = 0;
@@ -509,22 +569,63 @@ QuincyFrame::QuincyFrame(const wxString& title, const wxSize& size)
     VisibleWhiteSpace = false;
     IgnoreChangeEvent = false;
     PendingFlags = 0;
-    ExecPID = 0;
-    ExecProcess = 0;
+    Exec = new ExecSession("Output", Terminal);
+    SessionTime = 0;
     DebugMode = false;
+    DebugStopCount = 0;
+    DebugStepping = false;
+    DebugMarkerShown = false;
+    BreakpointHit = -1;
+    BreakpointLogging = false;
+    Profiler = NULL;
+    Transfer = NULL;
+    TransferProgress = NULL;
+    TransferSize = 0;
+    Simulator = NULL;
+    BenchSimulator = NULL;
+    BenchTransfer = NULL;
+    BenchStep = 0;
+    DebugStartTime = 0;
+    DebugStepTime = 0;
     WatchLog->Enable(DebugMode);
     WatchUpdateList.Clear();
 }
 
+QuincyFrame::~QuincyFrame()
+{
+    SessionTimer->Stop();
+    delete SessionTimer;
+    delete Exec;
+}
+
 void QuincyFrame::OnCloseWindow(wxCloseEvent& /* event */)
 {
     if (!SaveAllFiles(true))
         return;
     Disconnect(wxEVT_ACTIVATE, wxActivateEventHandler(QuincyFrame::OnActivate));
-    if (ExecPID != 0 && wxProcess::Exists(ExecPID)) {
-        wxProcess::Kill(ExecPID, wxSIGTERM);
-        wxProcess::Kill(ExecPID, wxSIGKILL);
-    }
+    Exec->Kill();
+    StopProfiler();
+    StopTransfer();
+    StopDeviceTransfers();
+    StopBenchmark();
+    EnumeratePortsStop();
+    if (Simulator) {
+        Simulator->Delete();
+        delete Simulator;
+        Simulator = NULL;
+    }
+    if (Indexer) {
+        Indexer->Stop();
+        delete Indexer;
+        Indexer = NULL;
+    }
+    if (ReportLoader) {
+        delete ReportLoader;    /* this waits for the worker threads */
+        ReportLoader = NULL;
+    }
+    for (unsigned idx = 0; idx < Sessions.size(); idx++)
+        delete Sessions[idx];   /* this also stops the script */
+    Sessions.clear();
     SaveSession();              /* save all options */
     IgnoreChangeEvent = true;
     /* optionally copy search options from the "FindData" structure to the main
@@ -614,7 +715,7 @@ void QuincyFrame::OnTabChange(wxAuiNotebookEvent& /* event */)
     /* user has clicked on a TAB to select a different file */
     AdjustTitle();
     wxStyledTextCtrl *edit = GetActiveEdit(EditTab);
-    context.ScanContext(edit, CTX_RESET);
+    context.ScanContext(edit);  /* shows the function list of the document right away, if it was scanned before */
 }
 
 void QuincyFrame::OnTabClose(wxAuiNotebookEvent& event)
@@ -721,9 +822,10 @@ void QuincyFrame::OnSymbolSelect(wxTreeEvent& event)
     BrowserItemData* data = dynamic_cast<BrowserItemData*>(BrowserTree->GetItemData(event.GetItem()));
     if (!data)
         return;
-    const CSymbolEntry* symbol = data->Symbol();
-    if (!symbol)
+    const CSymbolEntry* entry = data->Symbol(SymbolList);
+    if (!entry)
         return;
+    CSymbolEntry symbol = *entry;   /* copy, the list may change while the file is loaded */
 
     /* set a temporary bookmark on the current position */
     wxStyledTextCtrl* edit = GetActiveEdit(EditTab);
@@ -736,7 +838,23 @@ void QuincyFrame::OnSymbolSelect(wxTreeEvent& event)
         }
     }
 
-    GotoSymbol(symbol);
+    GotoSymbol(&symbol);
+}
+
+void QuincyFrame::OnSymbolExpanding(wxTreeEvent& event)
+{
+    /* create the items of a section when it is expanded for the first time */
+    for (int idx = 0; idx < BROWSER_SECTIONS; idx++) {
+        BrowserSection& section = BrowserSections[idx];
+        if (section.Item != event.GetItem() || section.Populated)
+            continue;
+        BrowserTree->Freeze();
+        wxTreeItemId previous;
+        for (std::map<wxString, wxTreeItemId>::iterator iter = section.Shown.begin(); iter != section.Shown.end(); ++iter)
+            previous = iter->second = InsertSymBrowserItem(section.Item, previous, iter->first);
+        section.Populated = true;
+        BrowserTree->Thaw();
+    }
 }
 
 bool QuincyFrame::AddEditor(const wxString &name)
@@ -771,11 +889,18 @@ bool QuincyFrame::AddEditor(const wxString &name)
     edit->SetCaretLineVisible(true);
     edit->SetMarginType(1, wxSTC_MARGIN_SYMBOL);
     edit->SetMarginWidth(1, 16);
-    edit->SetMarginMask(1,~wxSTC_MASK_FOLDERS);
+    edit->SetMarginMask(1,~wxSTC_MASK_FOLDERS & ~MASK_HEAT);
+    edit->SetMarginType(MARGIN_HEAT, wxSTC_MARGIN_SYMBOL);
+    edit->SetMarginWidth(MARGIN_HEAT, 0);   /* only shown after profiling */
+    edit->SetMarginMask(MARGIN_HEAT, MASK_HEAT);
     edit->MarkerDefine(MARKER_BOOKMARK, wxSTC_MARK_BOOKMARK, wxColour(0, 0, 0), wxColour(0, 160, 0));
     edit->MarkerDefine(MARKER_NAVIGATE, wxSTC_MARK_BOOKMARK, wxColour(0, 0, 0), wxColour(0, 0, 160));
     edit->MarkerDefine(MARKER_BREAKPOINT, wxSTC_MARK_CIRCLE, wxColour(192, 192, 192), wxColour(160, 0, 0));
     edit->MarkerDefine(MARKER_CURRENTLINE, wxSTC_MARK_SHORTARROW, wxColour(0, 0, 0), wxColour(240, 192, 0));
+    edit->MarkerDefine(MARKER_HEAT1, wxSTC_MARK_FULLRECT, wxColour(255, 240, 160), wxColour(255, 240, 160));
+    edit->MarkerDefine(MARKER_HEAT2, wxSTC_MARK_FULLRECT, wxColour(255, 192, 64), wxColour(255, 192, 64));
+    edit->MarkerDefine(MARKER_HEAT3, wxSTC_MARK_FULLRECT, wxColour(240, 112, 0), wxColour(240, 112, 0));
+    edit->MarkerDefine(MARKER_HEAT4, wxSTC_MARK_FULLRECT, wxColour(208, 0, 0), wxColour(208, 0, 0));
 
     if (name.Length() == 0 || IsPawnFile(name)) {
         edit->SetLexer(wxSTC_LEX_CPP);
@@ -811,6 +936,7 @@ bool QuincyFrame::AddEditor(const wxString &name)
     }
 
     Connect(IDC_EDIT + idx, wxEVT_STC_CHANGE, wxStyledTextEventHandler(QuincyFrame::OnEditorChange));
+    Connect(IDC_EDIT + idx, wxEVT_STC_MODIFIED, wxStyledTextEventHandler(QuincyFrame::OnEditorModified));
     Connect(IDC_EDIT + idx, wxEVT_STC_CHARADDED, wxStyledTextEventHandler(QuincyFrame::OnEditorCharAdded));
     Connect(IDC_EDIT + idx, wxEVT_STC_UPDATEUI, wxStyledTextEventHandler(QuincyFrame::OnEditorPosition));
     Connect(IDC_EDIT + idx, wxEVT_STC_DWELLSTART, wxStyledTextEventHandler(QuincyFrame::OnEditorDwellStart));
@@ -839,6 +965,8 @@ bool QuincyFrame::AddEditor(const wxString &name)
     if (name.Length() > 0) {
         if (!LoadFile(name, edit))
             wxMessageBox("Failed to load file " + str, "Pawn IDE", wxOK | wxICON_ERROR);
+        else if (ProfileResults.size() > 0)
+            ShowProfile(edit);
     } else {
         edit->ClearAll();
     }
@@ -873,6 +1001,11 @@ bool QuincyFrame::RemoveEditor(int index, bool deletecontrol)
     Editor[index] = NULL;
     Filename[index] = wxEmptyString;
     FileTimeStamp[index] = 0;
+    context.Forget(edit);
+    completion.Forget(edit);
+    for (unsigned idx = BreakpointConds.size(); idx > 0; idx--)
+        if (BreakpointConds[idx - 1].Edit == edit)
+            BreakpointConds.erase(BreakpointConds.begin() + (idx - 1));
 
     /* optionally find the tab page and delete it */
     if (deletecontrol) {
@@ -1168,6 +1301,8 @@ bool QuincyFrame::CheckSaveFile(bool force_save, bool force_prompt, wxStyledText
         fclose(fp);
         edit->SetSavePoint();   /* clear the modification flag */
         FileTimeStamp[idx] = wxFileModificationTime(Filename[idx]);
+        if (IsPawnFile(Filename[idx], true))
+            QueueIndex(Filename[idx]);
     }
     return true;
 }
@@ -1320,6 +1455,7 @@ bool QuincyFrame::LoadSession()
     DebugPort = ini->gets("Options", "DebugPort");
     DebugBaudrate = ini->getl("Options", "DebugBaudrate");
     DebugLogEnabled = ini->getbool("Options", "DebugLogging");
+    Monitor->SetPort(DebugPort, DebugBaudrate);
     strDefines = ini->gets("Options", "Defines");
     strPreBuild = ini->gets("Options", "PreBuild");
     strMiscCmdOptions = ini->gets("Options", "CmdOptions");
@@ -1356,7 +1492,26 @@ bool QuincyFrame::LoadSession()
     if ((DebuggerSelected & DebuggerEnabled) == 0)
         DebuggerSelected = DEBUG_NONE;
 
+    /* drop the symbols of the previous workspace and reclaim the string pool;
+       no string in the pool is in use after the tables that refer to it are
+       cleared, and these are all rebuilt below */
+    if (ReportLoader)
+        ReportLoader->Stop();   /* its workers add strings to the pool */
+    SymbolList.Clear();
+    InfoTipList.clear();
+    InfoTipKeywords.clear();
+    if (HelpIndex) {
+        delete HelpIndex;
+        HelpIndex = NULL;
+    }
+    IncludeRoot.Clear();
+    IncludeFiles.clear();
+    PaletteItems.Clear();
+    StringPool.Reset();
+
     UpdateSymBrowser();
+    LoadReferences();
+    IndexWorkspace();
     ReadInfoTips();
     RebuildHelpMenu();
     RebuildToolsMenu();
@@ -1368,6 +1523,9 @@ bool QuincyFrame::LoadSession()
 /* SaveSession() saves the session information, but not the files themselves */
 bool QuincyFrame::SaveSession()
 {
+    if (References.IsModified())
+        References.Save(ReferenceFile());
+
     /* protection: if there are no files at all, assume that the session does
        not exist (this protects against double save of the session, which is
        harmful because the files get removed from the workspace file) */
@@ -1449,6 +1607,7 @@ bool QuincyFrame::LoadHostConfiguration(const wxString& host)
     /* preset with compiler defaults */
     strFixedAMXName = wxEmptyString;
     UploadTool = wxEmptyString;
+    NativeTransfer = false;
     DeviceTool = wxEmptyString;
     DefaultOptimize = 1;
     DefaultDebugLevel = 1;
@@ -1516,6 +1675,10 @@ bool QuincyFrame::LoadHostConfiguration(const wxString& host)
         pos = line.Find("#upload:");
         if (START_OPTION(pos, line))
             UploadTool = line.Mid(pos + 8).Trim(true).Trim(false);
+        /* Quincy: transfer protocol (only "native" is recognized) */
+        pos = line.Find("#transfer:");
+        if (START_OPTION(pos, line))
+            NativeTransfer = line.Mid(pos + 10).Trim(true).Trim(false).CmpNoCase("native") == 0;
         /* Quincy: device-specific tool */
         pos = line.Find("#tool:");
         if (START_OPTION(pos, line))
@@ -1565,6 +1728,8 @@ void QuincyFrame::LoadSourceFile(const wxString& path)
     if (AddEditor(path)) {
         theApp->PushRecentFile(path);
         RebuildRecentMenus();
+        if (IsPawnFile(path, true))
+            QueueIndex(path);
     } else {
         wxMessageBox("Failed to load the file.", "Pawn IDE", wxOK | wxICON_ERROR);
     }
@@ -2396,34 +2561,20 @@ void QuincyFrame::OnSearchSelect(wxTreeEvent& event)
     wxString filename = SearchLog->GetItemText(parent);
 
     /* find the file, or load it */
-    wxStyledTextCtrl* edit = 0;
-    for (int idx = 0; idx < MAX_EDITORS && !edit; idx++)
-        if (Filename[idx].Cmp(filename) == 0)
-            edit = Editor[idx];
-    if (!edit) {
-        /* try to open the file (and find it) */
-        AddEditor(filename);
-        for (int idx = 0; idx < MAX_EDITORS && !edit; idx++)
-            if (Filename[idx].Cmp(filename) == 0)
-                edit = Editor[idx];
-    }
-    if (!edit) {
-        wxMessageBox("Could not open \"" + filename + "\".", "Pawn IDE", wxOK | wxICON_ERROR);
+    wxStyledTextCtrl* edit = ShowEditor(filename);
+    if (!edit)
         return;
-    }
 
-    /* find the TAB page to activate */
-    for (unsigned page = 0; page < EditTab->GetPageCount(); page++) {
-        if (EditTab->GetPage(page) == edit) {
-            EditTab->SetSelection(page);
-            break;
-        }
-    }
-
-    /* scroll to the position */
+    /* scroll to the position (and select the match, if it is known) */
     long line;
     string.ToLong(&line);
-    edit->GotoPos(edit->PositionFromLine((int)line));
+    SearchItemData* data = dynamic_cast<SearchItemData*>(SearchLog->GetItemData(event.GetItem()));
+    if (data) {
+        int pos = edit->PositionFromLine((int)line) + data->Column;
+        edit->SetSelection(pos, pos + data->Length);
+    } else {
+        edit->GotoPos(edit->PositionFromLine((int)line));
+    }
     PendingFlags |= PEND_SWITCHEDIT;    /* delayed switch focus (because calling edit->SetFocus() here does not work) */
     if (!Timer->IsRunning())
         Timer->Start(100, true);
@@ -2447,53 +2598,191 @@ void QuincyFrame::OnGotoDlg(wxCommandEvent& /* event */)
     }
 }
 
+void QuincyFrame::OnFindReferences(wxCommandEvent& /* event */)
+{
+    /* find the word that the text cursor points at */
+    wxString word = WordUnderCursor();
+    if (word.IsEmpty())
+        return;
+    std::vector<IndexLocation> locations;
+    if (!References.Find(word, locations)) {
+        wxMessageBox("No references to \"" + word + "\" found.", "Pawn IDE", wxOK | wxICON_INFORMATION);
+        return;
+    }
+
+    /* the results go to the search log (which is created if needed) */
+    PrepareSearchLog(true);
+    wxASSERT(SearchLog);
+    SearchLog->DeleteAllItems();
+    wxTreeItemId root = SearchLog->AddRoot("root");
+    wxTreeItemId file;
+    wxStyledTextCtrl* edit = NULL;
+    wxTextFile text;
+    for (unsigned idx = 0; idx < locations.size(); idx++) {
+        const IndexLocation& location = locations[idx];
+        if (idx == 0 || location.Path.Cmp(locations[idx - 1].Path) != 0) {
+            if (file.IsOk())
+                SearchLog->Expand(file);
+            file = SearchLog->AppendItem(root, location.Path);
+            /* take the lines from the editor if the file is open, because the
+               user sees that text */
+            edit = NULL;
+            for (int ed = 0; ed < MAX_EDITORS && !edit; ed++)
+                if (Editor[ed] && Filename[ed].Cmp(location.Path) == 0)
+                    edit = Editor[ed];
+            if (text.IsOpened())
+                text.Close();
+            if (!edit)
+                text.Open(location.Path);
+        }
+        int line = location.Line - 1;   /* 0-based, like the other search results */
+        wxString linetext;
+        if (edit && line < edit->GetLineCount())
+            linetext = edit->GetLine(line);
+        else if (text.IsOpened() && line < (int)text.GetLineCount())
+            linetext = text.GetLine(line);
+        linetext.Trim(false);
+        linetext.Trim(true);
+        wxString string = wxString::Format("%4d: ", line) + linetext;
+        SearchLog->AppendItem(file, string, -1, -1, new SearchItemData(location.Column, word.utf8_str().length()));
+    }
+    if (file.IsOk())
+        SearchLog->Expand(file);
+    PaneTab->SetSelection(TAB_SEARCH);
+}
+
+/** CollectPaletteItems() collects the candidates for the "go to anything"
+ *  palette. These are kept until the symbols, the workspace or the settings
+ *  change.
+ */
+void QuincyFrame::CollectPaletteItems()
+{
+    PaletteItems.Clear();
+    for (unsigned idx = 0; idx < SymbolList.Count(); idx++) {
+        const CSymbolEntry* entry = SymbolList.Entry(idx);
+        PaletteItems.Add(PALETTE_SYMBOL, entry->Name.Str(),
+                         entry->Syntax.Str() + " - " + entry->Source.Str().AfterLast(DIRSEP_CHAR) + wxString::Format(":%d", entry->Line),
+                         entry->Source.Str(), entry->Line);
+    }
+
+    wxArrayString dirs;
+    WorkspaceDirs(dirs);
+    for (unsigned idx = 0; idx < dirs.Count(); idx++) {
+        wxDir dir(dirs[idx]);
+        if (!dir.IsOpened())
+            continue;
+        wxString fname;
+        for (bool more = dir.GetFirst(&fname, wxEmptyString, wxDIR_FILES); more; more = dir.GetNext(&fname))
+            if (IsPawnFile(fname, true))
+                PaletteItems.Add(PALETTE_FILE, fname, dirs[idx], dirs[idx] + DIRSEP_STR + fname);
+    }
+
+    /* the keywords with a tip and the labels in the help index (each only
+       once, the keywords and labels are in the string pool) */
+    if (HelpIndex) {
+        std::set<unsigned> keywords;
+        for (InfoTipMap::iterator iter = InfoTipList.begin(); iter != InfoTipList.end(); ++iter) {
+            const InfoTip& tip = iter->second;
+            if (keywords.insert(tip.Keyword.Id()).second)
+                PaletteItems.Add(PALETTE_HELP, tip.Keyword.Str(), tip.Text.Str().BeforeFirst('\n'), tip.Keyword.Str());
+        }
+        std::vector<unsigned> keys;
+        HelpIndex->GetKeys(keys);
+        for (unsigned idx = 0; idx < keys.size(); idx++)
+            if (keywords.insert(keys[idx]).second)
+                PaletteItems.Add(PALETTE_HELP, StringPool.String(keys[idx]), wxEmptyString, StringPool.String(keys[idx]));
+    }
+}
+
+/** OnGotoAnything() shows a palette to jump to a symbol, to open a file in
+ *  the workspace or in the include path, or to open the help for a keyword.
+ */
+void QuincyFrame::OnGotoAnything(wxCommandEvent& /* event */)
+{
+    if (PaletteItems.IsEmpty())
+        CollectPaletteItems();
+    QuincyGotoPalette palette(this, PaletteItems);
+    if (palette.ShowModal() != wxID_OK || !palette.GetSelection())
+        return;
+    const PaletteItem item = *palette.GetSelection();
+    switch (item.Kind) {
+    case PALETTE_SYMBOL: {
+        CSymbolEntry symbol;
+        symbol.SymbolName = item.Label;
+        symbol.Source = item.Target;
+        symbol.Line = item.Line;
+        GotoSymbol(&symbol);
+        break;
+    }
+    case PALETTE_FILE: {
+        /* a file that is not open yet is loaded like from the "Open" dialog,
+           so that it is added to the recent files */
+        int idx;
+        for (idx = 0; idx < MAX_EDITORS && !(Editor[idx] && Filename[idx].Cmp(item.Target) == 0); idx++)
+            /* nothing */;
+        if (idx < MAX_EDITORS)
+            ShowEditor(item.Target);
+        else
+            LoadSourceFile(item.Target);
+        break;
+    }
+    case PALETTE_HELP:
+        ShowHelp(item.Target);
+        break;
+    }
+}
+
 void QuincyFrame::OnGotoSymbol(wxCommandEvent& /* event */)
 {
+    /* on an #include directive, open the included file */
+    wxStyledTextCtrl *edit = GetActiveEdit(EditTab);
+    if (edit && OpenIncludeFile(edit, edit->GetCurrentLine()))
+        return;
+
     /* find the word that the text cursor points at */
     wxString word = WordUnderCursor();
     if (word.IsEmpty())
         return;
-    const CSymbolEntry* symbol = SymbolList.Lookup(word);
-    if (!symbol) {
+    SymbolRange range = SymbolList.Lookup(word);
+    if (range.first == range.second) {
         wxMessageBox("Symbol \"" + word + "\"not found.", "Pawn IDE", wxOK | wxICON_ERROR);
         return;
     }
 
-    /* see whether there are more matches
-       if there are more matches (not a likely scenario), collect them and let
-       the user choose */
-    int count = 1;
-    while (SymbolList.Lookup(word, count) != NULL)
-        count++;
-    if (count > 1) {
-        const CSymbolEntry** symbollist = new const CSymbolEntry*[count];
-        if (symbollist) {
-            wxArrayString matches;
-            for (int idx = 0; idx < count; idx++) {
-                symbollist[idx] = SymbolList.Lookup(word, idx);
-                matches.Add(symbollist[idx]->Syntax + " - " + symbollist[idx]->Source);
-            }
-            /* create a dialog that the user can choose from */
-            static int dlgwidth = wxDefaultCoord;
-            static int dlgheight = wxDefaultCoord;
-            wxSingleChoiceDialog *dlg = new wxSingleChoiceDialog(this, "This symbol appears in multiple source files.", "Select source file", matches);
-            dlg->SetSize(wxDefaultCoord, wxDefaultCoord, dlgwidth, dlgheight, wxSIZE_AUTO);
-            int result = dlg->ShowModal();
-            dlg->GetSize(&dlgwidth, &dlgheight);
-            if (result == wxID_OK) {
-                int idx = dlg->GetSelection();
-                wxASSERT(idx >= 0 && idx < count);
-                symbol = symbollist[idx];
-            } else {
-                symbol = NULL;
-            }
-            delete[] symbollist;
+    /* if there are more matches (not a likely scenario), let the user choose;
+       the matches are copied, because the list may change while the dialog
+       is open */
+    std::vector<CSymbolEntry> symbollist(range.first, range.second);
+    /* prefer the declarations in the files that the script includes */
+    std::vector<CSymbolEntry> included;
+    const std::set<unsigned>& scope = IncludeScope();
+    for (unsigned idx = 0; idx < symbollist.size(); idx++)
+        if (InIncludeScope(&symbollist[idx], scope))
+            included.push_back(symbollist[idx]);
+    if (included.size() > 0)
+        symbollist.swap(included);
+    int choice = 0;
+    if (symbollist.size() > 1) {
+        wxArrayString matches;
+        for (unsigned idx = 0; idx < symbollist.size(); idx++)
+            matches.Add(symbollist[idx].Syntax.Str() + " - " + symbollist[idx].Source.Str());
+        /* create a dialog that the user can choose from */
+        static int dlgwidth = wxDefaultCoord;
+        static int dlgheight = wxDefaultCoord;
+        wxSingleChoiceDialog *dlg = new wxSingleChoiceDialog(this, "This symbol appears in multiple source files.", "Select source file", matches);
+        dlg->SetSize(wxDefaultCoord, wxDefaultCoord, dlgwidth, dlgheight, wxSIZE_AUTO);
+        int result = dlg->ShowModal();
+        dlg->GetSize(&dlgwidth, &dlgheight);
+        if (result == wxID_OK) {
+            choice = dlg->GetSelection();
+            wxASSERT(choice >= 0 && choice < (int)symbollist.size());
+        } else {
+            choice = -1;
         }
     }
-    if (!symbol)
+    if (choice < 0)
         return;
 
-    wxStyledTextCtrl *edit = GetActiveEdit(EditTab);
     wxASSERT(edit); /* otherwise a valid word could never have been found */
     int line = edit->GetCurrentLine();
     if ((edit->MarkerGet(line) & ((1 << MARKER_BOOKMARK) | (1 << MARKER_NAVIGATE))) == 0) {
@@ -2502,34 +2791,28 @@ void QuincyFrame::OnGotoSymbol(wxCommandEvent& /* event */)
         IgnoreChangeEvent = false;
     }
 
-    GotoSymbol(symbol);
+    GotoSymbol(&symbollist[choice]);
 }
 
-bool QuincyFrame::GotoSymbol(const CSymbolEntry* symbol)
+/** ShowEditor() activates the editor of a file, after loading the file if it
+ *  is not open yet. It returns the editor, or NULL (after showing a message)
+ *  if the file could not be loaded.
+ */
+wxStyledTextCtrl* QuincyFrame::ShowEditor(const wxString& filename)
 {
-    wxASSERT(symbol);
-
-    /* find the file, or load it (note: the symbol browser always has the full
-       paths of the filenames) */
-    wxString filename = symbol->Source;
-    if (!wxFileExists(filename)) {
-        wxMessageBox("The file \"" + filename + "\" no longer exists.", "Pawn IDE", wxOK | wxICON_ERROR);
-        return false;
-    }
     wxStyledTextCtrl* edit = 0;
     for (int idx = 0; idx < MAX_EDITORS && !edit; idx++)
         if (Filename[idx].Cmp(filename) == 0)
             edit = Editor[idx];
-    if (!edit) {
-        /* try to open the file (and find it) */
-        AddEditor(filename);
+    if (!edit && AddEditor(filename)) {
+        /* find the editor that was just created */
         for (int idx = 0; idx < MAX_EDITORS && !edit; idx++)
             if (Filename[idx].Cmp(filename) == 0)
                 edit = Editor[idx];
     }
     if (!edit) {
         wxMessageBox("Could not open \"" + filename + "\".", "Pawn IDE", wxOK | wxICON_ERROR);
-        return false;
+        return NULL;
     }
 
     /* find the TAB page to activate */
@@ -2539,12 +2822,29 @@ bool QuincyFrame::GotoSymbol(const CSymbolEntry* symbol)
             break;
         }
     }
+    return edit;
+}
+
+bool QuincyFrame::GotoSymbol(const CSymbolEntry* symbol)
+{
+    wxASSERT(symbol);
+
+    /* find the file, or load it (note: the symbol browser always has the full
+       paths of the filenames) */
+    wxString filename = symbol->Source.Str();
+    if (!wxFileExists(filename)) {
+        wxMessageBox("The file \"" + filename + "\" no longer exists.", "Pawn IDE", wxOK | wxICON_ERROR);
+        return false;
+    }
+    wxStyledTextCtrl* edit = ShowEditor(filename);
+    if (!edit)
+        return false;
 
     /* search up and down for the best match (because the file may have been
        edited since last compile) */
     int line = symbol->Line - 1;
     int pos = edit->PositionFromLine(line);
-    wxString name = symbol->SymbolName;
+    wxString name = symbol->SymbolName.Str();
     if (name.Length() > 1 && name[1] == ':')
         name = name.Mid(2);
     //??? if the type is F, also look for the word "new" on the same line; if the
@@ -2705,13 +3005,11 @@ void QuincyFrame::OnViewIndentGuides(wxCommandEvent& /* event */)
 
 void QuincyFrame::OnCompile(wxCommandEvent& /* event */)
 {
-    if (ExecPID != 0 && wxProcess::Exists(ExecPID)) {
+    if (IsExecRunning()) {
         int reply = wxMessageBox("Do you want to abort the running script?", "Pawn IDE", wxYES_NO | wxICON_QUESTION);
         if (reply != wxYES)
             return;
-        wxProcess::Kill(ExecPID, wxSIGTERM);
-        wxProcess::Kill(ExecPID, wxSIGKILL);
-        ExecPID = 0;
+        Exec->Kill();
         DebugMode = false;
     }
 
@@ -2782,7 +3080,7 @@ void QuincyFrame::OnCompile(wxCommandEvent& /* event */)
 
 void QuincyFrame::OnTransfer(wxCommandEvent& /* event */)
 {
-    if (ExecPID == 0 && (DebuggerSelected == DEBUG_REMOTE || UploadTool.length() > 0)) {
+    if (DebuggerSelected == DEBUG_REMOTE || UploadTool.length() > 0 || NativeTransfer) {
         if (strRecentAMXName.length() == 0) {
             wxMessageBox("No recent compiled file to transfer. Build the script first",
                          "Pawn IDE", wxOK | wxICON_ERROR);
@@ -2795,8 +3093,8 @@ void QuincyFrame::OnTransfer(wxCommandEvent& /* event */)
 void QuincyFrame::OnDebug(wxCommandEvent& /* event */)
 {
     LastWatchIndex = 0;
-    if (ExecPID != 0 && wxProcess::Exists(ExecPID) && DebugMode && !DebugRunning)
-        SendDebugCommand("g");
+    if (IsExecRunning() && DebugMode && (!DebugRunning || DebugStepping))
+        QueueDebugStep("g");
     else
         RunCurrentScript(true);
 }
@@ -2804,38 +3102,44 @@ void QuincyFrame::OnDebug(wxCommandEvent& /* event */)
 void QuincyFrame::OnRun(wxCommandEvent& /* event */)
 {
     LastWatchIndex = 0;
-    if (ExecPID != 0 && wxProcess::Exists(ExecPID) && DebugMode && !DebugRunning)
-        SendDebugCommand("g");
+    if (IsExecRunning() && DebugMode && (!DebugRunning || DebugStepping))
+        QueueDebugStep("g");
     else
         RunCurrentScript();
 }
 
 void QuincyFrame::OnAbort(wxCommandEvent& /* event */)
 {
-    if (ExecPID != 0 && wxProcess::Exists(ExecPID)) {
-        wxProcess::Kill(ExecPID, wxSIGTERM);
-        wxProcess::Kill(ExecPID, wxSIGKILL);
+    /* if the output of a script that runs in the background is shown, stop
+       that script; otherwise stop the foreground session */
+    int page = PaneTab->GetSelection();
+    ExecSession* session = (page >= 0) ? FindSession(0, PaneTab->GetPage(page)) : NULL;
+    if (session && session != Exec && session->IsRunning()) {
+        session->Kill();
+        return;
     }
-    ExecPID = 0;
+    Exec->Kill();
     DebugMode = false;
+    StepQueue.Clear();
+    DeferredWatches.clear();
 }
 
 void QuincyFrame::OnStepInto(wxCommandEvent& /* event */)
 {
     LastWatchIndex = 0;
-    SendDebugCommand("s");
+    QueueDebugStep("s");
 }
 
 void QuincyFrame::OnStepOver(wxCommandEvent& /* event */)
 {
     LastWatchIndex = 0;
-    SendDebugCommand("n");
+    QueueDebugStep("n");
 }
 
 void QuincyFrame::OnStepOut(wxCommandEvent& /* event */)
 {
     LastWatchIndex = 0;
-    SendDebugCommand("g func");
+    QueueDebugStep("g func");
 }
 
 void QuincyFrame::OnRunToCursor(wxCommandEvent& /* event */)
@@ -2846,7 +3150,7 @@ void QuincyFrame::OnRunToCursor(wxCommandEvent& /* event */)
     LastWatchIndex = 0;
     int line = edit->GetCurrentLine();
     wxString cmd = wxString::Format("g %d", line + 1);
-    SendDebugCommand(cmd);
+    QueueDebugStep(cmd);
 }
 
 void QuincyFrame::OnBreakpointToggle(wxCommandEvent& /* event */)
@@ -2856,17 +3160,83 @@ void QuincyFrame::OnBreakpointToggle(wxCommandEvent& /* event */)
         return;
     IgnoreChangeEvent = true;
     int line = edit->GetCurrentLine();
-    if (edit->MarkerGet(line) & (1 << MARKER_BREAKPOINT))
+    if (edit->MarkerGet(line) & (1 << MARKER_BREAKPOINT)) {
         edit->MarkerDelete(line, MARKER_BREAKPOINT);
-    else
+        /* also drop the hit count or log expression, if any */
+        for (unsigned idx = BreakpointConds.size(); idx > 0; idx--)
+            if (BreakpointConds[idx - 1].Edit == edit && edit->MarkerLineFromHandle(BreakpointConds[idx - 1].Handle) < 0)
+                BreakpointConds.erase(BreakpointConds.begin() + (idx - 1));
+    } else {
         edit->MarkerAdd(line, MARKER_BREAKPOINT);
+    }
+    IgnoreChangeEvent = false;
+    ChangedBreakpoints = true;
+
+    /* see whether we can send the update immediately */
+    if (IsExecRunning() && DebugMode && !DebugRunning) {
+        BuildBreakpointList();
+        PumpDebugQueries();     /* sends only the first, the others are sent in response */
+    }
+}
+
+/** OnBreakpointProperties() sets a hit count and/or a log expression on the
+ *  breakpoint at the current line (a breakpoint is added if there is none).
+ *  These conditions are handled by the IDE: the debugger stops on every hit,
+ *  and the IDE sends "go" straight away when the condition is not met.
+ */
+void QuincyFrame::OnBreakpointProperties(wxCommandEvent& /* event */)
+{
+    wxStyledTextCtrl *edit = GetActiveEdit(EditTab);
+    if (!edit || BreakpointHit >= 0)
+        return;
+    int line = edit->GetCurrentLine();
+    int index = -1;
+    for (unsigned idx = 0; idx < BreakpointConds.size() && index < 0; idx++)
+        if (BreakpointConds[idx].Edit == edit && edit->MarkerLineFromHandle(BreakpointConds[idx].Handle) == line)
+            index = idx;
+
+    long stopat = 0;
+    wxString expr;
+    wxString msg = "Stop (or log) from this hit on; 0 or 1 applies to every hit.";
+    if (index >= 0) {
+        const BreakpointCond& bp = BreakpointConds[index];
+        stopat = bp.StopAt;
+        expr = bp.LogExpr;
+        if (bp.Hits > 0)
+            msg += wxString::Format("\n\nHits so far: %lu", bp.Hits);
+        if (bp.Continued > 0)
+            msg += wxString::Format("\nContinued automatically: %lu (%.3f ms per hit)", bp.Continued, bp.Cost.ToDouble() / bp.Continued / 1000.0);
+    }
+    long value = wxGetNumberFromUser(msg, "Hit count", "Breakpoint properties", stopat, 0, LONG_MAX, this);
+    if (value < 0)
+        return;
+    expr = wxGetTextFromUser("Expression to log on a hit (execution then continues);\nleave empty to stop at the breakpoint.",
+                             "Breakpoint properties", expr, this);
+    expr.Trim();
+    expr.Trim(false);
+
+    /* (re-)set the marker, to get its handle */
+    IgnoreChangeEvent = true;
+    if (index >= 0) {
+        edit->MarkerDeleteHandle(BreakpointConds[index].Handle);
+        BreakpointConds.erase(BreakpointConds.begin() + index);
+    } else if (edit->MarkerGet(line) & (1 << MARKER_BREAKPOINT)) {
+        edit->MarkerDelete(line, MARKER_BREAKPOINT);
+    }
+    int handle = edit->MarkerAdd(line, MARKER_BREAKPOINT);
     IgnoreChangeEvent = false;
+    if (value > 1 || expr.Length() > 0) {
+        BreakpointCond bp(edit, handle);
+        bp.StopAt = value;
+        bp.LogExpr = expr;
+        BreakpointConds.push_back(bp);
+    }
     ChangedBreakpoints = true;
 
     /* see whether we can send the update immediately */
-    if (ExecPID != 0 && wxProcess::Exists(ExecPID) && DebugMode && !DebugRunning) {
+    if (IsExecRunning() && DebugMode && !DebugRunning) {
         BuildBreakpointList();
-        SendBreakpointList();   /* sends only the first, the others are sent in response */
+        PumpDebugQueries();
     }
 }
 
@@ -2884,23 +3254,23 @@ void QuincyFrame::OnBreakpointClear(wxCommandEvent& /* event */)
             line = next + 1;
         }
     }
+    BreakpointConds.clear();
     ChangedBreakpoints = true;
 
     /* see whether we can send the update immediately */
-    if (ExecPID != 0 && wxProcess::Exists(ExecPID) && DebugMode && !DebugRunning) {
+    if (IsExecRunning() && DebugMode && !DebugRunning) {
         BuildBreakpointList();  /* make sure to build an empty list */
-        SendBreakpointList();   /* sends the "clear" command */
+        PumpDebugQueries();     /* sends the "clear" command */
     }
 }
 
 void QuincyFrame::OnIdle(wxIdleEvent& event)
 {
-    if (ExecPID != 0 && !wxProcess::Exists(ExecPID))
-        ExecPID = 0;
-
-    if (ExecPID != 0) {
-        wxASSERT(wxProcess::Exists(ExecPID) && ExecProcess);
-        wxInputStream* istream = ExecProcess->GetInputStream();
+    bool foreground = IsExecRunning();
+    if (foreground) {
+        wxASSERT(Exec->GetProcess());
+        /* while profiling, the profiler thread handles the I/O */
+        wxInputStream* istream = Profiler ? NULL : Exec->GetProcess()->GetInputStream();
         if (istream) {
             wxString text;
             while (istream->CanRead()) {
@@ -2939,14 +3309,28 @@ void QuincyFrame::OnIdle(wxIdleEvent& event)
             }
         }
 
-        if (DebugRunning) {
+        if (Profiler) {
+            Profiler->SendInput(Exec->GetInput());
+            Exec->ClearInput();
+        } else if (DebugRunning) {
             /* collected text is only sent to the script if not waiting
                at a debugger prompt */
-            wxOutputStream* ostream = ExecProcess->GetOutputStream();
-            if (ostream) {
-                for (unsigned idx = 0; idx < ExecInputQueue.length(); idx++)
-                    ostream->PutC(ExecInputQueue[idx]);
-                ExecInputQueue.Empty();
+            Exec->FlushInput();
+        }
+
+        /* move the output of logging breakpoints to the output pane (in
+           batches, not on every hit) */
+        if (BreakpointLog.size() > 0 && wxGetLocalTimeMillis() - BreakpointLogTime >= BPLOG_INTERVAL)
+            FlushBreakpointLog();
+
+        /* check (a few times per second) whether array elements in the
+           inspector scrolled into view, and fetch these */
+        if (DebugMode && !DebugRunning && PaneTab->GetSelection() == TAB_INSPECT) {
+            wxLongLong tstamp = wxGetLocalTimeMillis();
+            if (tstamp - InspectScanTime >= 250) {
+                InspectScanTime = tstamp;
+                Inspector.QueueVisible();
+                PumpDebugQueries();
             }
         }
 
@@ -2954,16 +3338,66 @@ void QuincyFrame::OnIdle(wxIdleEvent& event)
         event.RequestMore();
     }
 
+    /* the background sessions are handled in OnSessionTimer() */
+    if (foreground && wxGetLocalTimeMillis() - SessionTime >= SESSION_INTERVAL)
+        UpdateSessionTabs();
+
     wxStyledTextCtrl *edit = GetActiveEdit(EditTab);
     if (!context.ScanContext(edit, 0))
         event.RequestMore();
+    else if (!completion.Update(edit, WORD_LINES))
+        event.RequestMore();
+}
+
+/** OnSessionTimer() copies the output of the scripts running in the
+ *  background (these have no debugger, so their output is copied as is) and
+ *  sends the text typed in their panes. The timer runs while there are
+ *  background sessions.
+ */
+void QuincyFrame::OnSessionTimer(wxTimerEvent& /* event */)
+{
+    bool background = false;
+    for (unsigned idx = 0; idx < Sessions.size(); idx++) {
+        ExecSession* session = Sessions[idx];
+        if (session->IsRunning()) {
+            session->DrainOutput();
+            session->FlushInput();
+            background = true;
+        }
+    }
+    if (!background)
+        SessionTimer->Stop();
+    else if (wxGetLocalTimeMillis() - SessionTime >= SESSION_INTERVAL)
+        UpdateSessionTabs();
 }
 
-void QuincyFrame::OnTerminateApp(wxProcessEvent& /* event */)
+void QuincyFrame::OnTerminateApp(wxProcessEvent& event)
 {
+    DeviceTransfer* device = FindDeviceTransfer(wxEmptyString, event.GetPid());
+    if (device) {
+        delete device->Process;
+        device->Process = NULL;
+        FinishDeviceTransfer(device, event.GetExitCode() == 0,
+                             wxString::Format("upload tool returned %d", event.GetExitCode()));
+        return;
+    }
+
+    ExecSession* session = FindSession(event.GetPid());
+    if (!session)
+        return;
+    Monitor->Reclaim(session);  /* in case the session used the serial port */
+    if (session != Exec) {
+        session->DrainOutput();
+        session->Finished();
+        UpdateSessionTabs();
+        return;
+    }
+
+    /* the profiler reads the output up to the end, then collect its results */
+    StopProfiler();
     /* flush the remaining output */
-    wxASSERT(ExecProcess);
-    wxInputStream* istream = ExecProcess->GetInputStream();
+    wxASSERT(Exec->GetProcess());
+    wxInputStream* istream = Exec->GetProcess()->GetInputStream();
     if (istream) {
         wxString text;
         while (istream->CanRead()) {
@@ -2977,9 +3411,89 @@ void QuincyFrame::OnTerminateApp(wxProcessEvent& /* event */)
                 PaneTab->SetSelection(TAB_OUTPUT);  /* make sure "output" window is visible */
         }
     }
+    Exec->Finished();
+    UpdateSessionTabs();
     /* keep the control enabled, so user can still scroll */
 }
 
+/** StartSession() runs a script next to the foreground session, with its
+ *  output in a tab of its own. The tab of a session that has ended is
+ *  re-used.
+ */
+ExecSession* QuincyFrame::StartSession(const wxString& name, const wxString& command)
+{
+    wxTextCtrl* output;
+    unsigned idx;
+    for (idx = 0; idx < Sessions.size() && Sessions[idx]->IsRunning(); idx++)
+        /* nothing */;
+    if (idx < Sessions.size()) {
+        output = Sessions[idx]->GetOutput();
+        delete Sessions[idx];
+        Sessions.erase(Sessions.begin() + idx);
+    } else if (Sessions.size() >= MAX_SESSIONS) {
+        wxMessageBox("Too many scripts are running.\nPlease stop a script first.", "Pawn IDE", wxOK | wxICON_ERROR);
+        return NULL;
+    } else {
+        output = new wxTextCtrl(PaneTab, wxID_ANY, wxEmptyString, wxDefaultPosition, wxDefaultSize, wxHSCROLL | wxTE_LEFT | wxTE_MULTILINE | wxTE_READONLY);
+        output->SetForegroundColour(Terminal->GetForegroundColour());
+        output->SetBackgroundColour(Terminal->GetBackgroundColour());
+        output->SetFont(Terminal->GetFont());
+        output->Connect(wxEVT_CHAR, wxKeyEventHandler(QuincyFrame::OnTerminalChar), NULL, this);
+        PaneTab->AddPage(output, "Output: " + name, false);
+    }
+    ExecSession* session = new ExecSession(name, output);
+    Sessions.push_back(session);    /* also on failure, to keep the tab */
+    if (!session->Start(this, command)) {
+        wxMessageBox("Pawn run-time could not be started.\nPlease check the settings.",
+                     "Pawn IDE", wxOK | wxICON_ERROR);
+        return NULL;
+    }
+    int page = PaneTab->GetPageIndex(output);
+    PaneTab->SetPageText(page, "Output: " + name);
+    PaneTab->SetSelection(page);
+    output->SetFocus();
+    if (!SessionTimer->IsRunning())
+        SessionTimer->Start(SESSION_POLL);
+    return session;
+}
+
+/** FindSession() looks up a session (foreground or background) on either the
+ *  process ID or the output control.
+ */
+ExecSession* QuincyFrame::FindSession(long pid, wxWindow* output)
+{
+    if (Exec && ((pid != 0 && Exec->GetPID() == pid) || (output && Exec->GetOutput() == output)))
+        return Exec;
+    for (unsigned idx = 0; idx < Sessions.size(); idx++) {
+        ExecSession* session = Sessions[idx];
+        if ((pid != 0 && session->GetPID() == pid) || (output && session->GetOutput() == output))
+            return session;
+    }
+    return NULL;
+}
+
+/** UpdateSessionTabs() shows the wall-clock time and the CPU time of each
+ *  session in its tab.
+ */
+void QuincyFrame::UpdateSessionTabs()
+{
+    SessionTime = wxGetLocalTimeMillis();
+    for (unsigned idx = 0; idx <= Sessions.size(); idx++) {
+        ExecSession* session = (idx < Sessions.size()) ? Sessions[idx] : Exec;
+        if (!session)
+            continue;
+        int page = PaneTab->GetPageIndex(session->GetOutput());
+        if (page == wxNOT_FOUND)
+            continue;
+        wxString label = (session == Exec) ? session->GetName() : "Output: " + session->GetName();
+        wxString times = session->GetTimes();
+        if (times.length() > 0)
+            label += " [" + times + "]";
+        if (PaneTab->GetPageText(page).Cmp(label) != 0)
+            PaneTab->SetPageText(page, label);
+    }
+}
+
 bool QuincyFrame::CompileSource(const wxString& script)
 {
     /* check whether there is a prebuild step */
@@ -3122,6 +3636,24 @@ bool QuincyFrame::CompileSource(const wxString& script)
     return errors.Count() == 0;
 }
 
+/** UploadCommand() returns the command line for the upload tool: the tool,
+ *  the compiled script and the arguments that follow the tool in the
+ *  "#upload:" option of the target host, where "%port%" is replaced by the
+ *  port.
+ */
+wxString QuincyFrame::UploadCommand(const wxString& path, const wxString& port)
+{
+    wxString tool = UploadTool.BeforeFirst(' ');
+    wxString args = UploadTool.AfterFirst(' ').Trim(false);
+    wxString command = strCompilerPath + DIRSEP_STR + tool + EXE_EXT;
+    command += " " + OptionallyQuoteString(path);
+    if (args.length() > 0) {
+        args.Replace("%port%", port);
+        command += " " + args;
+    }
+    return command;
+}
+
 bool QuincyFrame::TransferScript(const wxString& path)
 {
     //??? halt the RS232 reception, if any
@@ -3146,8 +3678,7 @@ bool QuincyFrame::TransferScript(const wxString& path)
         #endif
         wxArrayString output;
         wxArrayString errors;
-        command = strCompilerPath + DIRSEP_STR + UploadTool + EXE_EXT;
-        command += " " + path;
+        command = UploadCommand(path, GetTargetPort());
         long result = wxExecute(command, output, errors, wxEXEC_SYNC);
         delete disableAll;
         delete info;
@@ -3162,42 +3693,81 @@ bool QuincyFrame::TransferScript(const wxString& path)
         BuildLog->InsertItem(cnt + 1, msg);
         wxStatusBar* bar = GetStatusBar();
         SetStatusText(bar->GetStatusText(0) + ". " + msg);
+    } else if (NativeTransfer) {
+        if (Transfer) {
+            wxMessageBox("A transfer is already in progress.", "Pawn IDE", wxOK | wxICON_ERROR);
+            return false;
+        }
+        wxString port = GetTargetPort();
+        std::map<wxString, TransferImage>::iterator cached = TransferCache.find(port);
+        if (cached != TransferCache.end() && NoPatchPorts.count(port) == 0)
+            Transfer = new CSerialTransfer(this, IDM_TRANSFER, port, DebugBaudrate, path, cached->second);
+        else
+            Transfer = new CSerialTransfer(this, IDM_TRANSFER, port, DebugBaudrate, path);
+        Monitor->Release(port, &Transfer);
+        if (Transfer->Run() != wxTHREAD_NO_ERROR) {
+            delete Transfer;
+            Transfer = NULL;
+            Monitor->Reclaim(&Transfer);
+            wxMessageBox("Transfer could not be started.", "Pawn IDE", wxOK | wxICON_ERROR);
+            return false;
+        }
+        wxULongLong size = wxFileName::GetSize(path);
+        TransferSize = (size == wxInvalidSize) ? 0 : size.GetLo();
+        TransferProgress = new wxProgressDialog("Transfer", "Transferring " + path.AfterLast(DIRSEP_CHAR),
+                                                wxMax((int)TransferSize, 1), this,
+                                                wxPD_APP_MODAL | wxPD_CAN_ABORT | wxPD_ELAPSED_TIME);
+        TransferClock.Start();
+        success = true;     /* result is reported when the transfer completes */
     } else {
         command = strCompilerPath + DIRSEP_STR "pawndbg" EXE_EXT;
         command += " " + path;
         command += " -term=off,";
         command += debug_prefix;
-        command += " -rs232=" + DebugPort;
+        command += " -rs232=" + GetTargetPort();
         command += wxString::Format(",%ld", DebugBaudrate);
         command += " -transfer -quit";
 
-        ExecPID = wxExecute(command, wxEXEC_ASYNC, ExecProcess);
-        if (ExecPID <= 0) {
-            wxMessageBox("Pawn debugger could not be started.\nPlease check the settings.",
-                         "Pawn IDE", wxOK | wxICON_ERROR);
-            delete ExecProcess;
-            return success;
-        }
-        PaneTab->SetSelection(TAB_OUTPUT);
-        Terminal->Enable(true);
-        Terminal->Clear();
-        ExecInputQueue.Clear();
-        DebugMode = true;
-        DebugRunning = true;
-        DebugHoldback = 0;
+        if (IsExecRunning()) {
+            /* a script is running, so transfer in a session of its own; the
+               monitor must let go of the port before pawndbg opens it, so it
+               is released on the session list until the session exists */
+            Monitor->Release(GetTargetPort(), &Sessions);
+            ExecSession* session = StartSession("Transfer", command);
+            if (!session) {
+                Monitor->Reclaim(&Sessions);
+                return success;
+            }
+            session->SetPrefix(debug_prefix);
+            Monitor->Release(GetTargetPort(), session);
+            Monitor->Reclaim(&Sessions);
+        } else {
+            Monitor->Release(GetTargetPort(), Exec);
+            if (!Exec->Start(this, command)) {
+                Monitor->Reclaim(Exec);
+                wxMessageBox("Pawn debugger could not be started.\nPlease check the settings.",
+                             "Pawn IDE", wxOK | wxICON_ERROR);
+                return success;
+            }
+            PaneTab->SetSelection(TAB_OUTPUT);
+            DebugMode = true;
+            DebugRunning = true;
+            DebugHoldback = 0;
+        }
         success = true;
     }
     return success;
 }
 
-bool QuincyFrame::RunCurrentScript(bool debug)
+bool QuincyFrame::RunCurrentScript(bool debug, bool profile)
 {
-    /* check whether already running */
-    if (ExecPID != 0 && wxProcess::Exists(ExecPID)) {
+    /* check whether already running; another script may run next to it, but
+       not under the debugger */
+    bool background = IsExecRunning();
+    if (background && debug) {
         wxMessageBox("A script is already running.", "Pawn IDE", wxOK | wxICON_ERROR);
         return false;
     }
-    ExecPID = 0;    /* if not running, preset to an invalid value */
 
     wxStyledTextCtrl *edit = GetActiveEdit(EditTab);
     if (!edit) {
@@ -3293,11 +3863,6 @@ bool QuincyFrame::RunCurrentScript(bool debug)
         }
     }
 
-    /* create a process instance for redirected input and output */
-    ExecProcess = new wxProcess(this);
-    if (ExecProcess)
-        ExecProcess->Redirect();
-
     wxString command = strCompilerPath + DIRSEP_STR;
     if (debug)
         command += "pawndbg" EXE_EXT;
@@ -3308,27 +3873,47 @@ bool QuincyFrame::RunCurrentScript(bool debug)
         command += " -term=off,";
         command += debug_prefix;
         if (DebuggerSelected == DEBUG_REMOTE) {
-            //??? halt the RS232 reception, if any
-            command += " -rs232=" + DebugPort;
+            Monitor->Release(GetTargetPort(), Exec);    /* pawndbg needs the port */
+            command += " -rs232=" + GetTargetPort();
             command += wxString::Format(",%ld", DebugBaudrate);
         }
     }
-    ExecPID = wxExecute(command, wxEXEC_ASYNC, ExecProcess);
-    if (ExecPID <= 0) {
+    if (background)
+        return StartSession(amxname.AfterLast(DIRSEP_CHAR), command) != NULL;
+    if (!Exec->Start(this, command)) {
+        Monitor->Reclaim(Exec);
         wxMessageBox("Pawn run-time could not be started.\nPlease check the settings.",
                      "Pawn IDE", wxOK | wxICON_ERROR);
-        delete ExecProcess;
         return false;
     }
     PaneTab->SetSelection(TAB_OUTPUT);
-    Terminal->Enable(true);
-    Terminal->Clear();
     Terminal->SetFocus();
-    ExecInputQueue.Clear();
-    DebugMode = debug;
+    DebugMode = debug && !profile;  /* the profiler drives the debugger, the user cannot */
     DebugRunning = true;        /* start assuming "run mode" (wait for prompt) */
+    if (DebugMode) {
+        DebugLatency.Clear();
+        DebugStartTime = wxGetLocalTimeMillis();
+        DebugStepTime = 0;
+    }
     DebugHoldback = 0;
     WatchLog->Enable(DebugMode);
+    Inspector.Invalidate();
+    DebugQueries.clear();
+    ValueCache.clear();
+    PrefetchList.Clear();
+    HoverRequest.Clear();
+    DebugScope.Clear();
+    StepQueue.Clear();
+    DeferredWatches.clear();
+    DebugStepping = false;
+    DebugMarkerShown = false;
+    for (unsigned idx = 0; idx < BreakpointConds.size(); idx++) {
+        BreakpointConds[idx].Hits = 0;
+        BreakpointConds[idx].Continued = 0;
+        BreakpointConds[idx].Cost = 0;
+    }
+    BreakpointHit = -1;
+    BreakpointLog.clear();
     if (DebugMode) {
         /* copy all rows in the watch log to the update list */
         LastWatchIndex = 0;
@@ -3346,12 +3931,20 @@ bool QuincyFrame::RunCurrentScript(bool debug)
         ChangedBreakpoints = true;  /* force updating all breakpoints too */
         BuiltBreakpoints = false;
     }
+    if (profile && !StartProfiler(amxname)) {
+        Exec->Kill();
+        return false;
+    }
     return true;
 }
 
+#define STEP_MAXQUEUE           16  /* maximum number of steps queued while stepping */
+#define STEP_RENDER_INTERVAL    100 /* milliseconds between updates of the position, while stepping */
+
 void QuincyFrame::HandleDebugResponse(const wxString& cmd)
 {
-    SetStatusText(wxEmptyString, 0);
+    if (GetStatusBar() && GetStatusBar()->GetStatusText(0).Length() > 0)
+        SetStatusText(wxEmptyString, 0);   /* avoid a redraw on every step */
     if (cmd.Left(4).Cmp("file") == 0) {
         DebugCurrentFile = cmd.Mid(4);
         DebugCurrentFile.Trim();
@@ -3365,6 +3958,13 @@ void QuincyFrame::HandleDebugResponse(const wxString& cmd)
         wxString value = tokenizer.GetNextToken();
         while (tokenizer.HasMoreTokens())
             value += " " + tokenizer.GetNextToken();
+        if (StepQueue.Count() > 0 || BreakpointHit >= 0) {
+            /* more steps follow (or execution continues from a breakpoint
+               automatically), only the values at the final stop are shown */
+            DeferredWatches[LastWatchIndex] = name + "\t" + value;
+            return;
+        }
+        DeferredWatches.erase(LastWatchIndex);
         if (LastWatchIndex <= WatchLog->GetItemCount())
             WatchLog->SetItemText(LastWatchIndex - 1, name);
         else
@@ -3372,14 +3972,35 @@ void QuincyFrame::HandleDebugResponse(const wxString& cmd)
         WatchLog->SetItem(LastWatchIndex - 1, 1, value);
         WatchLog->SetColumnWidth(0, wxLIST_AUTOSIZE);
         WatchLog->SetColumnWidth(1, wxLIST_AUTOSIZE);
+        /* watches are evaluated in the current frame, so the value is also
+           valid for a calltip */
+        ValueCache[DebugScope + "\t" + name] = value;
     } else if (cmd.Left(3).Cmp("loc") == 0 || cmd.Left(3).Cmp("glb") == 0) {
-        wxStyledTextCtrl *edit = GetActiveEdit(EditTab);
-        if (edit) {
-            wxString tip = cmd.Mid(3);
-            tip.Trim(false);
-            tip.Trim();
-            tip = tip.AfterFirst('\t');
-            edit->CallTipShow(CalltipPos, tip);
+        wxString tip = cmd.Mid(3);
+        tip.Trim(false);
+        tip.Trim();
+        tip = tip.AfterFirst('\t');
+        if (DebugQueries.size() > 0) {
+            DebugQuery& query = DebugQueries.front();
+            query.Answered = true;
+            if (query.Stop != DebugStopCount)
+                return;     /* execution resumed since the query was sent, value is outdated */
+            wxString scope = (cmd.Left(3).Cmp("loc") == 0) ? DebugScope : wxString(wxEmptyString);
+            ValueCache[scope + "\t" + query.Symbol] = tip;
+            if (query.Type == DBGQUERY_INSPECT) {
+                if (Inspector.IsPending())
+                    Inspector.HandleReply(tip);
+            } else if (query.Type == DBGQUERY_LOG) {
+                LogBreakpoint(query.Symbol + " = " + tip);
+            } else if (query.Type == DBGQUERY_HOVER && query.Symbol.Cmp(HoverSymbol) == 0) {
+                wxStyledTextCtrl *edit = GetActiveEdit(EditTab);
+                if (edit)
+                    edit->CallTipShow(CalltipPos, tip);
+            }
+        } else {
+            wxStyledTextCtrl *edit = GetActiveEdit(EditTab);
+            if (edit)
+                edit->CallTipShow(CalltipPos, tip);
         }
     } else if (cmd.Left(4).Cmp("info") == 0) {
         wxString msg = cmd.Mid(4);
@@ -3387,29 +4008,86 @@ void QuincyFrame::HandleDebugResponse(const wxString& cmd)
         msg.Trim();
         SetStatusText(msg, 0);
     } else if (cmd.Left(4).Cmp("dbg>") == 0) {
-        DebugRunning = false;
-        /* set the "current line" marker */
-        wxStyledTextCtrl* edit = 0;
-        for (int idx = 0; idx < MAX_EDITORS && !edit; idx++)
-            if (Filename[idx].Cmp(DebugCurrentFile) == 0)
-                edit = Editor[idx];
-        if (!edit) {
-            /* compare the base names only if no full path on the match is found */
-            for (int idx = 0; idx < MAX_EDITORS && !edit; idx++) {
-                wxString basename = Filename[idx].AfterLast(DIRSEP_CHAR);
-                if (basename.Cmp(DebugCurrentFile) == 0)
-                    edit = Editor[idx];
+        if (DebugQueries.size() > 0) {
+            /* this prompt completes a query (execution did not resume) */
+            DebugQuery query = DebugQueries.front();
+            DebugQueries.pop_front();
+            if (query.Type == DBGQUERY_INSPECT && !query.Answered && query.Stop == DebugStopCount && Inspector.IsPending())
+                Inspector.HandleFailure();
+            if (query.Type == DBGQUERY_LOG) {
+                if (!query.Answered)
+                    LogBreakpoint(query.Symbol + " = (not available)");
+                ContinueFromBreakpoint();
+                return;
             }
-        }
-        if (edit) {
-            IgnoreChangeEvent = true;
-            edit->MarkerAdd(DebugCurrentLine, MARKER_CURRENTLINE);
-            IgnoreChangeEvent = false;
-        }
-        /* send any watches not yet sent */
-        if (WatchUpdateList.Count() > 0) {
-            SendWatchList();
+            if (DebugRunning)
+                return; /* a "go" or "step" was sent after the query, wait for that */
         } else {
+            DebugRunning = false;
+            if (DebugStartTime != 0) {
+                DebugLatency.Start = (wxGetLocalTimeMillis() - DebugStartTime).ToLong();
+                DebugStartTime = 0;
+            } else if (DebugStepTime != 0) {
+                DebugLatency.Add((wxGetLocalTimeMillis() - DebugStepTime).ToLong());
+                DebugStepTime = 0;
+            }
+            if (BreakpointHit >= 0) {
+                /* a breakpoint whose condition is not met, or a logging
+                   breakpoint: continue without showing the position */
+                if (BreakpointLogging)
+                    SendDebugQuery("d " + BreakpointConds[BreakpointHit].LogExpr, DBGQUERY_LOG, BreakpointConds[BreakpointHit].LogExpr);
+                else
+                    ContinueFromBreakpoint();
+                return;
+            }
+            if (StepQueue.Count() > 0) {
+                /* in a burst of steps, send the next step right away; the
+                   intermediate positions are only shown a few times per second */
+                wxLongLong tstamp = wxGetLocalTimeMillis();
+                if (tstamp - StepRenderTime >= STEP_RENDER_INTERVAL) {
+                    StepRenderTime = tstamp;
+                    ShowDebugPosition(false);
+                }
+                wxString step = StepQueue[0];
+                StepQueue.RemoveAt(0);
+                SendDebugCommand(step);
+                return;
+            }
+            /* go to the file & line, and set the "current line" marker */
+            wxStyledTextCtrl* edit = ShowDebugPosition(true);
+            if (edit) {
+                IgnoreChangeEvent = true;
+                edit->MarkerAdd(DebugCurrentLine, MARKER_CURRENTLINE);
+                IgnoreChangeEvent = false;
+                DebugMarkerShown = true;
+                /* for a breakpoint with a hit count, show the statistics */
+                for (unsigned idx = 0; idx < BreakpointConds.size(); idx++) {
+                    const BreakpointCond& bp = BreakpointConds[idx];
+                    if (bp.Edit == edit && bp.Continued > 0 && edit->MarkerLineFromHandle(bp.Handle) == DebugCurrentLine)
+                        SetStatusText(wxString::Format("Breakpoint hit %lu times, continued %lu times (%.3f ms per hit)",
+                                                       bp.Hits, bp.Continued, bp.Cost.ToDouble() / bp.Continued / 1000.0), 0);
+                }
+            }
+            StepRenderTime = wxGetLocalTimeMillis();
+            /* show the watches that were held back during the steps */
+            for (std::map<long, wxString>::iterator iter = DeferredWatches.begin(); iter != DeferredWatches.end(); ++iter) {
+                long index = iter->first;
+                if (index <= WatchLog->GetItemCount())
+                    WatchLog->SetItemText(index - 1, iter->second.BeforeFirst('\t'));
+                else
+                    WatchLog->InsertItem(index - 1, iter->second.BeforeFirst('\t'));
+                WatchLog->SetItem(index - 1, 1, iter->second.AfterFirst('\t'));
+            }
+            if (DeferredWatches.size() > 0) {
+                WatchLog->SetColumnWidth(0, wxLIST_AUTOSIZE);
+                WatchLog->SetColumnWidth(1, wxLIST_AUTOSIZE);
+                DeferredWatches.clear();
+            }
+            DebugScope = context.GetContext(edit, DebugCurrentLine);
+            Inspector.Refresh();
+            CollectPrefetch(edit);
+        }
+        if (WatchUpdateList.Count() == 0) {
             /* check that there is one (but only one) extra line in the watches
                pane (for the user to add a new watch) */
             int rows = WatchLog->GetItemCount();
@@ -3418,59 +4096,93 @@ void QuincyFrame::HandleDebugResponse(const wxString& cmd)
             if (rows <= LastWatchIndex)
                 WatchLog->InsertItem(rows, wxEmptyString);
         }
-        /* send any breakpoints not yet sent */
-        if (ChangedBreakpoints && !BuiltBreakpoints)
-            BuildBreakpointList();
-        if (ChangedBreakpoints || BreakpointList.Count() > 0)
-            SendBreakpointList();
+        /* send any pending watches, breakpoints and queries */
+        PumpDebugQueries();
     } else {
-        /* must be a line-change event */
+        /* must be a line-change event; the position is shown when the
+           debugger prompt is found (so that in a burst of steps, only the
+           final position is drawn) */
         cmd.ToLong(&DebugCurrentLine);
         DebugCurrentLine -= 1;
-        /* find the TAB that this file is loaded in (or load it) */
-        wxStyledTextCtrl* edit = 0;
-        for (int idx = 0; idx < MAX_EDITORS && !edit; idx++)
-            if (Filename[idx].Cmp(DebugCurrentFile) == 0)
-                edit = Editor[idx];
-        if (!edit) {
-            /* compare the base names only if no full path on the match is found */
-            for (int idx = 0; idx < MAX_EDITORS && !edit; idx++) {
-                wxString basename = Filename[idx].AfterLast(DIRSEP_CHAR);
-                if (basename.Cmp(DebugCurrentFile) == 0)
-                    edit = Editor[idx];
-            }
-        }
-        if (!edit) {
-            /* try to open the file (and find it) */
-            AddEditor(DebugCurrentFile);
-            for (int idx = 0; idx < MAX_EDITORS && !edit; idx++)
-                if (Filename[idx].Cmp(DebugCurrentFile) == 0)
-                    edit = Editor[idx];
-        }
-        if (!edit) {
-            wxMessageBox("Could not open " + DebugCurrentFile, "Pawn IDE", wxOK | wxICON_ERROR);
-            return;
-        }
-        /* find the TAB page to activate */
-        for (unsigned page = 0; page < EditTab->GetPageCount(); page++) {
-            if (EditTab->GetPage(page) == edit) {
-                EditTab->SetSelection(page);
-                break;
-            }
-        }
-        AdjustTitle();
-        /* scroll to the position (don't set the marker yet, this is done when
-           the debugger prompt is found) */
-        long pos = edit->PositionFromLine(DebugCurrentLine);
-        edit->GotoPos(pos);
+        /* check for breakpoints with a hit count or log expression (only
+           when running, a single step is not a breakpoint hit) */
+        BreakpointHit = -1;
+        if (!DebugStepping && BreakpointConds.size() > 0)
+            BreakpointHit = CheckBreakpointHit();
     }
 }
 
-void QuincyFrame::SendDebugCommand(const wxString& cmd)
+/** CheckBreakpointHit() counts a hit on a breakpoint with a condition, and
+ *  returns the index of the breakpoint if execution must continue (or -1 if
+ *  the IDE should stop as usual). The position is reported before the
+ *  prompt, so the decision is made before any watches arrive.
+ */
+int QuincyFrame::CheckBreakpointHit()
+{
+    for (unsigned idx = 0; idx < BreakpointConds.size(); idx++) {
+        BreakpointCond& bp = BreakpointConds[idx];
+        if (bp.Edit->MarkerLineFromHandle(bp.Handle) != DebugCurrentLine)
+            continue;
+        int index;
+        for (index = 0; index < MAX_EDITORS && Editor[index] != bp.Edit; index++)
+            /* nothing */;
+        if (index >= MAX_EDITORS || !CProfiler::SameFile(Filename[index], DebugCurrentFile))
+            continue;
+        BreakpointHitTime = wxGetUTCTimeUSec();
+        bp.Hits += 1;
+        bool met = (bp.Hits >= (unsigned long)bp.StopAt);
+        if (met && bp.LogExpr.Length() == 0)
+            return -1;
+        BreakpointLogging = met;
+        return idx;
+    }
+    return -1;
+}
+
+void QuincyFrame::ContinueFromBreakpoint()
+{
+    wxASSERT(BreakpointHit >= 0 && BreakpointHit < (int)BreakpointConds.size());
+    BreakpointCond& bp = BreakpointConds[BreakpointHit];
+    bp.Continued += 1;
+    bp.Cost += wxGetUTCTimeUSec() - BreakpointHitTime;
+    BreakpointHit = -1;
+    SendDebugCommand("g");
+}
+
+void QuincyFrame::LogBreakpoint(const wxString& text)
+{
+    /* the log is a ring: when the output pane is not updated quickly enough,
+       the oldest lines are dropped */
+    BreakpointLog.push_back(DebugCurrentFile.AfterLast(DIRSEP_CHAR) + wxString::Format("(%ld): ", DebugCurrentLine + 1) + text);
+    while (BreakpointLog.size() > BPLOG_MAXLINES)
+        BreakpointLog.pop_front();
+}
+
+/** FlushBreakpointLog() appends the lines of logging breakpoints to the
+ *  output pane. The output pane is kept to a maximum number of lines, so
+ *  that a breakpoint in a loop does not fill the memory.
+ */
+void QuincyFrame::FlushBreakpointLog()
+{
+    wxString text;
+    while (BreakpointLog.size() > 0) {
+        text += BreakpointLog.front() + "\n";
+        BreakpointLog.pop_front();
+    }
+    Terminal->AppendText(text);
+    int excess = Terminal->GetNumberOfLines() - OUTPUT_MAXLINES;
+    if (excess > 0)
+        Terminal->Remove(0, Terminal->XYToPosition(0, excess));
+    BreakpointLogTime = wxGetLocalTimeMillis();
+}
+
+/** ShowDebugPosition() activates the tab for the file that the execution
+ *  point is in, and scrolls to the line. If "load" is true, the file is
+ *  opened if needed. It returns the editor, or NULL on failure.
+ */
+wxStyledTextCtrl* QuincyFrame::ShowDebugPosition(bool load)
 {
-    /* remove the "current line" indicator;
-       find the edit control again (the user may be opened/closed files
-       in between) */
+    /* find the TAB that this file is loaded in (or load it) */
     wxStyledTextCtrl* edit = 0;
     for (int idx = 0; idx < MAX_EDITORS && !edit; idx++)
         if (Filename[idx].Cmp(DebugCurrentFile) == 0)
@@ -3483,14 +4195,92 @@ void QuincyFrame::SendDebugCommand(const wxString& cmd)
                 edit = Editor[idx];
         }
     }
-    if (edit) {
-        IgnoreChangeEvent = true;
-        edit->MarkerDelete(DebugCurrentLine, MARKER_CURRENTLINE);
-        IgnoreChangeEvent = false;
+    if (!edit && load) {
+        /* try to open the file (and find it) */
+        AddEditor(DebugCurrentFile);
+        for (int idx = 0; idx < MAX_EDITORS && !edit; idx++)
+            if (Filename[idx].Cmp(DebugCurrentFile) == 0)
+                edit = Editor[idx];
+        if (!edit)
+            wxMessageBox("Could not open " + DebugCurrentFile, "Pawn IDE", wxOK | wxICON_ERROR);
+    }
+    if (!edit)
+        return NULL;
+    /* find the TAB page to activate */
+    int sel = EditTab->GetSelection();
+    if (sel == wxNOT_FOUND || EditTab->GetPage(sel) != edit) {
+        for (unsigned page = 0; page < EditTab->GetPageCount(); page++) {
+            if (EditTab->GetPage(page) == edit) {
+                EditTab->SetSelection(page);
+                break;
+            }
+        }
+        AdjustTitle();
+    }
+    long pos = edit->PositionFromLine(DebugCurrentLine);
+    edit->GotoPos(pos);
+    return edit;
+}
+
+/** QueueDebugStep() sends a "step" or "go" command if the debugger waits at
+ *  the prompt. If a single step is still running, the command is queued and
+ *  sent as soon as that step finishes. Up to STEP_MAXQUEUE commands are
+ *  queued, so that releasing a held-down key stops quickly.
+ */
+void QuincyFrame::QueueDebugStep(const wxString& cmd)
+{
+    if (!IsExecRunning() || !DebugMode)
+        return;
+    if (DebugRunning) {
+        if (DebugStepping && StepQueue.Count() < STEP_MAXQUEUE)
+            StepQueue.Add(cmd);
+        return;
+    }
+    SendDebugCommand(cmd);
+}
+
+/** SendDebugCommand() sends a command that makes the script run (go, step).
+ *  All other commands go through SendDebugQuery().
+ */
+void QuincyFrame::SendDebugCommand(const wxString& cmd)
+{
+    /* remove the "current line" indicator (it is not set in a burst of
+       steps); find the edit control again (the user may be opened/closed
+       files in between) */
+    if (DebugMarkerShown) {
+        wxStyledTextCtrl* edit = 0;
+        for (int idx = 0; idx < MAX_EDITORS && !edit; idx++)
+            if (Filename[idx].Cmp(DebugCurrentFile) == 0)
+                edit = Editor[idx];
+        if (!edit) {
+            /* compare the base names only if no full path on the match is found */
+            for (int idx = 0; idx < MAX_EDITORS && !edit; idx++) {
+                wxString basename = Filename[idx].AfterLast(DIRSEP_CHAR);
+                if (basename.Cmp(DebugCurrentFile) == 0)
+                    edit = Editor[idx];
+            }
+        }
+        if (edit) {
+            IgnoreChangeEvent = true;
+            edit->MarkerDelete(DebugCurrentLine, MARKER_CURRENTLINE);
+            IgnoreChangeEvent = false;
+        }
+        DebugMarkerShown = false;
     }
+    /* only single steps may be queued behind this command */
+    DebugStepping = (cmd.Cmp("s") == 0 || cmd.Cmp("n") == 0);
+    DebugStepTime = DebugStepping ? wxGetLocalTimeMillis() : wxLongLong(0);
+
+    /* execution resumes, all values collected at this stop are outdated */
+    DebugStopCount++;
+    ValueCache.clear();
+    PrefetchList.Clear();
+    HoverRequest.Clear();
+    HoverSymbol.Clear();
+    Inspector.Invalidate();
 
-    if (ExecPID != 0 && wxProcess::Exists(ExecPID)) {
-        wxOutputStream* ostream = ExecProcess->GetOutputStream();
+    if (IsExecRunning()) {
+        wxOutputStream* ostream = Exec->GetProcess()->GetOutputStream();
         if (ostream) {
             for (unsigned idx = 0; idx < cmd.length(); idx++)
                 ostream->PutC(cmd[idx]);
@@ -3500,6 +4290,144 @@ void QuincyFrame::SendDebugCommand(const wxString& cmd)
     DebugRunning = true;
 }
 
+/** SendDebugQuery() sends a command that does not resume execution. The
+ *  current line marker stays, and the debugger stays in "stopped" state. The
+ *  prompt that follows the reply is matched to the query, so that it is not
+ *  taken as a new stop.
+ */
+void QuincyFrame::SendDebugQuery(const wxString& cmd, int type, const wxString& symbol)
+{
+    if (IsExecRunning()) {
+        wxOutputStream* ostream = Exec->GetProcess()->GetOutputStream();
+        if (ostream) {
+            for (unsigned idx = 0; idx < cmd.length(); idx++)
+                ostream->PutC(cmd[idx]);
+            ostream->PutC('\r');
+            DebugQueries.push_back(DebugQuery(type, symbol, DebugStopCount));
+        }
+    }
+}
+
+/** PumpDebugQueries() sends the next pending command to the debugger, if the
+ *  debugger is stopped and idle. Only a single query is outstanding at any
+ *  time, so that the reply can be matched to it. The order is: watches and
+ *  breakpoints (these must be set before continuing), a calltip (the user
+ *  waits for it), the inspector, and finally the values prefetched for
+ *  symbols near the execution point.
+ */
+void QuincyFrame::PumpDebugQueries()
+{
+    if (!IsExecRunning() || !DebugMode || DebugRunning || DebugQueries.size() > 0)
+        return;
+
+    if (WatchUpdateList.Count() > 0) {
+        SendWatchList();
+        return;
+    }
+    if (ChangedBreakpoints && !BuiltBreakpoints)
+        BuildBreakpointList();
+    if (ChangedBreakpoints || BreakpointList.Count() > 0) {
+        SendBreakpointList();
+        return;
+    }
+    if (HoverRequest.Length() > 0) {
+        wxString symbol = HoverRequest;
+        HoverRequest.Clear();
+        SendDebugQuery("d " + symbol, DBGQUERY_HOVER, symbol);
+        return;
+    }
+    if (!Inspector.IsPending() && Inspector.HasRequest()) {
+        wxString expr = Inspector.NextRequest();
+        SendDebugQuery("d " + expr, DBGQUERY_INSPECT, expr);
+        return;
+    }
+    while (PrefetchList.Count() > 0) {
+        wxString symbol = PrefetchList[0];
+        PrefetchList.RemoveAt(0);
+        if (!LookUpValue(symbol, NULL)) {
+            SendDebugQuery("d " + symbol, DBGQUERY_PREFETCH, symbol);
+            return;
+        }
+    }
+}
+
+/** LookUpValue() returns whether the value of the symbol is known at the
+ *  current stop; locals (in the scope of the current function) take
+ *  precedence over globals.
+ */
+bool QuincyFrame::LookUpValue(const wxString& symbol, wxString* value)
+{
+    std::map<wxString, wxString>::iterator iter = ValueCache.find(DebugScope + "\t" + symbol);
+    if (iter == ValueCache.end())
+        iter = ValueCache.find("\t" + symbol);
+    if (iter == ValueCache.end())
+        return false;
+    if (value)
+        *value = iter->second;
+    return true;
+}
+
+/** CollectPrefetch() makes a list of the variables in the lines around the
+ *  execution point (on the visible part of the editor only). These values
+ *  are fetched while the debugger is idle, so that a calltip for these is
+ *  immediate.
+ */
+#define PREFETCH_LINES  4   /* number of lines above and below the current line */
+#define PREFETCH_MAX    16  /* maximum number of symbols to prefetch */
+void QuincyFrame::CollectPrefetch(wxStyledTextCtrl* edit)
+{
+    PrefetchList.Clear();
+    if (!edit || edit->GetLexer() != wxSTC_LEX_CPP)
+        return;
+    int topline = edit->GetFirstVisibleLine();
+    int btmline = topline + edit->LinesOnScreen();
+    if (btmline >= edit->GetLineCount())
+        btmline = edit->GetLineCount() - 1;
+    /* handle the current line first, then the lines around it */
+    for (int dist = 0; dist <= PREFETCH_LINES && PrefetchList.Count() < PREFETCH_MAX; dist++) {
+        for (int sign = -1; sign <= 1 && PrefetchList.Count() < PREFETCH_MAX; sign += 2) {
+            if (dist == 0 && sign > 0)
+                break;
+            int line = DebugCurrentLine + sign * dist;
+            if (line < topline || line > btmline)
+                continue;
+            int pos = edit->PositionFromLine(line);
+            int end = edit->GetLineEndPosition(line);
+            while (pos < end && PrefetchList.Count() < PREFETCH_MAX) {
+                int ch = edit->GetCharAt(pos);
+                if (!isalpha(ch) && ch != '_' && ch != '@') {
+                    pos++;
+                    continue;
+                }
+                int start = pos;
+                while (pos < end && (isalnum(edit->GetCharAt(pos)) || edit->GetCharAt(pos) == '_' || edit->GetCharAt(pos) == '@'))
+                    pos++;
+                /* keywords, numbers, comments and strings are styled differently
+                   by the lexer */
+                if (edit->GetStyleAt(start) != wxSTC_C_IDENTIFIER)
+                    continue;
+                /* skip function calls, tag names and arrays */
+                int next = pos;
+                while (next < end && (edit->GetCharAt(next) == ' ' || edit->GetCharAt(next) == '\t'))
+                    next++;
+                if (next < end && (edit->GetCharAt(next) == '(' || edit->GetCharAt(next) == ':' || edit->GetCharAt(next) == '['))
+                    continue;
+                wxString word = edit->GetTextRange(start, pos);
+                if (PrefetchList.Index(word) != wxNOT_FOUND || LookUpValue(word, NULL))
+                    continue;
+                /* skip functions and constants */
+                bool skip = false;
+                SymbolRange range = SymbolList.Lookup(word);
+                for (const CSymbolEntry* entry = range.first; !skip && entry != range.second; entry++)
+                    if (entry->SymbolName[0] == 'M' || entry->SymbolName[0] == 'C')
+                        skip = true;
+                if (!skip)
+                    PrefetchList.Add(word);
+            }
+        }
+    }
+}
+
 void QuincyFrame::SendWatchList()
 {
     wxASSERT(WatchUpdateList.Count() > 0);
@@ -3512,7 +4440,7 @@ void QuincyFrame::SendWatchList()
             cmd = wxString::Format("w %d ", line + 1) + name;
         else
             cmd = wxString::Format("cw %d", line + 1);
-        SendDebugCommand(cmd);
+        SendDebugQuery(cmd, DBGQUERY_SETUP);
     }
 }
 
@@ -3542,21 +4470,21 @@ void QuincyFrame::SendBreakpointList()
 {
     /* before sending the first breakpoint, clear the entire stack */
     if (ChangedBreakpoints) {
-        SendDebugCommand("cbreak *");
+        SendDebugQuery("cbreak *", DBGQUERY_SETUP);
         ChangedBreakpoints = false;
         BuiltBreakpoints = false;
     } else if (BreakpointList.Count() > 0) {
         wxString bp = BreakpointList[0];
         BreakpointList.RemoveAt(0);
-        SendDebugCommand("break " + bp);
+        SendDebugQuery("break " + bp, DBGQUERY_SETUP);
     }
 }
 
-void QuincyFrame::PrepareSearchLog()
+void QuincyFrame::PrepareSearchLog(bool required)
 {
-    if (theApp->SearchAdvanced) {
+    if (theApp->SearchAdvanced || required) {
         if (!SearchLog) {
-            wxASSERT(PaneTab->GetPageCount() == TAB_SEARCH);
+            wxASSERT(PaneTab->GetPageCount() >= TAB_SEARCH);
             #if defined _WIN32
                 wxFont font(9, wxFONTFAMILY_TELETYPE, wxFONTSTYLE_NORMAL, wxFONTWEIGHT_NORMAL, false, "Courier New");
             #else
@@ -3565,7 +4493,7 @@ void QuincyFrame::PrepareSearchLog()
             SearchLog = new wxTreeCtrl(PaneTab, wxID_ANY, wxDefaultPosition, wxDefaultSize, wxTR_HAS_BUTTONS|wxTR_FULL_ROW_HIGHLIGHT|wxTR_HIDE_ROOT|wxTR_NO_LINES|wxTR_SINGLE|wxTR_DEFAULT_STYLE);
             SearchLog->SetFont(font);
             SearchLog->Connect(wxEVT_COMMAND_TREE_ITEM_ACTIVATED, wxTreeEventHandler(QuincyFrame::OnSearchSelect), NULL, this);
-            PaneTab->AddPage(SearchLog, "Search", false); /* TAB_SEARCH */
+            PaneTab->InsertPage(TAB_SEARCH, SearchLog, "Search", false);  /* before any session tabs */
         }
     } else {
         if (SearchLog) {
@@ -3582,6 +4510,7 @@ void QuincyFrame::OnSettings(wxCommandEvent& /* event */)
 {
     QuincySettingsDlg dlg(this);
     if (dlg.ShowModal() == wxID_OK) {
+        PaletteItems.Clear();   /* the include path may have changed */
         /* modify all editors (colours, settings) */
         wxASSERT(EditTab);
         unsigned idx;
@@ -3593,6 +4522,8 @@ void QuincyFrame::OnSettings(wxCommandEvent& /* event */)
         /* add/remove a page for the search results, depending on which search
            dialog is used */
         PrepareSearchLog();
+        Monitor->SetPort(DebugPort, DebugBaudrate);
+        IndexWorkspace();   /* the include path may have changed */
         /* since the target host may have changed, rescan the help index files
            and menu */
         RebuildHelpMenu();
@@ -3725,10 +4656,19 @@ void QuincyFrame::OnAbout(wxCommandEvent& /* event */)
 {
     wxIcon icon(Quincy48_xpm);
 
+    /* memory used for the symbol tables; the string pool also holds the
+       keywords of the info tips and the help index */
+    unsigned long unpooled;
+    unsigned long symbols = SymbolList.Footprint(&unpooled);
+    unsigned long pool = StringPool.Footprint();
+    wxString memory = wxString::Format("Symbol tables: %u symbols, %lu KiB + %lu KiB in the string pool (%u strings)\n"
+                                       "Without the string pool (a rough estimate): %lu KiB",
+                                       SymbolList.Count(), symbols / 1024, pool / 1024, StringPool.Count(), unpooled / 1024);
+
     wxAboutDialogInfo info;
     info.SetName("Pawn IDE");
     info.SetVersion("0.7." SVNREV_STR);
-    info.SetDescription("A tiny IDE for Pawn.");
+    info.SetDescription("A tiny IDE for Pawn.\n\n" + memory);
     info.SetCopyright("(C) 2009-2024 CompuPhase");
     info.SetIcon(icon);
     info.SetWebSite("https://www.compuphase.com/pawn/");
@@ -3784,6 +4724,14 @@ void QuincyFrame::OnContextHelp(wxCommandEvent& /* event */)
         return;
     if (isdigit(word[0]))
         return; /* a number is never a token for which there is help */
+    ShowHelp(word);
+}
+
+/** ShowHelp() opens the document with the help for a keyword, at the page
+ *  of the keyword.
+ */
+void QuincyFrame::ShowHelp(const wxString& word)
+{
     wxString label = word;  /* the label may be the word itself */
 
     /* find all document files that contain the bookmark */
@@ -3867,9 +4815,22 @@ void QuincyFrame::OnEditorChange(wxStyledTextEvent& /* event */)
     if (!IgnoreChangeEvent) {
         SetStatusText("Source file changed since last compile", 0);
         SetChanged();
-        /* flag start of re-scan of the context list (in the background, as an idle task */
-        wxStyledTextCtrl *edit = GetActiveEdit(EditTab);
-        context.ScanContext(edit, CTX_RESTART);
+    }
+}
+
+/** OnEditorModified() passes the lines that changed to the scanner for the
+ *  function list (the changed lines are scanned again in the background, as
+ *  an idle task).
+ */
+void QuincyFrame::OnEditorModified(wxStyledTextEvent& event)
+{
+    if ((event.GetModificationType() & (wxSTC_MOD_INSERTTEXT | wxSTC_MOD_DELETETEXT)) == 0)
+        return;
+    wxStyledTextCtrl *edit = dynamic_cast<wxStyledTextCtrl*>(event.GetEventObject());
+    if (edit) {
+        int line = edit->LineFromPosition(event.GetPosition());
+        context.Modified(edit, line, event.GetLinesAdded());
+        completion.Modified(edit, line, event.GetLinesAdded());
     }
 }
 
@@ -4037,7 +4998,7 @@ void QuincyFrame::OnEditorDwellStart(wxStyledTextEvent& /* event */)
     /* first check whether it is a known function or constant, or (if not
        debugging) a known variable */
     wxString tip;
-    if (ExecPID == 0)
+    if (!IsExecRunning())
         tip = LookUpInfoTip(word, TIP_ALL);
     else
         tip = LookUpInfoTip(word, TIP_FUNCTION | TIP_CONSTANT);
@@ -4046,14 +5007,34 @@ void QuincyFrame::OnEditorDwellStart(wxStyledTextEvent& /* event */)
         int bold = tip.Find("\n");
         if (bold > 0)
             edit->CallTipSetHighlight(0, bold);
-    } else if (ExecPID != 0 && DebugMode && !DebugRunning) {
-        /* if debugging and waiting at a prompt, send a command to show the value */
-        SendDebugCommand("d " + word);
+    } else if (IsExecRunning() && DebugMode && !DebugRunning) {
+        /* if debugging and waiting at a prompt, send a command to show the
+           value; but arrays are not dumped in a calltip, these go through
+           the (paged) inspector */
+        wxArrayLong dims;
+        if (GetArrayDimensions(word, edit, line, dims)) {
+            tip = word;
+            for (unsigned idx = 0; idx < dims.Count(); idx++)
+                tip += (dims[idx] > 0) ? wxString::Format("[%ld]", dims[idx]) : wxString("[]");
+            tip += "\nArray, use \"Inspect\"" + theApp->Shortcuts.FormatShortCut("Inspect", false, true) + " to view the contents";
+            edit->CallTipShow(CalltipPos, tip);
+            edit->CallTipSetHighlight(0, tip.Find('\n'));
+        } else if (LookUpValue(word, &tip)) {
+            edit->CallTipShow(CalltipPos, tip);    /* already evaluated at this stop */
+        } else {
+            /* evaluate as soon as the debugger is free (a prefetch may be
+               underway) */
+            HoverSymbol = word;
+            HoverRequest = word;
+            PumpDebugQueries();
+        }
     }
 }
 
 void QuincyFrame::OnEditorDwellEnd(wxStyledTextEvent& /* event */)
 {
+    HoverSymbol.Clear();    /* if a value arrives late, do not show it */
+    HoverRequest.Clear();
     wxStyledTextCtrl *edit = GetActiveEdit(EditTab);
     if (edit)
         edit->CallTipCancel();
@@ -4087,8 +5068,39 @@ void QuincyFrame::OnTimer(wxTimerEvent& event)
         }
     } /* if (edit) */
 
-    if (ExecPID != 0 && DebugMode && !DebugRunning && WatchUpdateList.Count() > 0)
-        SendWatchList();
+    if (IsExecRunning() && DebugMode && !DebugRunning && WatchUpdateList.Count() > 0)
+        PumpDebugQueries();
+}
+
+/** ParseParameters() returns the names of the parameters in a function
+ *  definition (the part between the parentheses), without tags and without
+ *  the "const" keyword.
+ */
+static void ParseParameters(const wxString& definition, std::vector<CPoolString>& params)
+{
+    int start = definition.Find('(');
+    if (start < 0)
+        return;
+    for ( ;; ) {
+        start++;    /* skip '(' or ',' */
+        while (start < (int)definition.Length() && (definition[start] <= ' ' || definition[start] <= '&'))
+            start++;
+        if (start >= (int)definition.Length())
+            break;
+        int pos;
+        for (pos = start; pos < (int)definition.Length() && (isalnum(definition[pos]) || definition[pos] == '_'); pos++)
+            /* nothing */;
+        if (pos > start) {
+            wxString param = definition.Mid(start, pos - start);
+            if (param.Cmp("const") == 0) {
+                start = pos;
+                continue;
+            }
+            params.push_back(CPoolString(param));
+        }
+        for (start = pos; start < (int)definition.Length() && definition[start] != ','; start++)
+            /* nothing */;
+    }
 }
 
 void QuincyFrame::OnAutoComplete(wxCommandEvent& /* event */)
@@ -4215,119 +5227,63 @@ void QuincyFrame::OnAutoComplete(wxCommandEvent& /* event */)
     wxArrayString list;
 
     if (contextsymbol.Length() > 0) {
-        wxString definition = wxEmptyString;
-        /* symbols from the symbol browser */
-        for (const CSymbolEntry* sym = SymbolList.Root(); sym && definition.IsEmpty(); sym = sym->Next) {
-            wxString name = sym->SymbolName;
-            if ((int)name.Length() > length + 2 && name[1] == ':') {
-                name = name.Mid(2);
-                if (name.Cmp(contextsymbol) == 0)
-                    definition = sym->Syntax;
-            }
-        }
-        if (definition.IsEmpty()) {
-            /* known (system) functions */
-            for (iter = InfoTipList.begin(); iter != InfoTipList.end() && definition.IsEmpty(); ++iter) {
-                wxASSERT(iter->first.Length() > 0);
-                wxString name = iter->first;
-                if ((int)name.Length() > length && name.Cmp(contextsymbol) == 0) {
-                    definition = iter->second;
-                    definition = definition.BeforeFirst('\n');
-                }
-            }
-        }
-        /* go through the definition to find the matching parameters */
-        start = definition.Find('(');
-        wxASSERT(start > 0 && start < (int)definition.Length());
-        for ( ;; ) {
-            start++;    /* skip '(' or ',' */
-            while (start < (int)definition.Length() && (definition[start] <= ' ' || definition[start] <= '&'))
-                start++;
-            if (start >= (int)definition.Length())
-                break;
-            for (pos = start; pos < (int)definition.Length() && (isalnum(definition[pos]) || definition[pos] == '_'); pos++)
-                /* nothing */;
-            if (pos > start) {
-                wxString param = definition.Mid(start, pos - start);
-                if (param.Cmp("const") == 0) {
-                    start = pos;
-                    continue;
-                }
-                if (length == 0 || param.Left(length).Cmp(prefix) == 0)
-                    list.Add(param);
-            }
-            for (start = pos; start < (int)definition.Length() && definition[start] != ','; start++)
-                /* nothing */;
+        /* symbols from the symbol browser, or else the known (system)
+           functions (for which the parameters were parsed when loading) */
+        std::vector<CPoolString> params;
+        SymbolRange range = SymbolList.Lookup(contextsymbol);
+        const std::set<unsigned>& scope = IncludeScope();
+        const CSymbolEntry* sym = range.first;
+        while (sym != range.second && !InIncludeScope(sym, scope))
+            sym++;
+        if (sym != range.second && (int)contextsymbol.Length() > length)
+            ParseParameters(sym->Syntax.Str(), params);
+        if (params.size() == 0 && (int)contextsymbol.Length() > length) {
+            /* no symbol, or a symbol without a syntax line */
+            unsigned id = StringPool.Find(contextsymbol);
+            InfoTipMap::iterator tip = (id != POOL_NONE) ? InfoTipList.find(id) : InfoTipList.end();
+            if (tip != InfoTipList.end() && tip->second.Keyword.Id() == id)
+                params = tip->second.Params;
+        }
+        for (unsigned idx = 0; idx < params.size(); idx++) {
+            wxString param = params[idx].Str();
+            if (length == 0 || param.Left(length).Cmp(prefix) == 0)
+                list.Add(param);
         }
     } else {
-        /* known (system) functions */
-        for (iter = InfoTipList.begin(); iter != InfoTipList.end(); ++iter) {
-            wxASSERT(iter->first.Length() > 0);
-            wxString name = iter->first;
-            if ((int)name.Length() > length && name.Left(length).Cmp(prefix) == 0)
-                list.Add(name);
-        }
-        /* symbols from the symbol browser */
-        for (const CSymbolEntry* sym = SymbolList.Root(); sym; sym = sym->Next) {
-            wxString name = sym->SymbolName;
-            if ((int)name.Length() > length + 2 && name[1] == ':') {
-                name = name.Mid(2);
-                if (name.Left(length).Cmp(prefix) == 0 && list.Index(name) == wxNOT_FOUND)
-                    list.Add(name);
-            }
-        }
-        /* symbols from the current document */
-        wxString fulltext = edit->GetText();
-        /* parse through the text, wipe out comments and literal strings */
-        size_t textlen = fulltext.Length();
-        size_t idx = 0;
-        while (idx < textlen)   {
-            wxChar cur = fulltext[idx];
-            wxChar nxt = (idx + 1 < textlen) ? fulltext[idx + 1] : '\0';
-            if (cur == '/' && nxt == '/') {
-                /* wipe out until '\r' or '\n' */
-                while (idx < textlen && fulltext[idx] != '\r' && fulltext[idx] != '\n')
-                    fulltext[idx++] = ' ';
-                if (idx < textlen && fulltext[idx] != '\n')
-                    fulltext[idx++] = ' ';
-            } else if (cur == '/' && nxt == '*') {
-                fulltext[idx++] = ' '; /* erase '/*' */
-                fulltext[idx++] = ' ';
-                wxChar prv = '\0';
-                while (idx < textlen && (fulltext[idx] != '/' || prv != '*')) {
-                    prv = fulltext[idx];
-                    fulltext[idx++] = ' ';
-                }
-                if (idx < textlen)
-                    fulltext[idx++] = ' '; /* also erase final '/' the comment */
-            } else if (cur == '"' || cur == '\'') {
-                fulltext[idx++] = ' ';     /* erase initial '"' */
-                while (idx < textlen && fulltext[idx] != cur) {
-                    if (idx + 1 < textlen && fulltext[idx] == '\\')
-                        fulltext[idx++] = ' '; /* erase '\' plus the character following it */
-                    fulltext[idx++] = ' ';
-                }
-                if (idx < textlen)
-                    fulltext[idx++] = ' '; /* also erase final '"' */
-            } else {
-                idx++;  /* none of the above: normal character */
-            }
-        }
-        wxStringTokenizer tokenizer(fulltext, " \t\r\n()[]{}<>`~!#$%^&*-+|\\;:'\",./?", wxTOKEN_STRTOK);
-        while (tokenizer.HasMoreTokens()) {
-            wxString word = tokenizer.GetNextToken();
-            /* only include tokens that are alphanumeric (but start alphabetic) */
-            if (!isalpha(word[0]) && word[0] != '_' && word[0] != '@')
-                continue;
-            /* only include words that are longer than what is typed already, and
-               limit the list to the words that start with the same prefix (and
-               avoid duplicates) */
-            if ((int)word.Length() > length && word.Left(length).Cmp(prefix) == 0
-                && list.Index(word) == wxNOT_FOUND)
-                list.Add(word);
-        }
-
-        list.Sort();
+        /* the known (system) functions, the symbols from the symbol browser
+           (without those from include files that the script does not include)
+           and the identifiers in the current document are each sorted, so the
+           words with the prefix are a range in each; the ranges are merged */
+        wxScopedCharBuffer utf8 = prefix.utf8_str();
+        const char* word = utf8.data();
+        size_t wordlength = utf8.length();
+        std::vector<const char*> tips, symbols, words;
+        std::vector<const char*>::iterator tip = std::lower_bound(InfoTipKeywords.begin(), InfoTipKeywords.end(), word, WordLess());
+        for ( ; tip != InfoTipKeywords.end() && strncmp(*tip, word, wordlength) == 0; ++tip)
+            if ((*tip)[wordlength] != '\0')
+                tips.push_back(*tip);
+        SymbolRange range = SymbolList.LookupPrefix(prefix);
+        const std::set<unsigned>& scope = IncludeScope();
+        for (const CSymbolEntry* sym = range.first; sym != range.second; sym++)
+            if (sym->Name.UTF8()[wordlength] != '\0' && (symbols.empty() || strcmp(symbols.back(), sym->Name.UTF8()) != 0) && InIncludeScope(sym, scope))
+                symbols.push_back(sym->Name.UTF8());
+        completion.Collect(edit, word, words);
+
+        std::vector<const char*> merged(tips.size() + symbols.size());
+        std::merge(tips.begin(), tips.end(), symbols.begin(), symbols.end(), merged.begin(), WordLess());
+        std::vector<const char*> all(merged.size() + words.size());
+        std::merge(merged.begin(), merged.end(), words.begin(), words.end(), all.begin(), WordLess());
+        std::string items;
+        for (unsigned idx = 0; idx < all.size(); idx++) {
+            if (idx > 0 && strcmp(all[idx - 1], all[idx]) == 0)
+                continue;   /* avoid duplicates */
+            if (items.length() > 0)
+                items += '|';
+            items += all[idx];
+        }
+        if (items.length() > 0)
+            edit->AutoCompShow(length, wxString::FromUTF8(items.data(), items.length()));
+        return;
     }
 
     wxString items;
@@ -4347,6 +5303,11 @@ void QuincyFrame::OnWatchActivated(wxListEvent& event)
 
 void QuincyFrame::OnWatchEdited(wxListEvent& event)
 {
+    /* if the value is known at this stop, show it immediately (the watch
+       must still be set in the debugger, for the next stops) */
+    wxString value;
+    if (DebugMode && !DebugRunning && !event.IsEditCancelled() && LookUpValue(event.GetLabel(), &value))
+        WatchLog->SetItem(event.GetIndex(), 1, value);
     /* add this row to the list to update */
     WatchUpdateList.Add(event.GetIndex());
     /* set a timer to update the watches */
@@ -4363,80 +5324,853 @@ void QuincyFrame::OnWatchDelete(wxListEvent& event)
     Timer->Start(200, true);
 }
 
-void QuincyFrame::OnTerminalChar(wxKeyEvent& event)
+void QuincyFrame::OnInspect(wxCommandEvent& /* event */)
 {
-    if (ExecPID != 0)
-        ExecInputQueue += (wxChar)event.GetUnicodeKey();
-    event.Skip();
+    wxStyledTextCtrl *edit = GetActiveEdit(EditTab);
+    if (!edit)
+        return;
+    wxString word = WordUnderCursor();
+    if (word.IsEmpty() || isdigit(word[0]))
+        return;
+    wxArrayLong dims;
+    GetArrayDimensions(word, edit, edit->GetCurrentLine(), dims);
+    Inspector.AddVariable(word, dims);
+    PaneTab->SetSelection(TAB_INSPECT);
+    PumpDebugQueries();
 }
 
-void QuincyFrame::OnUIWorkSpace(wxUpdateUIEvent& /* event */)
+void QuincyFrame::OnInspectExpanding(wxTreeEvent& event)
 {
-    if (menuFile) {
-        wxMenuItem *item = menuFile->FindItem(IDM_CLOSEWORKSPACE);
-        if (item)
-            item->Enable(strWorkspace.Length() > 0);
-    }
+    Inspector.Expand(event.GetItem());
+    PumpDebugQueries();
 }
 
-void QuincyFrame::OnUIUndo(wxUpdateUIEvent& /* event */)
+void QuincyFrame::OnInspectActivated(wxTreeEvent& event)
 {
-    wxStyledTextCtrl *edit = GetActiveEdit(EditTab);
-    int newflags = UIDisabledTools;
-    newflags = (edit && edit->CanUndo()) ? newflags & ~UI_UNDO : newflags | UI_UNDO;
-    newflags = (edit && edit->CanRedo()) ? newflags & ~UI_REDO : newflags | UI_REDO;
-    if (newflags != UIDisabledTools) {
-        if (menuEdit) {
-            wxMenuItem* itemUndo = menuEdit->FindItem(wxID_UNDO);
-            wxMenuItem* itemRedo = menuEdit->FindItem(wxID_REDO);
-            wxASSERT(itemUndo && itemRedo);
-            if (edit) {
-                itemUndo->Enable(edit->CanUndo());
-                itemRedo->Enable(edit->CanRedo());
-            }
-            else {
-                itemUndo->Enable(false);
-                itemRedo->Enable(false);
-            }
-        }
-        if (ToolBar) {
-            ToolBar->EnableTool(wxID_UNDO, edit && edit->CanUndo());
-            ToolBar->EnableTool(wxID_REDO, edit && edit->CanRedo());
-            ToolBar->Refresh(false);
-        }
-        UIDisabledTools = newflags;
+    /* activating the "..." item adds more pages */
+    InspectItemData* data = (InspectItemData*)InspectTree->GetItemData(event.GetItem());
+    if (data && data->Kind == INSPECT_MORE) {
+        Inspector.Expand(event.GetItem());
+        PumpDebugQueries();
+    } else {
+        event.Skip();
     }
 }
 
-void QuincyFrame::OnUICutCopy(wxUpdateUIEvent& /* event */)
+void QuincyFrame::OnInspectKeyDown(wxTreeEvent& event)
 {
-    wxStyledTextCtrl *edit = GetActiveEdit(EditTab);
-    int s1 = 0, s2 = 0;
-    if (edit) {
-        s1 = edit->GetSelectionStart();
-        s2 = edit->GetSelectionEnd();
-    }
-    int newflags = (s1 != s2) ? UIDisabledTools & ~UI_CUTCOPY : UIDisabledTools | UI_CUTCOPY;
-    if (newflags != UIDisabledTools) {
-        if (menuEdit) {
-            wxMenuItem *item;
-            if ((item = menuEdit->FindItem(wxID_CUT)) != NULL)
-                item->Enable(s1 != s2);
-            if ((item = menuEdit->FindItem(wxID_COPY)) != NULL)
-                item->Enable(s1 != s2);
-            if ((item = menuEdit->FindItem(IDM_FILLCOLUMN)) != NULL)
-                item->Enable(s1 != s2 && edit->SelectionIsRectangle());
-        }
-        if (ToolBar) {
-            ToolBar->EnableTool(wxID_CUT, s1 != s2);
-            ToolBar->EnableTool(wxID_COPY, s1 != s2);
-            ToolBar->Refresh(false);
-        }
-        UIDisabledTools = newflags;
-    }
+    if (event.GetKeyCode() == WXK_DELETE)
+        Inspector.Delete(InspectTree->GetSelection());
+    else
+        event.Skip();
 }
 
-void QuincyFrame::OnUIPaste(wxUpdateUIEvent& /* event */)
+void QuincyFrame::OnProfile(wxCommandEvent& /* event */)
+{
+    LastWatchIndex = 0;
+    RunCurrentScript(true, true);
+}
+
+/** StartProfiler() starts the thread that steps through the script (which
+ *  must already run under the debugger). The functions for the totals are
+ *  taken from the symbol list of the last build.
+ */
+bool QuincyFrame::StartProfiler(const wxString& amxfile)
+{
+    wxASSERT(!Profiler);
+    ProfileFunctions functions;
+    for (unsigned idx = 0; idx < SymbolList.Count(); idx++) {
+        const CSymbolEntry* entry = SymbolList.Entry(idx);
+        if (entry->SymbolName[0] == 'M' && !entry->Source.IsEmpty())
+            functions.push_back(ProfileFunction(entry->Name.Str(), entry->Source.Str(), entry->Line - 1));
+    }
+
+    Profiler = new CProfiler(this, IDM_PROFILE, Exec->GetProcess(), debug_prefix, functions);
+    if (Profiler->Create() != wxTHREAD_NO_ERROR || Profiler->Run() != wxTHREAD_NO_ERROR) {
+        delete Profiler;
+        Profiler = NULL;
+        wxMessageBox("The profiler could not be started.", "Pawn IDE", wxOK | wxICON_ERROR);
+        return false;
+    }
+    ProfileAMX = amxfile;
+    SetStatusText("Profiling...", 0);
+    return true;
+}
+
+/** StopProfiler() waits for the profiler thread to finish (it reads the
+ *  remaining output of the script first), and shows the results.
+ */
+void QuincyFrame::StopProfiler()
+{
+    if (!Profiler)
+        return;
+    Profiler->Delete();
+    Profiler->GetResults(ProfileResults, ProfileFuncs);
+    delete Profiler;
+    Profiler = NULL;
+
+    unsigned long lines = 0;
+    wxLongLong total = 0;
+    for (ProfileFiles::iterator file = ProfileResults.begin(); file != ProfileResults.end(); ++file) {
+        for (ProfileLines::iterator line = file->second.begin(); line != file->second.end(); ++line) {
+            lines += line->second.Hits;
+            total += line->second.Time;
+        }
+    }
+    for (int idx = 0; idx < MAX_EDITORS; idx++)
+        if (Editor[idx])
+            ShowProfile(Editor[idx]);
+    SetStatusText(wxString::Format("Profile: %lu lines executed in %.1f ms", lines, total.ToDouble() / 1000.0), 0);
+}
+
+void QuincyFrame::OnProfileEvent(wxThreadEvent& event)
+{
+    switch (event.GetInt()) {
+    case PROFILE_OUTPUT:
+        Terminal->AppendText(event.GetString());
+        if (PaneTab->GetSelection() != TAB_OUTPUT)
+            PaneTab->SetSelection(TAB_OUTPUT);  /* make sure "output" window is visible */
+        break;
+    case PROFILE_UPDATE:
+        /* events that arrive after the profiler stopped, are outdated (the
+           results were collected in StopProfiler()) */
+        if (Profiler) {
+            Profiler->GetResults(ProfileResults, ProfileFuncs);
+            wxStyledTextCtrl* edit = GetActiveEdit(EditTab);
+            if (edit)
+                ShowProfile(edit);
+        }
+        break;
+    }
+}
+
+void QuincyFrame::StopTransfer()
+{
+    if (Transfer) {
+        Transfer->Delete();
+        delete Transfer;
+        Transfer = NULL;
+    }
+    Monitor->Reclaim(&Transfer);
+    if (TransferProgress) {
+        TransferProgress->Destroy();
+        TransferProgress = NULL;
+    }
+}
+
+void QuincyFrame::OnTransferEvent(wxThreadEvent& event)
+{
+    if (!Transfer)
+        return;     /* event arrived after the transfer was aborted */
+    long bytes = event.GetExtraLong();
+    long msec = TransferClock.Time();
+    long rate = (msec > 0) ? (long)((wxLongLong(bytes) * 1000) / msec).ToLong() : 0;
+    switch (event.GetInt()) {
+    case TRANSFER_PROGRESS:
+        if (TransferProgress) {
+            wxString msg = wxString::Format("%ld of %lu bytes, %ld bytes/s", bytes, TransferSize, rate);
+            if (!TransferProgress->Update(wxMin(bytes, wxMax((long)TransferSize, 1L)), msg))
+                StopTransfer(); /* aborted by the user */
+        }
+        break;
+    case TRANSFER_DONE:
+    case TRANSFER_FAILED: {
+        /* the thread ends right after posting the event; keep the image for
+           a patch on the next transfer, or drop it, because the image on the
+           device is unknown after a failure */
+        Transfer->Wait();
+        bool patched = Transfer->Patched();
+        if (Transfer->PatchUnanswered())
+            NoPatchPorts.insert(Transfer->GetPort());
+        if (event.GetInt() == TRANSFER_DONE)
+            TransferCache[Transfer->GetPort()] = Transfer->GetImage();
+        else
+            TransferCache.erase(Transfer->GetPort());
+        delete Transfer;
+        Transfer = NULL;
+        StopTransfer();     /* closes the progress dialog */
+        wxString msg;
+        if (event.GetInt() == TRANSFER_DONE)
+            msg = wxString::Format("Transferred to target device (%s, %ld bytes/s).", patched ? "patched" : "full image", rate);
+        else
+            msg = "Failure to transfer the script: " + event.GetString();
+        int cnt = BuildLog->GetItemCount();
+        BuildLog->InsertItem(cnt + 1, msg);
+        SetStatusText(msg, 0);
+        break;
+    } /* case */
+    }
+}
+
+/** OnTransferMulti() transfers the compiled script to several devices at
+ *  once, with a worker per port (a native transfer thread, or a process of
+ *  the upload tool). Progress and results are shown in the build log, and a
+ *  summary is appended to a log file next to the compiled script.
+ */
+void QuincyFrame::OnTransferMulti(wxCommandEvent& /* event */)
+{
+    if (DeviceTransfers.size() > 0) {
+        wxMessageBox("A transfer to multiple devices is already in progress.", "Pawn IDE", wxOK | wxICON_ERROR);
+        return;
+    }
+    if (strRecentAMXName.length() == 0) {
+        wxMessageBox("No recent compiled file to transfer. Build the script first",
+                     "Pawn IDE", wxOK | wxICON_ERROR);
+        return;
+    }
+    if (!NativeTransfer && UploadTool.length() == 0) {
+        wxMessageBox("Transfer to multiple devices needs an upload tool or the native transfer\n"
+                     "in the configuration of the target host.", "Pawn IDE", wxOK | wxICON_ERROR);
+        return;
+    }
+    if (UploadTool.length() > 0 && UploadTool.Find("%port%") < 0) {
+        wxMessageBox("The upload tool of the target host does not take a port (\"%port%\" in the\n"
+                     "\"#upload:\" option), so it cannot transfer to multiple devices.", "Pawn IDE", wxOK | wxICON_ERROR);
+        return;
+    }
+
+    wxArrayString ports = EnumeratePortsList();
+    if (ports.Count() == 0) {
+        wxMessageBox("No serial ports were found.", "Pawn IDE", wxOK | wxICON_ERROR);
+        return;
+    }
+    wxArrayInt selection;
+    for (unsigned idx = 0; idx < ports.Count(); idx++)
+        if (DeviceTransferPorts.Index(ports[idx]) != wxNOT_FOUND)
+            selection.Add(idx);
+    wxMultiChoiceDialog dlg(this, "Please select the ports of the devices.", "Transfer to multiple devices", ports);
+    dlg.SetSelections(selection);
+    if (dlg.ShowModal() != wxID_OK)
+        return;
+    selection = dlg.GetSelections();
+    if (selection.Count() == 0)
+        return;
+    DeviceTransferPorts.Clear();
+    for (unsigned idx = 0; idx < selection.Count(); idx++)
+        DeviceTransferPorts.Add(ports[selection[idx]]);
+
+    BuildLog->DeleteAllItems();
+    PaneTab->SetSelection(TAB_BUILD);
+    /* all entries are created before the first transfer starts, so that a
+       port that fails immediately does not complete the batch */
+    for (unsigned idx = 0; idx < DeviceTransferPorts.Count(); idx++) {
+        const wxString& port = DeviceTransferPorts[idx];
+        DeviceTransfer* device = new DeviceTransfer(port, BuildLog->GetItemCount());
+        BuildLog->InsertItem(device->Row, port + ": starting");
+        DeviceTransfers.push_back(device);
+    }
+    std::vector<DeviceTransfer*> devices = DeviceTransfers; /* FinishDeviceTransfer() may clear the list */
+    for (unsigned idx = 0; idx < devices.size(); idx++) {
+        DeviceTransfer* device = devices[idx];
+        const wxString& port = device->Port;
+        Monitor->Release(port, device);
+        if (UploadTool.length() > 0) {
+            wxString command = UploadCommand(strRecentAMXName, port);
+            device->Process = new wxProcess(this);
+            device->PID = wxExecute(command, wxEXEC_ASYNC, device->Process);
+            if (device->PID <= 0) {
+                delete device->Process;
+                device->Process = NULL;
+                device->PID = 0;
+                FinishDeviceTransfer(device, false, "upload tool could not be started");
+                continue;
+            }
+        } else {
+            std::map<wxString, TransferImage>::iterator cached = TransferCache.find(port);
+            if (cached != TransferCache.end() && NoPatchPorts.count(port) == 0)
+                device->Worker = new CSerialTransfer(this, IDM_TRANSFERMULTI, port, DebugBaudrate, strRecentAMXName, cached->second);
+            else
+                device->Worker = new CSerialTransfer(this, IDM_TRANSFERMULTI, port, DebugBaudrate, strRecentAMXName);
+            if (device->Worker->Run() != wxTHREAD_NO_ERROR) {
+                delete device->Worker;
+                device->Worker = NULL;
+                FinishDeviceTransfer(device, false, "worker could not be started");
+                continue;
+            }
+        }
+        BuildLog->SetItemText(device->Row, port + ": transferring");
+    }
+}
+
+DeviceTransfer* QuincyFrame::FindDeviceTransfer(const wxString& port, long pid)
+{
+    for (unsigned idx = 0; idx < DeviceTransfers.size(); idx++) {
+        DeviceTransfer* device = DeviceTransfers[idx];
+        if ((pid != 0 && device->PID == pid) || (port.length() > 0 && device->Port.Cmp(port) == 0))
+            return device;
+    }
+    return NULL;
+}
+
+void QuincyFrame::OnDeviceTransferEvent(wxThreadEvent& event)
+{
+    DeviceTransfer* device = FindDeviceTransfer(event.GetPayload<wxString>());
+    if (!device || !device->Worker)
+        return;     /* event arrived after the transfer was stopped */
+    device->Bytes = event.GetExtraLong();
+    long msec = device->Clock.Time();
+    device->Rate = (msec > 0) ? (long)((wxLongLong(device->Bytes) * 1000) / msec).ToLong() : 0;
+    switch (event.GetInt()) {
+    case TRANSFER_PROGRESS:
+        BuildLog->SetItemText(device->Row, wxString::Format("%s: %lu bytes, %ld bytes/s",
+                                                            device->Port.c_str(), device->Bytes, device->Rate));
+        break;
+    case TRANSFER_DONE:
+    case TRANSFER_FAILED:
+        device->Worker->Wait();    /* the thread ends right after posting the event */
+        if (device->Worker->PatchUnanswered())
+            NoPatchPorts.insert(device->Port);
+        if (event.GetInt() == TRANSFER_DONE)
+            TransferCache[device->Port] = device->Worker->GetImage();
+        else
+            TransferCache.erase(device->Port);
+        delete device->Worker;
+        device->Worker = NULL;
+        FinishDeviceTransfer(device, event.GetInt() == TRANSFER_DONE, event.GetString());
+        break;
+    }
+}
+
+/** FinishDeviceTransfer() records the result for a port; after the last
+ *  port completes, it writes the summary.
+ */
+void QuincyFrame::FinishDeviceTransfer(DeviceTransfer* device, bool passed, const wxString& message)
+{
+    Monitor->Reclaim(device);
+    device->Status = passed ? DeviceTransfer::PASSED : DeviceTransfer::FAILED;
+    if (!passed)
+        device->Message = message;
+    wxString text = device->Port + (passed ? ": passed" : ": FAILED, " + message);
+    if (device->Worker == NULL && device->Process == NULL && device->Bytes > 0)
+        text += wxString::Format(" (%lu bytes, %ld bytes/s)", device->Bytes, device->Rate);
+    BuildLog->SetItemText(device->Row, text);
+
+    unsigned passcount = 0;
+    for (unsigned idx = 0; idx < DeviceTransfers.size(); idx++) {
+        if (DeviceTransfers[idx]->Status == DeviceTransfer::RUNNING)
+            return;
+        if (DeviceTransfers[idx]->Status == DeviceTransfer::PASSED)
+            passcount++;
+    }
+
+    /* all done: append the summary to the log file */
+    wxString summary = wxString::Format("Transferred to %u of %u devices.", passcount, (unsigned)DeviceTransfers.size());
+    wxString logname = strRecentAMXName.BeforeLast('.') + "-transfer.log";
+    wxFFile log(logname, "a");
+    if (log.IsOpened()) {
+        wxString stamp = wxDateTime::Now().FormatISOCombined(' ');
+        log.Write(stamp + " " + strRecentAMXName + "\n");
+        for (unsigned idx = 0; idx < DeviceTransfers.size(); idx++) {
+            DeviceTransfer* dev = DeviceTransfers[idx];
+            wxString line = "    " + dev->Port;
+            if (dev->Status == DeviceTransfer::PASSED)
+                line += wxString::Format("\tpass\t%lu bytes\t%ld bytes/s\t%.1f s", dev->Bytes, dev->Rate, dev->Clock.Time() / 1000.0);
+            else
+                line += "\tFAIL\t" + dev->Message;
+            log.Write(line + "\n");
+        }
+        log.Write("    " + summary + "\n");
+        log.Close();
+    }
+    BuildLog->InsertItem(BuildLog->GetItemCount(), summary + " Log: " + logname);
+    SetStatusText(summary, 0);
+    for (unsigned idx = 0; idx < DeviceTransfers.size(); idx++)
+        delete DeviceTransfers[idx];
+    DeviceTransfers.clear();
+}
+
+void QuincyFrame::StopDeviceTransfers()
+{
+    for (unsigned idx = 0; idx < DeviceTransfers.size(); idx++) {
+        DeviceTransfer* device = DeviceTransfers[idx];
+        if (device->Worker) {
+            device->Worker->Delete();
+            delete device->Worker;
+        }
+        if (device->Process)
+            device->Process->Detach();  /* let the upload tool finish, it deletes itself */
+        delete device;
+    }
+    DeviceTransfers.clear();
+}
+
+/** OnSimulator() starts or stops the device simulator. While it runs,
+ *  transfers and remote debugging go to the simulated device instead of the
+ *  configured port.
+ */
+void QuincyFrame::OnSimulator(wxCommandEvent& /* event */)
+{
+    if (Simulator) {
+        Simulator->Delete();
+        delete Simulator;
+        Simulator = NULL;
+        SetStatusText("Device simulator stopped", 0);
+    } else if (EditSimulatorOptions(this, SimOptions)) {
+        Simulator = new CDeviceSimulator(SimOptions);
+        wxString error;
+        if (!Simulator->Create(error) || Simulator->Run() != wxTHREAD_NO_ERROR) {
+            delete Simulator;
+            Simulator = NULL;
+            if (error.IsEmpty())
+                error = "The device simulator could not be started.";
+            wxMessageBox(error, "Pawn IDE", wxOK | wxICON_ERROR);
+        } else {
+            SetStatusText("Simulated device on " + Simulator->GetPortName(), 0);
+        }
+    }
+    GetMenuBar()->Check(IDM_SIMULATOR, Simulator != NULL);
+}
+
+/** OnSerialBenchmark() measures the serial path against a simulated device
+ *  (with the rate limit of the device simulator settings): a full transfer
+ *  of the compiled script, a patch of the same image, and a full transfer
+ *  with negative acknowledges on 5% of the frames. The results are added to
+ *  the build log, together with the latencies of the most recent debugging
+ *  session (run it against the device simulator to measure the serial path).
+ */
+void QuincyFrame::OnSerialBenchmark(wxCommandEvent& /* event */)
+{
+    if (BenchSimulator) {
+        wxMessageBox("The benchmark is already running.", "Pawn IDE", wxOK | wxICON_ERROR);
+        return;
+    }
+    if (strRecentAMXName.length() == 0 || !wxFileExists(strRecentAMXName)) {
+        wxMessageBox("No recent compiled file to transfer. Build the script first",
+                     "Pawn IDE", wxOK | wxICON_ERROR);
+        return;
+    }
+    SimulatorOptions options;
+    options.Rate = SimOptions.Rate;
+    BenchSimulator = new CDeviceSimulator(options);
+    wxString error;
+    if (!BenchSimulator->Create(error) || BenchSimulator->Run() != wxTHREAD_NO_ERROR) {
+        delete BenchSimulator;
+        BenchSimulator = NULL;
+        if (error.IsEmpty())
+            error = "The device simulator could not be started.";
+        wxMessageBox(error, "Pawn IDE", wxOK | wxICON_ERROR);
+        return;
+    }
+    BuildLog->DeleteAllItems();
+    PaneTab->SetSelection(TAB_BUILD);
+    wxString rate = (options.Rate > 0) ? wxString::Format("%ld bytes/s", options.Rate) : wxString("no rate limit");
+    BuildLog->InsertItem(BuildLog->GetItemCount(), "Serial benchmark on " + BenchSimulator->GetPortName() + " (" + rate + ")");
+    BenchStep = 0;
+    BenchImage.clear();
+    if (!StartBenchmarkStep())
+        StopBenchmark();
+}
+
+bool QuincyFrame::StartBenchmarkStep()
+{
+    wxASSERT(BenchSimulator && !BenchTransfer);
+    if (BenchStep == 1)
+        BenchTransfer = new CSerialTransfer(this, IDM_SERIALBENCH, BenchSimulator->GetPortName(), DebugBaudrate, strRecentAMXName, BenchImage);
+    else
+        BenchTransfer = new CSerialTransfer(this, IDM_SERIALBENCH, BenchSimulator->GetPortName(), DebugBaudrate, strRecentAMXName);
+    BenchSimulator->SetErrors((BenchStep == 2) ? 5 : 0, 0);
+    if (BenchTransfer->Run() != wxTHREAD_NO_ERROR) {
+        delete BenchTransfer;
+        BenchTransfer = NULL;
+        BuildLog->InsertItem(BuildLog->GetItemCount(), "The transfer could not be started.");
+        return false;
+    }
+    BenchClock.Start();
+    return true;
+}
+
+void QuincyFrame::OnBenchmarkEvent(wxThreadEvent& event)
+{
+    if (!BenchTransfer || event.GetInt() == TRANSFER_PROGRESS)
+        return;
+    BenchTransfer->Wait();  /* the thread ends right after posting the event */
+    long msec = BenchClock.Time();
+    static const char *steps[] = { "full image", "patch", "full image, 5% NAK" };
+    wxString msg = wxString("Transfer, ") + steps[BenchStep] + ": ";
+    bool passed = (event.GetInt() == TRANSFER_DONE);
+    if (passed) {
+        unsigned long bytes = BenchTransfer->GetImage().size();
+        long rate = (msec > 0) ? (long)((wxLongLong(bytes) * 1000) / msec).ToLong() : 0;
+        msg += wxString::Format("%lu bytes in %ld ms, %ld bytes/s", bytes, msec, rate);
+        if (BenchStep == 1 && !BenchTransfer->Patched())
+            msg += " (patch was refused)";
+        if (BenchSimulator->Naks() > 0)
+            msg += wxString::Format(", %lu of %lu frames rejected", BenchSimulator->Naks(), BenchSimulator->Frames());
+        if (BenchStep == 0)
+            BenchImage = BenchTransfer->GetImage();
+    } else {
+        msg += "FAILED, " + event.GetString();
+    }
+    BuildLog->InsertItem(BuildLog->GetItemCount(), msg);
+    delete BenchTransfer;
+    BenchTransfer = NULL;
+
+    if (passed && ++BenchStep < (int)WXSIZEOF(steps)) {
+        /* the next step creates a new simulator, so that the statistics and
+           the held image start afresh (except for the patch step) */
+        if (BenchStep != 1) {
+            SimulatorOptions options;
+            options.Rate = SimOptions.Rate;
+            BenchSimulator->Delete();
+            delete BenchSimulator;
+            BenchSimulator = new CDeviceSimulator(options);
+            wxString error;
+            if (!BenchSimulator->Create(error) || BenchSimulator->Run() != wxTHREAD_NO_ERROR) {
+                BuildLog->InsertItem(BuildLog->GetItemCount(), error.IsEmpty() ? wxString("The device simulator could not be started.") : error);
+                StopBenchmark();
+                return;
+            }
+        }
+        if (StartBenchmarkStep())
+            return;
+    }
+
+    if (DebugLatency.Start >= 0) {
+        msg = wxString::Format("Debugging (last session): %ld ms to the first stop", DebugLatency.Start);
+        if (DebugLatency.Count > 0)
+            msg += wxString::Format("; %ld steps, %ld ms average, %ld ms minimum, %ld ms maximum",
+                                    DebugLatency.Count, DebugLatency.Total / DebugLatency.Count,
+                                    DebugLatency.Min, DebugLatency.Max);
+    } else {
+        msg = "Debugging: no session measured (debug a script on the device simulator, with a target script)";
+    }
+    BuildLog->InsertItem(BuildLog->GetItemCount(), msg);
+    StopBenchmark();
+}
+
+void QuincyFrame::StopBenchmark()
+{
+    if (BenchTransfer) {
+        BenchTransfer->Delete();
+        delete BenchTransfer;
+        BenchTransfer = NULL;
+    }
+    if (BenchSimulator) {
+        BenchSimulator->Delete();
+        delete BenchSimulator;
+        BenchSimulator = NULL;
+    }
+}
+
+/** ShowProfile() marks the lines that were executed in the heat map margin
+ *  (on a logarithmic scale of the hit counts), and adds an annotation with
+ *  the counts to the lines where most time was spent.
+ */
+#define PROFILE_ANNOTATE    10  /* number of lines (over all files) that get an annotation */
+void QuincyFrame::ShowProfile(wxStyledTextCtrl* edit)
+{
+    wxASSERT(edit);
+    for (int marker = MARKER_HEAT1; marker <= MARKER_HEAT4; marker++)
+        edit->MarkerDeleteAll(marker);
+    edit->AnnotationClearAll();
+
+    int index;
+    for (index = 0; index < MAX_EDITORS && Editor[index] != edit; index++)
+        /* nothing */;
+    ProfileFiles::iterator file;
+    for (file = ProfileResults.begin(); file != ProfileResults.end(); ++file)
+        if (index < MAX_EDITORS && CProfiler::SameFile(Filename[index], file->first))
+            break;
+    if (file == ProfileResults.end()) {
+        edit->SetMarginWidth(MARGIN_HEAT, 0);
+        return;
+    }
+
+    /* the scale is the same for all files, find the maximum count and the
+       time for the lines that get an annotation */
+    unsigned long maxhits = 1;
+    std::vector<wxLongLong> times;
+    for (ProfileFiles::iterator iter = ProfileResults.begin(); iter != ProfileResults.end(); ++iter) {
+        for (ProfileLines::iterator line = iter->second.begin(); line != iter->second.end(); ++line) {
+            if (line->second.Hits > maxhits)
+                maxhits = line->second.Hits;
+            times.push_back(line->second.Time);
+        }
+    }
+    std::sort(times.begin(), times.end());
+    wxLongLong threshold = (times.size() > PROFILE_ANNOTATE) ? times[times.size() - PROFILE_ANNOTATE] : wxLongLong(0);
+
+    edit->SetMarginWidth(MARGIN_HEAT, 6);
+    IgnoreChangeEvent = true;
+    for (ProfileLines::iterator line = file->second.begin(); line != file->second.end(); ++line) {
+        if (line->first >= edit->GetLineCount())
+            continue;   /* file was edited since */
+        int level = 0;
+        if (maxhits > 1)
+            level = (int)(3.0 * log((double)line->second.Hits) / log((double)maxhits) + 0.5);
+        edit->MarkerAdd(line->first, MARKER_HEAT1 + level);
+        if (line->second.Time >= threshold && line->second.Time > 0) {
+            edit->AnnotationSetText(line->first, wxString::Format("%lu hits, %.2f ms", line->second.Hits, line->second.Time.ToDouble() / 1000.0));
+            edit->AnnotationSetStyle(line->first, STYLE_PROFILE);
+        }
+    }
+    edit->AnnotationSetVisible(wxSTC_ANNOTATION_BOXED);
+    IgnoreChangeEvent = false;
+}
+
+void QuincyFrame::OnProfileClear(wxCommandEvent& /* event */)
+{
+    if (Profiler)
+        return;
+    ProfileResults.clear();
+    ProfileFuncs.clear();
+    for (int idx = 0; idx < MAX_EDITORS; idx++)
+        if (Editor[idx])
+            ShowProfile(Editor[idx]);
+}
+
+/** OnProfileExport() saves the results of the last profiling run, either as
+ *  coverage data in the lcov "tracefile" format, or as a table with totals
+ *  per function (comma-separated). Only lines that were executed at least
+ *  once are known to the profiler, so the coverage data does not list lines
+ *  that were never reached.
+ */
+void QuincyFrame::OnProfileExport(wxCommandEvent& /* event */)
+{
+    if (ProfileResults.size() == 0) {
+        wxMessageBox("There are no profiling results; run the script with \"Profile\" first.", "Pawn IDE", wxOK | wxICON_ERROR);
+        return;
+    }
+    wxFileDialog * saveFileDialog = new wxFileDialog(this, "Export profile...",
+                                                    strCurrentDirectory, wxEmptyString,
+                                                    "Coverage (lcov)|*.info|Function totals|*.csv",
+                                                    wxFD_SAVE | wxFD_OVERWRITE_PROMPT);
+    if (saveFileDialog->ShowModal() != wxID_OK)
+        return;
+    wxString path = saveFileDialog->GetPath();
+    bool lcov = (saveFileDialog->GetFilterIndex() == 0);
+    FILE *fp = fopen(path.utf8_str(), "wt");
+    if (fp == NULL) {
+        wxMessageBox("Failed to create \"" + path + "\".", "Pawn IDE", wxOK | wxICON_ERROR);
+        return;
+    }
+
+    if (lcov) {
+        /* all lines with code (from the debug information) are reported, also
+           those that never ran */
+        ProfileFiles coverage = ProfileResults;
+        CProfiler::ReadLineTable(ProfileAMX, coverage);
+        fprintf(fp, "TN:\n");
+        for (ProfileFiles::iterator file = coverage.begin(); file != coverage.end(); ++file) {
+            /* prefer the full path, from the symbol list or from the editor */
+            wxString source = file->first;
+            for (unsigned idx = 0; idx < ProfileFuncs.size(); idx++) {
+                if (CProfiler::SameFile(ProfileFuncs[idx].File, file->first)) {
+                    source = ProfileFuncs[idx].File;
+                    break;
+                }
+            }
+            fprintf(fp, "SF:%s\n", (const char*)source.utf8_str());
+            int found = 0, hit = 0;
+            for (unsigned idx = 0; idx < ProfileFuncs.size(); idx++) {
+                const ProfileFunction& func = ProfileFuncs[idx];
+                if (CProfiler::SameFile(func.File, file->first)) {
+                    fprintf(fp, "FN:%ld,%s\n", func.Line + 1, (const char*)func.Name.utf8_str());
+                    found++;
+                }
+            }
+            for (unsigned idx = 0; idx < ProfileFuncs.size(); idx++) {
+                const ProfileFunction& func = ProfileFuncs[idx];
+                if (CProfiler::SameFile(func.File, file->first)) {
+                    fprintf(fp, "FNDA:%lu,%s\n", func.Entries, (const char*)func.Name.utf8_str());
+                    if (func.Entries > 0)
+                        hit++;
+                }
+            }
+            fprintf(fp, "FNF:%d\nFNH:%d\n", found, hit);
+            int executed = 0;
+            for (ProfileLines::iterator line = file->second.begin(); line != file->second.end(); ++line) {
+                fprintf(fp, "DA:%ld,%lu\n", line->first + 1, line->second.Hits);
+                if (line->second.Hits > 0)
+                    executed++;
+            }
+            fprintf(fp, "LF:%d\nLH:%d\n", (int)file->second.size(), executed);
+            fprintf(fp, "end_of_record\n");
+        }
+    } else {
+        /* the lines of a function are those from its header up to the header
+           of the next function in the same file */
+        fprintf(fp, "function,file,line,calls,lines executed,time (ms)\n");
+        for (unsigned idx = 0; idx < ProfileFuncs.size(); idx++) {
+            const ProfileFunction& func = ProfileFuncs[idx];
+            long end = LONG_MAX;
+            for (unsigned next = 0; next < ProfileFuncs.size(); next++)
+                if (ProfileFuncs[next].Line > func.Line && ProfileFuncs[next].Line < end && ProfileFuncs[next].File.Cmp(func.File) == 0)
+                    end = ProfileFuncs[next].Line;
+            unsigned long hits = 0;
+            wxLongLong time = 0;
+            for (ProfileFiles::iterator file = ProfileResults.begin(); file != ProfileResults.end(); ++file) {
+                if (!CProfiler::SameFile(func.File, file->first))
+                    continue;
+                for (ProfileLines::iterator line = file->second.lower_bound(func.Line); line != file->second.end() && line->first < end; ++line) {
+                    hits += line->second.Hits;
+                    time += line->second.Time;
+                }
+            }
+            fprintf(fp, "%s,%s,%ld,%lu,%lu,%.3f\n", (const char*)func.Name.utf8_str(),
+                    (const char*)func.File.utf8_str(), func.Line + 1, func.Entries, hits, time.ToDouble() / 1000.0);
+        }
+    }
+    fclose(fp);
+}
+
+/** GetArrayDimensions() finds the declaration of a variable and returns
+ *  whether it is an array. The dimensions are returned in "dims", where a
+ *  dimension whose size cannot be determined is set to 0.
+ *  The source is searched backwards from the given line, which finds locals,
+ *  function arguments and globals declared in the same file. Globals in other
+ *  files are found through the symbol list (from the compiler report).
+ */
+bool QuincyFrame::GetArrayDimensions(const wxString& word, wxStyledTextCtrl* edit, int line, wxArrayLong& dims)
+{
+    dims.Clear();
+    wxString decl;
+    size_t declpos = 0;
+    for (int ln = line; edit && ln >= 0 && decl.IsEmpty(); ln--) {
+        wxString text = edit->GetLine(ln);
+        int start = 0;
+        while (start < (int)text.length()) {
+            int idx = text.Mid(start).Find(word);
+            if (idx < 0)
+                break;
+            idx += start;
+            start = idx + word.length();
+            /* must be a complete word */
+            if (idx > 0 && (isalnum(text[idx - 1]) || text[idx - 1] == '_' || text[idx - 1] == '@'))
+                continue;
+            if (start < (int)text.length() && (isalnum(text[start]) || text[start] == '_'))
+                continue;
+            /* must be followed by a '[' and be a declaration or function argument */
+            size_t pos = start;
+            while (pos < text.length() && (text[pos] == ' ' || text[pos] == '\t'))
+                pos++;
+            if (pos >= text.length() || text[pos] != '[')
+                continue;
+            wxString head = text.Left(idx);
+            if (head.Find("new") >= 0 || head.Find("static") >= 0 || head.Find("decl") >= 0 || head.Find('(') >= 0) {
+                decl = text;
+                declpos = pos;
+                break;
+            }
+        }
+    }
+    if (decl.IsEmpty()) {
+        /* try a global variable from the report */
+        SymbolRange range = SymbolList.Lookup(word);
+        for (const CSymbolEntry* entry = range.first; decl.IsEmpty() && entry != range.second; entry++) {
+            if (entry->SymbolName[0] == 'F' && strchr(entry->Syntax.UTF8(), '[') != NULL) {
+                decl = entry->Syntax.Str();
+                declpos = decl.Find('[');
+            }
+        }
+    }
+    if (decl.IsEmpty())
+        return false;
+
+    while (declpos < decl.length() && decl[declpos] == '[') {
+        size_t end = declpos + 1;
+        while (end < decl.length() && decl[end] != ']')
+            end++;
+        wxString size = decl.Mid(declpos + 1, end - declpos - 1);
+        size.Trim(false);
+        size.Trim();
+        long value = 0;
+        if (size.length() > 0 && !size.ToLong(&value, 0)) {
+            /* may be a symbolic constant (the report stores it as "name (value)") */
+            value = 0;
+            SymbolRange range = SymbolList.Lookup(size);
+            for (const CSymbolEntry* entry = range.first; entry != range.second; entry++) {
+                if (entry->SymbolName[0] == 'C') {
+                    wxString num = entry->Syntax.Str().AfterLast('(').BeforeFirst(')');
+                    if (!num.ToLong(&value, 0))
+                        value = 0;
+                    break;
+                }
+            }
+        }
+        dims.Add(value > 0 ? value : 0);
+        declpos = end + 1;
+        while (declpos < decl.length() && (decl[declpos] == ' ' || decl[declpos] == '\t'))
+            declpos++;
+    }
+    return dims.Count() > 0;
+}
+
+void QuincyFrame::OnTerminalChar(wxKeyEvent& event)
+{
+    ExecSession* session = FindSession(0, dynamic_cast<wxWindow*>(event.GetEventObject()));
+    if (session && session->IsRunning())
+        session->QueueInput((wxChar)event.GetUnicodeKey());
+    event.Skip();
+}
+
+void QuincyFrame::OnUIWorkSpace(wxUpdateUIEvent& /* event */)
+{
+    if (menuFile) {
+        wxMenuItem *item = menuFile->FindItem(IDM_CLOSEWORKSPACE);
+        if (item)
+            item->Enable(strWorkspace.Length() > 0);
+    }
+}
+
+void QuincyFrame::OnUIUndo(wxUpdateUIEvent& /* event */)
+{
+    wxStyledTextCtrl *edit = GetActiveEdit(EditTab);
+    int newflags = UIDisabledTools;
+    newflags = (edit && edit->CanUndo()) ? newflags & ~UI_UNDO : newflags | UI_UNDO;
+    newflags = (edit && edit->CanRedo()) ? newflags & ~UI_REDO : newflags | UI_REDO;
+    if (newflags != UIDisabledTools) {
+        if (menuEdit) {
+            wxMenuItem* itemUndo = menuEdit->FindItem(wxID_UNDO);
+            wxMenuItem* itemRedo = menuEdit->FindItem(wxID_REDO);
+            wxASSERT(itemUndo && itemRedo);
+            if (edit) {
+                itemUndo->Enable(edit->CanUndo());
+                itemRedo->Enable(edit->CanRedo());
+            }
+            else {
+                itemUndo->Enable(false);
+                itemRedo->Enable(false);
+            }
+        }
+        if (ToolBar) {
+            ToolBar->EnableTool(wxID_UNDO, edit && edit->CanUndo());
+            ToolBar->EnableTool(wxID_REDO, edit && edit->CanRedo());
+            ToolBar->Refresh(false);
+        }
+        UIDisabledTools = newflags;
+    }
+}
+
+void QuincyFrame::OnUICutCopy(wxUpdateUIEvent& /* event */)
+{
+    wxStyledTextCtrl *edit = GetActiveEdit(EditTab);
+    int s1 = 0, s2 = 0;
+    if (edit) {
+        s1 = edit->GetSelectionStart();
+        s2 = edit->GetSelectionEnd();
+    }
+    int newflags = (s1 != s2) ? UIDisabledTools & ~UI_CUTCOPY : UIDisabledTools | UI_CUTCOPY;
+    if (newflags != UIDisabledTools) {
+        if (menuEdit) {
+            wxMenuItem *item;
+            if ((item = menuEdit->FindItem(wxID_CUT)) != NULL)
+                item->Enable(s1 != s2);
+            if ((item = menuEdit->FindItem(wxID_COPY)) != NULL)
+                item->Enable(s1 != s2);
+            if ((item = menuEdit->FindItem(IDM_FILLCOLUMN)) != NULL)
+                item->Enable(s1 != s2 && edit->SelectionIsRectangle());
+        }
+        if (ToolBar) {
+            ToolBar->EnableTool(wxID_CUT, s1 != s2);
+            ToolBar->EnableTool(wxID_COPY, s1 != s2);
+            ToolBar->Refresh(false);
+        }
+        UIDisabledTools = newflags;
+    }
+}
+
+void QuincyFrame::OnUIPaste(wxUpdateUIEvent& /* event */)
 {
     wxStyledTextCtrl *edit = GetActiveEdit(EditTab);
     bool enable = (edit != 0);
@@ -4473,15 +6207,18 @@ void QuincyFrame::OnUIFind(wxUpdateUIEvent& /* event */)
 
 void QuincyFrame::OnUIRun(wxUpdateUIEvent& /* event */)
 {
-    bool enable_abort = ExecPID != 0 && wxProcess::Exists(ExecPID);
-    bool enable_run = (enable_abort && DebugMode) || RunTimeEnabled;
-    bool enable_transfer = !enable_abort
-                           && (((DebuggerEnabled & DEBUG_REMOTE) != 0 && DebuggerSelected == DEBUG_REMOTE)
-                               || UploadTool.length() > 0);
+    /* scripts can run next to each other, but only one under the debugger */
+    bool foreground = IsExecRunning();
+    bool enable_abort = foreground;
+    for (unsigned idx = 0; idx < Sessions.size() && !enable_abort; idx++)
+        enable_abort = Sessions[idx]->IsRunning();
+    bool enable_run = (foreground && DebugMode) || RunTimeEnabled;
+    bool enable_transfer = ((DebuggerEnabled & DEBUG_REMOTE) != 0 && DebuggerSelected == DEBUG_REMOTE)
+                           || UploadTool.length() > 0 || NativeTransfer;
     int newflags = UIDisabledTools;
     newflags = enable_abort ? newflags & ~UI_ABORT : newflags | UI_ABORT;
-    newflags = enable_abort ? newflags & ~UI_RUN : newflags | UI_RUN;
-    newflags = enable_abort ? newflags & ~UI_TRANSFER : newflags | UI_TRANSFER;
+    newflags = foreground ? newflags & ~UI_RUN : newflags | UI_RUN;
+    newflags = foreground ? newflags & ~UI_TRANSFER : newflags | UI_TRANSFER;
     if (newflags != UIDisabledTools) {
         if (ToolBar) {
             ToolBar->EnableTool(IDM_TRANSFER, enable_transfer);
@@ -4501,12 +6238,16 @@ void QuincyFrame::OnUIRun(wxUpdateUIEvent& /* event */)
             wxMenuItem *item;
             if ((item = menuBuild->FindItem(IDM_TRANSFER)) != NULL)
                 item->Enable(enable_transfer);
+            if ((item = menuBuild->FindItem(IDM_TRANSFERMULTI)) != NULL)
+                item->Enable((UploadTool.length() > 0) ? UploadTool.Find("%port%") >= 0 : NativeTransfer);
             if ((item = menuBuild->FindItem(IDM_DEBUG)) != NULL)
                 item->Enable(DebuggerEnabled != DEBUG_NONE);
             if ((item = menuBuild->FindItem(IDM_RUN)) != NULL)
                 item->Enable(enable_run);
             if ((item = menuBuild->FindItem(IDM_ABORT)) != NULL)
                 item->Enable(enable_abort);
+            if ((item = menuBuild->FindItem(IDM_PROFILE)) != NULL)
+                item->Enable(!foreground && DebuggerEnabled != DEBUG_NONE);
         }
         UIDisabledTools = newflags;
     }
@@ -4514,7 +6255,9 @@ void QuincyFrame::OnUIRun(wxUpdateUIEvent& /* event */)
 
 void QuincyFrame::OnUIStepInto(wxUpdateUIEvent& /* event */)
 {
-    bool enable = ExecPID != 0 && wxProcess::Exists(ExecPID) && !DebugRunning;
+    /* while a single step runs, further steps are queued (so that holding
+       down a key steps through the code) */
+    bool enable = IsExecRunning() && (!DebugRunning || DebugStepping);
     int newflags = enable ? UIDisabledTools & ~UI_DBGTOOLS : UIDisabledTools | UI_DBGTOOLS;
     if (newflags != UIDisabledTools) {
         if (ToolBar) {
@@ -4555,54 +6298,400 @@ bool QuincyFrame::UpdateSymBrowser(const wxString& filename)
         wxDir dir(path);
         if (!dir.IsOpened())
             return false;
-        int count = 0;
+        wxArrayString files;
         wxString fname;
         if (dir.GetFirst(&fname, "*.xml", wxDIR_FILES )) {
             do {
                 /* get the full path of the matching PDF file, verify whether it exists */
                 fname = path + DIRSEP_STR + fname;
                 wxASSERT(wxFileExists(fname));
-                if (SymbolList.LoadReportFile(fname))
-                    count += 1;
+                files.Add(fname);
             } while (dir.GetNext(&fname));
         }
+        /* read the reports in the background; the browser shows the symbols
+           when all reports are read (see OnReportLoaderEvent) */
+        if (ReportLoader && ReportLoader->Start(files)) {
+            FillSymBrowser();
+            return true;
+        }
+        int count = 0;
+        for (unsigned idx = 0; idx < files.GetCount(); idx++)
+            if (SymbolList.LoadReportFile(files[idx]))
+                count += 1;
         result = (count > 0);
     } else {
-        result = SymbolList.LoadReportFile(filename.BeforeLast('.') + ".xml");
+        wxString report = filename.BeforeLast('.') + ".xml";
+        /* when the loader is still reading the reports, it may be reading the
+           previous version of this one, and its results would overwrite the
+           new symbols; so let the loader read the set again instead */
+        if (ReportLoader && ReportLoader->Restart(report)) {
+            FillSymBrowser();
+            return wxFileExists(report);
+        }
+        result = SymbolList.LoadReportFile(report);
     }
 
+    FillSymBrowser();
+    return result;
+}
+
+/** FillSymBrowser() shows the symbols from the reports and from the indexer
+ *  in the browser tree. The symbols are compared to the ones that are shown,
+ *  and only the symbols that were added or removed are updated in the tree, so
+ *  that the sections keep their state. Sections that were never expanded have
+ *  no items; these are created in OnSymbolExpanding().
+ */
+void QuincyFrame::FillSymBrowser()
+{
     wxASSERT(BrowserTree);
-    if (result) {
+    PaletteItems.Clear();   /* the symbols changed, collect the candidates again */
+    if (SymbolList.Count() == 0) {
+        wxString message = (ReportLoader && ReportLoader->IsBusy()) ? "Loading symbols..." : "No symbols loaded";
+        if (BrowserTree->GetCount() > 0 && !BrowserSections[0].Item.IsOk()) {
+            /* a message is already shown, only update it */
+            wxTreeItemIdValue cookie;
+            wxTreeItemId item = BrowserTree->GetFirstChild(BrowserTree->GetRootItem(), cookie);
+            if (item.IsOk()) {
+                BrowserTree->SetItemText(item, message);
+                return;
+            }
+        }
+        BrowserTree->DeleteAllItems();
+        for (int idx = 0; idx < BROWSER_SECTIONS; idx++)
+            BrowserSections[idx] = BrowserSection();
+        wxTreeItemId root = BrowserTree->AddRoot("root");
+        BrowserTree->AppendItem(root, message);
+        return;
+    }
+
+    if (!BrowserSections[0].Item.IsOk()) {
+        static const char* titles[BROWSER_SECTIONS] = { "Constants", "Global variables", "Functions" };
         BrowserTree->DeleteAllItems();
         wxTreeItemId root = BrowserTree->AddRoot("root");
-        wxTreeItemId sectionConstants = BrowserTree->AppendItem(root, "Constants");
-        wxTreeItemId sectionGlobals = BrowserTree->AppendItem(root, "Global variables");
-        wxTreeItemId sectionFunctions = BrowserTree->AppendItem(root, "Functions");
-        wxTreeItemId section;
-        for (const CSymbolEntry* item = SymbolList.Root(); item; item = item->Next) {
-            wxASSERT(item->SymbolName[1] == ':');
-            if (item->SymbolName[0] == 'C')
-                section = sectionConstants;
-            else if (item->SymbolName[0] == 'F')
-                section = sectionGlobals;
-            else if (item->SymbolName[0] == 'M')
-                section = sectionFunctions;
+        for (int idx = 0; idx < BROWSER_SECTIONS; idx++) {
+            BrowserSections[idx] = BrowserSection();
+            BrowserSections[idx].Item = BrowserTree->AppendItem(root, titles[idx]);
+        }
+    }
+
+    /* collect the keys of the symbols per section */
+    std::set<wxString> symbols[BROWSER_SECTIONS];
+    for (unsigned idx = 0; idx < SymbolList.Count(); idx++) {
+        const CSymbolEntry* item = SymbolList.Entry(idx);
+        wxASSERT(item->SymbolName[1] == ':');
+        int section;
+        if (item->SymbolName[0] == 'C')
+            section = 0;
+        else if (item->SymbolName[0] == 'F')
+            section = 1;
+        else if (item->SymbolName[0] == 'M')
+            section = 2;
+        else
+            continue;
+        symbols[section].insert(BrowserItemData::Key(item));
+    }
+
+    /* walk through the sorted lists of the new and the shown symbols */
+    bool frozen = false;
+    for (int idx = 0; idx < BROWSER_SECTIONS; idx++) {
+        BrowserSection& section = BrowserSections[idx];
+        std::map<wxString, wxTreeItemId>::iterator shown = section.Shown.begin();
+        std::set<wxString>::iterator next = symbols[idx].begin();
+        wxTreeItemId previous;  /* last item that is kept or inserted */
+        while (shown != section.Shown.end() || next != symbols[idx].end()) {
+            int order;
+            if (shown == section.Shown.end())
+                order = 1;
+            else if (next == symbols[idx].end())
+                order = -1;
             else
+                order = shown->first.Cmp(*next);
+            if (order == 0) {
+                previous = shown->second;
+                ++shown;
+                ++next;
                 continue;
-            BrowserTree->AppendItem(section, item->Syntax + " - " + item->Source, -1, -1, new BrowserItemData(item));
-        }
-    } else {
-        if (BrowserTree->GetCount() == 0) {
-            wxTreeItemId root = BrowserTree->AddRoot("root");
-            BrowserTree->AppendItem(root, "No symbols loaded");
+            }
+            if (section.Populated && !frozen) {
+                BrowserTree->Freeze();
+                frozen = true;
+            }
+            if (order < 0) {
+                /* shown, but no longer in the list */
+                if (section.Populated)
+                    BrowserTree->Delete(shown->second);
+                section.Shown.erase(shown++);
+            } else {
+                /* new symbol */
+                wxTreeItemId item;
+                if (section.Populated)
+                    previous = item = InsertSymBrowserItem(section.Item, previous, *next);
+                section.Shown.insert(shown, std::make_pair(*next, item));
+                ++next;
+            }
         }
+        BrowserTree->SetItemHasChildren(section.Item, section.Shown.size() > 0);
     }
-    return result;
+    if (frozen)
+        BrowserTree->Thaw();
+}
+
+/** InsertSymBrowserItem() adds an item for a symbol to a section of the
+ *  browser tree, after the "previous" item (or at the top of the section if
+ *  "previous" is not valid).
+ */
+wxTreeItemId QuincyFrame::InsertSymBrowserItem(const wxTreeItemId& section, const wxTreeItemId& previous, const wxString& key)
+{
+    wxString label = key.AfterFirst('\t').BeforeLast('\t') + " - " + key.AfterLast('\t');
+    BrowserItemData* data = new BrowserItemData(key);
+    if (previous.IsOk())
+        return BrowserTree->InsertItem(section, previous, label, -1, -1, data);
+    return BrowserTree->PrependItem(section, label, -1, -1, data);
+}
+
+/** QueueIndex() passes a source file to the indexer, with a full path (like
+ *  the paths in the report files).
+ */
+void QuincyFrame::QueueIndex(const wxString& path)
+{
+    if (!Indexer || path.Length() == 0)
+        return;
+    wxFileName name(path);
+    name.Normalize(wxPATH_NORM_DOTS | wxPATH_NORM_ABSOLUTE);
+    Indexer->Queue(name.GetFullPath());
+}
+
+/** IndexWorkspace() queues the source files of the workspace and the include
+ *  files in the include path for the indexer. Files that did not change since
+ *  they were last parsed are skipped by the indexer.
+ */
+void QuincyFrame::IndexWorkspace()
+{
+    IncludeRoot.Clear();    /* the include path may have changed */
+    if (!Indexer)
+        return;
+    wxArrayString includedirs;
+    IncludeDirs(includedirs);
+    Indexer->SetIncludePath(includedirs);
+    for (int idx = 0; idx < MAX_EDITORS; idx++)
+        if (Editor[idx] && IsPawnFile(Filename[idx], true))
+            QueueIndex(Filename[idx]);
+    wxArrayString dirs;
+    WorkspaceDirs(dirs);
+    for (unsigned idx = 0; idx < dirs.Count(); idx++) {
+        wxDir dir(dirs[idx]);
+        if (!dir.IsOpened())
+            continue;
+        wxString fname;
+        for (bool more = dir.GetFirst(&fname, wxEmptyString, wxDIR_FILES); more; more = dir.GetNext(&fname))
+            if (IsPawnFile(fname, true))
+                QueueIndex(dirs[idx] + DIRSEP_STR + fname);
+    }
+}
+
+/** ReferenceFile() returns the name of the file in which the reference index
+ *  is stored: next to the workspace file, or in the user data directory if
+ *  there is no workspace.
+ */
+wxString QuincyFrame::ReferenceFile() const
+{
+    if (strWorkspace.Length() > 0) {
+        wxFileName name(strWorkspace);
+        name.SetExt("xref");
+        return name.GetFullPath();
+    }
+    return theApp->GetUserDataPath() + DIRSEP_STR "quincy.xref";
+}
+
+/** LoadReferences() loads the stored reference index of the workspace, adds
+ *  the symbols in it to the symbol list and tells the indexer which files it
+ *  need not parse again.
+ */
+void QuincyFrame::LoadReferences()
+{
+    IncludeRoot.Clear();
+    if (Indexer) {
+        Indexer->Forget();  /* the index of a previous workspace is dropped */
+        wxArrayString includedirs;
+        IncludeDirs(includedirs);
+        Indexer->SetIncludePath(includedirs);
+    }
+    IndexResults results;
+    if (!References.Load(ReferenceFile(), results))
+        return;
+    for (IndexResults::iterator iter = results.begin(); iter != results.end(); ++iter) {
+        SymbolList.RemoveIndexed(iter->first);
+        const IndexSymbols& symbols = iter->second.Symbols;
+        for (unsigned idx = 0; idx < symbols.size(); idx++)
+            SymbolList.AddIndexed(iter->first, symbols[idx].Name, symbols[idx].Syntax, symbols[idx].Summary, symbols[idx].Line);
+        if (Indexer)
+            Indexer->Seed(iter->first, iter->second.Stamp);
+    }
+    SymbolList.Update();
+    FillSymBrowser();
+}
+
+/** WorkspaceDirs() returns the directories of the open source files, of the
+ *  workspace and of the include path.
+ */
+void QuincyFrame::WorkspaceDirs(wxArrayString& dirs)
+{
+    for (int idx = 0; idx < MAX_EDITORS; idx++)
+        if (Editor[idx] && IsPawnFile(Filename[idx], true) && dirs.Index(wxPathOnly(Filename[idx])) == wxNOT_FOUND)
+            dirs.Add(wxPathOnly(Filename[idx]));
+    if (strWorkspace.Length() > 0 && dirs.Index(wxPathOnly(strWorkspace)) == wxNOT_FOUND)
+        dirs.Add(wxPathOnly(strWorkspace));
+    wxArrayString includedirs;
+    IncludeDirs(includedirs);
+    for (unsigned idx = 0; idx < includedirs.Count(); idx++)
+        if (dirs.Index(includedirs[idx]) == wxNOT_FOUND)
+            dirs.Add(includedirs[idx]);
+}
+
+/** IncludeDirs() returns the directories in which the compiler looks for
+ *  include files: those of the include path, followed by the "include"
+ *  directory of the compiler (next to its "bin" directory).
+ */
+void QuincyFrame::IncludeDirs(wxArrayString& dirs)
+{
+    wxStringTokenizer tokenizer(strIncludePath, ";");
+    while (tokenizer.HasMoreTokens()) {
+        wxString path = tokenizer.GetNextToken().Trim(true).Trim(false);
+        if (path.Length() > 0 && dirs.Index(path) == wxNOT_FOUND)
+            dirs.Add(path);
+    }
+    if (strCompilerPath.Length() > 0) {
+        wxFileName name = wxFileName::DirName(strCompilerPath);
+        if (name.GetDirCount() > 0 && name.GetDirs().Last().CmpNoCase("bin") == 0)
+            name.RemoveLastDir();
+        name.AppendDir("include");
+        wxString path = name.GetPath();
+        if (wxDirExists(path) && dirs.Index(path) == wxNOT_FOUND)
+            dirs.Add(path);
+    }
+}
+
+/** IncludeScope() returns the files that the script in the active editor
+ *  includes (directly or indirectly), plus the script itself and the file
+ *  "default.inc" that the compiler includes implicitly, as ids of the full
+ *  paths in the string pool. The set is empty if the script was not indexed
+ *  yet. It is kept until another script becomes active, or until the indexer
+ *  has new results.
+ */
+const std::set<unsigned>& QuincyFrame::IncludeScope()
+{
+    wxString script;
+    wxStyledTextCtrl *edit = GetActiveEdit(EditTab);
+    int idx;
+    for (idx = 0; idx < MAX_EDITORS && (!edit || Editor[idx] != edit); idx++)
+        /* nothing */;
+    if (idx < MAX_EDITORS && Filename[idx].Length() > 0) {
+        wxFileName name(Filename[idx]);
+        name.Normalize(wxPATH_NORM_DOTS | wxPATH_NORM_ABSOLUTE);
+        script = name.GetFullPath();
+    }
+    if (script.Length() > 0 && script.Cmp(IncludeRoot) == 0)
+        return IncludeFiles;
+
+    IncludeRoot = script;
+    IncludeFiles.clear();
+    std::vector<wxString> includes;
+    if (script.IsEmpty() || !References.GetIncludes(script, includes))
+        return IncludeFiles;
+    std::vector<wxString> pending(1, script);
+    wxArrayString dirs;
+    IncludeDirs(dirs);
+    wxString implicit = CSourceIndexer::ResolveInclude("<default", wxEmptyString, dirs);
+    if (implicit.Length() > 0)
+        pending.push_back(implicit);
+    while (pending.size() > 0) {
+        wxString path = pending.back();
+        pending.pop_back();
+        if (!IncludeFiles.insert(CPoolString(path).Id()).second)
+            continue;   /* already seen */
+        if (References.GetIncludes(path, includes))
+            pending.insert(pending.end(), includes.begin(), includes.end());
+    }
+    return IncludeFiles;
+}
+
+/** InIncludeScope() returns false for a symbol from an include file that the
+ *  active script does not include; the scope is the set that IncludeScope()
+ *  returns (get it once, before testing a range of symbols). The symbols from
+ *  the reports and from other scripts are always in scope, and so are all
+ *  symbols when the includes of the script are not known.
+ */
+bool QuincyFrame::InIncludeScope(const CSymbolEntry* symbol, const std::set<unsigned>& scope)
+{
+    wxASSERT(symbol);
+    if (!symbol->Indexed)
+        return true;
+    if (scope.empty() || scope.count(symbol->Source.Id()) > 0)
+        return true;
+    return IsPawnFile(symbol->Source.Str(), false);
+}
+
+/** OpenIncludeFile() opens the file of the #include or #tryinclude directive
+ *  on the line (or activates its editor, if it is already open). It returns
+ *  false if the line holds no such directive.
+ */
+bool QuincyFrame::OpenIncludeFile(wxStyledTextCtrl* edit, int line)
+{
+    wxASSERT(edit);
+    wxScopedCharBuffer utf8 = edit->GetLine(line).utf8_str();
+    IndexSymbols symbols;
+    std::vector<wxString> includes;
+    CSourceIndexer::Parse(utf8.data(), utf8.length(), symbols, NULL, &includes);
+    if (includes.empty())
+        return false;
+
+    int idx;
+    for (idx = 0; idx < MAX_EDITORS && Editor[idx] != edit; idx++)
+        /* nothing */;
+    wxString sourcedir = (idx < MAX_EDITORS && Filename[idx].Length() > 0) ? wxPathOnly(Filename[idx]) : strCurrentDirectory;
+    wxArrayString dirs;
+    IncludeDirs(dirs);
+    wxString path = CSourceIndexer::ResolveInclude(includes[0], sourcedir, dirs);
+    if (path.IsEmpty()) {
+        wxMessageBox("Include file \"" + includes[0].Mid(1) + "\" not found.", "Pawn IDE", wxOK | wxICON_ERROR);
+        return true;
+    }
+
+    if (ShowEditor(path))
+        QueueIndex(path);
+    return true;
+}
+
+void QuincyFrame::OnIndexerEvent(wxThreadEvent& /* event */)
+{
+    IndexResults results;
+    if (!Indexer || !Indexer->TakeResults(results))
+        return;
+    IncludeRoot.Clear();    /* the include graph may have changed */
+    for (IndexResults::iterator iter = results.begin(); iter != results.end(); ++iter) {
+        References.Update(iter->first, iter->second);
+        SymbolList.RemoveIndexed(iter->first);
+        const IndexSymbols& symbols = iter->second.Symbols;
+        for (unsigned idx = 0; idx < symbols.size(); idx++)
+            SymbolList.AddIndexed(iter->first, symbols[idx].Name, symbols[idx].Syntax, symbols[idx].Summary, symbols[idx].Line);
+    }
+    SymbolList.Update();
+    FillSymBrowser();
+}
+
+void QuincyFrame::OnReportLoaderEvent(wxThreadEvent& /* event */)
+{
+    ReportTables reports;
+    if (!ReportLoader || !ReportLoader->TakeResults(reports))
+        return;
+    SymbolList.MergeReports(reports);
+    FillSymBrowser();
 }
 
 bool QuincyFrame::ReadInfoTips()
 {
     InfoTipList.clear();    /* delete any current contents */
+    InfoTipKeywords.clear();
 
     /* build the filename */
     wxString pathname;
@@ -4658,44 +6747,49 @@ bool QuincyFrame::ReadInfoTips()
                 }
                 wxString def = line.Left(namelength);
                 wxString descr = line.Mid(namelength).Trim(false);
-                /* add it to the list */
-                InfoTipList.insert(std::make_pair(keyword, def + "\n" + descr));
+                /* add it to the list, on the name only (for a public
+                   function, the keyword has the parameters too) */
+                wxString name = (keyword[0] == '@') ? keyword.BeforeFirst('(') : keyword;
+                unsigned id = StringPool.Intern(name);
+                if (InfoTipList.find(id) == InfoTipList.end()) {
+                    InfoTip& tip = InfoTipList[id];
+                    tip.Keyword = keyword;
+                    tip.Text = def + "\n" + descr;
+                    ParseParameters(def, tip.Params);
+                    InfoTipKeywords.push_back(tip.Keyword.UTF8());
+                }
             }
         }
     }
     flst.Close();
+    std::sort(InfoTipKeywords.begin(), InfoTipKeywords.end(), WordLess());
     return true;
 }
 
 wxString QuincyFrame::LookUpInfoTip(const wxString& keyword, int flags)
 {
     if (flags & TIP_FUNCTION) {
-        std::map<wxString,wxString>::iterator iter = InfoTipList.begin();
-        while (iter != InfoTipList.end()) {
-            wxString key = iter->first;
-            if (key[0] == '@') {
-                int paren = key.Find('(');
-                if (paren > 0)
-                    key = key.Left(paren);
-            }
-            if (key.Cmp(keyword) == 0)
-                return iter->second;
-            ++iter;
+        unsigned id = StringPool.Find(keyword);
+        if (id != POOL_NONE) {
+            InfoTipMap::iterator iter = InfoTipList.find(id);
+            if (iter != InfoTipList.end())
+                return iter->second.Text.Str();
         }
     }
 
-    /* not found in the "info" files, see whether the symbol browser has it */
-    for (const CSymbolEntry* sym = SymbolList.Root(); sym; sym = sym->Next) {
-        if (sym->SymbolName.Length() > 1 && sym->SymbolName[1] == ':'
-            && keyword.Cmp(sym->SymbolName.Mid(2)) == 0 && sym->Syntax.Length() > 0)
-        {
+    /* not found in the "info" files, see whether the symbol browser has it
+       (in the files that the script includes) */
+    SymbolRange range = SymbolList.Lookup(keyword);
+    const std::set<unsigned>& scope = IncludeScope();
+    for (const CSymbolEntry* sym = range.first; sym != range.second; sym++) {
+        if (!sym->Syntax.IsEmpty() && InIncludeScope(sym, scope)) {
             if (((flags & TIP_FUNCTION) && sym->SymbolName[0] == 'M')
                 || ((flags & TIP_VARIABLE) && sym->SymbolName[0] == 'F')
                 || ((flags & TIP_CONSTANT) && sym->SymbolName[0] == 'C'))
             {
-                wxString item = sym->Syntax;
-                if (sym->Summary.Length() > 0)
-                    item += "\n" + sym->Summary;
+                wxString item = sym->Syntax.Str();
+                if (!sym->Summary.IsEmpty())
+                    item += "\n" + sym->Summary.Str();
                 return item;
             }
         }
@@ -4866,6 +6960,11 @@ void QuincyFrame::SetEditorsStyle(wxStyledTextCtrl *edit)
     sz.SetWidth((sz.GetWidth() * 8) / 10);
     tipfont.SetPixelSize(sz);
     edit->StyleSetFont(wxSTC_STYLE_CALLTIP, tipfont);
+
+    edit->StyleSetFont(STYLE_PROFILE, tipfont);
+    edit->StyleSetForeground(STYLE_PROFILE, theApp->EditColours[CLR_COMMENTS]);
+    edit->StyleSetBackground(STYLE_PROFILE, theApp->EditColours[CLR_BACKGROUND]);
+    edit->StyleSetItalic(STYLE_PROFILE, true);
 }
 
 void QuincyFrame::OnSelectContext(wxCommandEvent& event)
@@ -4885,164 +6984,534 @@ void QuincyFrame::OnSelectContext(wxCommandEvent& event)
     }
 }
 
-/** ScanContext() scans the current editor file in small chunks. It returns true
- *  when it has completed, or false when it needs to be called again to finish.
+/** ScanContext() makes the editor the active one for the function list, and
+ *  scans the lines that changed since the previous scan, in small chunks. It
+ *  returns true when it has completed, or false when it needs to be called
+ *  again to finish.
  */
 bool ContextParse::ScanContext(wxStyledTextCtrl* edit, int flags)
 {
-    if (edit != activeedit)
-        flags |= CTX_RESET;
-    if ((flags & CTX_RESET) || (flags & CTX_FULL))
-        flags |= CTX_RESTART;
     bool updatectrl = false;
-    if (flags & CTX_RESTART) {
-        WorkNames.Clear();
-        WorkRanges.Clear();
-        startline = 0;
+    if (edit != activeedit) {
         activeedit = edit;
-        incomment = false;
-        inparamlist = false;
-        nestlevel = 0;
-        topline = -1;
-        context = wxEmptyString;
+        updatectrl = true;  /* show the list of the document (if it was scanned before) */
     }
-    if (flags & CTX_RESET) {
-        Names.Clear();
-        Ranges.Clear();
-        updatectrl = true;
+    if (!edit) {
+        if (choicectrl && shownnames.Count() > 0) {
+            shownnames.Clear();
+            choicectrl->Clear();
+        }
+        return true;
+    }
+
+    Document& doc = documents[edit];
+    if ((flags & CTX_RESET) || (flags & CTX_RESTART)) {
+        doc.dirtystart = 0;
+        doc.dirtyend = INT_MAX;
+        doc.scanstart = -1;
+        doc.Clean.clear();
+        if (flags & CTX_RESET) {
+            doc.Ranges.clear();
+            doc.NameIndex.clear();
+            updatectrl = true;
+        }
+    }
+
+    bool result = true;
+    if (doc.dirtystart >= 0) {
+        if (edit->GetLexer() == wxSTC_LEX_CPP) {
+            result = ScanLines(edit, doc, (flags & CTX_FULL) ? INT_MAX : CTX_LINES);
+        } else {
+            /* the scan relies on the styles that the lexer assigns */
+            doc.Ranges.clear();
+            doc.NameIndex.clear();
+            doc.Clean.clear();
+            doc.dirtystart = -1;
+        }
+        if (result)
+            updatectrl = true;
+    }
+    if (updatectrl)
+        UpdateControl(edit != NULL);
+    return result;
+}
+
+/** Modified() records a change in a document: the lines from linenr onwards
+ *  changed, and linesadded lines were inserted (or removed, if negative). The
+ *  positions of the functions below the change are adjusted right away; the
+ *  changed lines are scanned later.
+ */
+void ContextParse::Modified(wxStyledTextCtrl* edit, int linenr, int linesadded)
+{
+    std::map<wxStyledTextCtrl*, Document>::iterator iter = documents.find(edit);
+    if (iter == documents.end())
+        return;     /* document was never scanned, it is scanned in full when it becomes active */
+    Document& doc = iter->second;
+
+    /* lines removed from the document collapse onto the line of the change */
+    #define SHIFT(l)    ((l) <= linenr ? (l) : (linesadded < 0 && (l) <= linenr - linesadded) ? linenr : (l) + linesadded)
+    std::vector<Document::CleanLine> clean;
+    for (unsigned idx = 0; idx < doc.Clean.size(); idx++) {
+        int line = doc.Clean[idx].first;
+        if (line <= linenr || linesadded >= 0 || line > linenr - linesadded)
+            clean.push_back(Document::CleanLine(SHIFT(line), doc.Clean[idx].second));
+    }
+    doc.Clean.swap(clean);
+    for (unsigned idx = 0; idx < doc.Ranges.size(); idx++) {
+        doc.Ranges[idx].Top = SHIFT(doc.Ranges[idx].Top);
+        doc.Ranges[idx].Bottom = SHIFT(doc.Ranges[idx].Bottom);
+    }
+
+    int changed = linenr + (linesadded > 0 ? linesadded : 0);
+    if (doc.dirtystart < 0) {
+        doc.dirtystart = linenr;
+        doc.dirtyend = changed;
+    } else {
+        if (doc.dirtyend != INT_MAX)
+            doc.dirtyend = wxMax(SHIFT(doc.dirtyend), changed);
+        doc.dirtystart = wxMin(doc.dirtystart, linenr);
     }
+    #undef SHIFT
+    doc.scanstart = -1;     /* a scan in progress must start over */
+}
+
+/** Forget() drops the function list of a document that is closed. */
+void ContextParse::Forget(wxStyledTextCtrl* edit)
+{
+    documents.erase(edit);
+    if (edit == activeedit)
+        activeedit = NULL;
+}
+
+/* the style of the end-of-line character tells whether the next line starts
+   inside a comment (or a string that continues on the next line) */
+static int LineEndState(wxStyledTextCtrl* edit, int linenr)
+{
+    if (linenr < 0)
+        return 0;
+    int pos = edit->GetLineEndPosition(linenr);
+    return (pos < edit->GetLength()) ? (edit->GetStyleAt(pos) & 0x3f) : 0;
+}
+
+bool ContextParse::ScanLines(wxStyledTextCtrl* edit, Document& doc, int count)
+{
+    int linecount = edit->GetLineCount();
+    if (doc.scanstart < 0) {
+        /* start at the last clean line at or before the change */
+        std::vector<Document::CleanLine>::iterator iter = std::upper_bound(doc.Clean.begin(), doc.Clean.end(), Document::CleanLine(doc.dirtystart, INT_MAX));
+        doc.scanstart = (iter == doc.Clean.begin()) ? 0 : (iter - 1)->first;
+        doc.scanline = doc.scanstart;
+        doc.nestlevel = 0;
+        doc.parens = 0;
+        doc.context = wxEmptyString;
+        doc.topline = -1;
+        doc.WorkRanges.clear();
+        doc.WorkClean.clear();
+    }
+
+    int lastline = (count >= linecount - doc.scanline) ? linecount : doc.scanline + count;
+    /* make sure that the lexer has styled the lines */
+    int endpos = (lastline >= linecount) ? edit->GetLength() : edit->PositionFromLine(lastline);
+    if (edit->GetEndStyled() < endpos)
+        edit->Colourise(edit->GetEndStyled(), endpos);
+    if (doc.WorkClean.empty())
+        doc.WorkClean.push_back(Document::CleanLine(doc.scanstart, LineEndState(edit, doc.scanstart - 1)));
 
     if (!re.IsValid())
         re.Compile("^[[:blank:]]*(static[[:blank:]]+|)([A-Za-z@_][A-Za-z@_0-9]*:[[:blank:]]*|)([A-Za-z@_][A-Za-z@_0-9]*)[[:blank:]]*\\(", wxRE_EXTENDED);
-
-    /* run through the source code of the current document */
-    wxASSERT(edit == activeedit);
-    bool result = false;    /* assume not yet completed */
-    if (edit) {
-        int startline_save = startline;
-        int lastline;
-        if (flags & CTX_FULL) {
-            lastline = edit->GetLineCount();
-        } else {
-            lastline = startline + CTX_LINES;
-            if (lastline > edit->GetLineCount())
-                lastline = edit->GetLineCount();
-        }
-        wxASSERT(re.IsValid());
-        for (int idx = startline; idx < lastline; idx++) {
-            wxString line = edit->GetLine(idx);
-            if (line.Left(12).Cmp("timer_second")==0)
-                lastline = idx + 1;
-            /* strip line comments */
-            int pos;
-            if ((pos = line.Find("//")) >= 0)
-                line = line.Left(pos);
-            if (nestlevel == 0 && !incomment && re.Matches(line)) {
-                context = re.GetMatch(line, 3);
-                topline = idx;
-                inparamlist = true;
+    wxASSERT(re.IsValid());
+    for (int idx = doc.scanline; idx < lastline; idx++) {
+        ScanLine(edit, doc, idx);
+        if (doc.IsClean()) {
+            Document::CleanLine next(idx + 1, LineEndState(edit, idx));
+            doc.WorkClean.push_back(next);
+            /* the line must also start in the same lexer state as before */
+            if (next.first > doc.dirtyend && std::binary_search(doc.Clean.begin(), doc.Clean.end(), next)) {
+                /* the scan is back in step with the previous scan */
+                Merge(doc, next.first);
+                return true;
             }
-            bool instring = false;
-            bool escaped = false;
-            for (unsigned c = 0; c < line.Length(); c++) {
-                if (line[c] == '{' && !incomment && !instring && !inparamlist) {
-                    if (nestlevel == 0 && context.Length() > 0) {
-                        WorkNames.Add(context);
-                        wxASSERT(topline >= 0);
-                    }
-                    nestlevel++;
-                } else if (line[c] == '}' && !incomment && !instring && !inparamlist) {
-                    nestlevel--;
-                    if (nestlevel < 0)
-                        nestlevel = 0;
-                    if (nestlevel == 0  && context.Length() > 0) {
-                        wxASSERT(topline >= 0);
-                        btmline = idx;
-                        if (WorkRanges.Count() == WorkNames.Count() - 1)
-                            WorkRanges.Add((long)topline | ((long)btmline << 16));  /* with unbalanced braces, parsing fails */
-                        wxASSERT(WorkNames.Count() == WorkRanges.Count());
-                        context = wxEmptyString;
-                        topline = -1;
-                    }
-                } else if (line[c] == ')' && !incomment && !instring) {
-                    inparamlist = false;
-                } else if (line[c] == '"' && !incomment && !escaped) {
-                    instring = !instring;
-                } else if (line[c] == '/' && (c + 1) < line.Length() && line[c + 1] == '*' && !instring) {
-                    incomment = true;
-                } else if (line[c] == '*' && (c + 1) < line.Length() && line[c + 1] == '/' && !instring) {
-                    incomment = false;
+        }
+    }
+    doc.scanline = lastline;
+    if (lastline < linecount)
+        return false;
+    if (doc.WorkRanges.size() > 0 && doc.WorkRanges.back().Bottom < 0)
+        doc.WorkRanges.back().Bottom = linecount - 1;   /* closing brace is missing */
+    Merge(doc, -1);
+    return true;
+}
+
+static bool IsCodeStyle(int style)
+{
+    style &= 0x3f;  /* strip the flag for inactive code */
+    return style == wxSTC_C_WORD || style == wxSTC_C_WORD2 || style == wxSTC_C_IDENTIFIER;
+}
+
+static bool IsStatementKeyword(const wxString& word)
+{
+    static const char* keywords[] = { "assert", "case", "defined", "do", "else", "exit", "for",
+                                      "goto", "if", "return", "sizeof", "sleep", "state",
+                                      "switch", "tagof", "while" };
+    for (unsigned idx = 0; idx < WXSIZEOF(keywords); idx++)
+        if (word.Cmp(keywords[idx]) == 0)
+            return true;
+    return false;
+}
+
+void ContextParse::ScanLine(wxStyledTextCtrl* edit, Document& doc, int linenr)
+{
+    /* the text comes with the style of every character; comments and strings
+       are already marked by the lexer */
+    wxMemoryBuffer styled = edit->GetStyledText(edit->PositionFromLine(linenr), edit->GetLineEndPosition(linenr));
+    const unsigned char* text = (const unsigned char*)styled.GetData();
+    size_t length = styled.GetDataLen() / 2;
+
+    size_t first;
+    for (first = 0; first < length && (text[2 * first] == ' ' || text[2 * first] == '\t'); first++)
+        /* nothing */;
+    if (first < length && IsCodeStyle(text[2 * first + 1]) && ((doc.nestlevel == 0 && doc.parens == 0) || (first == 0 && doc.nestlevel > 0))) {
+        wxString line = edit->GetLine(linenr);
+        if (re.Matches(line) && !IsStatementKeyword(re.GetMatch(line, 3))) {
+            bool header = (doc.nestlevel == 0 && doc.parens == 0);
+            if (!header) {
+                /* a function header in the first column while still inside a
+                   function, means that a closing brace is missing; a call in
+                   the first column ends with a semicolon */
+                header = true;
+                for (size_t c = first; c < length && header; c++)
+                    if (text[2 * c] == ';' && (text[2 * c + 1] & 0x3f) == wxSTC_C_OPERATOR)
+                        header = false;
+                if (header) {
+                    if (doc.WorkRanges.size() > 0 && doc.WorkRanges.back().Bottom < 0)
+                        doc.WorkRanges.back().Bottom = (linenr > doc.WorkRanges.back().Top) ? linenr - 1 : linenr;
+                    doc.nestlevel = 0;
+                    doc.parens = 0;
                 }
-                if (line[c] == '\\')
-                    escaped = !escaped;
-                else
-                    escaped = false;
             }
-        } /* for (idx) */
-        startline = lastline;
-        if (startline >= edit->GetLineCount()) {
-            if (startline != startline_save) {
-                /* first see whether the work names are identical to the saved ones
-                   (the choice control does not need to be updated if they are) */
-                updatectrl = false;     /* preset */
-                if (Names.Count() != WorkNames.Count())
-                    updatectrl = true;
-                for (unsigned i =0; !updatectrl && i < WorkNames.Count(); i++)
-                    if (WorkNames[i].Cmp(Names[i]) != 0)
-                        updatectrl = true;
-                if (updatectrl)
-                    Names = WorkNames;
-                Ranges = WorkRanges;
-                WorkNames.Clear();
-                WorkRanges.Clear();
+            if (header) {
+                doc.context = re.GetMatch(line, 3);
+                doc.topline = linenr;
             }
-            result = true;
-        }
-    } else {
-        if (Names.Count() > 0) {
-            Names.Clear();
-            Ranges.Clear();
-            updatectrl = true;
         }
-        result = true;
     }
 
-    if (choicectrl && updatectrl) {
-        choicectrl->SetSelection(wxNOT_FOUND);
-        choicectrl->Set(Names);
-        if (edit) {
-            int pos = edit->GetCurrentPos();
-            int line = edit->LineFromPosition(pos);
-            currentselection = -1;  /* make invalid, to force ShowContext() to update */
-            ShowContext(line);
+    for (size_t c = 0; c < length; c++) {
+        if ((text[2 * c + 1] & 0x3f) != wxSTC_C_OPERATOR)
+            continue;
+        switch (text[2 * c]) {
+        case '(':
+            if (doc.nestlevel == 0 && doc.context.Length() > 0)
+                doc.parens++;
+            break;
+        case ')':
+            if (doc.parens > 0)
+                doc.parens--;
+            break;
+        case ';':
+            /* a declaration (a forward declaration or a native function) at
+               the top level, not a definition */
+            if (doc.nestlevel == 0 && doc.parens == 0) {
+                doc.context = wxEmptyString;
+                doc.topline = -1;
+            }
+            break;
+        case '{':
+            if (doc.parens > 0)
+                break;
+            if (doc.nestlevel == 0 && doc.context.Length() > 0) {
+                wxASSERT(doc.topline >= 0);
+                doc.WorkRanges.push_back(ContextRange(doc.context, doc.topline));
+            }
+            doc.nestlevel++;
+            break;
+        case '}':
+            if (doc.parens > 0)
+                break;
+            if (c == 0 && doc.nestlevel > 1)
+                doc.nestlevel = 1;  /* a brace in the first column closes the function */
+            doc.nestlevel--;
+            if (doc.nestlevel < 0)
+                doc.nestlevel = 0;  /* surplus closing brace */
+            if (doc.nestlevel == 0 && doc.context.Length() > 0) {
+                if (doc.WorkRanges.size() > 0 && doc.WorkRanges.back().Bottom < 0)
+                    doc.WorkRanges.back().Bottom = linenr;
+                doc.context = wxEmptyString;
+                doc.topline = -1;
+            }
+            break;
         }
     }
+}
 
-    return result;
+/** Merge() replaces the functions between the start of the scan and the given
+ *  line (or the end of the document, if line is -1) by the ones found in the
+ *  scan.
+ */
+void ContextParse::Merge(Document& doc, int line)
+{
+    std::vector<ContextRange> ranges;
+    /* no function spans a clean line, so a function is either before the
+       start of the scan, or after the line where it stopped */
+    unsigned idx;
+    for (idx = 0; idx < doc.Ranges.size() && doc.Ranges[idx].Bottom < doc.scanstart; idx++)
+        ranges.push_back(doc.Ranges[idx]);
+    ranges.insert(ranges.end(), doc.WorkRanges.begin(), doc.WorkRanges.end());
+    if (line >= 0) {
+        for ( ; idx < doc.Ranges.size(); idx++)
+            if (doc.Ranges[idx].Top >= line)
+                ranges.push_back(doc.Ranges[idx]);
+    }
+    doc.Ranges.swap(ranges);
+    doc.NameIndex.clear();
+    for (idx = 0; idx < doc.Ranges.size(); idx++)
+        if (doc.NameIndex.find(doc.Ranges[idx].Name) == doc.NameIndex.end())
+            doc.NameIndex[doc.Ranges[idx].Name] = idx;  /* for functions with states, keep the first */
+
+    /* the work list starts with the line at which the scan started */
+    std::vector<Document::CleanLine> clean(doc.Clean.begin(), std::lower_bound(doc.Clean.begin(), doc.Clean.end(), Document::CleanLine(doc.scanstart, INT_MIN)));
+    clean.insert(clean.end(), doc.WorkClean.begin(), doc.WorkClean.end());
+    if (line >= 0)
+        clean.insert(clean.end(), std::upper_bound(doc.Clean.begin(), doc.Clean.end(), Document::CleanLine(line, INT_MAX)), doc.Clean.end());
+    doc.Clean.swap(clean);
+
+    doc.WorkRanges.clear();
+    doc.WorkClean.clear();
+    doc.scanstart = -1;
+    doc.dirtystart = -1;
+}
+
+/** Find() returns the index of the function that holds the line, or -1. */
+int ContextParse::Find(const Document& doc, int linenr) const
+{
+    /* find the last function that starts at or before the line */
+    int low = 0, high = (int)doc.Ranges.size();
+    while (low < high) {
+        int mid = (low + high) / 2;
+        if (doc.Ranges[mid].Top <= linenr)
+            low = mid + 1;
+        else
+            high = mid;
+    }
+    if (low == 0 || doc.Ranges[low - 1].Bottom < linenr)
+        return -1;
+    return low - 1;
+}
+
+/** UpdateControl() sets the names of the active document in the choice
+ *  control, if these differ from the ones shown.
+ */
+void ContextParse::UpdateControl(bool force)
+{
+    if (!choicectrl)
+        return;
+    wxArrayString names;
+    if (activeedit) {
+        const Document& doc = documents[activeedit];
+        for (unsigned idx = 0; idx < doc.Ranges.size(); idx++)
+            names.Add(doc.Ranges[idx].Name);
+    }
+    bool changed = (names.Count() != shownnames.Count());
+    for (unsigned idx = 0; !changed && idx < names.Count(); idx++)
+        if (names[idx].Cmp(shownnames[idx]) != 0)
+            changed = true;
+    if (changed) {
+        shownnames = names;
+        choicectrl->SetSelection(wxNOT_FOUND);
+        choicectrl->Set(shownnames);
+    }
+    if ((changed || force) && activeedit) {
+        int line = activeedit->LineFromPosition(activeedit->GetCurrentPos());
+        currentselection = -1;  /* make invalid, to force ShowContext() to update */
+        ShowContext(line);
+    }
 }
 
 void ContextParse::ShowContext(int linenr)
 {
-    if (choicectrl) {
-        int newidx = -1;
-        for (unsigned idx = 0; idx < Ranges.Count() && newidx < 0; idx++)
-            if (linenr >= (Ranges[idx] & 0xffff) && linenr <= ((Ranges[idx] >> 16) & 0xffff))
-                newidx = idx;
+    if (choicectrl && activeedit) {
+        const Document& doc = documents[activeedit];
+        int newidx = Find(doc, linenr);
         if (newidx != currentselection) {
             currentselection = newidx;
-            int newsel = (newidx >= 0 && newidx < (int)Names.Count()) ? choicectrl->FindString(Names[newidx]) : wxNOT_FOUND;
+            int newsel = (newidx >= 0) ? choicectrl->FindString(doc.Ranges[newidx].Name) : wxNOT_FOUND;
             choicectrl->SetSelection(newsel);
         }
     }
 }
 
+wxString ContextParse::GetContext(wxStyledTextCtrl* edit, int linenr) const
+{
+    std::map<wxStyledTextCtrl*, Document>::const_iterator iter = documents.find(edit);
+    if (!edit || iter == documents.end())
+        return wxEmptyString;
+    int idx = Find(iter->second, linenr);
+    return (idx >= 0) ? iter->second.Ranges[idx].Name : wxString(wxEmptyString);
+}
+
 int ContextParse::Lookup(const wxString& name)
 {
-    unsigned idx;
-    for (idx = 0; idx < Names.Count() && Names[idx] != name; idx++)
-        /* nothing */;
-    if (idx >= Names.Count())
+    if (!activeedit)
+        return wxNOT_FOUND;
+    const Document& doc = documents[activeedit];
+    ContextNameIndex::const_iterator iter = doc.NameIndex.find(name);
+    if (iter == doc.NameIndex.end())
         return wxNOT_FOUND;
-    wxASSERT(idx < Ranges.Count());
-    return (int)(Ranges[idx] & 0xffff);
-}
\ No newline at end of file
+    wxASSERT(iter->second >= 0 && iter->second < (int)doc.Ranges.size());
+    return doc.Ranges[iter->second].Top;
+}
+
+/** Update() scans the lines of the document that changed (or all lines, for
+ *  a document that was not indexed before), up to a maximum number of lines.
+ *  It returns true when the index is up to date.
+ */
+bool CompletionIndex::Update(wxStyledTextCtrl* edit, int count)
+{
+    if (!edit)
+        return true;
+    Document& doc = documents[edit];
+    if ((int)doc.Lines.size() != edit->GetLineCount()) {
+        /* new document (or the index is out of step): scan all lines */
+        doc.Lines.assign(edit->GetLineCount(), Line());
+        doc.Words.clear();
+        doc.dirtystart = 0;
+        doc.dirtyend = doc.Lines.size();
+    }
+    while (doc.dirtystart < doc.dirtyend && count > 0) {
+        int linenr = doc.dirtystart++;
+        if (!doc.Lines[linenr].Dirty)
+            continue;
+        bool comment = doc.Lines[linenr].Comment;
+        ScanLine(edit, doc, linenr);
+        count--;
+        if (doc.Lines[linenr].Comment != comment && linenr + 1 < (int)doc.Lines.size()) {
+            /* a comment starts or ends on this line, the next line changes too */
+            doc.Lines[linenr + 1].Dirty = true;
+            if (doc.dirtyend < linenr + 2)
+                doc.dirtyend = linenr + 2;
+        }
+    }
+    return doc.dirtystart >= doc.dirtyend;
+}
+
+/** Modified() records a change in a document, see ContextParse::Modified().
+ *  Lines that are inserted are scanned later; the words of lines that are
+ *  removed are dropped right away.
+ */
+void CompletionIndex::Modified(wxStyledTextCtrl* edit, int linenr, int linesadded)
+{
+    std::map<wxStyledTextCtrl*, Document>::iterator iter = documents.find(edit);
+    if (iter == documents.end())
+        return;     /* document was never indexed, it is scanned in full when needed */
+    Document& doc = iter->second;
+    int linecount = doc.Lines.size();
+    if (linenr < 0 || linenr >= linecount || linenr + 1 - linesadded > linecount) {
+        documents.erase(iter);  /* out of step, build the index again */
+        return;
+    }
+
+    /* the line after the change must see the comment state that the line
+       before it had in the previous scan */
+    if (linesadded > 0) {
+        Line line;
+        line.Comment = doc.Lines[linenr].Comment;
+        doc.Lines.insert(doc.Lines.begin() + linenr + 1, linesadded, line);
+    } else if (linesadded < 0) {
+        int last = linenr + 1 - linesadded;
+        for (int idx = linenr + 1; idx < last; idx++)
+            RemoveWords(doc, doc.Lines[idx]);
+        doc.Lines[linenr].Comment = doc.Lines[last - 1].Comment;
+        doc.Lines.erase(doc.Lines.begin() + linenr + 1, doc.Lines.begin() + last);
+    }
+    doc.Lines[linenr].Dirty = true;
+
+    int changed = linenr + 1 + (linesadded > 0 ? linesadded : 0);
+    if (doc.dirtystart >= doc.dirtyend) {
+        doc.dirtystart = linenr;
+        doc.dirtyend = changed;
+    } else {
+        if (doc.dirtyend > linenr)
+            doc.dirtyend = wxMax(doc.dirtyend + linesadded, linenr + 1);
+        doc.dirtystart = wxMin(doc.dirtystart, linenr);
+        doc.dirtyend = wxMax(doc.dirtyend, changed);
+    }
+}
+
+/** Forget() drops the index of a document that is closed. */
+void CompletionIndex::Forget(wxStyledTextCtrl* edit)
+{
+    documents.erase(edit);
+}
+
+/** Collect() brings the index up to date and returns the identifiers in the
+ *  document that start with the prefix (but that are longer than the prefix),
+ *  sorted and without duplicates. The words are valid until the document
+ *  changes.
+ */
+void CompletionIndex::Collect(wxStyledTextCtrl* edit, const char* prefix, std::vector<const char*>& words)
+{
+    Update(edit);
+    const Document& doc = documents[edit];
+    size_t length = strlen(prefix);
+    for (WordCount::const_iterator iter = doc.Words.lower_bound(prefix); iter != doc.Words.end() && strncmp(iter->first.c_str(), prefix, length) == 0; ++iter)
+        if (iter->first.length() > length)
+            words.push_back(iter->first.c_str());
+}
+
+static bool IsWordChar(char c)
+{
+    return isalnum((unsigned char)c) || c == '_' || c == '@' || (unsigned char)c >= 0x80;
+}
+
+void CompletionIndex::ScanLine(wxStyledTextCtrl* edit, Document& doc, int linenr)
+{
+    Line& line = doc.Lines[linenr];
+    RemoveWords(doc, line);
+    bool comment = (linenr > 0) ? doc.Lines[linenr - 1].Comment : false;
+    wxCharBuffer buffer = edit->GetLineRaw(linenr);
+    const char* text = buffer.data();
+    size_t length = text ? strlen(text) : 0;
+    size_t idx = 0;
+    while (idx < length) {
+        char c = text[idx];
+        if (comment) {
+            if (c == '*' && text[idx + 1] == '/') {
+                comment = false;
+                idx++;
+            }
+            idx++;
+        } else if (c == '/' && text[idx + 1] == '/') {
+            break;
+        } else if (c == '/' && text[idx + 1] == '*') {
+            comment = true;
+            idx += 2;
+        } else if (c == '"' || c == '\'') {
+            /* literals end at the end of the line */
+            for (idx++; idx < length && text[idx] != c; idx++)
+                if (text[idx] == '\\' && idx + 1 < length)
+                    idx++;
+            idx++;
+        } else if (IsWordChar(c)) {
+            size_t start = idx;
+            while (idx < length && IsWordChar(text[idx]))
+                idx++;
+            if (!isdigit((unsigned char)c)) {   /* skip numbers */
+                WordCount::iterator word = doc.Words.insert(WordCount::value_type(std::string(text + start, idx - start), 0)).first;
+                word->second += 1;
+                line.Words.push_back(word);
+            }
+        } else {
+            idx++;
+        }
+    }
+    line.Comment = comment;
+    line.Dirty = false;
+}
+
+void CompletionIndex::RemoveWords(Document& doc, Line& line)
+{
+    for (unsigned idx = 0; idx < line.Words.size(); idx++)
+        if (--line.Words[idx]->second == 0)
+            doc.Words.erase(line.Words[idx]);
+    line.Words.clear();
+}
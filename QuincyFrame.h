@@ -23,9 +23,11 @@
 #include <wx/dnd.h>
 #include <wx/event.h>
 #include <wx/fdrepdlg.h>
+#include <wx/hashmap.h>
 #include <wx/icon.h>
 #include <wx/listctrl.h>
 #include <wx/process.h>
+#include <wx/progdlg.h>
 #include <wx/regex.h>
 #include <wx/splitter.h>
 #include <wx/stc/stc.h>
@@ -35,8 +37,23 @@
 #include <wx/aui/aui.h>
 #include <wx/aui/auibar.h>
 #include <wx/aui/auibook.h>
+#include <deque>
+#include <limits.h>
+#include <map>
+#include <set>
+#include <string.h>
+#include <string>
+#include <vector>
+#include "DeviceSimulator.h"
+#include "ExecSession.h"
 #include "HelpIndex.h"
+#include "QuincyGotoPalette.h"
+#include "Profiler.h"
+#include "SerialMonitor.h"
+#include "SerialTransfer.h"
+#include "SourceIndexer.h"
 #include "SymbolBrowser.h"
+#include "VarInspector.h"
 
 #define MAX_EDITORS 32
 
@@ -50,59 +67,221 @@
 #define UI_DBGTOOLS 0x0080
 #define UI_FINDNEXT 0x0100
 
-#define CTX_RESTART 0x01    /* start scanning from top (change was detected) */
+#define CTX_RESTART 0x01    /* rescan the complete document */
 #define CTX_RESET   0x02    /* like CTX_RESTART, but also clears the list before starting the scan */
-#define CTX_FULL    0x04    /* like CTX_RESTART, but scans the complete file before returning */
-#define CTX_LINES   1
+#define CTX_FULL    0x04    /* scan all changed lines before returning */
+#define CTX_LINES   200     /* lines to scan per call (per idle event) */
+#define WORD_LINES  2000    /* lines to scan for identifiers per call (per idle event) */
+/* A function in a document, with the first and last lines (0-based) */
+struct ContextRange {
+    ContextRange(const wxString& name, int top) : Name(name), Top(top), Bottom(-1) {}
+    wxString Name;
+    int Top, Bottom;    /* Bottom is -1 while the closing brace was not yet found */
+};
+WX_DECLARE_STRING_HASH_MAP(int, ContextNameIndex);
+
+#define BROWSER_SECTIONS 3  /* constants, global variables, functions */
+/* A section in the symbol browser. The symbols in a section are kept on a key
+   that sorts like the symbol list; the tree items are only created when the
+   section is first expanded. */
+struct BrowserSection {
+    BrowserSection() : Populated(false) {}
+    wxTreeItemId Item;
+    bool Populated;     /* tree items exist for all symbols in the section */
+    std::map<wxString, wxTreeItemId> Shown; /* key -> tree item (only valid when Populated) */
+};
+
+/* An entry in the list of "info tips", stored on the name of the function
+   (for a public function, the keyword also has the parameters) */
+struct InfoTip {
+    CPoolString Keyword;
+    CPoolString Text;   /* definition and description, separated by a newline */
+    std::vector<CPoolString> Params;    /* names of the parameters in the definition */
+};
+WX_DECLARE_HASH_MAP(unsigned, InfoTip, wxIntegerHash, wxIntegerEqual, InfoTipMap); /* name id -> tip */
+
 class ContextParse {
 public:
     ContextParse() {
         choicectrl = NULL;
-        Names.Clear();
-        Ranges.Clear();
-        currentselection = -1;
         activeedit = NULL;
-        startline = 0;
-        nestlevel = 0;
-        incomment = inparamlist = false;
-        context = wxEmptyString;
-        topline = btmline = -1;
+        currentselection = -1;
     }
     void SetControl(wxChoice* ctrl) { choicectrl = ctrl; }
     void ShowContext(int linenr); /* sets the context name in the control */
     bool ScanContext(wxStyledTextCtrl* edit, int flags = 0);
+    void Modified(wxStyledTextCtrl* edit, int linenr, int linesadded);
+    void Forget(wxStyledTextCtrl* edit);
     int Lookup(const wxString& name);
+    wxString GetContext(wxStyledTextCtrl* edit, int linenr) const;
 
 private:
-    wxRegEx re;
+    /* The function list of a document, and the state of the scan. Only the
+       lines that were changed are scanned again: the scan starts at a "clean"
+       line (a line at the top level, outside any function) before the change,
+       and it stops at the first clean line after the change that was also a
+       clean line in the previous scan, with the same lexer state (a change
+       that opens a comment also changes the lines below it). */
+    struct Document {
+        Document() : dirtystart(0), dirtyend(INT_MAX), scanstart(-1), scanline(0),
+                     nestlevel(0), parens(0), topline(-1) {}
+        std::vector<ContextRange> Ranges;   /* sorted on the top line, no overlaps */
+        ContextNameIndex NameIndex;         /* function name -> index in Ranges */
+        typedef std::pair<int, int> CleanLine;  /* line number, lexer state at the end of the line above it */
+        std::vector<CleanLine> Clean;   /* clean lines, sorted */
+        int dirtystart, dirtyend;   /* changed lines; dirtystart is -1 if the lists are up to date */
+        int scanstart;              /* clean line at which the scan started, or -1 */
+        int scanline;               /* next line to scan */
+        int nestlevel;
+        int parens;                 /* nesting of parentheses in a function header */
+        wxString context;
+        int topline;
+        std::vector<ContextRange> WorkRanges;
+        std::vector<CleanLine> WorkClean;
+        bool IsClean() const { return nestlevel == 0 && parens == 0 && context.IsEmpty(); }
+    };
+    bool ScanLines(wxStyledTextCtrl* edit, Document& doc, int count);
+    void ScanLine(wxStyledTextCtrl* edit, Document& doc, int linenr);
+    void Merge(Document& doc, int line);
+    int Find(const Document& doc, int linenr) const;
+    void UpdateControl(bool force);
 
-    wxArrayString WorkNames;
-    wxArrayLong WorkRanges;
+    wxRegEx re;
+    std::map<wxStyledTextCtrl*, Document> documents;
     wxStyledTextCtrl* activeedit; /* active editor */
-    int startline;          /* line that the previous scan left off */
-    bool incomment;
-    bool inparamlist;
-    int nestlevel;
-    wxString context;
-    int topline, btmline;
-
-    wxArrayString Names;
-    wxArrayLong Ranges;
+    wxArrayString shownnames;   /* names in the choice control */
     wxChoice* choicectrl;   /* control with the updated choice lists */
     int currentselection;
 };
 
+/* for sorting the text of strings in the string pool (the pointers are stable) */
+struct WordLess {
+    bool operator()(const char* a, const char* b) const { return strcmp(a, b) < 0; }
+};
+
+class CompletionIndex {
+public:
+    bool Update(wxStyledTextCtrl* edit, int count = INT_MAX);
+    void Modified(wxStyledTextCtrl* edit, int linenr, int linesadded);
+    void Forget(wxStyledTextCtrl* edit);
+    void Collect(wxStyledTextCtrl* edit, const char* prefix, std::vector<const char*>& words);
+
+private:
+    /* The identifiers in a document (outside comments and strings), per line
+       and with a count for the whole document, sorted so that the words with
+       a prefix form a range. The words are owned by the document (and not
+       kept in the string pool), so that words that are removed from the
+       document (including the partial words while typing) are freed too. The
+       lines that changed are scanned again when the words are collected; a
+       line that starts or ends a comment also marks the next line as
+       changed. */
+    typedef std::map<std::string, unsigned> WordCount;
+    struct Line {
+        Line() : Dirty(true), Comment(false) {}
+        std::vector<WordCount::iterator> Words;
+        bool Dirty;
+        bool Comment;       /* inside a block comment at the end of the line */
+    };
+    struct Document {
+        Document() : dirtystart(0), dirtyend(0) {}
+        std::vector<Line> Lines;
+        WordCount Words;
+        int dirtystart, dirtyend;   /* range of lines that may be dirty (dirtyend is exclusive) */
+    };
+    void ScanLine(wxStyledTextCtrl* edit, Document& doc, int linenr);
+    void RemoveWords(Document& doc, Line& line);
+
+    std::map<wxStyledTextCtrl*, Document> documents;
+};
+
 #define DEBUG_NONE      0
 #define DEBUG_LOCAL     0x01
 #define DEBUG_REMOTE    0x02
 #define DEBUG_BOTH      (DEBUG_LOCAL | DEBUG_REMOTE)
 
+#define DBGQUERY_SETUP      0   /* watch or breakpoint command (no value is returned) */
+#define DBGQUERY_HOVER      1   /* value for a calltip */
+#define DBGQUERY_PREFETCH   2   /* value for the cache only */
+#define DBGQUERY_INSPECT    3   /* value for the inspector */
+#define DBGQUERY_LOG        4   /* value for a logging breakpoint */
+
+class DebugQuery {
+public:
+    DebugQuery(int type, const wxString& symbol, unsigned long stop)
+        : Type(type), Symbol(symbol), Stop(stop), Answered(false)
+        {}
+    int Type;
+    wxString Symbol;
+    unsigned long Stop;     /* the stop at which the query was sent */
+    bool Answered;
+};
+
+#define BPLOG_MAXLINES  1000    /* lines of logging breakpoints that are kept (older are dropped) */
+#define BPLOG_INTERVAL  250     /* milliseconds between updates of the output pane with the log */
+#define OUTPUT_MAXLINES 5000    /* maximum number of lines kept in the output pane while logging */
+#define MAX_SESSIONS    4       /* maximum number of scripts running next to the foreground session */
+#define SESSION_INTERVAL 1000   /* milliseconds between updates of the times in the session tabs */
+#define SESSION_POLL    50      /* milliseconds between reads of the output of the background sessions */
+
+class BreakpointCond {
+public:
+    BreakpointCond(wxStyledTextCtrl* edit, int handle)
+        : Edit(edit), Handle(handle), StopAt(0), Hits(0), Continued(0), Cost(0)
+        {}
+    wxStyledTextCtrl* Edit;
+    int Handle;             /* marker handle (follows the line when the text is edited) */
+    long StopAt;            /* the condition is met from this hit on (0 or 1 = every hit) */
+    wxString LogExpr;       /* if set, log this expression and continue, instead of stopping */
+    unsigned long Hits;
+    unsigned long Continued;/* number of hits where the IDE continued automatically */
+    wxLongLong Cost;        /* total time (in microseconds) spent handling these */
+};
+
+class DeviceTransfer {
+public:
+    enum { RUNNING, PASSED, FAILED };
+    DeviceTransfer(const wxString& port, long row)
+        : Port(port), Worker(NULL), Process(NULL), PID(0), Row(row), Status(RUNNING), Bytes(0), Rate(0)
+        {}
+    wxString Port;
+    CSerialTransfer* Worker;/* native transfer (or NULL) */
+    wxProcess* Process;     /* upload tool (or NULL) */
+    long PID;
+    long Row;               /* row in the build log */
+    int Status;
+    wxString Message;       /* reason for failure */
+    unsigned long Bytes;
+    long Rate;              /* bytes per second */
+    wxStopWatch Clock;
+};
+
+class LatencyStats {
+public:
+    LatencyStats() { Clear(); }
+    void Clear() { Start = -1; Count = 0; Total = 0; Min = 0; Max = 0; }
+    void Add(long msec)
+        {
+            if (Count == 0 || msec < Min)
+                Min = msec;
+            if (msec > Max)
+                Max = msec;
+            Total += msec;
+            Count++;
+        }
+    long Start;             /* milliseconds from launch to the first stop, -1 if unknown */
+    long Count;             /* number of steps measured */
+    long Total;
+    long Min;
+    long Max;
+};
+
 class QuincyFrame : public wxFrame
 {
     friend class DragAndDropFile;
 
 public:
     QuincyFrame(const wxString& title, const wxSize& size);
+    ~QuincyFrame();
 
     void AdjustTitle();
     virtual void OnCloseWindow(wxCloseEvent& event);
@@ -134,6 +313,8 @@ public:
     virtual void OnReplaceDlg(wxCommandEvent& event);
     virtual void OnGotoDlg(wxCommandEvent& event);
     virtual void OnGotoSymbol(wxCommandEvent& event);
+    virtual void OnFindReferences(wxCommandEvent& event);
+    virtual void OnGotoAnything(wxCommandEvent& event);
     virtual void OnMatchBrace(wxCommandEvent& event);
     virtual void OnFillColumn(wxCommandEvent& event);
     virtual void OnViewWhiteSpace(wxCommandEvent& event);
@@ -159,6 +340,8 @@ public:
     virtual void OnAbout(wxCommandEvent& event);
     virtual void OnHelp(wxCommandEvent& event);
     virtual void OnContextHelp(wxCommandEvent& event);
+    void ShowHelp(const wxString& word);
+    void CollectPaletteItems();
     virtual void OnAutoComplete(wxCommandEvent& event);
     virtual void OnIdle(wxIdleEvent& event);
     virtual void OnTerminateApp(wxProcessEvent& event);
@@ -180,8 +363,26 @@ public:
     virtual void OnWatchActivated(wxListEvent& event);
     virtual void OnWatchDelete(wxListEvent& event);
     virtual void OnSymbolSelect(wxTreeEvent& event);
+    virtual void OnSymbolExpanding(wxTreeEvent& event);
     virtual void OnTerminalChar(wxKeyEvent& event);
     virtual void OnSearchSelect(wxTreeEvent& event);
+    virtual void OnInspect(wxCommandEvent& event);
+    virtual void OnInspectExpanding(wxTreeEvent& event);
+    virtual void OnInspectActivated(wxTreeEvent& event);
+    virtual void OnInspectKeyDown(wxTreeEvent& event);
+    virtual void OnBreakpointProperties(wxCommandEvent& event);
+    virtual void OnProfile(wxCommandEvent& event);
+    virtual void OnProfileEvent(wxThreadEvent& event);
+    virtual void OnTransferEvent(wxThreadEvent& event);
+    virtual void OnTransferMulti(wxCommandEvent& event);
+    virtual void OnDeviceTransferEvent(wxThreadEvent& event);
+    virtual void OnSimulator(wxCommandEvent& event);
+    virtual void OnSerialBenchmark(wxCommandEvent& event);
+    virtual void OnBenchmarkEvent(wxThreadEvent& event);
+    virtual void OnIndexerEvent(wxThreadEvent& event);
+    virtual void OnReportLoaderEvent(wxThreadEvent& event);
+    virtual void OnProfileExport(wxCommandEvent& event);
+    virtual void OnProfileClear(wxCommandEvent& event);
 
     virtual void OnFindAction(wxFindDialogEvent& event);
     virtual void OnFindClose(wxFindDialogEvent& event);
@@ -189,6 +390,7 @@ public:
     virtual void OnReplaceAll(wxFindDialogEvent& event);
 
     virtual void OnEditorChange(wxStyledTextEvent& event);
+    virtual void OnEditorModified(wxStyledTextEvent& event);
     virtual void OnEditorCharAdded(wxStyledTextEvent& event);
     virtual void OnEditorPosition(wxStyledTextEvent& event);
     virtual void OnEditorDwellStart(wxStyledTextEvent& event);
@@ -229,6 +431,7 @@ public:
     void SetDebugBaudrate(long baud)                { DebugBaudrate = baud; }
     wxString GetDebugPort() const                   { return DebugPort; }
     void     SetDebugPort(const wxString& port)     { DebugPort = port; }
+    wxString GetTargetPort() const                  { return Simulator ? Simulator->GetPortName() : DebugPort; }
 
     wxString GetTargetHost() const                  { return strTargetHost; }
     void     SetTargetHost(const wxString& name)    { strTargetHost = name; }
@@ -276,8 +479,11 @@ private:
     wxListView* BuildLog;   /* Build */
     wxListView* ErrorLog;   /* Messages */
     wxTreeCtrl* BrowserTree;/* Symbols */
+    BrowserSection BrowserSections[BROWSER_SECTIONS];
     wxListView* WatchLog;   /* Watches */
     wxTextCtrl* Terminal;   /* Output */
+    wxTreeCtrl* InspectTree;/* Inspect */
+    SerialMonitor* Monitor; /* Monitor */
     wxTreeCtrl* SearchLog;  /* Search results */
 
     wxStyledTextCtrl* Editor[MAX_EDITORS];
@@ -299,17 +505,43 @@ private:
     void StripTrailingSpaces(wxStyledTextCtrl *edit);
     wxString OptionallyQuoteString(const wxString& string);
     bool IsPawnFile(const wxString& path, bool allow_inc = true);
-    void PrepareSearchLog();
+    void PrepareSearchLog(bool required = false);
     void SpaceToTab(bool indent_only);
     bool CompileSource(const wxString& script);
     bool TransferScript(const wxString& path);
-    bool RunCurrentScript(bool debug = false);
+    wxString UploadCommand(const wxString& path, const wxString& port);
+    bool RunCurrentScript(bool debug = false, bool profile = false);
     void HandleDebugResponse(const wxString& cmd);
     void SendDebugCommand(const wxString& cmd);
+    void QueueDebugStep(const wxString& cmd);
+    wxStyledTextCtrl* ShowDebugPosition(bool load);
+    void SendDebugQuery(const wxString& cmd, int type, const wxString& symbol = wxEmptyString);
+    void PumpDebugQueries();
+    void CollectPrefetch(wxStyledTextCtrl* edit);
+    bool LookUpValue(const wxString& symbol, wxString* value);
     void SendWatchList();
     void BuildBreakpointList();
     void SendBreakpointList();
+    int CheckBreakpointHit();
+    void ContinueFromBreakpoint();
+    void LogBreakpoint(const wxString& text);
+    void FlushBreakpointLog();
+    bool IsExecRunning() const { return Exec && Exec->IsRunning(); }
+    ExecSession* StartSession(const wxString& name, const wxString& command);
+    ExecSession* FindSession(long pid, wxWindow* output = NULL);
+    void UpdateSessionTabs();
+    bool StartProfiler(const wxString& amxfile);
+    void StopProfiler();
+    void StopTransfer();
+    DeviceTransfer* FindDeviceTransfer(const wxString& port, long pid = 0);
+    void FinishDeviceTransfer(DeviceTransfer* device, bool passed, const wxString& message);
+    void StopDeviceTransfers();
+    bool StartBenchmarkStep();
+    void StopBenchmark();
+    void ShowProfile(wxStyledTextCtrl* edit);
+    bool GetArrayDimensions(const wxString& word, wxStyledTextCtrl* edit, int line, wxArrayLong& dims);
     bool GotoSymbol(const CSymbolEntry* symbol);
+    wxStyledTextCtrl* ShowEditor(const wxString& filename);
 
     bool IgnoreChangeEvent;     /* ignore any "change" event of an editor, because the change is forced */
     long MatchBracePos[2];      /* brace matching should be */
@@ -339,7 +571,8 @@ private:
 
     wxString strRecentAMXName;  /* most recently compiled script (or empty on failure to build) */
     wxString strFixedAMXName;   /* name of the fixed compiled script (or empty) */
-    wxString UploadTool;        /* program to use for transferring the AMX file to the target */
+    wxString UploadTool;        /* program to use for transferring the AMX file to the target, optionally with arguments (%port% is replaced by the port) */
+    bool NativeTransfer;        /* transfer over the serial port by Quincy itself, instead of by pawndbg */
     wxString DeviceTool;        /* device-specific configuration tool */
     int DefaultOptimize;        /* default optimization level, depending on the target host */
     int MaxOptimize;            /* maximum optimization level supported by the target host */
@@ -349,9 +582,9 @@ private:
     int DebuggerEnabled;        /* whether the debugger is enabled, for local and/or remote debugging */
     int DebuggerSelected;       /* either local or remote (but never both) */
     bool AutoTransfer;          /* whether automatic transfer after build is selected */
-    long ExecPID;               /* process ID of running program/debugger */
-    wxProcess *ExecProcess;     /* I/O redirection */
-    wxString ExecInputQueue;    /* queue with text typed in the console pane */
+    ExecSession* Exec;          /* foreground session (program/debugger), in the "Output" tab */
+    std::vector<ExecSession*> Sessions; /* background sessions, each with its own tab */
+    wxLongLong SessionTime;     /* last update of the times in the session tabs */
     int DebugHoldback;          /* number characters held back, for recognizing the debugger output */
     bool DebugMode;             /* whether we are currently debugging */
     bool DebugRunning;
@@ -363,16 +596,61 @@ private:
     bool ChangedBreakpoints;    /* if true, the breakpoints must be reset */
     bool BuiltBreakpoints;      /* if true, the breakpoint list is ready to be sent */
     long CalltipPos;            /* position to use for the calltip (for "delayed" calltips)*/
+    CVarInspector Inspector;    /* paged view on arrays (values are fetched on demand) */
+    std::deque<DebugQuery> DebugQueries;    /* commands sent while stopped, that wait for a prompt */
+    unsigned long DebugStopCount;           /* incremented each time execution resumes */
+    wxString DebugScope;                    /* function that the execution point is in */
+    std::map<wxString, wxString> ValueCache;/* values at the current stop, key is "scope\tsymbol" */
+    wxString HoverRequest;                  /* symbol to evaluate for a calltip, when the debugger is free */
+    wxString HoverSymbol;                   /* symbol for the calltip that is waited for */
+    wxArrayString PrefetchList;             /* symbols near the execution point, to evaluate while idle */
+    wxLongLong InspectScanTime; /* time of the last check for elements scrolled into view */
+    wxArrayString StepQueue;    /* step commands typed while the previous step was still running */
+    bool DebugStepping;         /* whether the last resume command was a single step */
+    bool DebugMarkerShown;      /* whether the "current line" marker is set (not set during a stepping burst) */
+    wxLongLong StepRenderTime;  /* time that the execution point was last shown during a stepping burst */
+    std::map<long, wxString> DeferredWatches;   /* watch values received during a stepping burst */
+    std::vector<BreakpointCond> BreakpointConds;/* breakpoints with a hit count or a log expression */
+    int BreakpointHit;          /* index in BreakpointConds of a hit to continue from, or -1 */
+    bool BreakpointLogging;     /* whether the expression must be logged for this hit */
+    wxLongLong BreakpointHitTime;   /* time of the hit, to measure the cost of handling it */
+    std::deque<wxString> BreakpointLog; /* logged values, not yet shown in the output pane */
+    wxLongLong BreakpointLogTime;   /* time that the log was last moved to the output pane */
+    CProfiler* Profiler;        /* set while a profiling run is active */
+    CSerialTransfer* Transfer;  /* set while a native transfer runs */
+    wxProgressDialog* TransferProgress;
+    wxStopWatch TransferClock;
+    unsigned long TransferSize; /* size of the file being transferred */
+    std::map<wxString, TransferImage> TransferCache;    /* image last sent to each port (for patching) */
+    std::set<wxString> NoPatchPorts;    /* ports whose device did not reply to a patch request */
+    std::vector<DeviceTransfer*> DeviceTransfers;       /* transfers to multiple devices */
+    wxArrayString DeviceTransferPorts;  /* ports selected for the last transfer to multiple devices */
+    CDeviceSimulator* Simulator;        /* simulated device that replaces the debug port (or NULL) */
+    SimulatorOptions SimOptions;
+    CDeviceSimulator* BenchSimulator;   /* simulated device for the benchmark (or NULL) */
+    CSerialTransfer* BenchTransfer;
+    int BenchStep;
+    TransferImage BenchImage;           /* image sent in the first step, for the patch step */
+    wxStopWatch BenchClock;
+    wxLongLong DebugStartTime;  /* time that the debugger was launched, until the first stop */
+    wxLongLong DebugStepTime;   /* time that the last single step was sent, until the stop */
+    LatencyStats DebugLatency;  /* of the most recent debugging session */
+    ProfileFiles ProfileResults;/* line counts of the last profiling run */
+    ProfileFunctions ProfileFuncs;
+    wxString ProfileAMX;        /* compiled script of the last profiling run (for its line table) */
 
     int UIDisabledTools;        /* whether any of the toolbar buttons and menu items are disabled (if these items do not change state, there is no need to update the UI) */
 
     wxTimer* Timer;             /* for delayed actions */
+    wxTimer* SessionTimer;      /* for the I/O of the background sessions */
     virtual void OnTimer(wxTimerEvent& event);
+    virtual void OnSessionTimer(wxTimerEvent& event);
 
     unsigned long RectSelectChkSum; /* checksum to detect paste of rectangular selection */
     unsigned long CalcClipboardChecksum();
 
     ContextParse context;
+    CompletionIndex completion;
 
     wxFindReplaceDialog *FindDlg;
     wxFindReplaceData FindData;
@@ -381,8 +659,20 @@ private:
     void FindAllInEditor(wxStyledTextCtrl* edit, const wxString& fullpath = wxEmptyString);
 
     bool UpdateSymBrowser(const wxString& filename = wxEmptyString);
-
-    std::map<wxString, wxString> InfoTipList;
+    void FillSymBrowser();
+    wxTreeItemId InsertSymBrowserItem(const wxTreeItemId& section, const wxTreeItemId& previous, const wxString& key);
+    void IndexWorkspace();
+    void WorkspaceDirs(wxArrayString& dirs);
+    void IncludeDirs(wxArrayString& dirs);
+    void QueueIndex(const wxString& path);
+    wxString ReferenceFile() const;
+    void LoadReferences();
+    const std::set<unsigned>& IncludeScope();
+    bool InIncludeScope(const CSymbolEntry* symbol, const std::set<unsigned>& scope);
+    bool OpenIncludeFile(wxStyledTextCtrl* edit, int line);
+
+    InfoTipMap InfoTipList;
+    std::vector<const char*> InfoTipKeywords;   /* keywords of InfoTipList, sorted (see WordLess) */
     bool ReadInfoTips();
     void RebuildHelpMenu();
     void RebuildToolsMenu();
@@ -390,6 +680,12 @@ private:
 
     CHelpIndex* HelpIndex;
     CSymbolList SymbolList;
+    CSourceIndexer* Indexer;    /* parses the sources in the background, for the symbol list */
+    CReferenceIndex References; /* results of the indexer, with the uses of all identifiers */
+    wxString IncludeRoot;       /* script for which IncludeFiles was built (empty if it must be rebuilt) */
+    std::set<unsigned> IncludeFiles;    /* files that IncludeRoot includes, as ids in the string pool */
+    CPaletteItems PaletteItems; /* candidates of the "go to anything" palette (empty if these must be collected) */
+    CReportLoader* ReportLoader;/* reads the report files in the background */
 };
 
 class DragAndDropFile: public wxFileDropTarget {
@@ -405,12 +701,34 @@ private:
 #define PEND_DELETE_BM      0x04    /* caret on a line with a temporary bookmark */
 #define PEND_SWITCHEDIT     0x08    /* TAB is active, but should set focus to the active editor */
 
+/* The data of an item in the symbol browser is the key of the symbol (type
+   and name, syntax and source file, separated by TABs); the symbol is looked
+   up when needed, because the list changes while the tree is kept. */
 class BrowserItemData : public wxTreeItemData {
 public:
-    BrowserItemData(const CSymbolEntry* symbol) { m_symbol = symbol; }
-    const CSymbolEntry* Symbol() const { return m_symbol; }
+    BrowserItemData(const wxString& key) { m_key = key; }
+    static wxString Key(const CSymbolEntry* symbol)
+        { return symbol->SymbolName.Str() + "\t" + symbol->Syntax.Str() + "\t" + symbol->Source.Str(); }
+    const CSymbolEntry* Symbol(const CSymbolList& list) const
+        {
+            wxString symname = m_key.BeforeFirst('\t');
+            SymbolRange range = list.Lookup(symname.Mid(2));
+            for (const CSymbolEntry* entry = range.first; entry != range.second; entry++)
+                if (Key(entry) == m_key)
+                    return entry;
+            return NULL;
+        }
 private:
-    const CSymbolEntry* m_symbol;
+    wxString m_key;
+};
+
+/* The data of an item in the search results, for a match in a line: the
+   position and the length of the match, to select it. */
+class SearchItemData : public wxTreeItemData {
+public:
+    SearchItemData(int column, int length) : Column(column), Length(length) {}
+    int Column;     /* in bytes, from the start of the line */
+    int Length;
 };
 
 #define TIP_FUNCTION    0x01
@@ -427,7 +745,14 @@ enum {
     MARKER_NAVIGATE,
     MARKER_BREAKPOINT,
     MARKER_CURRENTLINE,
+    MARKER_HEAT1,       /* heat map levels of the profiler, from cold to hot */
+    MARKER_HEAT2,
+    MARKER_HEAT3,
+    MARKER_HEAT4,
 };
+#define MASK_HEAT   ((1 << MARKER_HEAT1) | (1 << MARKER_HEAT2) | (1 << MARKER_HEAT3) | (1 << MARKER_HEAT4))
+#define MARGIN_HEAT 2   /* margin for the heat map */
+#define STYLE_PROFILE 100   /* style for the annotations of the profiler (above the lexer styles) */
 
 enum {
     /* the order in this enum must be the same as the order in which the TABs are created */
@@ -436,6 +761,8 @@ enum {
     TAB_SYMBOLS,
     TAB_WATCHES,
     TAB_OUTPUT,
+    TAB_INSPECT,
+    TAB_MONITOR,
     TAB_SEARCH,
 };
 
@@ -448,6 +775,8 @@ enum {
     IDM_FINDNEXT,
     IDM_MATCHBRACE,
     IDM_GOTOSYMBOL,
+    IDM_FINDREFERENCES,
+    IDM_GOTOANYTHING,
     IDM_BOOKMARKTOGGLE,
     IDM_BOOKMARKNEXT,
     IDM_BOOKMARKPREV,
@@ -468,6 +797,7 @@ enum {
     IDM_BREAKPOINTTOGGLE,
     IDM_BREAKPOINTCLEAR,
     IDM_BREAKPOINTLIST,
+    IDM_BREAKPOINTPROPS,
     IDM_TABSTOSPACES,
     IDM_SPACESTOTABS,
     IDM_INDENTSTOTABS,
@@ -476,11 +806,21 @@ enum {
     IDM_CONTEXTHELP,
     IDM_SELECTCONTEXT,
     IDM_SAMPLEBROWSER,
+    IDM_INSPECT,
+    IDM_PROFILE,
+    IDM_PROFILEEXPORT,
+    IDM_PROFILECLEAR,
+    IDM_TRANSFERMULTI,
+    IDM_SIMULATOR,
+    IDM_SERIALBENCH,
+    IDM_INDEXER,
+    IDM_REPORTLOADER,
     //-----
     IDM_RECENTFILE1,
     IDM_RECENTWORKSPACE1 = IDM_RECENTFILE1 + MAX_RECENTFILES,
     IDM_HELP1 = IDM_RECENTWORKSPACE1 + MAX_RECENTWORKSPACES,
     IDM_TIMER = IDM_HELP1 + MAX_HELPFILES,
+    IDM_SESSIONTIMER,
     //-----
     IDC_EDIT,   /* must remain last */
 };
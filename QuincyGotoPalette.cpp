@@ -0,0 +1,236 @@
+/*  Quincy IDE for the Pawn scripting language
+ *
+ *  Copyright CompuPhase, 2009-2024
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License"); you may not
+ *  use this file except in compliance with the License. You may obtain a copy
+ *  of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS, WITHOUT
+ *  WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. See the
+ *  License for the specific language governing permissions and limitations
+ *  under the License.
+ *
+ *  Version: $Id$
+ */
+#include "wxQuincy.h"
+#include <algorithm>
+#include <ctype.h>
+#include "QuincyGotoPalette.h"
+
+static inline char Lower(char c)
+{
+    return (c >= 'A' && c <= 'Z') ? (char)(c - 'A' + 'a') : c;
+}
+
+static bool ScoreLess(const std::pair<int, unsigned>& a, const std::pair<int, unsigned>& b)
+{
+    if (a.first != b.first)
+        return a.first > b.first;   /* highest score first */
+    return a.second < b.second;     /* then in the order of the candidates */
+}
+
+void CFuzzyMatcher::Clear()
+{
+    m_keys.clear();
+    m_offsets.clear();
+    m_offsets.push_back(0);
+    m_query.clear();
+    m_matches.clear();
+}
+
+void CFuzzyMatcher::Add(const wxString& key)
+{
+    wxScopedCharBuffer utf8 = key.utf8_str();
+    m_keys.append(utf8.data(), utf8.length());
+    m_keys += '\0';
+    m_offsets.push_back(m_keys.length());
+}
+
+/* Score() returns -1 if the key does not match the query (which is in lower
+   case), or a score that is higher for a better match */
+int CFuzzyMatcher::Score(unsigned idx, const std::string& query) const
+{
+    const char* key = m_keys.data() + m_offsets[idx];
+    unsigned length = m_offsets[idx + 1] - m_offsets[idx] - 1;
+    if (length < query.length())
+        return -1;
+    int score = 0;
+    int run = 0;
+    size_t pos = 0;
+    for (unsigned k = 0; k < length && pos < query.length(); k++) {
+        char c = key[k];
+        if (Lower(c) != query[pos]) {
+            run = 0;
+            continue;
+        }
+        int bonus = 1;
+        if (k == 0)
+            bonus += 10;
+        else if ((unsigned char)key[k - 1] < 0x80 && !isalnum((unsigned char)key[k - 1]))
+            bonus += 8;     /* start of a word */
+        else if (isupper((unsigned char)c) && islower((unsigned char)key[k - 1]))
+            bonus += 7;     /* start of a word in "camel case" */
+        if (run > 0)
+            bonus += 3;     /* consecutive characters */
+        run++;
+        score += bonus;
+        pos++;
+    }
+    if (pos < query.length())
+        return -1;
+    if (length == query.length())
+        score += 10;        /* exact match */
+    return score * 64 - (int)(length < 63 ? length : 63);   /* on a tie, prefer the shorter key */
+}
+
+/* Match() returns the best matches (up to "limit"), sorted on the score, and
+ * the total number of matches. An empty query matches all candidates, which
+ * are returned in the order that they were added.
+ */
+unsigned CFuzzyMatcher::Match(const wxString& query, std::vector<unsigned>& result, unsigned limit)
+{
+    wxScopedCharBuffer utf8 = query.utf8_str();
+    std::string lower(utf8.data(), utf8.length());
+    for (size_t idx = 0; idx < lower.length(); idx++)
+        lower[idx] = Lower(lower[idx]);
+
+    result.clear();
+    if (lower.empty()) {
+        m_query.clear();
+        m_matches.clear();
+        for (unsigned idx = 0; idx < Count() && idx < limit; idx++)
+            result.push_back(idx);
+        return Count();
+    }
+
+    /* if the query only got longer, the matches are a subset of the previous
+       matches */
+    bool narrow = m_query.length() > 0 && lower.compare(0, m_query.length(), m_query) == 0;
+    std::vector< std::pair<int, unsigned> > scored;
+    if (narrow) {
+        for (unsigned idx = 0; idx < m_matches.size(); idx++) {
+            int score = Score(m_matches[idx], lower);
+            if (score >= 0)
+                scored.push_back(std::make_pair(score, m_matches[idx]));
+        }
+    } else {
+        for (unsigned idx = 0; idx < Count(); idx++) {
+            int score = Score(idx, lower);
+            if (score >= 0)
+                scored.push_back(std::make_pair(score, idx));
+        }
+    }
+    m_query = lower;
+    m_matches.resize(scored.size());
+    for (unsigned idx = 0; idx < scored.size(); idx++)
+        m_matches[idx] = scored[idx].second;
+
+    unsigned count = scored.size();
+    if (limit > count)
+        limit = count;
+    std::partial_sort(scored.begin(), scored.begin() + limit, scored.end(), ScoreLess);
+    for (unsigned idx = 0; idx < limit; idx++)
+        result.push_back(scored[idx].second);
+    return count;
+}
+
+
+QuincyGotoPalette::QuincyGotoPalette(wxWindow* parent, CPaletteItems& candidates)
+    : wxDialog(parent, wxID_ANY, "Go to anything", wxDefaultPosition, wxDefaultSize, wxDEFAULT_DIALOG_STYLE | wxRESIZE_BORDER),
+      m_candidates(candidates)
+{
+    m_selected = NULL;
+
+    wxBoxSizer* bSizer = new wxBoxSizer(wxVERTICAL);
+    m_search = new wxTextCtrl(this, wxID_ANY, wxEmptyString, wxDefaultPosition, wxDefaultSize, wxTE_PROCESS_ENTER);
+    bSizer->Add(m_search, 0, wxEXPAND | wxALL, 8);
+    m_list = new wxListView(this, wxID_ANY, wxDefaultPosition, wxSize(600, 320), wxLC_REPORT | wxLC_SINGLE_SEL);
+    m_list->InsertColumn(0, "Name", wxLIST_FORMAT_LEFT, 200);
+    m_list->InsertColumn(1, "Kind", wxLIST_FORMAT_LEFT, 60);
+    m_list->InsertColumn(2, "Details", wxLIST_FORMAT_LEFT, 320);
+    bSizer->Add(m_list, 1, wxEXPAND | wxLEFT | wxRIGHT, 8);
+    m_status = new wxStaticText(this, wxID_ANY, wxEmptyString);
+    bSizer->Add(m_status, 0, wxEXPAND | wxALL, 8);
+    SetSizerAndFit(bSizer);
+    Centre();
+
+    m_search->Connect(wxEVT_COMMAND_TEXT_UPDATED, wxCommandEventHandler(QuincyGotoPalette::OnText), NULL, this);
+    m_search->Connect(wxEVT_COMMAND_TEXT_ENTER, wxCommandEventHandler(QuincyGotoPalette::OnEnter), NULL, this);
+    m_search->Connect(wxEVT_KEY_DOWN, wxKeyEventHandler(QuincyGotoPalette::OnKeyDown), NULL, this);
+    m_list->Connect(wxEVT_COMMAND_LIST_ITEM_ACTIVATED, wxListEventHandler(QuincyGotoPalette::OnActivated), NULL, this);
+    m_search->SetFocus();
+    UpdateList();
+}
+
+void QuincyGotoPalette::UpdateList()
+{
+    static const char* kinds[] = { "symbol", "file", "help" };
+    unsigned count = m_candidates.Matcher().Match(m_search->GetValue(), m_shown, PALETTE_ROWS);
+    m_list->Freeze();
+    m_list->DeleteAllItems();
+    for (unsigned row = 0; row < m_shown.size(); row++) {
+        const PaletteItem& item = m_candidates.Item(m_shown[row]);
+        wxASSERT(item.Kind >= 0 && item.Kind < (int)WXSIZEOF(kinds));
+        m_list->InsertItem(row, item.Label);
+        m_list->SetItem(row, 1, kinds[item.Kind]);
+        m_list->SetItem(row, 2, item.Detail);
+    }
+    if (m_shown.size() > 0)
+        m_list->Select(0);
+    m_list->Thaw();
+    if (count > m_shown.size())
+        m_status->SetLabel(wxString::Format("%u matches (the best %u are shown)", count, (unsigned)m_shown.size()));
+    else
+        m_status->SetLabel(wxString::Format("%u matches", count));
+}
+
+void QuincyGotoPalette::Choose(long row)
+{
+    if (row < 0 || row >= (long)m_shown.size())
+        return;
+    m_selected = &m_candidates.Item(m_shown[row]);
+    EndModal(wxID_OK);
+}
+
+void QuincyGotoPalette::OnText(wxCommandEvent& /* event */)
+{
+    UpdateList();
+}
+
+void QuincyGotoPalette::OnEnter(wxCommandEvent& /* event */)
+{
+    Choose(m_list->GetFirstSelected());
+}
+
+void QuincyGotoPalette::OnKeyDown(wxKeyEvent& event)
+{
+    /* the cursor keys in the search field move the selection in the list */
+    int key = event.GetKeyCode();
+    long count = m_list->GetItemCount();
+    if (count == 0 || (key != WXK_DOWN && key != WXK_UP && key != WXK_PAGEDOWN && key != WXK_PAGEUP)) {
+        event.Skip();
+        return;
+    }
+    long step = 1;
+    if (key == WXK_PAGEDOWN || key == WXK_PAGEUP)
+        step = (m_list->GetCountPerPage() > 1) ? m_list->GetCountPerPage() : 1;
+    if (key == WXK_UP || key == WXK_PAGEUP)
+        step = -step;
+    long row = m_list->GetFirstSelected();
+    row = (row < 0) ? 0 : row + step;
+    if (row < 0)
+        row = 0;
+    else if (row >= count)
+        row = count - 1;
+    m_list->Select(row);
+    m_list->Focus(row);
+}
+
+void QuincyGotoPalette::OnActivated(wxListEvent& event)
+{
+    Choose(event.GetIndex());
+}
@@ -0,0 +1,114 @@
+/*  Quincy IDE for the Pawn scripting language
+ *
+ *  Copyright CompuPhase, 2009-2024
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License"); you may not
+ *  use this file except in compliance with the License. You may obtain a copy
+ *  of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS, WITHOUT
+ *  WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. See the
+ *  License for the specific language governing permissions and limitations
+ *  under the License.
+ *
+ *  Version: $Id$
+ */
+#ifndef _QUINCYGOTOPALETTE_H
+#define _QUINCYGOTOPALETTE_H
+
+#include <wx/wx.h>
+#include <wx/listctrl.h>
+#include <string>
+#include <vector>
+
+#define PALETTE_ROWS    200     /* maximum number of matches that are shown */
+
+enum {
+    PALETTE_SYMBOL,
+    PALETTE_FILE,
+    PALETTE_HELP,
+};
+
+struct PaletteItem {
+    PaletteItem(int kind, const wxString& label, const wxString& detail, const wxString& target, int line)
+        : Kind(kind), Label(label), Detail(detail), Target(target), Line(line)
+        {}
+    int Kind;
+    wxString Label;     /* text that is matched */
+    wxString Detail;    /* shown next to the label */
+    wxString Target;    /* source file (symbol), full path (file) or keyword (help) */
+    int Line;           /* 1-based, for a symbol */
+};
+
+/* The fuzzy matcher holds the keys of all candidates in a single buffer, so
+ * that a scan over all keys runs through contiguous memory. A key matches if
+ * the characters of the query appear in it in the same order (ignoring case);
+ * the score favours matches at the start of words and runs of consecutive
+ * characters. When the query grows, only the candidates that matched the
+ * shorter query are scanned again.
+ */
+class CFuzzyMatcher {
+public:
+    CFuzzyMatcher() { Clear(); }
+    void Clear();
+    void Add(const wxString& key);
+    unsigned Count() const { return m_offsets.size() - 1; }
+    unsigned Match(const wxString& query, std::vector<unsigned>& result, unsigned limit);
+
+private:
+    int Score(unsigned idx, const std::string& query) const;
+
+    std::string m_keys;             /* keys in UTF-8, each terminated with a zero byte */
+    std::vector<unsigned> m_offsets;/* start of each key in m_keys, plus the end of the buffer */
+    std::string m_query;            /* most recent query, in lower case */
+    std::vector<unsigned> m_matches;/* candidates that match m_query */
+};
+
+/* The candidates of the palette, with the matcher for their labels. The
+ * owner keeps these from one use of the palette to the next, and clears them
+ * when the symbols, the files or the help keywords change.
+ */
+class CPaletteItems {
+public:
+    void Clear() { m_items.clear(); m_matcher.Clear(); }
+    bool IsEmpty() const { return m_items.empty(); }
+    void Add(int kind, const wxString& label, const wxString& detail, const wxString& target, int line = 0)
+        { m_items.push_back(PaletteItem(kind, label, detail, target, line)); m_matcher.Add(label); }
+    const PaletteItem& Item(unsigned idx) const { return m_items[idx]; }
+    CFuzzyMatcher& Matcher() { return m_matcher; }
+
+private:
+    std::vector<PaletteItem> m_items;
+    CFuzzyMatcher m_matcher;
+};
+
+/* The "go to anything" palette: a search field with a list of the best
+ * matches, updated as the user types.
+ */
+class QuincyGotoPalette : public wxDialog {
+public:
+    QuincyGotoPalette(wxWindow* parent, CPaletteItems& candidates);
+
+    const PaletteItem* GetSelection() const { return m_selected; }
+
+private:
+    void UpdateList();
+    void Choose(long row);
+
+    void OnText(wxCommandEvent& event);
+    void OnEnter(wxCommandEvent& event);
+    void OnKeyDown(wxKeyEvent& event);
+    void OnActivated(wxListEvent& event);
+
+    wxTextCtrl* m_search;
+    wxListView* m_list;
+    wxStaticText* m_status;
+    CPaletteItems& m_candidates;
+    std::vector<unsigned> m_shown;  /* candidates in the list */
+    const PaletteItem* m_selected;
+};
+
+#endif /* _QUINCYGOTOPALETTE_H */
@@ -33,6 +33,24 @@ QuincySettingsDlg::QuincySettingsDlg(wxWindow* parent)
     Parent = static_cast<QuincyFrame*>(parent);
     NeedRestart = false;
     InitData();
+    /* keep the list of ports current while the dialog is open */
+    Connect(wxEVT_THREAD, wxThreadEventHandler(QuincySettingsDlg::OnPortsChanged));
+    EnumeratePortsWatch(this);
+}
+
+QuincySettingsDlg::~QuincySettingsDlg()
+{
+    EnumeratePortsWatch(NULL);
+}
+
+void QuincySettingsDlg::OnPortsChanged(wxThreadEvent& /* event */)
+{
+    wxString port = m_ctrlPort->GetStringSelection();
+    if (port.length() == 0)
+        port = Parent->GetDebugPort();
+    m_ctrlPort->Clear();
+    m_ctrlPort->Append(EnumeratePortsList());
+    m_ctrlPort->SetStringSelection(port);
 }
 
 void QuincySettingsDlg::OnCancel(wxCommandEvent& /* event */)
@@ -37,9 +37,11 @@ protected:
     virtual void OnSnippetEdit(wxGridEvent& event);
     virtual void OnUserPDFReader(wxCommandEvent& event);
     virtual void OnUserReaderBrowse(wxCommandEvent& event);
+    void OnPortsChanged(wxThreadEvent& event);
 
 public:
     QuincySettingsDlg(wxWindow* parent);
+    ~QuincySettingsDlg();
     void InitData();
     void CopyData();
 
@@ -0,0 +1,459 @@
+/*  Quincy IDE for the Pawn scripting language
+ *
+ *  Copyright CompuPhase, 2009-2024
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License"); you may not
+ *  use this file except in compliance with the License. You may obtain a copy
+ *  of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS, WITHOUT
+ *  WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. See the
+ *  License for the specific language governing permissions and limitations
+ *  under the License.
+ *
+ *  Version: $Id$
+ */
+#include "wxQuincy.h"
+#include <wx/datetime.h>
+#include <wx/filedlg.h>
+#include "SerialMonitor.h"
+#include "SerialTransfer.h"
+#include "portscan.h"
+#include "rs232.h"
+
+#define READ_TIMEOUT    100     /* milliseconds to wait for data, before checking for termination */
+#define READ_BUFSIZE    4096
+
+static const long baudrates[] = { 9600, 19200, 38400, 57600, 115200, 230400, 460800, 921600, 1000000 };
+
+/** SamePort() compares port names, ignoring a "/dev/" or "\\.\" prefix. */
+static bool SamePort(const wxString& a, const wxString& b)
+{
+    return a.AfterLast('/').AfterLast('\\').CmpNoCase(b.AfterLast('/').AfterLast('\\')) == 0;
+}
+
+CSerialReader::CSerialReader(const wxString& port, long baudrate)
+    : wxThread(wxTHREAD_JOINABLE), m_port(port), m_baudrate(baudrate), m_hcom(NULL),
+      m_data(MONITOR_BUFSIZE), m_chunks(MONITOR_CHUNKS), m_received(0), m_dropped(0), m_failed(false)
+{
+}
+
+CSerialReader::~CSerialReader()
+{
+    if (m_hcom) {
+        wxMutexLocker lock(SerialPortLock());
+        rs232_close((HCOM*)m_hcom);
+    }
+}
+
+/** Open() opens the port; it must be called before the thread is run. */
+bool CSerialReader::Open()
+{
+    wxMutexLocker lock(SerialPortLock());
+    m_hcom = rs232_open(m_port.utf8_str(), (unsigned)m_baudrate, 8, 1, PAR_NONE, FLOWCTRL_NONE);
+    return m_hcom != NULL;
+}
+
+wxThread::ExitCode CSerialReader::Entry()
+{
+    HCOM* hcom = (HCOM*)m_hcom;
+    unsigned char buffer[READ_BUFSIZE];
+    int idle = 0;
+    while (!TestDestroy()) {
+        int result = rs232_wait(hcom, READ_TIMEOUT);
+        if (result < 0)
+            break;
+        if (result == 0)
+            continue;
+        size_t count = rs232_recv(hcom, buffer, sizeof buffer);
+        if (count == 0) {
+            /* a port that is reported readable but has no data, time after
+               time, has hung up */
+            if (!rs232_isopen(hcom) || ++idle > 10)
+                break;
+            continue;
+        }
+        idle = 0;
+        m_received += count;
+        /* data first, then the chunk that refers to it, so that the consumer
+           finds the data when it reads the chunk */
+        size_t stored = 0;
+        if (m_chunks.Free() > 0) {
+            stored = m_data.Write(buffer, count);
+            if (stored > 0) {
+                MonitorChunk chunk;
+                chunk.Length = stored;
+                chunk.Stamp = wxGetLocalTimeMillis();
+                m_chunks.Write(&chunk, 1);
+            }
+        }
+        if (stored < count)
+            m_dropped += count - stored;
+    }
+    m_failed = !TestDestroy();
+    return (ExitCode)0;
+}
+
+
+SerialMonitor::SerialMonitor(wxWindow* parent, const wxFont& font)
+    : wxPanel(parent, wxID_ANY, wxDefaultPosition, wxDefaultSize, wxTAB_TRAVERSAL),
+      m_timer(this), m_reader(NULL), m_baudrate(115200), m_suspended(false), m_buffer(READ_BUFSIZE),
+      m_linestamp(0), m_lastbyte(0), m_haveline(false), m_lastreceived(0), m_laststats(0), m_rate(0)
+{
+    wxBoxSizer* bSizer = new wxBoxSizer(wxVERTICAL);
+    wxBoxSizer* bSizerBar = new wxBoxSizer(wxHORIZONTAL);
+    m_ctrlPort = new wxChoice(this, wxID_ANY);
+    bSizerBar->Add(m_ctrlPort, 0, wxALIGN_CENTER_VERTICAL | wxRIGHT, 3);
+    m_ctrlBaud = new wxChoice(this, wxID_ANY);
+    for (unsigned idx = 0; idx < WXSIZEOF(baudrates); idx++)
+        m_ctrlBaud->Append(wxString::Format("%ld", baudrates[idx]));
+    bSizerBar->Add(m_ctrlBaud, 0, wxALIGN_CENTER_VERTICAL | wxRIGHT, 3);
+    m_btnConnect = new wxButton(this, wxID_ANY, "Connect", wxDefaultPosition, wxDefaultSize, wxBU_EXACTFIT);
+    bSizerBar->Add(m_btnConnect, 0, wxALIGN_CENTER_VERTICAL | wxRIGHT, 9);
+    m_chkPause = new wxCheckBox(this, wxID_ANY, "Pause");
+    bSizerBar->Add(m_chkPause, 0, wxALIGN_CENTER_VERTICAL | wxRIGHT, 6);
+    m_chkHex = new wxCheckBox(this, wxID_ANY, "Hex");
+    bSizerBar->Add(m_chkHex, 0, wxALIGN_CENTER_VERTICAL | wxRIGHT, 6);
+    m_chkTime = new wxCheckBox(this, wxID_ANY, "Time stamps");
+    bSizerBar->Add(m_chkTime, 0, wxALIGN_CENTER_VERTICAL | wxRIGHT, 9);
+    bSizerBar->Add(new wxStaticText(this, wxID_ANY, "Filter"), 0, wxALIGN_CENTER_VERTICAL | wxRIGHT, 3);
+    m_ctrlFilter = new wxTextCtrl(this, wxID_ANY, wxEmptyString, wxDefaultPosition, wxSize(120, -1));
+    m_ctrlFilter->SetToolTip("Show only lines that contain this text (the log file gets all lines)");
+    bSizerBar->Add(m_ctrlFilter, 0, wxALIGN_CENTER_VERTICAL | wxRIGHT, 9);
+    wxButton* btnClear = new wxButton(this, wxID_ANY, "Clear", wxDefaultPosition, wxDefaultSize, wxBU_EXACTFIT);
+    bSizerBar->Add(btnClear, 0, wxALIGN_CENTER_VERTICAL | wxRIGHT, 3);
+    m_btnLog = new wxButton(this, wxID_ANY, "Log...", wxDefaultPosition, wxDefaultSize, wxBU_EXACTFIT);
+    bSizerBar->Add(m_btnLog, 0, wxALIGN_CENTER_VERTICAL, 0);
+    bSizer->Add(bSizerBar, 0, wxEXPAND | wxALL, 2);
+    m_output = new wxTextCtrl(this, wxID_ANY, wxEmptyString, wxDefaultPosition, wxDefaultSize, wxHSCROLL | wxTE_LEFT | wxTE_MULTILINE | wxTE_READONLY);
+    m_output->SetFont(font);
+    bSizer->Add(m_output, 1, wxEXPAND, 0);
+    m_stats = new wxStaticText(this, wxID_ANY, wxEmptyString);
+    bSizer->Add(m_stats, 0, wxEXPAND | wxALL, 2);
+    SetSizer(bSizer);
+    Layout();
+
+    m_btnConnect->Connect(wxEVT_COMMAND_BUTTON_CLICKED, wxCommandEventHandler(SerialMonitor::OnConnectPort), NULL, this);
+    m_chkPause->Connect(wxEVT_COMMAND_CHECKBOX_CLICKED, wxCommandEventHandler(SerialMonitor::OnPause), NULL, this);
+    m_chkHex->Connect(wxEVT_COMMAND_CHECKBOX_CLICKED, wxCommandEventHandler(SerialMonitor::OnViewChanged), NULL, this);
+    m_chkTime->Connect(wxEVT_COMMAND_CHECKBOX_CLICKED, wxCommandEventHandler(SerialMonitor::OnViewChanged), NULL, this);
+    btnClear->Connect(wxEVT_COMMAND_BUTTON_CLICKED, wxCommandEventHandler(SerialMonitor::OnClear), NULL, this);
+    m_btnLog->Connect(wxEVT_COMMAND_BUTTON_CLICKED, wxCommandEventHandler(SerialMonitor::OnLog), NULL, this);
+    Connect(wxEVT_TIMER, wxTimerEventHandler(SerialMonitor::OnTimer));
+
+    SetPort(wxEmptyString, m_baudrate);
+}
+
+SerialMonitor::~SerialMonitor()
+{
+    m_timer.Stop();
+    if (m_reader) {
+        m_reader->Delete();
+        delete m_reader;
+        m_reader = NULL;
+    }
+    if (m_log.IsOpened())
+        m_log.Close();
+}
+
+/** SetPort() sets the port and the baud rate that the monitor proposes (the
+ *  ones for remote debugging), and refreshes the list of ports. It does not
+ *  change an open connection.
+ */
+void SerialMonitor::SetPort(const wxString& port, long baudrate)
+{
+    wxString select = (m_reader || m_suspended) ? m_port : port;
+    if (select.length() == 0)
+        select = m_ctrlPort->GetStringSelection();
+    wxArrayString ports = EnumeratePortsList();
+    m_ctrlPort->Clear();
+    m_ctrlPort->Append(ports);
+    for (unsigned idx = 0; idx < ports.Count(); idx++)
+        if (SamePort(ports[idx], select))
+            m_ctrlPort->SetSelection(idx);
+    if (m_ctrlPort->GetSelection() == wxNOT_FOUND && ports.Count() > 0)
+        m_ctrlPort->SetSelection(0);
+    if (!m_reader && !m_suspended)
+        m_baudrate = baudrate;
+    m_ctrlBaud->SetStringSelection(wxString::Format("%ld", m_baudrate));
+    UpdateControls();
+}
+
+/** Release() closes the port if another part of the IDE needs it; the owner
+ *  is any value that identifies that user. The port is opened again when all
+ *  users have called Reclaim().
+ */
+void SerialMonitor::Release(const wxString& port, const void* owner)
+{
+    if (m_reader && SamePort(port, m_port)) {
+        Close();
+        m_suspended = true;
+        m_status = "released";
+    }
+    if (m_suspended && SamePort(port, m_port))
+        m_holders.insert(owner);
+    UpdateControls();
+    UpdateStats();
+}
+
+void SerialMonitor::Reclaim(const void* owner)
+{
+    if (m_holders.erase(owner) == 0 || m_holders.size() > 0 || !m_suspended)
+        return;
+    m_suspended = false;
+    if (!Open(false))
+        m_status = "port could not be opened again";
+    UpdateControls();
+    UpdateStats();
+}
+
+bool SerialMonitor::Open(bool verbose)
+{
+    wxASSERT(!m_reader);
+    m_reader = new CSerialReader(m_port, m_baudrate);
+    if (!m_reader->Open() || m_reader->Run() != wxTHREAD_NO_ERROR) {
+        delete m_reader;
+        m_reader = NULL;
+        if (verbose)
+            wxMessageBox("The port " + m_port + " could not be opened.", "Pawn IDE", wxOK | wxICON_ERROR);
+        return false;
+    }
+    m_status.Empty();
+    m_lastreceived = 0;
+    m_laststats = wxGetLocalTimeMillis();
+    m_rate = 0;
+    m_timer.Start(MONITOR_INTERVAL);
+    return true;
+}
+
+void SerialMonitor::Close()
+{
+    if (m_reader) {
+        m_reader->Delete();
+        Drain();    /* data that arrived before the thread stopped */
+        delete m_reader;
+        m_reader = NULL;
+    }
+    m_timer.Stop();
+    FlushLine();
+    ShowText(wxEmptyString);
+}
+
+/** Drain() moves the data from the reader to the pane (and the log). */
+void SerialMonitor::Drain()
+{
+    MonitorChunk chunk;
+    while (m_reader->NextChunk(chunk)) {
+        unsigned long remaining = chunk.Length;
+        while (remaining > 0) {
+            size_t count = m_reader->ReadData(&m_buffer[0], wxMin(remaining, (unsigned long)m_buffer.size()));
+            wxASSERT(count > 0);
+            if (count == 0)
+                break;
+            for (size_t idx = 0; idx < count; idx++)
+                AddByte(m_buffer[idx], chunk.Stamp);
+            remaining -= count;
+        }
+        m_lastbyte = chunk.Stamp;
+    }
+}
+
+void SerialMonitor::AddByte(unsigned char byte, const wxLongLong& stamp)
+{
+    if (!m_haveline) {
+        m_linestamp = stamp;
+        m_haveline = true;
+    }
+    if (m_chkHex->GetValue()) {
+        m_hexline.push_back(byte);
+        if (m_hexline.size() == 16)
+            FlushLine();
+    } else if (byte == '\n') {
+        FlushLine();
+    } else if (byte == '\r') {
+        /* ignore, lines end at the '\n' */
+    } else if (byte >= ' ' || byte == '\t') {
+        m_line += (wxChar)byte;
+    } else {
+        m_line += wxString::Format("\\x%02x", byte);
+    }
+}
+
+/** FlushLine() ends the line that is being collected. */
+void SerialMonitor::FlushLine()
+{
+    if (!m_haveline)
+        return;
+    if (m_hexline.size() > 0) {
+        wxString text, ascii;
+        for (unsigned idx = 0; idx < 16; idx++) {
+            if (idx < m_hexline.size()) {
+                unsigned char byte = m_hexline[idx];
+                text += wxString::Format("%02x ", byte);
+                ascii += (byte >= ' ' && byte < 0x7f) ? (wxChar)byte : '.';
+            } else {
+                text += "   ";
+            }
+        }
+        EmitLine(text + " " + ascii, m_linestamp);
+    } else {
+        EmitLine(m_line, m_linestamp);
+    }
+    m_line.Empty();
+    m_hexline.clear();
+    m_haveline = false;
+}
+
+void SerialMonitor::EmitLine(const wxString& text, const wxLongLong& stamp)
+{
+    wxString time = wxDateTime(stamp).Format("%H:%M:%S.%l ");
+    if (m_log.IsOpened())
+        m_log.Write(time + text + "\n");
+    wxString filter = m_ctrlFilter->GetValue();
+    if (filter.length() > 0 && text.Lower().Find(filter.Lower()) == wxNOT_FOUND)
+        return;
+    if (m_chkTime->GetValue())
+        m_pending += time;
+    m_pending += text + "\n";
+}
+
+/** ShowText() adds the collected lines to the pane (or holds them while the
+ *  display is paused), and limits the number of lines in the pane.
+ */
+void SerialMonitor::ShowText(const wxString& text)
+{
+    m_pending += text;
+    if (m_pending.length() == 0)
+        return;
+    if (m_chkPause->GetValue()) {
+        m_held += m_pending;
+        if (m_held.length() > MONITOR_HOLDMAX) {
+            size_t pos = m_held.find('\n', m_held.length() - MONITOR_HOLDMAX);
+            m_held.erase(0, (pos == wxString::npos) ? m_held.length() - MONITOR_HOLDMAX : pos + 1);
+        }
+    } else {
+        m_output->AppendText(m_pending);
+        int excess = m_output->GetNumberOfLines() - MONITOR_MAXLINES;
+        if (excess > 0)
+            m_output->Remove(0, m_output->XYToPosition(0, excess));
+    }
+    m_pending.Empty();
+}
+
+void SerialMonitor::UpdateStats()
+{
+    wxString text;
+    if (m_reader) {
+        text = wxString::Format("%s at %ld baud: %ld bytes/s, %lu bytes received, %lu bytes dropped",
+                                m_port.c_str(), m_baudrate, m_rate, m_reader->Received(), m_reader->Dropped());
+        if (m_chkPause->GetValue())
+            text += " (paused)";
+    } else if (m_suspended) {
+        text = m_port + " is in use for a transfer or debugging, the monitor resumes afterwards";
+    } else {
+        text = "Not connected";
+        if (m_status.length() > 0)
+            text += " (" + m_status + ")";
+    }
+    if (m_log.IsOpened())
+        text += ", logging to " + m_log.GetName();
+    if (m_stats->GetLabel().Cmp(text) != 0)
+        m_stats->SetLabel(text);
+}
+
+void SerialMonitor::UpdateControls()
+{
+    bool open = (m_reader != NULL || m_suspended);
+    m_btnConnect->SetLabel(open ? "Disconnect" : "Connect");
+    m_ctrlPort->Enable(!open);
+    m_ctrlBaud->Enable(!open);
+    m_btnLog->SetLabel(m_log.IsOpened() ? "Stop log" : "Log...");
+    UpdateStats();
+}
+
+void SerialMonitor::OnConnectPort(wxCommandEvent& /* event */)
+{
+    if (m_reader || m_suspended) {
+        Close();
+        m_suspended = false;
+        m_holders.clear();
+        m_status.Empty();
+    } else {
+        m_port = m_ctrlPort->GetStringSelection();
+        m_ctrlBaud->GetStringSelection().ToLong(&m_baudrate);
+        if (m_port.length() == 0) {
+            wxMessageBox("No serial port is selected.", "Pawn IDE", wxOK | wxICON_ERROR);
+            return;
+        }
+        Open(true);
+    }
+    UpdateControls();
+}
+
+void SerialMonitor::OnPause(wxCommandEvent& /* event */)
+{
+    if (!m_chkPause->GetValue() && m_held.length() > 0) {
+        wxString text = m_held;
+        m_held.Empty();
+        ShowText(text);
+    }
+    UpdateStats();
+}
+
+void SerialMonitor::OnViewChanged(wxCommandEvent& /* event */)
+{
+    FlushLine();    /* the view applies to new lines */
+    ShowText(wxEmptyString);
+}
+
+void SerialMonitor::OnClear(wxCommandEvent& /* event */)
+{
+    m_output->Clear();
+    m_held.Empty();
+}
+
+void SerialMonitor::OnLog(wxCommandEvent& /* event */)
+{
+    if (m_log.IsOpened()) {
+        m_log.Close();
+    } else {
+        wxFileDialog dlg(this, "Log serial data to file", wxEmptyString, "serial.log",
+                         "Log files|*.log;*.txt|All files|*",
+                         wxFD_SAVE | wxFD_OVERWRITE_PROMPT);
+        if (dlg.ShowModal() != wxID_OK)
+            return;
+        if (!m_log.Open(dlg.GetPath(), "w"))
+            wxMessageBox("The log file could not be created.", "Pawn IDE", wxOK | wxICON_ERROR);
+    }
+    UpdateControls();
+}
+
+void SerialMonitor::OnTimer(wxTimerEvent& /* event */)
+{
+    if (!m_reader)
+        return;
+    Drain();
+    if (m_haveline && (wxGetLocalTimeMillis() - m_lastbyte) >= MONITOR_LINEWAIT)
+        FlushLine();    /* show a prompt (or a line without '\n') after a while */
+    ShowText(wxEmptyString);
+
+    wxLongLong now = wxGetLocalTimeMillis();
+    long elapsed = (now - m_laststats).ToLong();
+    if (elapsed >= 1000) {
+        unsigned long received = m_reader->Received();
+        m_rate = (long)((wxLongLong(received - m_lastreceived) * 1000) / elapsed).ToLong();
+        m_lastreceived = received;
+        m_laststats = now;
+    }
+
+    if (m_reader->Failed()) {
+        /* the device was removed or the port was closed */
+        Close();
+        m_status = "port closed";
+        UpdateControls();
+    }
+    UpdateStats();
+}
@@ -0,0 +1,182 @@
+/*  Quincy IDE for the Pawn scripting language
+ *
+ *  Copyright CompuPhase, 2009-2024
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License"); you may not
+ *  use this file except in compliance with the License. You may obtain a copy
+ *  of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS, WITHOUT
+ *  WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. See the
+ *  License for the specific language governing permissions and limitations
+ *  under the License.
+ *
+ *  Version: $Id$
+ */
+#ifndef _SERIALMONITOR_H
+#define _SERIALMONITOR_H
+
+#include <wx/wx.h>
+#include <wx/ffile.h>
+#include <wx/thread.h>
+#include <wx/timer.h>
+#include <atomic>
+#include <set>
+#include <vector>
+
+#define MONITOR_BUFSIZE     (1 << 20)   /* received data, ~10 seconds at 921600 baud (power of 2) */
+#define MONITOR_CHUNKS      (1 << 14)   /* time stamps of the reads (power of 2) */
+#define MONITOR_INTERVAL    100         /* milliseconds between display updates */
+#define MONITOR_LINEWAIT    250         /* milliseconds before an unterminated line is shown */
+#define MONITOR_MAXLINES    5000        /* lines kept in the pane */
+#define MONITOR_HOLDMAX     (4 << 20)   /* characters kept for display while paused */
+
+/* SpscRing is a ring buffer for a single producer thread and a single consumer
+ * thread, without locks. The size must be a power of 2; the indices run freely
+ * and are masked on access.
+ */
+template <class T>
+class SpscRing {
+public:
+    SpscRing(size_t size) : m_buffer(size), m_mask(size - 1), m_head(0), m_tail(0)
+        { wxASSERT((size & (size - 1)) == 0); }
+
+    size_t Free() const     /* producer side */
+        { return m_buffer.size() - (m_head.load(std::memory_order_relaxed) - m_tail.load(std::memory_order_acquire)); }
+
+    size_t Write(const T* data, size_t count)
+        {
+            size_t head = m_head.load(std::memory_order_relaxed);
+            size_t free = m_buffer.size() - (head - m_tail.load(std::memory_order_acquire));
+            if (count > free)
+                count = free;
+            for (size_t idx = 0; idx < count; idx++)
+                m_buffer[(head + idx) & m_mask] = data[idx];
+            m_head.store(head + count, std::memory_order_release);
+            return count;
+        }
+
+    size_t Read(T* data, size_t count)
+        {
+            size_t tail = m_tail.load(std::memory_order_relaxed);
+            size_t avail = m_head.load(std::memory_order_acquire) - tail;
+            if (count > avail)
+                count = avail;
+            for (size_t idx = 0; idx < count; idx++)
+                data[idx] = m_buffer[(tail + idx) & m_mask];
+            m_tail.store(tail + count, std::memory_order_release);
+            return count;
+        }
+
+private:
+    std::vector<T> m_buffer;
+    size_t m_mask;
+    std::atomic<size_t> m_head;     /* written by the producer only */
+    std::atomic<size_t> m_tail;     /* written by the consumer only */
+};
+
+struct MonitorChunk {
+    unsigned long Length;   /* number of bytes in the data ring for this read */
+    wxLongLong Stamp;       /* local time of the read, in milliseconds */
+};
+
+/* The reader thread waits for data on the port (without spinning), and copies
+ * it to the rings as it arrives. When the display falls behind so far that the
+ * rings are full, new data is dropped (and counted).
+ */
+class CSerialReader : public wxThread {
+public:
+    CSerialReader(const wxString& port, long baudrate);
+    ~CSerialReader();
+
+    bool Open();
+    bool Failed() const { return m_failed; }
+    unsigned long Received() const { return m_received; }
+    unsigned long Dropped() const { return m_dropped; }
+
+    bool NextChunk(MonitorChunk& chunk) { return m_chunks.Read(&chunk, 1) == 1; }
+    size_t ReadData(unsigned char* buffer, size_t size) { return m_data.Read(buffer, size); }
+
+protected:
+    virtual ExitCode Entry();
+
+private:
+    wxString m_port;
+    long m_baudrate;
+    void* m_hcom;           /* HCOM* of rs232.c */
+    SpscRing<unsigned char> m_data;
+    SpscRing<MonitorChunk> m_chunks;
+    std::atomic<unsigned long> m_received;
+    std::atomic<unsigned long> m_dropped;
+    std::atomic<bool> m_failed;
+};
+
+/* The serial monitor is a pane that shows the data received on a serial port,
+ * as text or as a hex dump, optionally with time stamps. The port is released
+ * while a transfer or a remote debugging session uses it (see Release() and
+ * Reclaim()).
+ */
+class SerialMonitor : public wxPanel {
+public:
+    SerialMonitor(wxWindow* parent, const wxFont& font);
+    ~SerialMonitor();
+
+    void SetPort(const wxString& port, long baudrate);
+    bool IsConnected() const { return m_reader != NULL; }
+    void Release(const wxString& port, const void* owner);
+    void Reclaim(const void* owner);
+
+private:
+    bool Open(bool verbose);
+    void Close();
+    void Drain();
+    void AddByte(unsigned char byte, const wxLongLong& stamp);
+    void FlushLine();
+    void EmitLine(const wxString& text, const wxLongLong& stamp);
+    void ShowText(const wxString& text);
+    void UpdateStats();
+    void UpdateControls();
+
+    void OnConnectPort(wxCommandEvent& event);
+    void OnPause(wxCommandEvent& event);
+    void OnViewChanged(wxCommandEvent& event);
+    void OnClear(wxCommandEvent& event);
+    void OnLog(wxCommandEvent& event);
+    void OnTimer(wxTimerEvent& event);
+
+    wxChoice* m_ctrlPort;
+    wxChoice* m_ctrlBaud;
+    wxButton* m_btnConnect;
+    wxCheckBox* m_chkPause;
+    wxCheckBox* m_chkHex;
+    wxCheckBox* m_chkTime;
+    wxTextCtrl* m_ctrlFilter;
+    wxButton* m_btnLog;
+    wxTextCtrl* m_output;
+    wxStaticText* m_stats;
+    wxTimer m_timer;
+
+    CSerialReader* m_reader;
+    wxString m_port;        /* port that is open (or that is released) */
+    long m_baudrate;
+    bool m_suspended;       /* port is released for a transfer or debug session */
+    std::set<const void*> m_holders;    /* users of the released port */
+    wxString m_status;      /* reason for the last close, for the stats line */
+    wxFFile m_log;
+    std::vector<unsigned char> m_buffer;
+    wxString m_line;        /* line being collected (text view) */
+    std::vector<unsigned char> m_hexline;   /* bytes being collected (hex view) */
+    wxLongLong m_linestamp; /* time stamp of the first byte in the line */
+    wxLongLong m_lastbyte;  /* time stamp of the most recent byte */
+    bool m_haveline;        /* a line was started */
+    wxString m_pending;     /* lines to add to the pane in this update */
+    wxString m_held;        /* lines kept while the display is paused */
+    unsigned long m_lastreceived;
+    wxLongLong m_laststats;
+    long m_rate;
+};
+
+#endif /* _SERIALMONITOR_H */
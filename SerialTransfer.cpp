@@ -0,0 +1,426 @@
+/*  Quincy IDE for the Pawn scripting language
+ *
+ *  Copyright CompuPhase, 2009-2024
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License"); you may not
+ *  use this file except in compliance with the License. You may obtain a copy
+ *  of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS, WITHOUT
+ *  WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. See the
+ *  License for the specific language governing permissions and limitations
+ *  under the License.
+ *
+ *  Version: $Id$
+ */
+#include "wxQuincy.h"
+#include <wx/file.h>
+#include <map>
+#include "SerialTransfer.h"
+#include "rs232.h"
+
+#define FRAME_MARK  0xbf
+
+/** SerialPortLock() returns the lock that serializes opening and closing
+ *  ports: rs232.c keeps a table of open ports, which is not thread-safe, and
+ *  the transfer workers and the serial monitor run concurrently.
+ */
+wxMutex& SerialPortLock()
+{
+    static wxMutex lock;
+    return lock;
+}
+
+CSerialTransfer::CSerialTransfer(wxEvtHandler* owner, int id, const wxString& port, long baudrate, const wxString& path,
+                                 const TransferImage& previous)
+    : wxThread(wxTHREAD_JOINABLE), m_owner(owner), m_id(id), m_port(port),
+      m_baudrate(baudrate), m_path(path), m_previous(previous), m_patched(false), m_unanswered(false), m_seq(0),
+      m_lastupdate(0), m_hcom(NULL), m_replylen(0)
+{
+}
+
+static const unsigned long crc_table[256] = {
+    0x00000000UL, 0x77073096UL, 0xee0e612cUL, 0x990951baUL, 0x076dc419UL, 0x706af48fUL,
+    0xe963a535UL, 0x9e6495a3UL, 0x0edb8832UL, 0x79dcb8a4UL, 0xe0d5e91eUL, 0x97d2d988UL,
+    0x09b64c2bUL, 0x7eb17cbdUL, 0xe7b82d07UL, 0x90bf1d91UL, 0x1db71064UL, 0x6ab020f2UL,
+    0xf3b97148UL, 0x84be41deUL, 0x1adad47dUL, 0x6ddde4ebUL, 0xf4d4b551UL, 0x83d385c7UL,
+    0x136c9856UL, 0x646ba8c0UL, 0xfd62f97aUL, 0x8a65c9ecUL, 0x14015c4fUL, 0x63066cd9UL,
+    0xfa0f3d63UL, 0x8d080df5UL, 0x3b6e20c8UL, 0x4c69105eUL, 0xd56041e4UL, 0xa2677172UL,
+    0x3c03e4d1UL, 0x4b04d447UL, 0xd20d85fdUL, 0xa50ab56bUL, 0x35b5a8faUL, 0x42b2986cUL,
+    0xdbbbc9d6UL, 0xacbcf940UL, 0x32d86ce3UL, 0x45df5c75UL, 0xdcd60dcfUL, 0xabd13d59UL,
+    0x26d930acUL, 0x51de003aUL, 0xc8d75180UL, 0xbfd06116UL, 0x21b4f4b5UL, 0x56b3c423UL,
+    0xcfba9599UL, 0xb8bda50fUL, 0x2802b89eUL, 0x5f058808UL, 0xc60cd9b2UL, 0xb10be924UL,
+    0x2f6f7c87UL, 0x58684c11UL, 0xc1611dabUL, 0xb6662d3dUL, 0x76dc4190UL, 0x01db7106UL,
+    0x98d220bcUL, 0xefd5102aUL, 0x71b18589UL, 0x06b6b51fUL, 0x9fbfe4a5UL, 0xe8b8d433UL,
+    0x7807c9a2UL, 0x0f00f934UL, 0x9609a88eUL, 0xe10e9818UL, 0x7f6a0dbbUL, 0x086d3d2dUL,
+    0x91646c97UL, 0xe6635c01UL, 0x6b6b51f4UL, 0x1c6c6162UL, 0x856530d8UL, 0xf262004eUL,
+    0x6c0695edUL, 0x1b01a57bUL, 0x8208f4c1UL, 0xf50fc457UL, 0x65b0d9c6UL, 0x12b7e950UL,
+    0x8bbeb8eaUL, 0xfcb9887cUL, 0x62dd1ddfUL, 0x15da2d49UL, 0x8cd37cf3UL, 0xfbd44c65UL,
+    0x4db26158UL, 0x3ab551ceUL, 0xa3bc0074UL, 0xd4bb30e2UL, 0x4adfa541UL, 0x3dd895d7UL,
+    0xa4d1c46dUL, 0xd3d6f4fbUL, 0x4369e96aUL, 0x346ed9fcUL, 0xad678846UL, 0xda60b8d0UL,
+    0x44042d73UL, 0x33031de5UL, 0xaa0a4c5fUL, 0xdd0d7cc9UL, 0x5005713cUL, 0x270241aaUL,
+    0xbe0b1010UL, 0xc90c2086UL, 0x5768b525UL, 0x206f85b3UL, 0xb966d409UL, 0xce61e49fUL,
+    0x5edef90eUL, 0x29d9c998UL, 0xb0d09822UL, 0xc7d7a8b4UL, 0x59b33d17UL, 0x2eb40d81UL,
+    0xb7bd5c3bUL, 0xc0ba6cadUL, 0xedb88320UL, 0x9abfb3b6UL, 0x03b6e20cUL, 0x74b1d29aUL,
+    0xead54739UL, 0x9dd277afUL, 0x04db2615UL, 0x73dc1683UL, 0xe3630b12UL, 0x94643b84UL,
+    0x0d6d6a3eUL, 0x7a6a5aa8UL, 0xe40ecf0bUL, 0x9309ff9dUL, 0x0a00ae27UL, 0x7d079eb1UL,
+    0xf00f9344UL, 0x8708a3d2UL, 0x1e01f268UL, 0x6906c2feUL, 0xf762575dUL, 0x806567cbUL,
+    0x196c3671UL, 0x6e6b06e7UL, 0xfed41b76UL, 0x89d32be0UL, 0x10da7a5aUL, 0x67dd4accUL,
+    0xf9b9df6fUL, 0x8ebeeff9UL, 0x17b7be43UL, 0x60b08ed5UL, 0xd6d6a3e8UL, 0xa1d1937eUL,
+    0x38d8c2c4UL, 0x4fdff252UL, 0xd1bb67f1UL, 0xa6bc5767UL, 0x3fb506ddUL, 0x48b2364bUL,
+    0xd80d2bdaUL, 0xaf0a1b4cUL, 0x36034af6UL, 0x41047a60UL, 0xdf60efc3UL, 0xa867df55UL,
+    0x316e8eefUL, 0x4669be79UL, 0xcb61b38cUL, 0xbc66831aUL, 0x256fd2a0UL, 0x5268e236UL,
+    0xcc0c7795UL, 0xbb0b4703UL, 0x220216b9UL, 0x5505262fUL, 0xc5ba3bbeUL, 0xb2bd0b28UL,
+    0x2bb45a92UL, 0x5cb36a04UL, 0xc2d7ffa7UL, 0xb5d0cf31UL, 0x2cd99e8bUL, 0x5bdeae1dUL,
+    0x9b64c2b0UL, 0xec63f226UL, 0x756aa39cUL, 0x026d930aUL, 0x9c0906a9UL, 0xeb0e363fUL,
+    0x72076785UL, 0x05005713UL, 0x95bf4a82UL, 0xe2b87a14UL, 0x7bb12baeUL, 0x0cb61b38UL,
+    0x92d28e9bUL, 0xe5d5be0dUL, 0x7cdcefb7UL, 0x0bdbdf21UL, 0x86d3d2d4UL, 0xf1d4e242UL,
+    0x68ddb3f8UL, 0x1fda836eUL, 0x81be16cdUL, 0xf6b9265bUL, 0x6fb077e1UL, 0x18b74777UL,
+    0x88085ae6UL, 0xff0f6a70UL, 0x66063bcaUL, 0x11010b5cUL, 0x8f659effUL, 0xf862ae69UL,
+    0x616bffd3UL, 0x166ccf45UL, 0xa00ae278UL, 0xd70dd2eeUL, 0x4e048354UL, 0x3903b3c2UL,
+    0xa7672661UL, 0xd06016f7UL, 0x4969474dUL, 0x3e6e77dbUL, 0xaed16a4aUL, 0xd9d65adcUL,
+    0x40df0b66UL, 0x37d83bf0UL, 0xa9bcae53UL, 0xdebb9ec5UL, 0x47b2cf7fUL, 0x30b5ffe9UL,
+    0xbdbdf21cUL, 0xcabac28aUL, 0x53b39330UL, 0x24b4a3a6UL, 0xbad03605UL, 0xcdd70693UL,
+    0x54de5729UL, 0x23d967bfUL, 0xb3667a2eUL, 0xc4614ab8UL, 0x5d681b02UL, 0x2a6f2b94UL,
+    0xb40bbe37UL, 0xc30c8ea1UL, 0x5a05df1bUL, 0x2d02ef8dUL
+};
+
+/** Crc32() calculates the CRC-32 (the one of zlib and Ethernet); pass in 0
+ *  for the initial crc, or the result of the previous call to continue. The
+ *  table is constant, so that the transfer threads can share it.
+ */
+unsigned long CSerialTransfer::Crc32(unsigned long crc, const unsigned char* data, size_t size)
+{
+    crc = crc ^ 0xffffffffUL;
+    while (size-- > 0)
+        crc = crc_table[(crc ^ *data++) & 0xff] ^ (crc >> 8);
+    return (crc ^ 0xffffffffUL) & 0xffffffffUL;
+}
+
+static void put32(unsigned char* buffer, unsigned long value)
+{
+    for (int i = 0; i < 4; i++)
+        buffer[i] = (unsigned char)(value >> (8 * i));
+}
+
+static void AddOp(std::vector<DeltaOp>& ops, bool copy, unsigned long offset, unsigned long length)
+{
+    /* merge with the previous operation, if contiguous */
+    if (ops.size() > 0) {
+        DeltaOp& last = ops.back();
+        if (last.Copy == copy && last.Offset + last.Length == offset) {
+            last.Length += length;
+            return;
+        }
+    }
+    ops.push_back(DeltaOp(copy, offset, length));
+}
+
+/** Diff() finds the blocks of the previous image in the new image (at any
+ *  offset, using a rolling checksum like rsync), and returns the list of
+ *  copy and literal operations that build the new image.
+ */
+void CSerialTransfer::Diff(const TransferImage& previous, const TransferImage& image, std::vector<DeltaOp>& ops)
+{
+    const unsigned long B = DELTA_BLOCKSIZE;
+    ops.clear();
+    if (previous.size() < B) {
+        if (image.size() > 0)
+            ops.push_back(DeltaOp(false, 0, image.size()));
+        return;
+    }
+
+    /* index the blocks of the previous image on their weak checksum */
+    std::multimap<unsigned long, unsigned long> index;
+    for (unsigned long offset = 0; offset + B <= previous.size(); offset += B) {
+        unsigned long a = 0, b = 0;
+        for (unsigned long i = 0; i < B; i++) {
+            a += previous[offset + i];
+            b += (B - i) * previous[offset + i];
+        }
+        index.insert(std::make_pair(((b & 0xffff) << 16) | (a & 0xffff), offset));
+    }
+
+    unsigned long literal = 0;  /* start of the pending literal data */
+    unsigned long pos = 0;
+    unsigned long a = 0, b = 0;
+    bool valid = false;
+    while (pos + B <= image.size()) {
+        if (!valid) {
+            a = b = 0;
+            for (unsigned long i = 0; i < B; i++) {
+                a += image[pos + i];
+                b += (B - i) * image[pos + i];
+            }
+            valid = true;
+        }
+        /* the weak checksum selects candidates, the comparison confirms (the
+           previous image is at hand, so no strong hash is needed) */
+        long match = -1;
+        std::pair<std::multimap<unsigned long, unsigned long>::iterator, std::multimap<unsigned long, unsigned long>::iterator> range;
+        range = index.equal_range(((b & 0xffff) << 16) | (a & 0xffff));
+        for (std::multimap<unsigned long, unsigned long>::iterator it = range.first; it != range.second && match < 0; ++it)
+            if (memcmp(&previous[it->second], &image[pos], B) == 0)
+                match = (long)it->second;
+        if (match >= 0) {
+            if (pos > literal)
+                AddOp(ops, false, literal, pos - literal);
+            AddOp(ops, true, (unsigned long)match, B);
+            pos += B;
+            literal = pos;
+            valid = false;
+        } else {
+            /* roll the window by one byte */
+            if (pos + B < image.size()) {
+                unsigned char out = image[pos];
+                unsigned char in = image[pos + B];
+                a = a - out + in;
+                b = b - B * out + a;
+            }
+            pos++;
+        }
+    }
+    if (literal < image.size())
+        AddOp(ops, false, literal, image.size() - literal);
+}
+
+wxThread::ExitCode CSerialTransfer::Entry()
+{
+    wxFile file;
+    if (!file.Open(m_path)) {
+        Post(TRANSFER_FAILED, 0, "Cannot read " + m_path);
+        return (ExitCode)1;
+    }
+    m_image.resize(file.Length());
+    if (m_image.size() > 0 && file.Read(&m_image[0], m_image.size()) != (ssize_t)m_image.size()) {
+        Post(TRANSFER_FAILED, 0, "Cannot read " + m_path);
+        return (ExitCode)1;
+    }
+    file.Close();
+
+    HCOM* hcom;
+    {
+        wxMutexLocker lock(SerialPortLock());
+        hcom = rs232_open(m_port.utf8_str(), (unsigned)m_baudrate, 8, 1, PAR_NONE, FLOWCTRL_NONE);
+    }
+    if (!hcom) {
+        Post(TRANSFER_FAILED, 0, "Cannot open port " + m_port);
+        return (ExitCode)1;
+    }
+    m_hcom = hcom;
+    rs232_flush(hcom);
+    m_clock.Start();
+
+    wxString error;
+    bool success = true;
+    if (SendPatch(error) <= 0) {
+        /* patch not possible or not accepted: send the complete image, unless
+           the transfer failed or was aborted */
+        success = error.IsEmpty() && SendFull(error);
+    }
+
+    {
+        wxMutexLocker lock(SerialPortLock());
+        rs232_close(hcom);
+    }
+    m_hcom = NULL;
+    if (!success) {
+        Post(TRANSFER_FAILED, 0, error);
+        return (ExitCode)1;
+    }
+    Post(TRANSFER_DONE, m_image.size());
+    return (ExitCode)0;
+}
+
+/** SendPatch() returns 1 if the device accepted the patch, 0 if the image
+ *  must be sent in full, or -1 on error.
+ */
+int CSerialTransfer::SendPatch(wxString& error)
+{
+    if (m_previous.size() == 0)
+        return 0;
+    std::vector<DeltaOp> ops;
+    Diff(m_previous, m_image, ops);
+    /* check that the patch is smaller than the image (including the frame
+       overhead of 10 bytes per frame) */
+    unsigned long cost = 0;
+    for (unsigned idx = 0; idx < ops.size(); idx++) {
+        if (ops[idx].Copy)
+            cost += 10 + 8;
+        else
+            cost += ops[idx].Length + 10 * ((ops[idx].Length + TRANSFER_BLOCKSIZE - 1) / TRANSFER_BLOCKSIZE);
+    }
+    if (cost >= m_image.size())
+        return 0;
+
+    wxScopedCharBuffer utf8 = m_path.AfterLast(DIRSEP_CHAR).utf8_str();
+    std::vector<unsigned char> start(8 + utf8.length());
+    put32(&start[0], m_image.size());
+    put32(&start[4], Crc32(0, m_previous.data(), m_previous.size()));
+    memcpy(&start[8], utf8.data(), utf8.length());
+    int reply = Exchange('P', &start[0], start.size(), 1, error);
+    if (reply != 'A') {
+        /* a device without support for patches may not reply at all (the
+           caller should then not try a patch on this port again) */
+        m_unanswered = (reply == 0 && error.IsEmpty());
+        return error.IsEmpty() ? 0 : -1;
+    }
+
+    unsigned long done = 0;
+    for (unsigned idx = 0; idx < ops.size(); idx++) {
+        const DeltaOp& op = ops[idx];
+        if (op.Copy) {
+            unsigned char payload[8];
+            put32(payload, op.Offset);
+            put32(payload + 4, op.Length);
+            if (Exchange('C', payload, sizeof payload, TRANSFER_RETRIES, error) != 'A')
+                return error.IsEmpty() ? 0 : -1;
+        } else {
+            for (unsigned long offset = 0; offset < op.Length; offset += TRANSFER_BLOCKSIZE) {
+                size_t length = wxMin((unsigned long)TRANSFER_BLOCKSIZE, op.Length - offset);
+                if (Exchange('D', &m_image[op.Offset + offset], length, TRANSFER_RETRIES, error) != 'A')
+                    return error.IsEmpty() ? 0 : -1;
+                Progress(done + offset + length);
+            }
+        }
+        done += op.Length;
+        Progress(done);
+    }
+
+    unsigned char crc[4];
+    put32(crc, Crc32(0, m_image.data(), m_image.size()));
+    if (Exchange('E', crc, sizeof crc, TRANSFER_RETRIES, error) != 'A')
+        return error.IsEmpty() ? 0 : -1;
+    m_patched = true;
+    return 1;
+}
+
+bool CSerialTransfer::SendFull(wxString& error)
+{
+    Progress(0);
+    wxScopedCharBuffer utf8 = m_path.AfterLast(DIRSEP_CHAR).utf8_str();
+    std::vector<unsigned char> start(4 + utf8.length());
+    put32(&start[0], m_image.size());
+    memcpy(&start[4], utf8.data(), utf8.length());
+    if (Exchange('S', &start[0], start.size(), TRANSFER_RETRIES, error) != 'A') {
+        if (error.IsEmpty())
+            error = "No acknowledge from the device";
+        return false;
+    }
+    unsigned long sent;
+    for (sent = 0; sent < m_image.size(); ) {
+        size_t length = wxMin((size_t)TRANSFER_BLOCKSIZE, m_image.size() - sent);
+        if (Exchange('D', &m_image[sent], length, TRANSFER_RETRIES, error) != 'A') {
+            if (error.IsEmpty())
+                error = wxString::Format("No acknowledge from the device (after %lu bytes)", sent);
+            return false;
+        }
+        sent += length;
+        Progress(sent);
+    }
+    if (Exchange('E', NULL, 0, TRANSFER_RETRIES, error) != 'A') {
+        if (error.IsEmpty())
+            error = "No acknowledge from the device (at the end)";
+        return false;
+    }
+    return true;
+}
+
+/** Exchange() sends a frame and waits for the reply, and it sends the frame
+ *  again (up to the number of attempts) on a negative acknowledge or a
+ *  time-out. It returns 'A' or 'U' for the reply, or 0 on failure; the error
+ *  string is only set when the port fails or the transfer is aborted.
+ */
+int CSerialTransfer::Exchange(int type, const unsigned char* payload, size_t size, int attempts, wxString& error)
+{
+    int reply = 0;
+    for (int attempt = 0; attempt < attempts && reply != 'A' && reply != 'U'; attempt++) {
+        if (TestDestroy()) {
+            error = "Transfer aborted";
+            return 0;
+        }
+        if (!SendFrame(type, m_seq, payload, size)) {
+            error = "Failure writing to port " + m_port;
+            return 0;
+        }
+        reply = WaitReply(m_seq);
+    }
+    m_seq = (m_seq + 1) & 0xffff;
+    return (reply == 'A' || reply == 'U') ? reply : 0;
+}
+
+/** SendFrame() builds the frame in a single buffer and writes it at once;
+ *  the port is not drained after the write.
+ */
+bool CSerialTransfer::SendFrame(int type, int seq, const unsigned char* payload, size_t size)
+{
+    m_frame.resize(6 + size + 4);
+    m_frame[0] = FRAME_MARK;
+    m_frame[1] = (unsigned char)type;
+    m_frame[2] = (unsigned char)seq;
+    m_frame[3] = (unsigned char)(seq >> 8);
+    m_frame[4] = (unsigned char)size;
+    m_frame[5] = (unsigned char)(size >> 8);
+    if (size > 0)
+        memcpy(&m_frame[6], payload, size);
+    unsigned long crc = Crc32(0, &m_frame[1], 5 + size);
+    for (int i = 0; i < 4; i++)
+        m_frame[6 + size + i] = (unsigned char)(crc >> (8 * i));
+    m_replylen = 0;
+    size_t written = rs232_xmit((HCOM*)m_hcom, &m_frame[0], m_frame.size());
+    return written == m_frame.size();
+}
+
+/** WaitReply() returns 'A', 'N' or 'U' for a reply to the frame with the given
+ *  sequence number, or 0 on a time-out. Replies to other frames (late replies
+ *  to an earlier attempt) and stray bytes are skipped. The wait is blocking,
+ *  but in slices, so that an abort request is still noticed.
+ */
+int CSerialTransfer::WaitReply(int seq)
+{
+    wxStopWatch clock;
+    long remaining;
+    while ((remaining = TRANSFER_TIMEOUT - clock.Time()) > 0 && !TestDestroy()) {
+        int result = rs232_wait((HCOM*)m_hcom, (int)wxMin(remaining, 100L));
+        if (result < 0)
+            return 0;
+        if (result == 0)
+            continue;
+        unsigned char buffer[64];
+        size_t count = rs232_recv((HCOM*)m_hcom, buffer, sizeof buffer);
+        for (size_t idx = 0; idx < count; idx++) {
+            unsigned char ch = buffer[idx];
+            if (m_replylen == 0 && ch != FRAME_MARK)
+                continue;
+            m_reply[m_replylen++] = ch;
+            if (m_replylen == 4) {
+                m_replylen = 0;
+                int rseq = m_reply[2] | (m_reply[3] << 8);
+                if ((m_reply[1] == 'A' || m_reply[1] == 'N' || m_reply[1] == 'U') && rseq == seq)
+                    return m_reply[1];
+            }
+        }
+    }
+    return 0;
+}
+
+void CSerialTransfer::Progress(unsigned long bytes)
+{
+    if (m_clock.Time() - m_lastupdate >= TRANSFER_INTERVAL) {
+        m_lastupdate = m_clock.Time();
+        Post(TRANSFER_PROGRESS, bytes);
+    }
+}
+
+void CSerialTransfer::Post(int type, long bytes, const wxString& text)
+{
+    wxThreadEvent* event = new wxThreadEvent(wxEVT_THREAD, m_id);
+    event->SetInt(type);
+    event->SetExtraLong(bytes);
+    event->SetString(text);
+    event->SetPayload(m_port);
+    wxQueueEvent(m_owner, event);
+}
@@ -0,0 +1,127 @@
+/*  Quincy IDE for the Pawn scripting language
+ *
+ *  Copyright CompuPhase, 2009-2024
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License"); you may not
+ *  use this file except in compliance with the License. You may obtain a copy
+ *  of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS, WITHOUT
+ *  WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. See the
+ *  License for the specific language governing permissions and limitations
+ *  under the License.
+ *
+ *  Version: $Id$
+ */
+#ifndef _SERIALTRANSFER_H
+#define _SERIALTRANSFER_H
+
+#include <wx/wx.h>
+#include <wx/stopwatch.h>
+#include <wx/thread.h>
+#include <vector>
+
+enum {
+    TRANSFER_PROGRESS,  /* event int: bytes sent so far is in GetExtraLong() */
+    TRANSFER_DONE,
+    TRANSFER_FAILED,    /* event string holds the reason */
+};  /* the payload of all events is the port name */
+
+#define TRANSFER_BLOCKSIZE  1024    /* payload bytes in a data block */
+#define TRANSFER_RETRIES    4       /* attempts per block before giving up */
+#define TRANSFER_TIMEOUT    2000    /* milliseconds to wait for an acknowledge */
+#define TRANSFER_INTERVAL   200     /* milliseconds between TRANSFER_PROGRESS events */
+#define DELTA_BLOCKSIZE     128     /* block size for matching against the previous image */
+
+typedef std::vector<unsigned char> TransferImage;
+
+wxMutex& SerialPortLock();
+
+struct DeltaOp {
+    DeltaOp(bool copy, unsigned long offset, unsigned long length)
+        : Copy(copy), Offset(offset), Length(length)
+        {}
+    bool Copy;              /* copy from the previous image, or literal data from the new image */
+    unsigned long Offset;   /* offset in the previous image (copy) or in the new image (literal) */
+    unsigned long Length;
+};
+
+/* The serial transfer sends a compiled script to a device over a serial port
+ * (or a pseudo-terminal that stands in for one), without going through
+ * pawndbg. The host configuration enables it with "#transfer:native".
+ *
+ * All frames start with a mark byte, followed by a type, a sequence number
+ * and a payload length (both 16-bit, Little Endian), the payload and a CRC-32
+ * over the type, sequence, length and payload (32-bit, Little Endian):
+ *
+ *      0xbf  type  seq(2)  len(2)  payload(len)  crc(4)
+ *
+ * The types are 'S' (start; payload is the file size as 32-bit Little Endian
+ * value followed by the base name of the file), 'D' (data; at most
+ * TRANSFER_BLOCKSIZE bytes) and 'E' (end; no payload). The device replies to
+ * every frame with a 4-byte acknowledge or a negative acknowledge:
+ *
+ *      0xbf  'A' | 'N'  seq(2)
+ *
+ * A frame is sent again on a negative acknowledge, on a CRC error reported
+ * by the device or when no reply arrives within TRANSFER_TIMEOUT.
+ *
+ * When the image that was last sent to the port is known, the transfer first
+ * tries a patch. A 'P' frame (payload: size of the new image, CRC-32 of the
+ * previous image, both 32-bit Little Endian, and the base name) asks the
+ * device to build the new image from the one it holds. The device replies
+ * 'A' if it holds an image with that CRC and supports patching, or 'U' if it
+ * does not. The patch is a sequence of 'C' frames (copy; payload is an offset
+ * in the previous image and a length, both 32-bit Little Endian) and 'D'
+ * frames with literal data, which together produce the new image from start
+ * to end. The closing 'E' frame holds the CRC-32 of the complete new image; the
+ * device checks it before it replaces the old image. If the device does not
+ * acknowledge the patch, the image is sent in full.
+ */
+class CSerialTransfer : public wxThread {
+public:
+    CSerialTransfer(wxEvtHandler* owner, int id, const wxString& port, long baudrate, const wxString& path,
+                    const TransferImage& previous = TransferImage());
+
+    const wxString& GetPort() const { return m_port; }
+    const TransferImage& GetImage() const { return m_image; }   /* valid after the thread ended */
+    bool Patched() const { return m_patched; }
+    bool PatchUnanswered() const { return m_unanswered; }  /* no reply to the 'P' frame */
+
+    static unsigned long Crc32(unsigned long crc, const unsigned char* data, size_t size);
+    static void Diff(const TransferImage& previous, const TransferImage& image, std::vector<DeltaOp>& ops);
+
+protected:
+    virtual ExitCode Entry();
+
+private:
+    int SendPatch(wxString& error);
+    bool SendFull(wxString& error);
+    int Exchange(int type, const unsigned char* payload, size_t size, int attempts, wxString& error);
+    bool SendFrame(int type, int seq, const unsigned char* payload, size_t size);
+    int WaitReply(int seq);
+    void Progress(unsigned long bytes);
+    void Post(int type, long bytes, const wxString& text = wxEmptyString);
+
+    wxEvtHandler* m_owner;
+    int m_id;
+    wxString m_port;
+    long m_baudrate;
+    wxString m_path;
+    TransferImage m_previous;   /* image last sent to the port (may be empty) */
+    TransferImage m_image;      /* image to send */
+    bool m_patched;
+    bool m_unanswered;
+    int m_seq;
+    wxStopWatch m_clock;
+    long m_lastupdate;
+    void* m_hcom;               /* HCOM* of rs232.c (not in this header, to keep <windows.h> out) */
+    std::vector<unsigned char> m_frame;
+    unsigned char m_reply[4];
+    int m_replylen;
+};
+
+#endif /* _SERIALTRANSFER_H */
@@ -0,0 +1,81 @@
+/*  Quincy IDE for the Pawn scripting language
+ *
+ *  Copyright CompuPhase, 2009-2024
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License"); you may not
+ *  use this file except in compliance with the License. You may obtain a copy
+ *  of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS, WITHOUT
+ *  WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. See the
+ *  License for the specific language governing permissions and limitations
+ *  under the License.
+ *
+ *  Version: $Id$
+ */
+#include "wxQuincy.h"
+#include "Serialize.h"
+
+void PutNumber(std::string& buffer, unsigned long value)
+{
+    for (int idx = 0; idx < 4; idx++)
+        buffer += (char)((value >> (8 * idx)) & 0xff);
+}
+
+void PutString(std::string& buffer, const wxString& text)
+{
+    wxScopedCharBuffer utf8 = text.utf8_str();
+    PutNumber(buffer, (unsigned long)utf8.length());
+    buffer.append(utf8.data(), utf8.length());
+}
+
+void PutString(std::string& buffer, const CPoolString& text)
+{
+    unsigned length = StringPool.Length(text.Id());
+    PutNumber(buffer, (unsigned long)length);
+    buffer.append(text.UTF8(), length);
+}
+
+bool GetNumber(const char*& ptr, const char* end, unsigned long* value)
+{
+    if (end - ptr < 4)
+        return false;
+    *value = 0;
+    for (int idx = 0; idx < 4; idx++)
+        *value |= (unsigned long)(unsigned char)ptr[idx] << (8 * idx);
+    ptr += 4;
+    return true;
+}
+
+/* GetText() returns the start and the length of the text of a string */
+static bool GetText(const char*& ptr, const char* end, const char** text, unsigned long* length)
+{
+    if (!GetNumber(ptr, end, length) || (unsigned long)(end - ptr) < *length)
+        return false;
+    *text = ptr;
+    ptr += *length;
+    return true;
+}
+
+bool GetString(const char*& ptr, const char* end, wxString& text)
+{
+    const char* start;
+    unsigned long length;
+    if (!GetText(ptr, end, &start, &length))
+        return false;
+    text = wxString::FromUTF8(start, length);
+    return true;
+}
+
+bool GetString(const char*& ptr, const char* end, CPoolString& text)
+{
+    const char* start;
+    unsigned long length;
+    if (!GetText(ptr, end, &start, &length))
+        return false;
+    text = CPoolString::FromUTF8(start, length);
+    return true;
+}
@@ -0,0 +1,39 @@
+/*  Quincy IDE for the Pawn scripting language
+ *
+ *  Copyright CompuPhase, 2009-2024
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License"); you may not
+ *  use this file except in compliance with the License. You may obtain a copy
+ *  of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS, WITHOUT
+ *  WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. See the
+ *  License for the specific language governing permissions and limitations
+ *  under the License.
+ *
+ *  Version: $Id$
+ */
+#ifndef _SERIALIZE_H
+#define _SERIALIZE_H
+
+#include <wx/wx.h>
+#include <string>
+#include "StringPool.h"
+
+/* Helpers for the cache files (of the symbol browser and of the source
+ * indexer). A number is stored as 32-bit Little Endian value, a string as its
+ * length in bytes followed by the UTF-8 text (without terminating zero). The
+ * Get functions advance the pointer, and they return false if the buffer is
+ * too short.
+ */
+void PutNumber(std::string& buffer, unsigned long value);
+void PutString(std::string& buffer, const wxString& text);
+void PutString(std::string& buffer, const CPoolString& text);
+bool GetNumber(const char*& ptr, const char* end, unsigned long* value);
+bool GetString(const char*& ptr, const char* end, wxString& text);
+bool GetString(const char*& ptr, const char* end, CPoolString& text);
+
+#endif /* _SERIALIZE_H */
@@ -0,0 +1,1132 @@
+/*  Quincy IDE for the Pawn scripting language
+ *
+ *  Copyright CompuPhase, 2009-2024
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License"); you may not
+ *  use this file except in compliance with the License. You may obtain a copy
+ *  of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS, WITHOUT
+ *  WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. See the
+ *  License for the specific language governing permissions and limitations
+ *  under the License.
+ *
+ *  Version: $Id$
+ */
+#include "wxQuincy.h"
+#include <wx/dir.h>
+#include <wx/ffile.h>
+#include <wx/filefn.h>
+#include <wx/filename.h>
+#include <algorithm>
+#include <ctype.h>
+#include <string.h>
+#include <string>
+#include "Serialize.h"
+#include "SourceIndexer.h"
+
+enum {
+    TOK_NAME,
+    TOK_NUMBER,
+    TOK_STRING,     /* string or character literal */
+    TOK_PUNCT,      /* a single character */
+    TOK_DOC,        /* documentation comment */
+};
+
+struct Token {
+    Token(int type, size_t start, size_t end, int line) : Type(type), Start(start), End(end), Line(line) {}
+    int Type;
+    size_t Start, End;  /* byte offsets in the source */
+    int Line;           /* 1-based */
+};
+
+/* The tokenizer drops comments (except documentation comments) and the
+   preprocessor directives; #define directives are stored as constants. The
+   uses of identifiers (outside comments and strings, and also in directives)
+   and the names in #include directives are optionally collected too. */
+class IndexParser {
+public:
+    IndexParser(const char* text, size_t size, IndexSymbols& symbols, IndexUses* uses, std::vector<wxString>* includes)
+        : m_text(text), m_size(size), m_symbols(symbols), m_uses(uses), m_includes(includes)
+        {}
+    void Tokenize();
+    void Parse();
+    void CollectUses();
+
+private:
+    void Directive(size_t start, size_t end, int line);
+    void Include(const std::string& text, size_t pos);
+    void DirectiveUses(size_t start, size_t end, int line, size_t linestart);
+    void AddUse(size_t start, size_t end, int line, size_t linestart);
+    size_t Statement(size_t idx, const wxString& doc);
+    size_t Function(size_t idx, size_t name, size_t first, bool declaration, const wxString& doc);
+    size_t Variables(size_t idx, bool constant, const wxString& doc);
+    size_t Enumeration(size_t idx, const wxString& doc);
+    size_t SkipBlock(size_t idx) const;
+    size_t SkipBody(size_t idx) const;
+    bool IsDeclaration(size_t idx) const;
+    size_t SkipStatement(size_t idx) const;
+    void Add(const wxString& name, const wxString& syntax, int line, const wxString& doc);
+
+    bool IsPunct(size_t idx, char c) const
+        { return idx < m_tokens.size() && m_tokens[idx].Type == TOK_PUNCT && m_text[m_tokens[idx].Start] == c; }
+    bool IsName(size_t idx) const
+        { return idx < m_tokens.size() && m_tokens[idx].Type == TOK_NAME; }
+    bool IsWord(size_t idx, const char* word) const;
+    bool IsFirstColumn(size_t idx) const
+        { return idx < m_tokens.size() && (m_tokens[idx].Start == 0 || m_text[m_tokens[idx].Start - 1] == '\n'); }
+    bool IsTag(size_t idx) const
+        { return IsName(idx) && IsPunct(idx + 1, ':') && !IsPunct(idx + 2, ':'); }
+    wxString Text(size_t idx) const
+        { return wxString::FromUTF8(m_text + m_tokens[idx].Start, m_tokens[idx].End - m_tokens[idx].Start); }
+    wxString Text(size_t first, size_t last) const;
+    static wxString CleanDoc(const wxString& text);
+
+    const char* m_text;
+    size_t m_size;
+    IndexSymbols& m_symbols;
+    IndexUses* m_uses;
+    std::vector<wxString>* m_includes;
+    std::vector<Token> m_tokens;
+    std::map<std::string, std::vector<IndexUse> > m_names;  /* uses, collected in CollectUses() */
+};
+
+static bool IsNameChar(char c, bool first)
+{
+    return isalpha((unsigned char)c) || c == '_' || c == '@' || (!first && isdigit((unsigned char)c));
+}
+
+static bool IsKeyword(const char* text, size_t length)
+{
+    static const char* keywords[] = { "assert", "break", "case", "char", "const", "continue",
+                                      "default", "defined", "do", "else", "enum", "exit", "for",
+                                      "forward", "goto", "if", "native", "new", "operator",
+                                      "public", "return", "sizeof", "sleep", "state", "static",
+                                      "stock", "switch", "tagof", "while" };
+    for (unsigned idx = 0; idx < WXSIZEOF(keywords); idx++)
+        if (strlen(keywords[idx]) == length && strncmp(keywords[idx], text, length) == 0)
+            return true;
+    return false;
+}
+
+void IndexParser::Tokenize()
+{
+    size_t pos = 0;
+    int line = 1;
+    size_t linepos = 0;     /* offset of the start of the line */
+    bool linestart = true;
+    while (pos < m_size) {
+        char c = m_text[pos];
+        if (c == '\n') {
+            line++;
+            linestart = true;
+            linepos = ++pos;
+        } else if (isspace((unsigned char)c)) {
+            pos++;
+        } else if (c == '/' && pos + 1 < m_size && m_text[pos + 1] == '/') {
+            size_t start = pos;
+            while (pos < m_size && m_text[pos] != '\n')
+                pos++;
+            if (start + 2 < m_size && m_text[start + 2] == '/') {
+                /* consecutive "///" lines form a single comment */
+                if (m_tokens.size() > 0 && m_tokens.back().Type == TOK_DOC && m_text[m_tokens.back().Start] == '/'
+                    && m_tokens.back().Line == line - 1)
+                {
+                    m_tokens.back().End = pos;
+                    m_tokens.back().Line = line;
+                } else {
+                    m_tokens.push_back(Token(TOK_DOC, start, pos, line));
+                }
+            }
+        } else if (c == '/' && pos + 1 < m_size && m_text[pos + 1] == '*') {
+            size_t start = pos;
+            pos += 2;
+            while (pos + 1 < m_size && !(m_text[pos] == '*' && m_text[pos + 1] == '/')) {
+                if (m_text[pos] == '\n') {
+                    line++;
+                    linepos = pos + 1;
+                }
+                pos++;
+            }
+            pos = (pos + 1 < m_size) ? pos + 2 : m_size;
+            if (start + 3 < pos && m_text[start + 2] == '*' && m_text[start + 3] != '/')
+                m_tokens.push_back(Token(TOK_DOC, start, pos, line));
+        } else if (c == '#' && linestart) {
+            size_t start = pos;
+            size_t firstpos = linepos;
+            int first = line;
+            while (pos < m_size && m_text[pos] != '\n') {
+                if (m_text[pos] == '\\' && pos + 1 < m_size && (m_text[pos + 1] == '\n' || m_text[pos + 1] == '\r')) {
+                    /* line continuation */
+                    while (pos < m_size && m_text[pos] != '\n')
+                        pos++;
+                    line++;
+                    linepos = pos + 1;
+                }
+                pos++;
+            }
+            Directive(start, pos, first);
+            if (m_uses)
+                DirectiveUses(start, pos, first, firstpos);
+        } else {
+            linestart = false;
+            size_t start = pos;
+            if (IsNameChar(c, true)) {
+                while (pos < m_size && IsNameChar(m_text[pos], false))
+                    pos++;
+                m_tokens.push_back(Token(TOK_NAME, start, pos, line));
+                if (m_uses)
+                    AddUse(start, pos, line, linepos);
+            } else if (isdigit((unsigned char)c)) {
+                while (pos < m_size && (isalnum((unsigned char)m_text[pos]) || m_text[pos] == '.' || m_text[pos] == '_'))
+                    pos++;
+                m_tokens.push_back(Token(TOK_NUMBER, start, pos, line));
+            } else if (c == '"' || c == '\'' || (c == '\\' && pos + 1 < m_size && m_text[pos + 1] == '"')) {
+                bool raw = (c == '\\');
+                if (raw)
+                    pos++;
+                char quote = m_text[pos++];
+                while (pos < m_size && m_text[pos] != quote && m_text[pos] != '\n') {
+                    if (!raw && m_text[pos] == '\\' && pos + 1 < m_size && m_text[pos + 1] != '\n')
+                        pos++;
+                    pos++;
+                }
+                if (pos < m_size && m_text[pos] == quote)
+                    pos++;
+                m_tokens.push_back(Token(TOK_STRING, start, pos, line));
+            } else {
+                pos++;
+                m_tokens.push_back(Token(TOK_PUNCT, start, pos, line));
+            }
+        }
+    }
+}
+
+void IndexParser::Directive(size_t start, size_t end, int line)
+{
+    std::string text(m_text + start + 1, end - start - 1);
+    size_t pos = text.find_first_not_of(" \t");
+    if (pos == std::string::npos)
+        return;
+    size_t wordstart = pos;
+    while (pos < text.length() && IsNameChar(text[pos], false))
+        pos++;
+    std::string word = text.substr(wordstart, pos - wordstart);
+    if (word == "include" || word == "tryinclude") {
+        if (m_includes)
+            Include(text, pos);
+        return;
+    }
+    if (word != "define")
+        return;
+    pos = text.find_first_not_of(" \t", pos);
+    if (pos == std::string::npos || !IsNameChar(text[pos], true))
+        return;
+    size_t namestart = pos;
+    while (pos < text.length() && IsNameChar(text[pos], false))
+        pos++;
+    wxString name = wxString::FromUTF8(text.c_str() + namestart, pos - namestart);
+    /* the value, without a trailing comment */
+    std::string value = text.substr(pos);
+    size_t cmt = value.find("//");
+    if (cmt != std::string::npos)
+        value.erase(cmt);
+    cmt = value.find("/*");
+    if (cmt != std::string::npos)
+        value.erase(cmt);
+    wxString syntax = wxString::FromUTF8(value.c_str());
+    syntax.Replace("\\\r\n", " ");
+    syntax.Replace("\\\n", " ");
+    syntax.Trim(true);
+    syntax.Trim(false);
+    if (syntax.Length() > 0 && syntax[0] != '(')
+        syntax = name + " (" + syntax + ")";
+    else
+        syntax = name + syntax;     /* a macro with parameters */
+    Add("C:" + name, syntax, line, wxEmptyString);
+}
+
+/* Include() stores the file name of an #include or #tryinclude directive,
+   with a "<" or a double quote in front, for how the file is looked up (a
+   name without quotes is looked up like one in double quotes) */
+void IndexParser::Include(const std::string& text, size_t pos)
+{
+    pos = text.find_first_not_of(" \t", pos);
+    if (pos == std::string::npos)
+        return;
+    std::string name;
+    if (text[pos] == '<' || text[pos] == '"') {
+        size_t end = text.find((text[pos] == '<') ? '>' : '"', pos + 1);
+        if (end == std::string::npos)
+            return;
+        name = text.substr(pos, end - pos);
+    } else {
+        size_t end = text.find_first_of(" \t\r", pos);
+        name = '"' + text.substr(pos, (end == std::string::npos) ? std::string::npos : end - pos);
+    }
+    if (name.length() > 1)
+        m_includes->push_back(wxString::FromUTF8(name.c_str()));
+}
+
+void IndexParser::AddUse(size_t start, size_t end, int line, size_t linestart)
+{
+    if (!IsKeyword(m_text + start, end - start))
+        m_names[std::string(m_text + start, end - start)].push_back(IndexUse(line, (int)(start - linestart)));
+}
+
+/* DirectiveUses() collects the identifiers in a directive (after the name of
+   the directive), skipping strings and comments */
+void IndexParser::DirectiveUses(size_t start, size_t end, int line, size_t linestart)
+{
+    size_t pos = start + 1;
+    while (pos < end && (m_text[pos] == ' ' || m_text[pos] == '\t'))
+        pos++;
+    size_t directive = pos;
+    while (pos < end && IsNameChar(m_text[pos], false))
+        pos++;      /* skip the directive name */
+    bool include = (pos - directive == 7 && strncmp(m_text + directive, "include", 7) == 0)
+                   || (pos - directive == 10 && strncmp(m_text + directive, "tryinclude", 10) == 0);
+    while (pos < end) {
+        char c = m_text[pos];
+        if (c == '\n') {
+            line++;
+            linestart = ++pos;
+        } else if (c == '/' && pos + 1 < end && m_text[pos + 1] == '/') {
+            break;
+        } else if (c == '/' && pos + 1 < end && m_text[pos + 1] == '*') {
+            pos += 2;
+            while (pos + 1 < end && !(m_text[pos] == '*' && m_text[pos + 1] == '/')) {
+                if (m_text[pos] == '\n') {
+                    line++;
+                    linestart = pos + 1;
+                }
+                pos++;
+            }
+            pos += 2;
+        } else if (c == '"' || c == '\'' || (c == '<' && include)) {
+            /* a string, or the file name of an #include */
+            char quote = (c == '<') ? '>' : c;
+            pos++;
+            while (pos < end && m_text[pos] != quote && m_text[pos] != '\n')
+                pos++;
+            if (pos < end && m_text[pos] == quote)
+                pos++;
+        } else if (IsNameChar(c, true)) {
+            size_t name = pos;
+            while (pos < end && IsNameChar(m_text[pos], false))
+                pos++;
+            AddUse(name, pos, line, linestart);
+        } else if (isdigit((unsigned char)c)) {
+            while (pos < end && (isalnum((unsigned char)m_text[pos]) || m_text[pos] == '_'))
+                pos++;
+        } else {
+            pos++;
+        }
+    }
+}
+
+/* CollectUses() moves the uses that the tokenizer found to the result */
+void IndexParser::CollectUses()
+{
+    if (!m_uses)
+        return;
+    for (std::map<std::string, std::vector<IndexUse> >::iterator iter = m_names.begin(); iter != m_names.end(); ++iter)
+        (*m_uses)[wxString::FromUTF8(iter->first.c_str())].swap(iter->second);
+    m_names.clear();
+}
+
+bool IndexParser::IsWord(size_t idx, const char* word) const
+{
+    if (!IsName(idx))
+        return false;
+    size_t length = m_tokens[idx].End - m_tokens[idx].Start;
+    return length == strlen(word) && strncmp(m_text + m_tokens[idx].Start, word, length) == 0;
+}
+
+/* Text() returns the source text of a range of tokens (inclusive), with a
+   single space where the source has white space or a comment */
+wxString IndexParser::Text(size_t first, size_t last) const
+{
+    std::string text;
+    for (size_t idx = first; idx <= last && idx < m_tokens.size(); idx++) {
+        if (m_tokens[idx].Type == TOK_DOC)
+            continue;
+        if (text.length() > 0 && m_tokens[idx].Start > m_tokens[idx - 1].End)
+            text += ' ';
+        text.append(m_text + m_tokens[idx].Start, m_tokens[idx].End - m_tokens[idx].Start);
+    }
+    return wxString::FromUTF8(text.c_str());
+}
+
+/* CleanDoc() strips the comment delimiters, the leading asterisks and any XML
+   markup from a documentation comment */
+wxString IndexParser::CleanDoc(const wxString& text)
+{
+    wxString result;
+    bool markup = false;
+    bool space = false;
+    bool linestart = true;
+    size_t length = text.Length();
+    for (size_t idx = 0; idx < length; idx++) {
+        wxChar c = text[idx];
+        if (c == '\n') {
+            linestart = true;
+            space = true;
+            continue;
+        }
+        if (linestart && (c == '/' || c == '*' || c == ' ' || c == '\t'))
+            continue;   /* comment delimiters at the start of the line */
+        linestart = false;
+        if (c == '<')
+            markup = true;
+        if (markup) {
+            if (c == '>') {
+                markup = false;
+                space = true;
+            }
+            continue;
+        }
+        if (c == ' ' || c == '\t' || c == '\r') {
+            space = true;
+            continue;
+        }
+        if (space && result.Length() > 0)
+            result += ' ';
+        space = false;
+        result += c;
+    }
+    if (result.EndsWith("*/"))
+        result.RemoveLast(2);
+    result.Trim(true);
+    return result;
+}
+
+void IndexParser::Add(const wxString& name, const wxString& syntax, int line, const wxString& doc)
+{
+    m_symbols.push_back(IndexSymbol(name, syntax, line));
+    if (doc.Length() > 0)
+        m_symbols.back().Summary = CleanDoc(doc);
+}
+
+/* SkipBlock() returns the index of the token after the brace (or bracket or
+   parenthesis) that matches the one at idx */
+size_t IndexParser::SkipBlock(size_t idx) const
+{
+    int nest = 0;
+    for ( ; idx < m_tokens.size(); idx++) {
+        if (m_tokens[idx].Type != TOK_PUNCT)
+            continue;
+        char c = m_text[m_tokens[idx].Start];
+        if (c == '{' || c == '(' || c == '[')
+            nest++;
+        else if ((c == '}' || c == ')' || c == ']') && --nest <= 0)
+            return idx + 1;
+    }
+    return idx;
+}
+
+/* IsDeclaration() returns true if the token is in the first column and it
+   starts a declaration (or a function definition) */
+bool IndexParser::IsDeclaration(size_t idx) const
+{
+    static const char* keywords[] = { "const", "enum", "forward", "native", "new", "public", "static", "stock" };
+    if (!IsFirstColumn(idx) || !IsName(idx))
+        return false;
+    for (unsigned k = 0; k < WXSIZEOF(keywords); k++)
+        if (IsWord(idx, keywords[k]))
+            return true;
+    if (IsTag(idx))
+        idx += 2;
+    return IsName(idx) && IsPunct(idx + 1, '(') && IsPunct(SkipBlock(idx + 1), '{');
+}
+
+/* SkipBody() skips a function body, like SkipBlock(). If the braces are not
+   balanced, the body ends at a closing brace in the first column, or before a
+   declaration in the first column. */
+size_t IndexParser::SkipBody(size_t idx) const
+{
+    int nest = 0;
+    for ( ; idx < m_tokens.size(); idx++) {
+        if (nest > 0 && IsFirstColumn(idx)) {
+            if (IsPunct(idx, '}'))
+                return idx + 1;
+            if (IsDeclaration(idx))
+                return idx;
+        }
+        if (m_tokens[idx].Type != TOK_PUNCT)
+            continue;
+        char c = m_text[m_tokens[idx].Start];
+        if (c == '{')
+            nest++;
+        else if (c == '}' && --nest <= 0)
+            return idx + 1;
+    }
+    return idx;
+}
+
+/* SkipStatement() returns the index of the token after the statement that
+   starts at idx: after the semicolon, or after a block (semicolons are
+   optional in Pawn, so it also stops before a declaration on a next line) */
+size_t IndexParser::SkipStatement(size_t idx) const
+{
+    size_t start = idx;
+    while (idx < m_tokens.size()) {
+        if (idx > start && IsDeclaration(idx))
+            return idx;
+        if (IsPunct(idx, ';'))
+            return idx + 1;
+        if (IsPunct(idx, '{'))
+            return SkipBlock(idx);
+        if (IsPunct(idx, '(') || IsPunct(idx, '['))
+            idx = SkipBlock(idx);
+        else
+            idx++;
+    }
+    return idx;
+}
+
+void IndexParser::Parse()
+{
+    wxString doc;
+    size_t idx = 0;
+    while (idx < m_tokens.size()) {
+        if (m_tokens[idx].Type == TOK_DOC) {
+            doc = Text(idx);
+            idx++;
+        } else if (IsPunct(idx, ';') || IsPunct(idx, '}')) {
+            idx++;  /* stray (unbalanced) */
+        } else if (IsPunct(idx, '{')) {
+            idx = SkipBlock(idx);
+        } else {
+            idx = Statement(idx, doc);
+            doc.Clear();
+        }
+    }
+
+    /* drop the forward declarations of the functions that the file implements */
+    std::map<wxString, size_t> definitions;
+    for (size_t idx = 0; idx < m_symbols.size(); idx++)
+        if (m_symbols[idx].Name.StartsWith("M:") && !m_symbols[idx].Syntax.StartsWith("forward ") && !m_symbols[idx].Syntax.StartsWith("native "))
+            definitions.insert(std::make_pair(m_symbols[idx].Name, idx));
+    std::vector<bool> drop(m_symbols.size(), false);
+    for (size_t idx = 0; idx < m_symbols.size(); idx++) {
+        std::map<wxString, size_t>::iterator def;
+        if (m_symbols[idx].Syntax.StartsWith("forward ") && (def = definitions.find(m_symbols[idx].Name)) != definitions.end()) {
+            if (m_symbols[def->second].Summary.IsEmpty())
+                m_symbols[def->second].Summary = m_symbols[idx].Summary;
+            drop[idx] = true;
+        }
+    }
+    IndexSymbols symbols;
+    for (size_t idx = 0; idx < m_symbols.size(); idx++)
+        if (!drop[idx])
+            symbols.push_back(m_symbols[idx]);
+    m_symbols.swap(symbols);
+}
+
+/* Statement() handles a declaration at the top level and returns the index of
+   the token after it */
+size_t IndexParser::Statement(size_t idx, const wxString& doc)
+{
+    size_t first = idx;
+    bool native = false, forward = false, variable = false, constant = false;
+    while (IsName(idx)) {
+        if (IsWord(idx, "native"))
+            native = true;
+        else if (IsWord(idx, "forward"))
+            forward = true;
+        else if (IsWord(idx, "new") || IsWord(idx, "decl"))
+            variable = true;
+        else if (IsWord(idx, "const"))
+            constant = true;
+        else if (!IsWord(idx, "public") && !IsWord(idx, "stock") && !IsWord(idx, "static"))
+            break;
+        idx++;
+    }
+    if (IsWord(idx, "enum"))
+        return Enumeration(idx + 1, doc);
+
+    size_t tag = idx;
+    if (IsTag(idx))
+        idx += 2;
+    if (IsWord(idx, "operator"))
+        return SkipStatement(idx);  /* user-defined operators are not listed */
+    if (IsName(idx) && IsPunct(idx + 1, '(') && !variable)
+        return Function(idx + 1, idx, tag, native || forward, doc);
+    if (idx > first && IsName(idx))
+        return Variables(tag, constant && !variable, doc);
+    return SkipStatement(idx > first ? idx : first + 1);
+}
+
+size_t IndexParser::Function(size_t idx, size_t name, size_t first, bool declaration, const wxString& doc)
+{
+    wxASSERT(IsPunct(idx, '('));
+    idx = SkipBlock(idx);
+    size_t last = idx - 1;  /* closing parenthesis */
+    wxString syntax = Text(first, last);
+    /* skip a state specification */
+    if (IsPunct(idx, '<')) {
+        while (idx < m_tokens.size() && !IsPunct(idx, '>') && !IsPunct(idx, ';') && !IsPunct(idx, '{'))
+            idx++;
+        if (IsPunct(idx, '>'))
+            idx++;
+    }
+    if (IsPunct(idx, ';') || IsPunct(idx, '=') || declaration) {
+        /* a declaration without body: a native function (possibly with an
+           external name) or a forward declaration */
+        bool native = (first > 0 && IsWord(first - 1, "native")) || (first > 1 && IsWord(first - 2, "native"));
+        syntax = (native ? "native " : "forward ") + syntax;
+    }
+    idx = IsPunct(idx, '{') ? SkipBody(idx) : SkipStatement(idx);
+    Add("M:" + Text(name), syntax, m_tokens[name].Line, doc);
+    return idx;
+}
+
+size_t IndexParser::Variables(size_t idx, bool constant, const wxString& doc)
+{
+    bool firstitem = true;
+    while (idx < m_tokens.size()) {
+        size_t start = idx;
+        if (IsTag(idx))
+            idx += 2;
+        if (!IsName(idx))
+            return SkipStatement(idx);
+        size_t name = idx++;
+        while (IsPunct(idx, '['))
+            idx = SkipBlock(idx);
+        size_t decl = idx - 1;
+        size_t value = 0;
+        if (IsPunct(idx, '=')) {
+            value = ++idx;
+            while (idx < m_tokens.size() && !IsPunct(idx, ',') && !IsPunct(idx, ';')) {
+                if (IsPunct(idx, '{') || IsPunct(idx, '(') || IsPunct(idx, '['))
+                    idx = SkipBlock(idx);
+                else
+                    idx++;
+            }
+        }
+        if (constant)
+            Add("C:" + Text(name), Text(name) + (value > 0 ? " (" + Text(value, idx - 1) + ")" : wxString()), m_tokens[name].Line, firstitem ? doc : wxString());
+        else
+            Add("F:" + Text(name), Text(start, decl), m_tokens[name].Line, firstitem ? doc : wxString());
+        firstitem = false;
+        if (!IsPunct(idx, ','))
+            break;
+        idx++;
+    }
+    return SkipStatement(idx);
+}
+
+size_t IndexParser::Enumeration(size_t idx, const wxString& doc)
+{
+    if (IsName(idx)) {
+        Add("T:" + Text(idx), "enum " + Text(idx), m_tokens[idx].Line, doc);
+        idx++;
+        if (IsPunct(idx, ':'))
+            idx++;
+    }
+    if (IsPunct(idx, '('))
+        idx = SkipBlock(idx);   /* increment */
+    if (!IsPunct(idx, '{'))
+        return SkipStatement(idx);
+    idx++;
+    wxString memberdoc;
+    while (idx < m_tokens.size() && !IsPunct(idx, '}')) {
+        if (m_tokens[idx].Type == TOK_DOC) {
+            /* a comment behind a member documents that member */
+            if (m_symbols.size() > 0 && m_symbols.back().Line == m_tokens[idx].Line && m_symbols.back().Summary.IsEmpty())
+                m_symbols.back().Summary = CleanDoc(Text(idx));
+            else
+                memberdoc = Text(idx);
+            idx++;
+            continue;
+        }
+        if (IsTag(idx))
+            idx += 2;
+        if (IsName(idx)) {
+            size_t name = idx++;
+            while (IsPunct(idx, '['))
+                idx = SkipBlock(idx);
+            wxString syntax = Text(name);
+            if (IsPunct(idx, '=')) {
+                size_t value = ++idx;
+                while (idx < m_tokens.size() && !IsPunct(idx, ',') && !IsPunct(idx, '}')) {
+                    if (IsPunct(idx, '(') || IsPunct(idx, '['))
+                        idx = SkipBlock(idx);
+                    else
+                        idx++;
+                }
+                if (idx > value)
+                    syntax += " (" + Text(value, idx - 1) + ")";
+            }
+            Add("C:" + Text(name), syntax, m_tokens[name].Line, memberdoc);
+            memberdoc.Clear();
+        }
+        /* skip up to the next member */
+        while (idx < m_tokens.size() && !IsPunct(idx, ',') && !IsPunct(idx, '}') && !IsPunct(idx, ';'))
+            idx++;
+        if (IsPunct(idx, ';'))
+            return idx + 1; /* closing brace is missing */
+        if (IsPunct(idx, ','))
+            idx++;
+    }
+    if (IsPunct(idx, '}'))
+        idx++;
+    if (IsPunct(idx, ';'))
+        idx++;
+    return idx;
+}
+
+
+/** Parse() collects the global symbols in the source text, and optionally
+ *  the uses of all identifiers and the names in the #include directives (see
+ *  ResolveInclude() for the format).
+ */
+void CSourceIndexer::Parse(const char* text, size_t size, IndexSymbols& symbols, IndexUses* uses,
+                           std::vector<wxString>* includes)
+{
+    IndexParser parser(text, size, symbols, uses, includes);
+    parser.Tokenize();
+    parser.Parse();
+    parser.CollectUses();
+}
+
+/** ResolveInclude() returns the full path of the file in an #include
+ *  directive, or an empty string if it is not found. The name starts with a
+ *  "<" or a double quote, like in the directive. It is looked up like the
+ *  compiler does: a name in double quotes is first looked up in the directory
+ *  of the source file, and then in the include directories; a name without
+ *  extension is tried with the extensions .inc, .p and .pawn. On a file system
+ *  that ignores case, the file name is returned in the case that it has on
+ *  disk.
+ */
+wxString CSourceIndexer::ResolveInclude(const wxString& name, const wxString& sourcedir, const wxArrayString& dirs)
+{
+    static const char* extensions[] = { ".inc", ".p", ".pawn" };
+    if (name.Length() < 2)
+        return wxEmptyString;
+    wxString file = name.Mid(1);
+    wxArrayString paths;
+    if (wxFileName(file).IsAbsolute()) {
+        paths.Add(wxEmptyString);
+    } else {
+        if (name[0] != '<' && sourcedir.Length() > 0)
+            paths.Add(sourcedir);
+        for (unsigned idx = 0; idx < dirs.Count(); idx++)
+            paths.Add(dirs[idx]);
+    }
+    bool hasext = wxFileName(file).HasExt();
+    for (unsigned idx = 0; idx < paths.Count(); idx++) {
+        wxString base = (paths[idx].Length() > 0) ? paths[idx] + DIRSEP_STR + file : file;
+        wxString found;
+        if (hasext) {
+            if (wxFileExists(base))
+                found = base;
+        } else {
+            for (unsigned ext = 0; ext < WXSIZEOF(extensions) && found.IsEmpty(); ext++)
+                if (wxFileExists(base + extensions[ext]))
+                    found = base + extensions[ext];
+        }
+        if (found.Length() > 0) {
+            wxFileName path(found);
+            path.Normalize(wxPATH_NORM_DOTS | wxPATH_NORM_ABSOLUTE);
+            if (!wxFileName::IsCaseSensitive()) {
+                /* the paths are keys in the index, so use the name as it is
+                   stored on disk (otherwise <Console> and "console.inc" give
+                   two entries for the same file) */
+                wxDir dir(path.GetPath());
+                wxString ondisk;
+                if (dir.IsOpened() && dir.GetFirst(&ondisk, path.GetFullName(), wxDIR_FILES))
+                    path.SetFullName(ondisk);
+            }
+            return path.GetFullPath();
+        }
+    }
+    return wxEmptyString;
+}
+
+CSourceIndexer::CSourceIndexer(wxEvtHandler* owner, int id)
+    : wxThread(wxTHREAD_JOINABLE), m_owner(owner), m_id(id), m_posted(false)
+{
+}
+
+/** Queue() adds a file to parse (again). The path should be a full path. */
+void CSourceIndexer::Queue(const wxString& path)
+{
+    wxCriticalSectionLocker lock(m_lock);
+    if (m_pending.insert(path).second)
+        m_queue.Post(path);
+}
+
+/** Seed() sets the time stamp of a file whose results were loaded from the
+ *  stored index, so that the file is only parsed again if it changed.
+ */
+void CSourceIndexer::Seed(const wxString& path, time_t stamp)
+{
+    wxCriticalSectionLocker lock(m_lock);
+    m_stamps[path] = stamp;
+}
+
+/** Forget() clears the time stamps, so that all files that are queued are
+ *  parsed again.
+ */
+void CSourceIndexer::Forget()
+{
+    wxCriticalSectionLocker lock(m_lock);
+    m_stamps.clear();
+}
+
+/** SetIncludePath() sets the directories in which the included files are
+ *  looked up. When these change, the time stamps are cleared, because an
+ *  #include directive may now refer to another file.
+ */
+void CSourceIndexer::SetIncludePath(const wxArrayString& dirs)
+{
+    wxCriticalSectionLocker lock(m_lock);
+    if (dirs == m_includedirs)
+        return;
+    m_includedirs = dirs;
+    m_stamps.clear();
+}
+
+/** Stop() drops the files that are still queued and waits for the thread to
+ *  exit.
+ */
+void CSourceIndexer::Stop()
+{
+    m_queue.Clear();
+    m_queue.Post(wxEmptyString);
+    Wait();
+}
+
+/** TakeResults() returns the symbols and the uses of the files that were
+ *  parsed since the previous call. A file that no longer exists is returned
+ *  with a zero time stamp.
+ */
+bool CSourceIndexer::TakeResults(IndexResults& results)
+{
+    wxCriticalSectionLocker lock(m_lock);
+    results.clear();
+    results.swap(m_results);
+    m_posted = false;
+    return results.size() > 0;
+}
+
+void CSourceIndexer::Post()
+{
+    wxCriticalSectionLocker lock(m_lock);
+    if (m_posted || m_results.size() == 0)
+        return;
+    m_posted = true;
+    wxQueueEvent(m_owner, new wxThreadEvent(wxEVT_THREAD, m_id));
+}
+
+wxThread::ExitCode CSourceIndexer::Entry()
+{
+    int count = 0;
+    for ( ;; ) {
+        wxString path;
+        wxMessageQueueError err = m_queue.ReceiveTimeout(0, path);
+        if (err == wxMSGQUEUE_TIMEOUT) {
+            /* queue is empty, hand over what was collected before waiting */
+            if (count > 0)
+                Post();
+            count = 0;
+            err = m_queue.Receive(path);
+        }
+        if (err != wxMSGQUEUE_NO_ERROR || path.IsEmpty())
+            break;
+        time_t stamp = wxFileExists(path) ? wxFileModificationTime(path) : 0;
+        {
+            wxCriticalSectionLocker lock(m_lock);
+            m_pending.erase(path);
+            std::map<wxString, time_t>::iterator iter = m_stamps.find(path);
+            if (iter != m_stamps.end() && iter->second == stamp)
+                continue;   /* not changed since it was parsed */
+            m_stamps[path] = stamp;
+        }
+
+        IndexResult result;
+        result.Stamp = stamp;
+        std::vector<wxString> includes;
+        wxFFile file;
+        if (stamp != 0 && file.Open(path, "rb")) {
+            std::vector<char> buffer(file.Length());
+            size_t size = buffer.size() > 0 ? file.Read(&buffer[0], buffer.size()) : 0;
+            file.Close();
+            if (size > 0)
+                Parse(&buffer[0], size, result.Symbols, &result.Uses, &includes);
+        }
+        if (includes.size() > 0) {
+            /* look up the included files, and parse these too (a file that
+               did not change is skipped, which also ends a circular include) */
+            wxArrayString dirs;
+            {
+                wxCriticalSectionLocker lock(m_lock);
+                dirs = m_includedirs;
+            }
+            for (unsigned idx = 0; idx < includes.size(); idx++) {
+                wxString included = ResolveInclude(includes[idx], wxPathOnly(path), dirs);
+                if (included.Length() > 0 && std::find(result.Includes.begin(), result.Includes.end(), included) == result.Includes.end()) {
+                    result.Includes.push_back(included);
+                    Queue(included);
+                }
+            }
+        }
+        {
+            wxCriticalSectionLocker lock(m_lock);
+            std::swap(m_results[path], result);
+        }
+        if (++count >= INDEX_BATCH) {
+            Post();
+            count = 0;
+        }
+    }
+    return 0;
+}
+
+void CReferenceIndex::Clear()
+{
+    m_files.clear();
+    m_fileindex.clear();
+    m_names.clear();
+    m_modified = false;
+}
+
+/** Update() replaces the results of a file. A result with a zero time stamp
+ *  removes the file from the index.
+ */
+void CReferenceIndex::Update(const wxString& path, const IndexResult& result)
+{
+    unsigned id;
+    ReferenceFiles::iterator iter = m_fileindex.find(path);
+    if (iter != m_fileindex.end()) {
+        id = iter->second;
+    } else {
+        if (result.Stamp == 0)
+            return;
+        id = m_files.size();
+        m_files.push_back(FileEntry());
+        m_fileindex[path] = id;
+    }
+
+    /* remove the old uses */
+    FileEntry& entry = m_files[id];
+    for (unsigned idx = 0; idx < entry.Names.size(); idx++) {
+        ReferenceNames::iterator name = m_names.find(entry.Names[idx]);
+        if (name == m_names.end())
+            continue;
+        std::vector<ReferenceUse>& uses = name->second;
+        unsigned count = 0;
+        for (unsigned use = 0; use < uses.size(); use++)
+            if (uses[use].File != id)
+                uses[count++] = uses[use];
+        if (count == 0)
+            m_names.erase(name);
+        else
+            uses.erase(uses.begin() + count, uses.end());
+    }
+    entry.Names.clear();
+    m_modified = true;
+
+    if (result.Stamp == 0) {
+        /* the slot is not re-used, it is dropped when the index is stored */
+        entry.Path.Clear();
+        entry.Symbols.clear();
+        entry.Includes.clear();
+        m_fileindex.erase(path);
+        return;
+    }
+    entry.Path = path;
+    entry.Stamp = result.Stamp;
+    entry.Symbols = result.Symbols;
+    entry.Includes = result.Includes;
+    for (IndexUses::const_iterator name = result.Uses.begin(); name != result.Uses.end(); ++name) {
+        entry.Names.push_back(name->first);
+        std::vector<ReferenceUse>& uses = m_names[name->first];
+        for (unsigned idx = 0; idx < name->second.size(); idx++)
+            uses.push_back(ReferenceUse(id, name->second[idx].Line, name->second[idx].Column));
+    }
+}
+
+static bool LocationLess(const IndexLocation& a, const IndexLocation& b)
+{
+    int result = a.Path.Cmp(b.Path);
+    if (result == 0)
+        result = a.Line - b.Line;
+    if (result == 0)
+        result = a.Column - b.Column;
+    return result < 0;
+}
+
+/** Find() returns the uses of an identifier, sorted on the file and the
+ *  position in the file.
+ */
+bool CReferenceIndex::Find(const wxString& name, std::vector<IndexLocation>& locations) const
+{
+    locations.clear();
+    ReferenceNames::const_iterator iter = m_names.find(name);
+    if (iter == m_names.end())
+        return false;
+    const std::vector<ReferenceUse>& uses = iter->second;
+    locations.reserve(uses.size());
+    for (unsigned idx = 0; idx < uses.size(); idx++)
+        locations.push_back(IndexLocation(m_files[uses[idx].File].Path, uses[idx].Line, uses[idx].Column));
+    std::sort(locations.begin(), locations.end(), LocationLess);
+    return locations.size() > 0;
+}
+
+/** GetIncludes() returns the full paths of the files that a file includes
+ *  (directly). It returns false if the file is not in the index.
+ */
+bool CReferenceIndex::GetIncludes(const wxString& path, std::vector<wxString>& includes) const
+{
+    includes.clear();
+    ReferenceFiles::const_iterator iter = m_fileindex.find(path);
+    if (iter == m_fileindex.end())
+        return false;
+    includes = m_files[iter->second].Includes;
+    return true;
+}
+
+/** Load() replaces the index by the one stored in the file, and returns the
+ *  time stamps and the symbols of the files in it. Files that no longer exist
+ *  are dropped.
+ */
+bool CReferenceIndex::Load(const wxString& file, IndexResults& results)
+{
+    Clear();
+    wxFFile store;
+    if (!wxFileExists(file) || !store.Open(file, "rb"))
+        return false;
+    std::vector<char> buffer((size_t)store.Length());
+    if (buffer.size() < 8 || store.Read(&buffer[0], buffer.size()) != buffer.size())
+        return false;
+    store.Close();
+
+    const char* ptr = &buffer[0];
+    const char* end = ptr + buffer.size();
+    if (memcmp(ptr, INDEX_SIGNATURE, 4) != 0)
+        return false;
+    ptr += 4;
+    unsigned long filecount;
+    if (!GetNumber(ptr, end, &filecount))
+        return false;
+    bool dropped = false;
+    for (unsigned long fileidx = 0; fileidx < filecount; fileidx++) {
+        wxString path;
+        unsigned long low, high, count;
+        IndexResult result;
+        if (!GetString(ptr, end, path) || !GetNumber(ptr, end, &low) || !GetNumber(ptr, end, &high))
+            break;
+        result.Stamp = (time_t)(((wxULongLong_t)high << 32) | low);
+        if (!GetNumber(ptr, end, &count))
+            break;
+        bool ok = true;
+        for (unsigned long idx = 0; idx < count && ok; idx++) {
+            wxString name, syntax, summary;
+            unsigned long line;
+            ok = GetString(ptr, end, name) && GetString(ptr, end, syntax) && GetString(ptr, end, summary)
+                 && GetNumber(ptr, end, &line);
+            if (ok) {
+                result.Symbols.push_back(IndexSymbol(name, syntax, (int)line));
+                result.Symbols.back().Summary = summary;
+            }
+        }
+        ok = ok && GetNumber(ptr, end, &count);
+        for (unsigned long idx = 0; idx < count && ok; idx++) {
+            wxString name;
+            unsigned long uses;
+            ok = GetString(ptr, end, name) && GetNumber(ptr, end, &uses);
+            std::vector<IndexUse>& list = result.Uses[name];
+            for (unsigned long use = 0; use < uses && ok; use++) {
+                unsigned long line, column;
+                ok = GetNumber(ptr, end, &line) && GetNumber(ptr, end, &column);
+                list.push_back(IndexUse((int)line, (int)column));
+            }
+        }
+        ok = ok && GetNumber(ptr, end, &count);
+        for (unsigned long idx = 0; idx < count && ok; idx++) {
+            wxString include;
+            ok = GetString(ptr, end, include);
+            if (ok)
+                result.Includes.push_back(include);
+        }
+        if (!ok)
+            break;  /* truncated file, keep what was read */
+        if (!wxFileExists(path)) {
+            dropped = true;
+            continue;
+        }
+        Update(path, result);
+        IndexResult& item = results[path];
+        item.Stamp = result.Stamp;
+        item.Symbols.swap(result.Symbols);
+        item.Includes.swap(result.Includes);
+    }
+    m_modified = dropped;
+    return true;
+}
+
+/** Save() stores the index in a file. */
+bool CReferenceIndex::Save(const wxString& file)
+{
+    /* collect the uses per file */
+    std::vector<IndexUses> uses(m_files.size());
+    for (ReferenceNames::const_iterator iter = m_names.begin(); iter != m_names.end(); ++iter) {
+        for (unsigned idx = 0; idx < iter->second.size(); idx++) {
+            const ReferenceUse& use = iter->second[idx];
+            uses[use.File][iter->first].push_back(IndexUse(use.Line, use.Column));
+        }
+    }
+
+    std::string buffer(INDEX_SIGNATURE);
+    unsigned long filecount = 0;
+    for (unsigned idx = 0; idx < m_files.size(); idx++)
+        if (m_files[idx].Path.Length() > 0)
+            filecount++;
+    PutNumber(buffer, filecount);
+    for (unsigned fileidx = 0; fileidx < m_files.size(); fileidx++) {
+        const FileEntry& entry = m_files[fileidx];
+        if (entry.Path.IsEmpty())
+            continue;
+        PutString(buffer, entry.Path);
+        PutNumber(buffer, (unsigned long)((wxULongLong_t)entry.Stamp & 0xffffffffUL));
+        PutNumber(buffer, (unsigned long)((wxULongLong_t)entry.Stamp >> 32));
+        PutNumber(buffer, (unsigned long)entry.Symbols.size());
+        for (unsigned idx = 0; idx < entry.Symbols.size(); idx++) {
+            PutString(buffer, entry.Symbols[idx].Name);
+            PutString(buffer, entry.Symbols[idx].Syntax);
+            PutString(buffer, entry.Symbols[idx].Summary);
+            PutNumber(buffer, (unsigned long)entry.Symbols[idx].Line);
+        }
+        const IndexUses& names = uses[fileidx];
+        PutNumber(buffer, (unsigned long)names.size());
+        for (IndexUses::const_iterator iter = names.begin(); iter != names.end(); ++iter) {
+            PutString(buffer, iter->first);
+            PutNumber(buffer, (unsigned long)iter->second.size());
+            for (unsigned idx = 0; idx < iter->second.size(); idx++) {
+                PutNumber(buffer, (unsigned long)iter->second[idx].Line);
+                PutNumber(buffer, (unsigned long)iter->second[idx].Column);
+            }
+        }
+        PutNumber(buffer, (unsigned long)entry.Includes.size());
+        for (unsigned idx = 0; idx < entry.Includes.size(); idx++)
+            PutString(buffer, entry.Includes[idx]);
+    }
+
+    wxFFile store;
+    if (!store.Open(file, "wb"))
+        return false;
+    bool ok = (store.Write(buffer.data(), buffer.length()) == buffer.length());
+    store.Close();
+    if (!ok) {
+        wxRemoveFile(file);
+        return false;
+    }
+    m_modified = false;
+    return true;
+}
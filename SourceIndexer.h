@@ -0,0 +1,154 @@
+/*  Quincy IDE for the Pawn scripting language
+ *
+ *  Copyright CompuPhase, 2009-2024
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License"); you may not
+ *  use this file except in compliance with the License. You may obtain a copy
+ *  of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS, WITHOUT
+ *  WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. See the
+ *  License for the specific language governing permissions and limitations
+ *  under the License.
+ *
+ *  Version: $Id$
+ */
+#ifndef _SOURCEINDEXER_H
+#define _SOURCEINDEXER_H
+
+#include <wx/wx.h>
+#include <wx/hashmap.h>
+#include <wx/msgqueue.h>
+#include <wx/thread.h>
+#include <map>
+#include <set>
+#include <vector>
+
+#define INDEX_BATCH     32      /* files parsed before the results are posted */
+#define INDEX_SIGNATURE "QXR2"  /* signature (and version) of the stored index */
+
+struct IndexSymbol {
+    IndexSymbol(const wxString& name, const wxString& syntax, int line)
+        : Name(name), Syntax(syntax), Line(line)
+        {}
+    wxString Name;      /* with a prefix for the type, like in the report: M: F: C: T: */
+    wxString Syntax;    /* declaration, for display */
+    wxString Summary;   /* from a documentation comment */
+    int Line;           /* 1-based */
+};
+
+typedef std::vector<IndexSymbol> IndexSymbols;
+
+struct IndexUse {
+    IndexUse(int line, int column) : Line(line), Column(column) {}
+    int Line;           /* 1-based */
+    int Column;         /* 0-based, in bytes (like the positions in the editor) */
+};
+typedef std::map<wxString, std::vector<IndexUse> > IndexUses;   /* identifier -> uses in the file */
+
+struct IndexResult {
+    IndexResult() : Stamp(0) {}
+    time_t Stamp;       /* modification time of the file, 0 if the file does not exist */
+    IndexSymbols Symbols;
+    IndexUses Uses;
+    std::vector<wxString> Includes; /* full paths of the included files (those that were found) */
+};
+typedef std::map<wxString, IndexResult> IndexResults;   /* full path -> results for the file */
+
+/* The indexer parses Pawn source files on a worker thread, to collect the
+ * global symbols (functions, natives, forwards, constants, enumerations, global
+ * variables and tags) without running the compiler. It only looks at the
+ * declarations at the top level, so it also works on code that does not
+ * compile. Files are queued with Queue(); files that did not change since they
+ * were last parsed are skipped. The files in #include and #tryinclude
+ * directives are looked up like the compiler does, and queued as well. The
+ * owner receives a wxEVT_THREAD event with the given id when results are
+ * available, and collects these with TakeResults().
+ */
+class CSourceIndexer : public wxThread {
+public:
+    CSourceIndexer(wxEvtHandler* owner, int id);
+
+    void Queue(const wxString& path);
+    void Seed(const wxString& path, time_t stamp);
+    void Forget();
+    void SetIncludePath(const wxArrayString& dirs);
+    void Stop();
+    bool TakeResults(IndexResults& results);
+
+    static void Parse(const char* text, size_t size, IndexSymbols& symbols, IndexUses* uses = NULL,
+                      std::vector<wxString>* includes = NULL);
+    static wxString ResolveInclude(const wxString& name, const wxString& sourcedir, const wxArrayString& dirs);
+
+protected:
+    virtual ExitCode Entry();
+
+private:
+    void Post();
+
+    wxEvtHandler* m_owner;
+    int m_id;
+    wxMessageQueue<wxString> m_queue;   /* an empty name stops the thread */
+
+    wxCriticalSection m_lock;   /* protects the fields below */
+    std::map<wxString, time_t> m_stamps;    /* time stamps of the files when they were parsed */
+    std::set<wxString> m_pending;
+    wxArrayString m_includedirs;
+    IndexResults m_results;
+    bool m_posted;              /* an event was posted, but the results were not yet taken */
+};
+
+struct IndexLocation {
+    IndexLocation(const wxString& path, int line, int column) : Path(path), Line(line), Column(column) {}
+    wxString Path;
+    int Line;           /* 1-based */
+    int Column;         /* 0-based, in bytes */
+};
+
+struct ReferenceUse {
+    ReferenceUse(unsigned file, int line, int column) : File(file), Line(line), Column(column) {}
+    unsigned File;      /* index in the file table */
+    int Line, Column;
+};
+WX_DECLARE_STRING_HASH_MAP(std::vector<ReferenceUse>, ReferenceNames);
+WX_DECLARE_STRING_HASH_MAP(unsigned, ReferenceFiles);
+
+/* The reference index keeps the results of the indexer for all files, with an
+ * inverted index from an identifier to its uses (for "find references"). A
+ * file is replaced as a whole when it is parsed again. The index is stored in
+ * a file between sessions, so that files that did not change need not be
+ * parsed again (see CSourceIndexer::Seed()). With the included files of each
+ * file, it also holds the include graph.
+ */
+class CReferenceIndex {
+public:
+    CReferenceIndex() : m_modified(false) {}
+
+    void Clear();
+    void Update(const wxString& path, const IndexResult& result);
+    bool Find(const wxString& name, std::vector<IndexLocation>& locations) const;
+    bool GetIncludes(const wxString& path, std::vector<wxString>& includes) const;
+    bool Load(const wxString& file, IndexResults& results);
+    bool Save(const wxString& file);
+    bool IsModified() const { return m_modified; }
+
+private:
+    struct FileEntry {
+        FileEntry() : Stamp(0) {}
+        wxString Path;      /* empty if the file was removed from the index */
+        time_t Stamp;
+        IndexSymbols Symbols;
+        std::vector<wxString> Names;    /* identifiers that are used in the file */
+        std::vector<wxString> Includes; /* full paths of the included files */
+    };
+
+    std::vector<FileEntry> m_files;
+    ReferenceFiles m_fileindex; /* path -> index in m_files */
+    ReferenceNames m_names;
+    bool m_modified;            /* changed since it was loaded or saved */
+};
+
+#endif /* _SOURCEINDEXER_H */
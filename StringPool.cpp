@@ -0,0 +1,223 @@
+/*  Quincy IDE for the Pawn scripting language
+ *
+ *  Copyright CompuPhase, 2009-2024
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License"); you may not
+ *  use this file except in compliance with the License. You may obtain a copy
+ *  of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS, WITHOUT
+ *  WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. See the
+ *  License for the specific language governing permissions and limitations
+ *  under the License.
+ *
+ *  Version: $Id$
+ */
+#include "wxQuincy.h"
+#include <string.h>
+#include "StringPool.h"
+
+CStringPool StringPool;
+
+/* FNV-1a */
+static unsigned HashText(const char* text, size_t length)
+{
+    unsigned hash = 2166136261u;
+    for (size_t idx = 0; idx < length; idx++) {
+        hash ^= (unsigned char)text[idx];
+        hash *= 16777619u;
+    }
+    return hash;
+}
+
+CStringPool::CStringPool()
+{
+    memset(m_slots, 0, sizeof m_slots);
+    Init();
+}
+
+CStringPool::~CStringPool()
+{
+    Free();
+}
+
+void CStringPool::Init()
+{
+    m_free = NULL;
+    m_left = 0;
+    m_count = 0;
+    m_textsize = 0;
+    m_arenasize = 0;
+    m_table.assign(1024, 0);
+    Add("", 0, HashText("", 0));  /* id 0 is the empty string */
+}
+
+void CStringPool::Free()
+{
+    for (unsigned idx = 0; idx < m_blocks.size(); idx++)
+        delete[] m_blocks[idx];
+    m_blocks.clear();
+    for (unsigned idx = 0; idx < POOL_SLOTBLOCKS && m_slots[idx] != NULL; idx++) {
+        delete[] m_slots[idx];
+        m_slots[idx] = NULL;
+    }
+}
+
+/* Reset() drops all strings (except the empty string) and frees the memory.
+   All ids and all pointers to the text become invalid, so the caller must
+   first clear every table that refers to the pool, and make sure that no
+   other thread adds strings while the pool is reset. */
+void CStringPool::Reset()
+{
+    wxCriticalSectionLocker lock(m_lock);
+    Free();
+    std::vector<char*>().swap(m_blocks);
+    std::vector<unsigned>().swap(m_table);
+    Init();
+}
+
+/* Lookup() returns the id of the string, or POOL_NONE; the caller must hold
+   the lock */
+unsigned CStringPool::Lookup(const char* text, size_t length, unsigned hash) const
+{
+    size_t mask = m_table.size() - 1;
+    for (size_t pos = hash & mask; m_table[pos] != 0; pos = (pos + 1) & mask) {
+        const PoolSlot& slot = Slot(m_table[pos] - 1);
+        if (slot.Hash == hash && slot.Length == length && memcmp(slot.Text, text, length) == 0)
+            return m_table[pos] - 1;
+    }
+    return POOL_NONE;
+}
+
+/* Add() copies a string into the arena and returns its id; the caller must
+   hold the lock and have checked that the string is not yet in the pool */
+unsigned CStringPool::Add(const char* text, size_t length, unsigned hash)
+{
+    unsigned id = m_count;
+    unsigned block = id >> POOL_SLOTBITS;
+    wxASSERT(block < POOL_SLOTBLOCKS);
+    if (block >= POOL_SLOTBLOCKS)
+        return 0;   /* pool is full, fall back to the empty string */
+    if (m_slots[block] == NULL)
+        m_slots[block] = new PoolSlot[1u << POOL_SLOTBITS];
+
+    char* copy;
+    if (length + 1 > POOL_BLOCKSIZE / 4) {
+        /* a long string gets a block of its own, so that the current block
+           is not abandoned */
+        copy = new char[length + 1];
+        m_blocks.push_back(copy);
+        m_arenasize += length + 1;
+    } else {
+        if (length + 1 > m_left) {
+            m_free = new char[POOL_BLOCKSIZE];
+            m_left = POOL_BLOCKSIZE;
+            m_blocks.push_back(m_free);
+            m_arenasize += POOL_BLOCKSIZE;
+        }
+        copy = m_free;
+        m_free += length + 1;
+        m_left -= length + 1;
+    }
+    memcpy(copy, text, length);
+    copy[length] = '\0';
+    m_textsize += length + 1;
+
+    PoolSlot& slot = m_slots[block][id & ((1u << POOL_SLOTBITS) - 1)];
+    slot.Text = copy;
+    slot.Length = (unsigned)length;
+    slot.Hash = hash;
+    slot.Lower = POOL_NONE;
+    m_count = id + 1;   /* only now the slot is complete */
+
+    if (2 * m_count > m_table.size())
+        Grow();
+    size_t mask = m_table.size() - 1;
+    size_t pos;
+    for (pos = hash & mask; m_table[pos] != 0; pos = (pos + 1) & mask)
+        /* nothing */;
+    m_table[pos] = id + 1;
+    return id;
+}
+
+void CStringPool::Grow()
+{
+    std::vector<unsigned> table(2 * m_table.size(), 0);
+    size_t mask = table.size() - 1;
+    for (unsigned id = 0; id + 1 < m_count; id++) { /* the last one is inserted by the caller */
+        size_t pos;
+        for (pos = Slot(id).Hash & mask; table[pos] != 0; pos = (pos + 1) & mask)
+            /* nothing */;
+        table[pos] = id + 1;
+    }
+    m_table.swap(table);
+}
+
+unsigned CStringPool::Intern(const char* text, size_t length)
+{
+    if (length == 0)
+        return 0;
+    unsigned hash = HashText(text, length);
+    wxCriticalSectionLocker lock(m_lock);
+    unsigned id = Lookup(text, length, hash);
+    if (id == POOL_NONE)
+        id = Add(text, length, hash);
+    return id;
+}
+
+unsigned CStringPool::Intern(const wxString& text)
+{
+    if (text.IsEmpty())
+        return 0;
+    wxScopedCharBuffer utf8 = text.utf8_str();
+    return Intern(utf8.data(), utf8.length());
+}
+
+/* Find() returns the id of a string, without adding it to the pool; it
+   returns POOL_NONE if the string is not in the pool */
+unsigned CStringPool::Find(const char* text, size_t length) const
+{
+    if (length == 0)
+        return 0;
+    unsigned hash = HashText(text, length);
+    wxCriticalSectionLocker lock(m_lock);
+    return Lookup(text, length, hash);
+}
+
+unsigned CStringPool::Find(const wxString& text) const
+{
+    if (text.IsEmpty())
+        return 0;
+    wxScopedCharBuffer utf8 = text.utf8_str();
+    return Find(utf8.data(), utf8.length());
+}
+
+/* Lower() returns the id of the lower case version of a string, for
+   comparisons that ignore case (like file names) */
+unsigned CStringPool::Lower(unsigned id)
+{
+    {
+        wxCriticalSectionLocker lock(m_lock);
+        if (Slot(id).Lower != POOL_NONE)
+            return Slot(id).Lower;
+    }
+    unsigned lower = Intern(String(id).Lower());
+    wxCriticalSectionLocker lock(m_lock);
+    Slot(id).Lower = lower;
+    Slot(lower).Lower = lower;
+    return lower;
+}
+
+/* Footprint() returns the memory used by the pool, in bytes */
+unsigned long CStringPool::Footprint() const
+{
+    wxCriticalSectionLocker lock(m_lock);
+    unsigned long size = sizeof(CStringPool) + m_arenasize + m_table.size() * sizeof(unsigned)
+                         + m_blocks.capacity() * sizeof(char*);
+    for (unsigned idx = 0; idx < POOL_SLOTBLOCKS && m_slots[idx] != NULL; idx++)
+        size += (1u << POOL_SLOTBITS) * sizeof(PoolSlot);
+    return size;
+}
@@ -0,0 +1,116 @@
+/*  Quincy IDE for the Pawn scripting language
+ *
+ *  Copyright CompuPhase, 2009-2024
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License"); you may not
+ *  use this file except in compliance with the License. You may obtain a copy
+ *  of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS, WITHOUT
+ *  WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. See the
+ *  License for the specific language governing permissions and limitations
+ *  under the License.
+ *
+ *  Version: $Id$
+ */
+#ifndef _STRINGPOOL_H
+#define _STRINGPOOL_H
+
+#include <wx/wx.h>
+#include <wx/thread.h>
+#include <atomic>
+#include <string.h>
+#include <vector>
+
+#define POOL_BLOCKSIZE  65536   /* size of a block of text in the arena */
+#define POOL_SLOTBITS   12      /* 4096 strings per block of slots */
+#define POOL_SLOTBLOCKS 4096    /* maximum number of blocks of slots (16M strings) */
+#define POOL_NONE       (~0u)   /* returned by Find() for a string that is not in the pool */
+
+/* The string pool keeps a single copy of each string, in UTF-8, in large
+ * blocks that are never moved or freed (an arena). A string is referred to
+ * by an id; two strings are equal if their ids are equal. Id 0 is the empty
+ * string. Strings may be added from any thread; the text of an id that a
+ * thread has received may be read without locking. The memory is reclaimed
+ * in one go, with Reset(), when the tables that use the pool are rebuilt.
+ */
+class CStringPool {
+public:
+    CStringPool();
+    ~CStringPool();
+
+    unsigned Intern(const char* text, size_t length);
+    unsigned Intern(const char* text) { return Intern(text, strlen(text)); }
+    unsigned Intern(const wxString& text);
+    unsigned Find(const char* text, size_t length) const;
+    unsigned Find(const wxString& text) const;
+    unsigned Lower(unsigned id);
+    void Reset();
+
+    const char* Text(unsigned id) const { return Slot(id).Text; }
+    unsigned Length(unsigned id) const { return Slot(id).Length; }
+    wxString String(unsigned id) const { return wxString::FromUTF8(Slot(id).Text, Slot(id).Length); }
+
+    unsigned Count() const { return m_count; }
+    unsigned long Footprint() const;
+    unsigned long TextSize() const { return m_textsize; }
+
+private:
+    struct PoolSlot {
+        const char* Text;
+        unsigned Length;    /* in bytes */
+        unsigned Hash;
+        unsigned Lower;     /* id of the lower case version, or POOL_NONE if not yet known */
+    };
+
+    PoolSlot& Slot(unsigned id) const
+        { wxASSERT(id < m_count); return m_slots[id >> POOL_SLOTBITS][id & ((1u << POOL_SLOTBITS) - 1)]; }
+    unsigned Lookup(const char* text, size_t length, unsigned hash) const;
+    unsigned Add(const char* text, size_t length, unsigned hash);
+    void Grow();
+    void Init();
+    void Free();
+
+    mutable wxCriticalSection m_lock;   /* protects adding strings (and the hash table) */
+    PoolSlot* m_slots[POOL_SLOTBLOCKS];
+    std::vector<char*> m_blocks;
+    char* m_free;               /* free space in the current block */
+    size_t m_left;
+    std::vector<unsigned> m_table;  /* hash table: id + 1, or 0 for an empty entry */
+    std::atomic<unsigned> m_count;
+    unsigned long m_textsize;   /* bytes of text (including the terminating zero bytes) */
+    unsigned long m_arenasize;  /* bytes allocated for the text */
+};
+
+extern CStringPool StringPool;
+
+/* A string in the pool; it converts to a wxString where needed, but it is
+ * compared by its id. The index operator returns a byte of the UTF-8 text,
+ * which is only useful for ASCII characters (like the type prefix of a symbol).
+ */
+class CPoolString {
+public:
+    CPoolString() : m_id(0) {}
+    explicit CPoolString(const wxString& text) : m_id(StringPool.Intern(text)) {}
+    CPoolString& operator=(const wxString& text) { m_id = StringPool.Intern(text); return *this; }
+    static CPoolString FromUTF8(const char* text, size_t length)
+        { CPoolString s; s.m_id = StringPool.Intern(text, length); return s; }
+
+    unsigned Id() const { return m_id; }
+    bool IsEmpty() const { return m_id == 0; }
+    const char* UTF8() const { return StringPool.Text(m_id); }
+    wxString Str() const { return StringPool.String(m_id); }
+    operator wxString() const { return Str(); }
+    char operator[](unsigned idx) const { return (idx < StringPool.Length(m_id)) ? StringPool.Text(m_id)[idx] : '\0'; }
+
+    bool operator==(const CPoolString& other) const { return m_id == other.m_id; }
+    bool operator!=(const CPoolString& other) const { return m_id != other.m_id; }
+
+private:
+    unsigned m_id;
+};
+
+#endif /* _STRINGPOOL_H */
@@ -17,136 +17,751 @@
  *  Version: $Id: SymbolBrowser.cpp 5689 2017-06-05 14:05:58Z thiadmer $
  */
 #include "wxQuincy.h"
+#include <wx/ffile.h>
+#include <wx/filefn.h>
+#include <wx/filename.h>
+#include <algorithm>
+#include <set>
+#include <string.h>
+#include "Serialize.h"
 #include "SymbolBrowser.h"
-#include "tinyxml/tinyxml2.h"
 
-bool CSymbolEntry::Add(const wxString &xmlfile, const wxString &symname,
-                       const wxString &syntax, const wxString &summary,
-                       const wxString &source, int line)
+#define SYMCACHE_EXT        ".symcache"     /* extension of the cache, added to the name of the report */
+#define SYMCACHE_SIGNATURE  "QSC1"          /* also the version of the format */
+#define MAX_ATTRIBUTES      4               /* attributes of an element that are kept */
+
+/* the names are sorted on the UTF-8 text (which is the order of the code
+   points) */
+static bool SymbolLess(const CSymbolEntry &a, const CSymbolEntry &b)
 {
-    CSymbolEntry *item;
+    int result = (a.Name == b.Name) ? 0 : strcmp(a.Name.UTF8(), b.Name.UTF8());
+    if (result == 0)
+        result = (int)a.SymbolName[0] - (int)b.SymbolName[0];
+    if (result == 0 && a.Source != b.Source)
+        result = strcmp(StringPool.Text(StringPool.Lower(a.Source.Id())), StringPool.Text(StringPool.Lower(b.Source.Id())));
+    if (result == 0)
+        result = a.Line - b.Line;
+    return result < 0;
+}
 
-    /* first see whether the item exists already (same name, same source file,
-     * same syntax); if so, only update the line number
-     */
-    for (item = this; item; item = item->Next) {
-        if (item->Source.CmpNoCase(source) == 0
-            && item->SymbolName.Cmp(symname) == 0
-            && item->Syntax.Cmp(syntax) == 0)
-        {
-            item->Line = line;
-            return true;
-        }
-    }
+static bool NameLess(const CSymbolEntry &entry, const char *name)
+{
+    return strcmp(entry.Name.UTF8(), name) < 0;
+}
+
+static bool PrefixLess(const char *prefix, const CSymbolEntry &entry)
+{
+    return strncmp(prefix, entry.Name.UTF8(), strlen(prefix)) < 0;
+}
 
+/* Key()
+ * Returns the key for the index on the source file, the name and (optionally)
+ * the syntax; the syntax of an entry is never empty.
+ */
+SymbolKey CSymbolList::Key(const CPoolString &source, const CPoolString &symname, const CPoolString &syntax)
+{
+    return SymbolKey(StringPool.Lower(source.Id()), symname.Id(), syntax.Id());
+}
+
+void CSymbolList::Clear()
+{
+    Entries.clear();
+    NameIndex.clear();
+    KeyIndex.clear();
+    ReportIndex.clear();
+}
+
+/* Insert()
+ * Appends a symbol (the name without the type and the default syntax are
+ * filled in); call Update() after adding symbols, to sort the list.
+ */
+bool CSymbolList::Insert(const CSymbolEntry &symbol)
+{
     /* special case, ignore anonymous types */
-    if (symname.CmpNoCase(wxT("t:anonymous")) == 0)
+    if (wxStricmp(symbol.SymbolName.UTF8(), "t:anonymous") == 0)
         return false;
     /* also ignore any prefefind constant, these do not have a location */
-    if (source.Length() == 0)
+    if (symbol.Source.IsEmpty())
         return false;
 
-    /* item does not exist, create & insert */
-    item = new CSymbolEntry;
-    if (!item)
-        return false;
+    CSymbolEntry item = symbol;
+    unsigned length = StringPool.Length(symbol.SymbolName.Id());
+    item.Name = CPoolString::FromUTF8(symbol.SymbolName.UTF8() + (length > 2 ? 2 : length), (length > 2) ? length - 2 : 0);
+    if (item.Syntax.IsEmpty())
+        item.Syntax = item.Name;
 
-    item->XMLfile = xmlfile;
-    item->SymbolName = symname;
-    if (syntax.Length() == 0)
-        item->Syntax = symname.Mid(2);
-    else
-        item->Syntax = syntax;
-    item->Summary = summary;
-    item->Source = source;
-    item->Line = line;
-
-    CSymbolEntry *root = this;
-    while (root->Next && root->Next->SymbolName.Cmp(item->SymbolName)<0)
-        root = root->Next;
-    item->Next = root->Next;
-    root->Next = item;
+    /* first see whether the item exists already (same name, same source file,
+     * same syntax); if so, only update the line number, unless a symbol from
+     * a report replaces a symbol of the indexer (the line number of the
+     * indexer is kept, because it is more recent)
+     */
+    SymbolKey key = Key(item.Source, item.SymbolName, item.Syntax);
+    SymbolKeyIndex::iterator iter = KeyIndex.find(key);
+    if (iter != KeyIndex.end()) {
+        CSymbolEntry &entry = Entries[iter->second];
+        if (entry.Indexed && !item.Indexed) {
+            item.Line = entry.Line;
+            entry = item;
+            ReportIndex[Key(item.Source, item.SymbolName, CPoolString())] = iter->second;
+        } else {
+            entry.Line = item.Line;
+        }
+        return true;
+    }
 
+    KeyIndex[key] = Entries.size();
+    if (!item.Indexed)
+        ReportIndex[Key(item.Source, item.SymbolName, CPoolString())] = Entries.size();
+    Entries.push_back(item);
     return true;
 }
 
-void CSymbolEntry::Remove(const wxString &xmlfile)
+/* Remove()
+ * Removes the symbols from a report file (or all reports if the name is
+ * empty), or the symbols that the indexer found in a source file.
+ */
+void CSymbolList::Remove(bool indexed, const wxString &file)
+{
+    unsigned fileid = StringPool.Lower(StringPool.Intern(file));
+    unsigned count = 0;
+    for (unsigned idx = 0; idx < Entries.size(); idx++) {
+        const CSymbolEntry &item = Entries[idx];
+        bool remove;
+        if (indexed)
+            remove = item.Indexed && StringPool.Lower(item.Source.Id()) == fileid;
+        else
+            remove = !item.Indexed && (fileid == 0 || StringPool.Lower(item.XMLfile.Id()) == fileid);
+        if (!remove) {
+            if (count != idx)
+                Entries[count] = item;
+            count++;
+        }
+    }
+    if (count == Entries.size())
+        return;
+    Entries.resize(count);
+    Reindex();  /* the order does not change, so the list stays sorted */
+}
+
+void CSymbolList::Reindex()
+{
+    NameIndex.clear();
+    KeyIndex.clear();
+    ReportIndex.clear();
+    for (unsigned idx = 0; idx < Entries.size(); idx++) {
+        const CSymbolEntry &item = Entries[idx];
+        KeyIndex[Key(item.Source, item.SymbolName, item.Syntax)] = idx;
+        if (!item.Indexed)
+            ReportIndex[Key(item.Source, item.SymbolName, CPoolString())] = idx;
+        if (idx > 0 && Entries[idx - 1].Name == item.Name)
+            NameIndex[item.Name.Id()].second += 1;
+        else
+            NameIndex[item.Name.Id()] = SymbolSpan(idx, 1);
+    }
+}
+
+/* Update()
+ * Sorts the list and rebuilds the indices, after symbols were added.
+ */
+void CSymbolList::Update()
 {
-    CSymbolEntry *item, *next;
-    item = this;
-    while (item->Next) {
-        next = item->Next;
-        if (xmlfile.IsEmpty() || next->XMLfile.CmpNoCase(xmlfile) == 0) {
-            item->Next = next->Next;
-            delete next;
+    std::sort(Entries.begin(), Entries.end(), SymbolLess);
+    Reindex();
+}
+
+/* The reports are scanned for the <member> elements (below <doc><members>),
+ * without building a document tree. The attributes and the text are decoded
+ * in the buffer itself ("in situ").
+ */
+struct ReportMember {
+    ReportMember() : Name(NULL), Syntax(NULL), Value(NULL), File(NULL), Line(NULL) {}
+    const char *Name, *Syntax, *Value;
+    const char *File, *Line;    /* from <location> */
+    CPoolString Summary;        /* text of <summary> */
+};
+
+/* PoolTrimmed() adds a string to the pool, without leading and trailing
+   white space */
+static CPoolString PoolTrimmed(const char *text)
+{
+    while (*text != '\0' && (unsigned char)*text <= ' ')
+        text++;
+    size_t length = strlen(text);
+    while (length > 0 && (unsigned char)text[length - 1] <= ' ')
+        length--;
+    return CPoolString::FromUTF8(text, length);
+}
+
+/* XmlDecode() replaces the entities in a zero-terminated string, in place */
+static void XmlDecode(char *text)
+{
+    char *dest = text;
+    while (*text != '\0') {
+        if (*text != '&') {
+            *dest++ = *text++;
+            continue;
+        }
+        char *semicolon = strchr(text, ';');
+        if (semicolon == NULL || semicolon - text > 10) {
+            *dest++ = *text++;
+            continue;
+        }
+        unsigned long code = 0;
+        if (strncmp(text, "&lt;", 4) == 0)
+            code = '<';
+        else if (strncmp(text, "&gt;", 4) == 0)
+            code = '>';
+        else if (strncmp(text, "&amp;", 5) == 0)
+            code = '&';
+        else if (strncmp(text, "&quot;", 6) == 0)
+            code = '"';
+        else if (strncmp(text, "&apos;", 6) == 0)
+            code = '\'';
+        else if (text[1] == '#')
+            code = (text[2] == 'x' || text[2] == 'X') ? strtoul(text + 3, NULL, 16) : strtoul(text + 2, NULL, 10);
+        if (code == 0 || code > 0x10ffff) {
+            *dest++ = *text++;
+            continue;
+        }
+        /* store as UTF-8 (always shorter than the entity) */
+        if (code < 0x80) {
+            *dest++ = (char)code;
+        } else if (code < 0x800) {
+            *dest++ = (char)(0xc0 | (code >> 6));
+            *dest++ = (char)(0x80 | (code & 0x3f));
+        } else if (code < 0x10000) {
+            *dest++ = (char)(0xe0 | (code >> 12));
+            *dest++ = (char)(0x80 | ((code >> 6) & 0x3f));
+            *dest++ = (char)(0x80 | (code & 0x3f));
         } else {
-            item = next;
+            *dest++ = (char)(0xf0 | (code >> 18));
+            *dest++ = (char)(0x80 | ((code >> 12) & 0x3f));
+            *dest++ = (char)(0x80 | ((code >> 6) & 0x3f));
+            *dest++ = (char)(0x80 | (code & 0x3f));
         }
+        text = semicolon + 1;
     }
+    *dest = '\0';
 }
 
-bool CSymbolList::LoadReportFile(const wxString& file)
+/* ParseReport() scans the text of a report (which must be zero-terminated)
+ * and returns the members that have a location. The text is modified.
+ */
+static bool ParseReport(char *text, std::vector<CSymbolEntry> &symbols)
 {
-    SymbolList.Remove(file);
+    int depth = 0;          /* nesting level of the current element */
+    int membersdepth = -1;  /* level of <members> (below <doc>) */
+    int memberdepth = -1;   /* level of the <member> that is being scanned */
+    ReportMember member;
+    bool found = false;
 
-    tinyxml2::XMLDocument doc;
-    if (doc.LoadFile(file.utf8_str()) != tinyxml2::XML_NO_ERROR)
-        return false;
-    tinyxml2::XMLHandle docHandle(doc);
-    tinyxml2::XMLHandle child = docHandle.FirstChildElement("doc").FirstChildElement("members").FirstChildElement("member");
-    if (!child.ToElement())
-        return false;
-    while (child.ToElement()) {
-        tinyxml2::XMLElement* summary = child.FirstChildElement("summary").ToElement();
-        tinyxml2::XMLElement* location = child.FirstChildElement("location").ToElement();
-        if (location) {
-            wxString symname = wxString::FromUTF8(child.ToElement()->Attribute("name"));    /* for type and sorting */
-            wxString source = wxString::FromUTF8(location->Attribute("file"));
-            int line = (int)strtol(location->Attribute("line"), NULL, 10);
-            wxString syntax = wxEmptyString;    /* syntax or value, for display */
-            if (symname[1] == wxT(':')) {
-                if (symname[0] == wxT('M') || symname[0] == wxT('F'))
-                    syntax = wxString::FromUTF8(child.ToElement()->Attribute("syntax"));
-                else if (symname[0] == wxT('C'))
-                    syntax = symname.Mid(2) + wxT(" (") + wxString::FromUTF8(child.ToElement()->Attribute("value")) + wxT(")");
+    char *ptr = text;
+    while ((ptr = strchr(ptr, '<')) != NULL) {
+        if (strncmp(ptr, "<!--", 4) == 0) {
+            char *end = strstr(ptr + 4, "-->");
+            ptr = end ? end + 3 : ptr + strlen(ptr);
+            continue;
+        }
+        if (strncmp(ptr, "<![CDATA[", 9) == 0) {
+            /* the text of a CDATA section may hold '<' and '>' */
+            char *end = strstr(ptr + 9, "]]>");
+            ptr = end ? end + 3 : ptr + strlen(ptr);
+            continue;
+        }
+        if (ptr[1] == '?' || ptr[1] == '!') {
+            char *end = strchr(ptr, '>');
+            ptr = end ? end + 1 : ptr + strlen(ptr);
+            continue;
+        }
+        bool closing = (ptr[1] == '/');
+        char *name = ptr + (closing ? 2 : 1);
+        char *end = name;
+        while (*end != '\0' && *end != '>' && *end != '/' && *end != ' ' && *end != '\t' && *end != '\r' && *end != '\n')
+            end++;
+        size_t namelength = end - name;
+
+        if (closing) {
+            depth--;
+            if (depth == memberdepth && namelength == 6 && strncmp(name, "member", 6) == 0) {
+                if (member.Name != NULL && member.File != NULL) {
+                    CSymbolEntry item;
+                    item.SymbolName = CPoolString::FromUTF8(member.Name, strlen(member.Name));
+                    item.Source = CPoolString::FromUTF8(member.File, strlen(member.File));
+                    item.Line = member.Line ? (int)strtol(member.Line, NULL, 10) : 0;
+                    if (member.Name[0] != '\0' && member.Name[1] == ':') {
+                        /* syntax or value, for display */
+                        if ((member.Name[0] == 'M' || member.Name[0] == 'F') && member.Syntax != NULL) {
+                            item.Syntax = CPoolString::FromUTF8(member.Syntax, strlen(member.Syntax));
+                        } else if (member.Name[0] == 'C') {
+                            std::string syntax = std::string(member.Name + 2) + " (" + (member.Value ? member.Value : "") + ")";
+                            item.Syntax = CPoolString::FromUTF8(syntax.data(), syntax.length());
+                        }
+                    }
+                    item.Summary = member.Summary;
+                    symbols.push_back(item);
+                }
+                memberdepth = -1;
+            } else if (depth == membersdepth && namelength == 7 && strncmp(name, "members", 7) == 0) {
+                membersdepth = -1;
+            }
+            ptr = strchr(end, '>');
+            if (ptr == NULL)
+                break;
+            continue;
+        }
+
+        /* parse the attributes, terminate the values */
+        const char *attrname[MAX_ATTRIBUTES];
+        const char *attrvalue[MAX_ATTRIBUTES];
+        int attrcount = 0;
+        ptr = end;
+        while (*ptr != '\0' && *ptr != '>' && !(ptr[0] == '/' && ptr[1] == '>')) {
+            if (*ptr == ' ' || *ptr == '\t' || *ptr == '\r' || *ptr == '\n') {
+                ptr++;
+                continue;
+            }
+            char *attr = ptr;
+            while (*ptr != '\0' && *ptr != '=' && *ptr != '>' && *ptr != '/' && *ptr > ' ')
+                ptr++;
+            size_t attrlength = ptr - attr;
+            if (attrlength == 0) {
+                if (*ptr != '>' && !(ptr[0] == '/' && ptr[1] == '>'))
+                    ptr++;  /* stray character */
+                continue;
+            }
+            while (*ptr == ' ')
+                ptr++;
+            if (*ptr != '=')
+                continue;
+            ptr++;
+            while (*ptr == ' ')
+                ptr++;
+            char quote = *ptr;
+            if (quote != '"' && quote != '\'')
+                continue;
+            char *value = ++ptr;
+            while (*ptr != '\0' && *ptr != quote)
+                ptr++;
+            if (*ptr == '\0')
+                break;
+            *ptr++ = '\0';
+            attr[attrlength] = '\0';    /* overwrites the '=' or a space */
+            if (attrcount < MAX_ATTRIBUTES) {
+                XmlDecode(value);
+                attrname[attrcount] = attr;
+                attrvalue[attrcount] = value;
+                attrcount++;
             }
-            wxString descr = wxEmptyString;
-            if (summary) {
-                descr = wxString::FromUTF8(summary->GetText());
-                descr.Trim(false);
-                descr.Trim(true);
+        }
+        if (*ptr == '\0')
+            break;
+        bool empty = (*ptr == '/');
+        ptr += empty ? 2 : 1;
+        *end = '\0';    /* terminate the element name (this is white space, '>' or '/') */
+
+        if (depth == 1 && strcmp(name, "members") == 0) {
+            membersdepth = depth;
+        } else if (membersdepth >= 0 && depth == membersdepth + 1 && strcmp(name, "member") == 0) {
+            found = true;
+            member = ReportMember();
+            memberdepth = depth;
+            for (int idx = 0; idx < attrcount; idx++) {
+                if (strcmp(attrname[idx], "name") == 0)
+                    member.Name = attrvalue[idx];
+                else if (strcmp(attrname[idx], "syntax") == 0)
+                    member.Syntax = attrvalue[idx];
+                else if (strcmp(attrname[idx], "value") == 0)
+                    member.Value = attrvalue[idx];
+            }
+        } else if (memberdepth >= 0 && depth == memberdepth + 1 && strcmp(name, "location") == 0) {
+            member.File = "";
+            for (int idx = 0; idx < attrcount; idx++) {
+                if (strcmp(attrname[idx], "file") == 0)
+                    member.File = attrvalue[idx];
+                else if (strcmp(attrname[idx], "line") == 0)
+                    member.Line = attrvalue[idx];
+            }
+        } else if (memberdepth >= 0 && depth == memberdepth + 1 && strcmp(name, "summary") == 0 && !empty) {
+            /* only the text up to the first nested element (or the end tag) */
+            char *stop = strchr(ptr, '<');
+            if (stop != NULL && stop != ptr) {
+                *stop = '\0';
+                XmlDecode(ptr);
+                member.Summary = PoolTrimmed(ptr);
+                *stop = '<';
+                ptr = stop;
             }
-            /* make a full path, if needed */
-            if (source[0] != DIRSEP_CHAR && source.Length() > 1 && source[1] != ':')
-                source = file.BeforeLast(DIRSEP_CHAR) + wxT(DIRSEP_STR) + source;
-            SymbolList.Add(file, symname, syntax, descr, source, line);
         }
-        child = child.NextSiblingElement("member");
+        if (!empty)
+            depth++;
     }
+    return found;
+}
+
+/* LoadSymbolCache() reads the symbols of a report from the cache, provided
+ * that the size and the time stamp of the report match the ones stored in
+ * the cache.
+ */
+static bool LoadSymbolCache(const wxString &file, wxFileOffset size, time_t stamp, std::vector<CSymbolEntry> &symbols)
+{
+    wxFFile cache;
+    if (!wxFileExists(file + SYMCACHE_EXT) || !cache.Open(file + SYMCACHE_EXT, "rb"))
+        return false;
+    std::vector<char> buffer((size_t)cache.Length());
+    if (buffer.size() < 16 || cache.Read(&buffer[0], buffer.size()) != buffer.size())
+        return false;
+    cache.Close();
 
+    const char *ptr = &buffer[0];
+    const char *end = ptr + buffer.size();
+    if (memcmp(ptr, SYMCACHE_SIGNATURE, 4) != 0)
+        return false;
+    ptr += 4;
+    unsigned long cachedsize, cachedstamp, count;
+    if (!GetNumber(ptr, end, &cachedsize) || !GetNumber(ptr, end, &cachedstamp) || !GetNumber(ptr, end, &count))
+        return false;
+    if (cachedsize != ((unsigned long)size & 0xffffffffUL) || cachedstamp != ((unsigned long)stamp & 0xffffffffUL))
+        return false;
+    for (unsigned long idx = 0; idx < count; idx++) {
+        CSymbolEntry item;
+        unsigned long line;
+        if (!GetString(ptr, end, item.SymbolName) || !GetString(ptr, end, item.Syntax)
+            || !GetString(ptr, end, item.Summary) || !GetString(ptr, end, item.Source)
+            || !GetNumber(ptr, end, &line))
+            return false;
+        item.Line = (int)line;
+        symbols.push_back(item);
+    }
     return true;
 }
 
+/* SaveSymbolCache() writes the symbols of a report to the cache; a failure
+ * is not an error (the directory may be read-only).
+ */
+static void SaveSymbolCache(const wxString &file, wxFileOffset size, time_t stamp, const std::vector<CSymbolEntry> &symbols)
+{
+    std::string buffer(SYMCACHE_SIGNATURE);
+    PutNumber(buffer, (unsigned long)size);
+    PutNumber(buffer, (unsigned long)stamp);
+    PutNumber(buffer, (unsigned long)symbols.size());
+    for (unsigned idx = 0; idx < symbols.size(); idx++) {
+        PutString(buffer, symbols[idx].SymbolName);
+        PutString(buffer, symbols[idx].Syntax);
+        PutString(buffer, symbols[idx].Summary);
+        PutString(buffer, symbols[idx].Source);
+        PutNumber(buffer, (unsigned long)symbols[idx].Line);
+    }
+    wxFFile cache;
+    if (cache.Open(file + SYMCACHE_EXT, "wb")) {
+        bool ok = (cache.Write(buffer.data(), buffer.length()) == buffer.length());
+        cache.Close();
+        if (!ok)
+            wxRemoveFile(file + SYMCACHE_EXT);
+    }
+}
+
+/* ReadReportFile()
+ * Reads the symbols from a report (or from its cache), with full paths for
+ * the source files. This function does not touch a symbol list, so it may
+ * run on any thread.
+ */
+bool CSymbolList::ReadReportFile(const wxString& file, std::vector<CSymbolEntry>& symbols)
+{
+    wxFFile report;
+    if (!wxFileExists(file) || !report.Open(file, "rb"))
+        return false;
+    wxFileOffset size = report.Length();
+    time_t stamp = wxFileModificationTime(file);
+    if (!LoadSymbolCache(file, size, stamp, symbols)) {
+        symbols.clear();
+        std::vector<char> text((size_t)size + 1);
+        if (size <= 0 || report.Read(&text[0], (size_t)size) != (size_t)size)
+            return false;
+        text[(size_t)size] = '\0';
+        if (!ParseReport(&text[0], symbols))
+            return false;
+        SaveSymbolCache(file, size, stamp, symbols);
+    }
+    report.Close();
+
+    /* the cache has the paths as they are in the report; make a full path,
+       if needed */
+    wxString path = file.BeforeLast(DIRSEP_CHAR) + wxT(DIRSEP_STR);
+    CPoolString prevsource, prevpath;   /* most symbols come from the same few files */
+    for (unsigned idx = 0; idx < symbols.size(); idx++) {
+        CPoolString &source = symbols[idx].Source;
+        if (source == prevsource) {
+            source = prevpath;
+            continue;
+        }
+        prevsource = source;
+        if (source[0] != '\0' && source[1] != '\0' && source[0] != DIRSEP_CHAR && source[1] != ':')
+            source = path + source.Str();
+        prevpath = source;
+    }
+    return true;
+}
+
+/* MergeReports()
+ * Replaces the symbols of the reports in the set (read with ReadReportFile())
+ * and updates the list.
+ */
+void CSymbolList::MergeReports(const ReportTables& reports)
+{
+    std::set<unsigned> files;
+    for (ReportTables::const_iterator iter = reports.begin(); iter != reports.end(); ++iter)
+        files.insert(StringPool.Lower(StringPool.Intern(iter->first)));
+    unsigned count = 0;
+    for (unsigned idx = 0; idx < Entries.size(); idx++) {
+        const CSymbolEntry &item = Entries[idx];
+        if (!item.Indexed && files.find(StringPool.Lower(item.XMLfile.Id())) != files.end())
+            continue;
+        if (count != idx)
+            Entries[count] = item;
+        count++;
+    }
+    Entries.resize(count);
+    Reindex();
+
+    for (ReportTables::const_iterator iter = reports.begin(); iter != reports.end(); ++iter) {
+        const std::vector<CSymbolEntry> &symbols = iter->second;
+        CPoolString xmlfile(iter->first);
+        for (unsigned idx = 0; idx < symbols.size(); idx++) {
+            CSymbolEntry item = symbols[idx];
+            item.XMLfile = xmlfile;
+            item.Indexed = false;
+            Insert(item);
+        }
+    }
+    RemoveIndexedDuplicates();
+    Update();
+}
+
+bool CSymbolList::LoadReportFile(const wxString& file)
+{
+    ReportTables reports;
+    if (!ReadReportFile(file, reports[file])) {
+        Remove(false, file);
+        return false;
+    }
+    MergeReports(reports);
+    return true;
+}
+
+/* AddIndexed()
+ * Adds a symbol that the source indexer found; call Update() after adding the
+ * symbols. A symbol from a report takes precedence (it has more information),
+ * but the line number of the indexer is more recent.
+ */
+bool CSymbolList::AddIndexed(const wxString &source, const wxString &symname, const wxString &syntax,
+                             const wxString &summary, int line)
+{
+    CSymbolEntry item;
+    item.SymbolName = symname;
+    item.Syntax = syntax;
+    item.Summary = summary;
+    item.Source = source;
+    item.Line = line;
+    item.Indexed = true;
+    SymbolKeyIndex::iterator iter = ReportIndex.find(Key(item.Source, item.SymbolName, CPoolString()));
+    if (iter != ReportIndex.end()) {
+        Entries[iter->second].Line = line;
+        return false;
+    }
+    return Insert(item);
+}
+
+void CSymbolList::RemoveIndexed(const wxString &source)
+{
+    Remove(true, source);
+}
+
+/* RemoveIndexedDuplicates()
+ * Removes the symbols of the indexer that are now also in a report.
+ */
+void CSymbolList::RemoveIndexedDuplicates()
+{
+    unsigned count = 0;
+    for (unsigned idx = 0; idx < Entries.size(); idx++) {
+        const CSymbolEntry &item = Entries[idx];
+        if (item.Indexed && ReportIndex.find(Key(item.Source, item.SymbolName, CPoolString())) != ReportIndex.end())
+            continue;
+        if (count != idx)
+            Entries[count] = item;
+        count++;
+    }
+    Entries.resize(count);
+}
+
 /* Lookup()
- * Looks up a symbol in the "browse" information.
- * If "skip" is greater than zero, the first "skip" matches are ignored. You can
- * use this when there are multiple symbols with the same name.
- * If "partial" is true, only the length of "symbol" is matched; a symbol that is
- * longer than parameter "symbol" but match it up to that length, is returned.
+ * Looks up a symbol in the "browse" information, and returns the range of
+ * all symbols with that name (there may be multiple symbols with the same
+ * name, in different source files or of different types). The range is empty
+ * if the symbol is not found.
+ */
+SymbolRange CSymbolList::Lookup(const wxString& symbol) const
+{
+    unsigned id = StringPool.Find(symbol);
+    if (id == POOL_NONE)
+        return SymbolRange(NULL, NULL);
+    SymbolNameIndex::const_iterator iter = NameIndex.find(id);
+    if (iter == NameIndex.end())
+        return SymbolRange(NULL, NULL);
+    const CSymbolEntry *first = &Entries[iter->second.first];
+    return SymbolRange(first, first + iter->second.second);
+}
+
+/* LookupPrefix()
+ * Returns the range of all symbols whose name starts with the prefix.
+ */
+SymbolRange CSymbolList::LookupPrefix(const wxString& prefix) const
+{
+    if (Entries.empty())
+        return SymbolRange(NULL, NULL);
+    wxScopedCharBuffer utf8 = prefix.utf8_str();
+    const char *text = utf8.data();
+    std::vector<CSymbolEntry>::const_iterator low = std::lower_bound(Entries.begin(), Entries.end(), text, NameLess);
+    std::vector<CSymbolEntry>::const_iterator high = std::upper_bound(low, Entries.end(), text, PrefixLess);
+    const CSymbolEntry *base = &Entries[0];
+    return SymbolRange(base + (low - Entries.begin()), base + (high - Entries.begin()));
+}
+
+/* Footprint()
+ * Returns the memory used by the list and its indices, in bytes, without the
+ * text of the strings (which is in the string pool). Optionally, it returns
+ * an estimate for the same list where each field and each key is a separate
+ * wxString.
  */
-const CSymbolEntry* CSymbolList::Lookup(const wxString& symbol, int skip, bool partial) const
+unsigned long CSymbolList::Footprint(unsigned long* unpooled) const
 {
-    CSymbolEntry *item = SymbolList.Next;
-    while (item) {
-        wxString symname = item->SymbolName.Mid(2);
-        if (partial)
-            symname = symname.Left(symbol.Length());
-        if (symname.Cmp(symbol) == 0) {
-            if (--skip < 0)
-                return item;
+    /* an entry in a hash map has the key, the value and a "next" pointer */
+    unsigned long size = Entries.capacity() * sizeof(CSymbolEntry)
+                         + NameIndex.size() * (sizeof(unsigned) + sizeof(SymbolSpan) + sizeof(void*))
+                         + (KeyIndex.size() + ReportIndex.size()) * (sizeof(SymbolKey) + sizeof(unsigned) + sizeof(void*));
+    if (unpooled) {
+        const unsigned long fields = 6;
+        const unsigned long overhead = sizeof(wxString) + sizeof(void*);    /* wxString plus its heap block header */
+        unsigned long estimate = Entries.capacity() * (sizeof(CSymbolEntry) + fields * (sizeof(wxString) - sizeof(CPoolString)));
+        for (unsigned idx = 0; idx < Entries.size(); idx++) {
+            const CSymbolEntry &item = Entries[idx];
+            unsigned long name = StringPool.Length(item.Name.Id());
+            unsigned long symname = StringPool.Length(item.SymbolName.Id());
+            unsigned long syntax = StringPool.Length(item.Syntax.Id());
+            unsigned long source = StringPool.Length(item.Source.Id());
+            unsigned long text = name + symname + syntax + source
+                                 + StringPool.Length(item.Summary.Id()) + StringPool.Length(item.XMLfile.Id());
+            estimate += (text + fields) * sizeof(wxChar) + fields * sizeof(void*);
+            /* the keys of the indices */
+            estimate += (source + symname + syntax + 3) * sizeof(wxChar) + overhead + sizeof(unsigned) + sizeof(void*);
+            if (!item.Indexed)
+                estimate += (source + symname + 2) * sizeof(wxChar) + overhead + sizeof(unsigned) + sizeof(void*);
+            if (idx == 0 || Entries[idx - 1].Name != item.Name)
+                estimate += (name + 1) * sizeof(wxChar) + overhead + sizeof(SymbolSpan) + sizeof(void*);
         }
-        item = item->Next;
+        *unpooled = estimate;
     }
-    return 0;
+    return size;
+}
+
+CReportLoader::CReportLoader(wxEvtHandler* owner, int id)
+    : Owner(owner), Id(id), Next(0), Running(0), Abort(false)
+{
+}
+
+CReportLoader::~CReportLoader()
+{
+    Stop();
+}
+
+/* Start()
+ * Starts reading the files; a set that is still being read is dropped. The
+ * function returns false if no worker thread could be started (the caller
+ * should then load the files itself).
+ */
+bool CReportLoader::Start(const wxArrayString& files)
+{
+    Stop();
+    if (files.IsEmpty())
+        return false;
+    Files = files;
+    Tables.assign(files.GetCount(), std::vector<CSymbolEntry>());
+    Loaded.assign(files.GetCount(), 0);
+    Next = 0;
+    Abort = false;
+
+    unsigned count = (wxThread::GetCPUCount() > 0) ? (unsigned)wxThread::GetCPUCount() : 1;
+    if (count > REPORT_WORKERS)
+        count = REPORT_WORKERS;
+    if (count > files.GetCount())
+        count = files.GetCount();
+    for (unsigned idx = 0; idx < count; idx++) {
+        Worker* worker = new Worker(this);
+        Running++;
+        if (worker->Create() != wxTHREAD_NO_ERROR || worker->Run() != wxTHREAD_NO_ERROR) {
+            delete worker;
+            if (--Running == 0 && !Workers.empty())
+                wxQueueEvent(Owner, new wxThreadEvent(wxEVT_THREAD, Id));  /* the others are done already */
+            continue;
+        }
+        Workers.push_back(worker);
+    }
+    return !Workers.empty();
+}
+
+/* Restart()
+ * Reads the current set again, with the file added to it (if it is not in the
+ * set yet), for a report that was rewritten while the set is being read; the
+ * workers might otherwise return the previous version of that report. The
+ * function returns false if no set is being read, or if no worker thread could
+ * be started.
+ */
+bool CReportLoader::Restart(const wxString& file)
+{
+    if (!IsBusy())
+        return false;
+    wxArrayString files = Files;
+    if (files.Index(file, wxFileName::IsCaseSensitive()) == wxNOT_FOUND)
+        files.Add(file);
+    return Start(files);
+}
+
+void CReportLoader::Stop()
+{
+    Abort = true;
+    for (unsigned idx = 0; idx < Workers.size(); idx++) {
+        Workers[idx]->Wait();
+        delete Workers[idx];
+    }
+    Workers.clear();
+    Running = 0;
+}
+
+/* TakeResults()
+ * Returns the tables of the files that could be read, after all workers have
+ * finished; it returns false if the set is not complete (or if the results
+ * were already taken).
+ */
+bool CReportLoader::TakeResults(ReportTables& reports)
+{
+    if (Workers.empty() || Running != 0)
+        return false;
+    Stop();
+    for (unsigned idx = 0; idx < Files.GetCount(); idx++)
+        if (Loaded[idx])
+            reports[Files[idx]].swap(Tables[idx]);
+    Files.Clear();
+    Tables.clear();
+    Loaded.clear();
+    return true;
 }
 
+wxThread::ExitCode CReportLoader::Worker::Entry()
+{
+    unsigned idx;
+    while (!Loader->Abort && (idx = Loader->Next++) < Loader->Files.GetCount())
+        Loader->Loaded[idx] = CSymbolList::ReadReportFile(Loader->Files[idx], Loader->Tables[idx]);
+    /* the last worker to finish notifies the owner */
+    if (--Loader->Running == 0 && !Loader->Abort)
+        wxQueueEvent(Loader->Owner, new wxThreadEvent(wxEVT_THREAD, Loader->Id));
+    return 0;
+}
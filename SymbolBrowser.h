@@ -20,36 +20,130 @@
 #define _SYMBOLBROWSER_H
 
 #include <wx/wx.h>
+#include <wx/hashmap.h>
+#include <wx/thread.h>
+#include <atomic>
+#include <map>
+#include <utility>
+#include <vector>
+#include "StringPool.h"
+
+#define REPORT_WORKERS  8       // maximum number of threads for loading reports
 
 class CSymbolEntry
 {
 public:
-    CSymbolEntry() : Next(0), Line(0) {}
-    bool Add(const wxString &xmlfile, const wxString &symname, const wxString &syntax,
-             const wxString &summary, const wxString &source, int line);
-    void Remove(const wxString &xmlfile = wxEmptyString);
+    CSymbolEntry() : Line(0), Indexed(false) {}
 
 public:
-    wxString SymbolName;    // name plus type
-    wxString Syntax;        // name plus decoration
-    wxString Source;        // source file where the symbol is defined
-    wxString Summary;       // symbol documentation (summary)
+    CPoolString SymbolName; // name plus type
+    CPoolString Name;       // name without type (for lookups)
+    CPoolString Syntax;     // name plus decoration
+    CPoolString Source;     // source file where the symbol is defined
+    CPoolString Summary;    // symbol documentation (summary)
     int Line;
 
-    wxString XMLfile;       // XML report file from which the declaration comes
-    CSymbolEntry *Next;
+    CPoolString XMLfile;    // XML report file from which the declaration comes
+    bool Indexed;           // declaration comes from the source indexer (no report)
+};
+
+// Key of a symbol: the source file (in lower case), the name plus type and
+// (optionally) the syntax, all as ids in the string pool
+struct SymbolKey {
+    SymbolKey(unsigned source, unsigned symname, unsigned syntax) : Source(source), SymbolName(symname), Syntax(syntax) {}
+    unsigned Source, SymbolName, Syntax;
+};
+class SymbolKeyHash {
+public:
+    SymbolKeyHash() {}
+    unsigned long operator()(const SymbolKey& key) const
+        { return (key.Source * 31u + key.SymbolName) * 31u + key.Syntax; }
+    SymbolKeyHash& operator=(const SymbolKeyHash&) { return *this; }
 };
+class SymbolKeyEqual {
+public:
+    SymbolKeyEqual() {}
+    bool operator()(const SymbolKey& a, const SymbolKey& b) const
+        { return a.Source == b.Source && a.SymbolName == b.SymbolName && a.Syntax == b.Syntax; }
+    SymbolKeyEqual& operator=(const SymbolKeyEqual&) { return *this; }
+};
+
+typedef std::pair<const CSymbolEntry*, const CSymbolEntry*> SymbolRange;   // begin, end
+typedef std::pair<unsigned, unsigned> SymbolSpan;                           // first index, count
+WX_DECLARE_HASH_MAP(unsigned, SymbolSpan, wxIntegerHash, wxIntegerEqual, SymbolNameIndex);    // name id -> range
+WX_DECLARE_HASH_MAP(SymbolKey, unsigned, SymbolKeyHash, SymbolKeyEqual, SymbolKeyIndex);
+typedef std::map<wxString, std::vector<CSymbolEntry> > ReportTables;     // report file -> symbols
 
+// The symbols are kept in a vector, sorted on the name (and on the type, for
+// symbols with the same name), so that all symbols with the same name, or that
+// start with the same prefix, form a range. Pointers to the entries are valid
+// until the list changes.
 class CSymbolList
 {
 public:
-    ~CSymbolList() { Clear(); }
-    void Clear() { SymbolList.Remove(); }
+    void Clear();
     bool LoadReportFile(const wxString& file);
-    const CSymbolEntry* Lookup(const wxString& symbol, int skip = 0, bool partial = false) const;
-    const CSymbolEntry* Root() const { return SymbolList.Next; }
+    void MergeReports(const ReportTables& reports);
+    static bool ReadReportFile(const wxString& file, std::vector<CSymbolEntry>& symbols);
+    bool AddIndexed(const wxString &source, const wxString &symname, const wxString &syntax,
+                    const wxString &summary, int line);
+    void RemoveIndexed(const wxString &source);
+    void Update();
+
+    SymbolRange Lookup(const wxString& symbol) const;
+    SymbolRange LookupPrefix(const wxString& prefix) const;
+    unsigned Count() const { return Entries.size(); }
+    const CSymbolEntry* Entry(unsigned idx) const { return &Entries[idx]; }
+    unsigned long Footprint(unsigned long* unpooled = NULL) const;
+
 private:
-    CSymbolEntry SymbolList;
+    bool Insert(const CSymbolEntry &symbol);
+    void Remove(bool indexed, const wxString &file);
+    void Reindex();
+    void RemoveIndexedDuplicates();
+    static SymbolKey Key(const CPoolString &source, const CPoolString &symname, const CPoolString &syntax);
+
+    std::vector<CSymbolEntry> Entries;
+    SymbolNameIndex NameIndex;  // name -> range in Entries (valid after Update())
+    SymbolKeyIndex KeyIndex;    // source + type + name + syntax -> index in Entries
+    SymbolKeyIndex ReportIndex; // source + type + name -> index in Entries, for symbols from a report
+};
+
+// The report loader reads a set of report files on a pool of worker threads,
+// each file into a separate table. The owner receives a wxEVT_THREAD event
+// with the given id when all files are read, and then collects the tables
+// with TakeResults(), to merge them into the symbol list in one step.
+class CReportLoader
+{
+public:
+    CReportLoader(wxEvtHandler* owner, int id);
+    ~CReportLoader();
+
+    bool Start(const wxArrayString& files);
+    bool Restart(const wxString& file);
+    void Stop();
+    bool IsBusy() const { return !Workers.empty(); }
+    bool TakeResults(ReportTables& reports);
+
+private:
+    class Worker : public wxThread {
+    public:
+        Worker(CReportLoader* loader) : wxThread(wxTHREAD_JOINABLE), Loader(loader) {}
+    protected:
+        virtual ExitCode Entry();
+    private:
+        CReportLoader* Loader;
+    };
+
+    wxEvtHandler* Owner;
+    int Id;
+    std::vector<Worker*> Workers;
+    wxArrayString Files;        // the files of the current set (fixed while the workers run)
+    std::vector< std::vector<CSymbolEntry> > Tables;  // symbols per file, each filled by a single worker
+    std::vector<char> Loaded;   // whether the file was read
+    std::atomic<unsigned> Next; // next file to read
+    std::atomic<unsigned> Running;
+    std::atomic<bool> Abort;
 };
 
 #endif /* _SYMBOLBROWSER_H */
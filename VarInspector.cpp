@@ -0,0 +1,280 @@
+/*  Quincy IDE for the Pawn scripting language
+ *
+ *  Copyright CompuPhase, 2009-2024
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License"); you may not
+ *  use this file except in compliance with the License. You may obtain a copy
+ *  of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS, WITHOUT
+ *  WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. See the
+ *  License for the specific language governing permissions and limitations
+ *  under the License.
+ *
+ *  Version: $Id$
+ */
+#include "wxQuincy.h"
+#include "VarInspector.h"
+
+/* The inspector never asks the debugger for a complete array. Arrays are
+ * split in pages of INSPECT_PAGESIZE elements, and only the elements of the
+ * pages that are expanded (and visible) are requested, one element per
+ * command. The values are kept until execution resumes.
+ */
+
+bool CVarInspector::AddVariable(const wxString& name, const wxArrayLong& dims)
+{
+    wxASSERT(m_tree);
+    wxTreeItemId root = m_tree->GetRootItem();
+    wxASSERT(root.IsOk());
+
+    /* if the variable is already in the list, just select it */
+    wxTreeItemIdValue cookie;
+    for (wxTreeItemId item = m_tree->GetFirstChild(root, cookie); item.IsOk(); item = m_tree->GetNextChild(root, cookie)) {
+        InspectItemData* data = (InspectItemData*)m_tree->GetItemData(item);
+        if (data && data->Expr.Cmp(name) == 0) {
+            m_tree->SelectItem(item);
+            return false;
+        }
+    }
+
+    m_dims[name] = dims;
+    wxTreeItemId item;
+    if (dims.Count() == 0) {
+        item = m_tree->AppendItem(root, Label(name, "?"), -1, -1, new InspectItemData(INSPECT_VALUE, name, 0));
+        m_leaves[name] = item;
+        Request(name);
+    } else {
+        wxString label = name;
+        for (unsigned idx = 0; idx < dims.Count(); idx++)
+            label += (dims[idx] > 0) ? wxString::Format("[%ld]", dims[idx]) : wxString("[]");
+        item = m_tree->AppendItem(root, label, -1, -1, new InspectItemData(INSPECT_ARRAY, name, 0));
+        m_tree->SetItemHasChildren(item, true);
+    }
+    m_tree->SelectItem(item);
+    return true;
+}
+
+void CVarInspector::Clear()
+{
+    wxASSERT(m_tree);
+    m_tree->DeleteChildren(m_tree->GetRootItem());
+    m_dims.clear();
+    m_leaves.clear();
+    m_values.clear();
+    m_queue.Clear();
+}
+
+void CVarInspector::Remove(const wxTreeItemId& item)
+{
+    /* remove any leaves below this item from the lookup table (and the queue) */
+    wxASSERT(m_tree);
+    InspectItemData* data = (InspectItemData*)m_tree->GetItemData(item);
+    if (data && data->Kind == INSPECT_VALUE) {
+        m_leaves.erase(data->Expr);
+        int idx = m_queue.Index(data->Expr);
+        if (idx != wxNOT_FOUND)
+            m_queue.RemoveAt(idx);
+    }
+    wxTreeItemIdValue cookie;
+    for (wxTreeItemId child = m_tree->GetFirstChild(item, cookie); child.IsOk(); child = m_tree->GetNextChild(item, cookie))
+        Remove(child);
+}
+
+void CVarInspector::Delete(const wxTreeItemId& item)
+{
+    wxASSERT(m_tree);
+    if (!item.IsOk() || m_tree->GetItemParent(item) != m_tree->GetRootItem())
+        return; /* only complete variables can be removed */
+    InspectItemData* data = (InspectItemData*)m_tree->GetItemData(item);
+    if (data)
+        m_dims.erase(data->Expr);
+    Remove(item);
+    m_tree->Delete(item);
+}
+
+void CVarInspector::Expand(const wxTreeItemId& item)
+{
+    wxASSERT(m_tree);
+    InspectItemData* data = (InspectItemData*)m_tree->GetItemData(item);
+    if (!data)
+        return;
+
+    switch (data->Kind) {
+    case INSPECT_ARRAY:
+        if (!data->Populated) {
+            AddPages(item, data, 0);
+            data->Populated = true;
+        }
+        break;
+    case INSPECT_PAGE: {
+        if (!data->Populated) {
+            const wxArrayLong& dims = m_dims[data->Expr.BeforeFirst('[')];
+            bool leaf = (data->Level + 1 >= (int)dims.Count());
+            for (int index = data->First; index < data->First + data->Count; index++) {
+                wxString expr = data->Expr + wxString::Format("[%d]", index);
+                if (leaf) {
+                    wxTreeItemId child = m_tree->AppendItem(item, Label(expr, "?"), -1, -1, new InspectItemData(INSPECT_VALUE, expr, data->Level + 1));
+                    m_leaves[expr] = child;
+                } else {
+                    wxTreeItemId child = m_tree->AppendItem(item, wxString::Format("[%d]", index), -1, -1, new InspectItemData(INSPECT_ARRAY, expr, data->Level + 1));
+                    m_tree->SetItemHasChildren(child, true);
+                }
+            }
+            data->Populated = true;
+        }
+        /* fetch the elements on this page that are not yet known */
+        wxTreeItemIdValue cookie;
+        for (wxTreeItemId child = m_tree->GetFirstChild(item, cookie); child.IsOk(); child = m_tree->GetNextChild(item, cookie)) {
+            InspectItemData* cdata = (InspectItemData*)m_tree->GetItemData(child);
+            if (cdata && cdata->Kind == INSPECT_VALUE)
+                Request(cdata->Expr);
+        }
+        break;
+    }
+    case INSPECT_MORE: {
+        /* replace the placeholder by the next series of pages */
+        wxTreeItemId parent = m_tree->GetItemParent(item);
+        InspectItemData* pdata = (InspectItemData*)m_tree->GetItemData(parent);
+        int first = data->First;
+        m_tree->Delete(item);   /* also deletes "data" */
+        if (pdata)
+            AddPages(parent, pdata, first);
+        break;
+    }
+    }
+}
+
+void CVarInspector::AddPages(const wxTreeItemId& parent, const InspectItemData* data, int first)
+{
+    wxASSERT(m_tree);
+    wxASSERT(data);
+    const wxArrayLong& dims = m_dims[data->Expr.BeforeFirst('[')];
+    wxASSERT(data->Level < (int)dims.Count());
+    long size = dims[data->Level];     /* 0 if unknown */
+
+    /* if the size is unknown, add a single page at a time: the end of the
+       array is found when the debugger refuses an index */
+    int maxpages = (size > 0) ? INSPECT_MAXPAGES : 1;
+    int start = first;
+    for (int page = 0; page < maxpages && (size == 0 || start < size); page++) {
+        int count = INSPECT_PAGESIZE;
+        if (size > 0 && start + count > size)
+            count = size - start;
+        wxString label = wxString::Format("[%d..%d]", start, start + count - 1);
+        wxTreeItemId item = m_tree->AppendItem(parent, label, -1, -1, new InspectItemData(INSPECT_PAGE, data->Expr, data->Level, start, count));
+        m_tree->SetItemHasChildren(item, true);
+        start += count;
+    }
+    if (size == 0 || start < size)
+        m_tree->AppendItem(parent, "...", -1, -1, new InspectItemData(INSPECT_MORE, data->Expr, data->Level, start));
+}
+
+void CVarInspector::Request(const wxString& expr)
+{
+    std::map<wxString, wxString>::iterator iter = m_values.find(expr);
+    if (iter != m_values.end()) {
+        /* in the cache, no need to ask the debugger */
+        std::map<wxString, wxTreeItemId>::iterator leaf = m_leaves.find(expr);
+        if (leaf != m_leaves.end())
+            m_tree->SetItemText(leaf->second, Label(expr, iter->second));
+        return;
+    }
+    if (m_pending.Cmp(expr) != 0 && m_queue.Index(expr) == wxNOT_FOUND)
+        m_queue.Add(expr);
+}
+
+wxString CVarInspector::NextRequest()
+{
+    wxASSERT(m_queue.Count() > 0);
+    m_pending = m_queue[0];
+    m_queue.RemoveAt(0);
+    return m_pending;
+}
+
+void CVarInspector::HandleReply(const wxString& value)
+{
+    wxASSERT(m_pending.Length() > 0);
+    m_values[m_pending] = value;
+    std::map<wxString, wxTreeItemId>::iterator leaf = m_leaves.find(m_pending);
+    if (leaf != m_leaves.end())
+        m_tree->SetItemText(leaf->second, Label(m_pending, value));
+    m_pending.Clear();
+}
+
+void CVarInspector::HandleFailure()
+{
+    wxASSERT(m_pending.Length() > 0);
+    std::map<wxString, wxTreeItemId>::iterator leaf = m_leaves.find(m_pending);
+    if (leaf != m_leaves.end()) {
+        wxTreeItemId item = leaf->second;
+        InspectItemData* data = (InspectItemData*)m_tree->GetItemData(item);
+        const wxArrayLong& dims = m_dims[m_pending.BeforeFirst('[')];
+        int level = data ? data->Level - 1 : -1;
+        if (level >= 0 && level < (int)dims.Count() && dims[level] == 0) {
+            /* array of unknown size: the index is past the end, so remove this
+               element, the elements following it, and any further pages */
+            wxTreeItemId page = m_tree->GetItemParent(item);
+            while (item.IsOk()) {
+                wxTreeItemId next = m_tree->GetNextSibling(item);
+                Remove(item);
+                m_tree->Delete(item);
+                item = next;
+            }
+            wxTreeItemId next = m_tree->GetNextSibling(page);
+            while (next.IsOk()) {
+                wxTreeItemId follow = m_tree->GetNextSibling(next);
+                Remove(next);
+                m_tree->Delete(next);
+                next = follow;
+            }
+            if (m_tree->GetChildrenCount(page, false) == 0) {
+                Remove(page);
+                m_tree->Delete(page);
+            }
+        } else {
+            m_tree->SetItemText(item, Label(m_pending, "(not available)"));
+        }
+    }
+    m_pending.Clear();
+}
+
+void CVarInspector::Invalidate()
+{
+    /* execution resumes: all values become stale */
+    m_values.clear();
+    m_queue.Clear();
+    m_pending.Clear();
+    m_stale = true;
+}
+
+void CVarInspector::Refresh()
+{
+    if (m_stale) {
+        m_stale = false;
+        QueueVisible();
+    }
+}
+
+void CVarInspector::QueueVisible()
+{
+    /* only request the elements that the user can see; the others are
+       fetched when they scroll into view */
+    wxASSERT(m_tree);
+    for (std::map<wxString, wxTreeItemId>::iterator iter = m_leaves.begin(); iter != m_leaves.end(); ++iter) {
+        if (m_values.find(iter->first) == m_values.end() && m_tree->IsVisible(iter->second))
+            Request(iter->first);
+    }
+}
+
+wxString CVarInspector::Label(const wxString& expr, const wxString& value) const
+{
+    /* elements only show their (last) index, top-level variables the full name */
+    wxString name = expr;
+    if (expr.Right(1).Cmp("]") == 0)
+        name = "[" + expr.AfterLast('[');
+    return name + " = " + value;
+}
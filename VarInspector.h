@@ -0,0 +1,84 @@
+/*  Quincy IDE for the Pawn scripting language
+ *
+ *  Copyright CompuPhase, 2009-2024
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License"); you may not
+ *  use this file except in compliance with the License. You may obtain a copy
+ *  of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS, WITHOUT
+ *  WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. See the
+ *  License for the specific language governing permissions and limitations
+ *  under the License.
+ *
+ *  Version: $Id$
+ */
+#ifndef _VARINSPECTOR_H
+#define _VARINSPECTOR_H
+
+#include <wx/wx.h>
+#include <wx/treectrl.h>
+#include <map>
+
+#define INSPECT_PAGESIZE    16  /* number of array elements per page */
+#define INSPECT_MAXPAGES    32  /* number of pages added in one go (more are added on request) */
+
+enum {
+    INSPECT_VALUE,      /* scalar (or array element), its value is fetched from the debugger */
+    INSPECT_ARRAY,      /* array (or sub-array), children are pages */
+    INSPECT_PAGE,       /* range of elements of an array */
+    INSPECT_MORE,       /* placeholder to add more pages */
+};
+
+class InspectItemData : public wxTreeItemData {
+public:
+    InspectItemData(int kind, const wxString& expr, int level, int first = 0, int count = 0)
+        : Kind(kind), Expr(expr), Level(level), First(first), Count(count), Populated(false)
+        {}
+    int Kind;
+    wxString Expr;      /* expression for the debugger ("buf" or "table[3]") */
+    int Level;          /* the dimension that this node (or its children) index */
+    int First, Count;   /* range of indices (for pages) */
+    bool Populated;     /* whether the children have been added */
+};
+
+class CVarInspector {
+public:
+    CVarInspector() : m_tree(0), m_stale(false) {}
+    void SetControl(wxTreeCtrl* tree) { m_tree = tree; }
+    wxTreeCtrl* GetControl() const { return m_tree; }
+
+    bool AddVariable(const wxString& name, const wxArrayLong& dims);
+    void Clear();
+    void Delete(const wxTreeItemId& item);
+    void Expand(const wxTreeItemId& item);
+
+    bool HasRequest() const { return m_queue.Count() > 0; }
+    wxString NextRequest();
+    bool IsPending() const { return m_pending.Length() > 0; }
+    void HandleReply(const wxString& value);
+    void HandleFailure();
+
+    void Invalidate();
+    void Refresh();
+    void QueueVisible();
+
+private:
+    void Remove(const wxTreeItemId& item);
+    void AddPages(const wxTreeItemId& parent, const InspectItemData* data, int first);
+    void Request(const wxString& expr);
+    wxString Label(const wxString& expr, const wxString& value) const;
+
+    wxTreeCtrl* m_tree;
+    std::map<wxString, wxArrayLong> m_dims;         /* dimensions per top-level variable */
+    std::map<wxString, wxTreeItemId> m_leaves;      /* expression -> tree item */
+    std::map<wxString, wxString> m_values;          /* cached values, valid until the next step */
+    wxArrayString m_queue;                          /* expressions still to fetch */
+    wxString m_pending;                             /* expression sent to the debugger */
+    bool m_stale;                                   /* execution resumed since the last refresh */
+};
+
+#endif /* _VARINSPECTOR_H */
@@ -1,7 +1,8 @@
 /* List valid COM ports
  *
  * For the Microsoft Windows part: see http://www.codeproject.com/system/serial_portsenum_fifo.asp
- * For the Linux part: see the source code of setserial.
+ * For the Linux part: the serial ports are read from /sys/class/tty, and the
+ * list is kept up to date by watching /dev (with inotify).
  *
  * Partial copyright 2006-2024 CompuPhase
  *
@@ -28,6 +29,7 @@
   #include <tchar.h>
 #endif
 #include <assert.h>
+#include <wx/thread.h>
 #include "portscan.h"
 
 //---------------------------------------------------------------------------
@@ -149,13 +151,40 @@ bool EndEnumeratePorts(HPORT DeviceInfoSet)
 
 #else // WIN32
 
-#include <sys/ioctl.h>
-#include <linux/serial.h>
+#include <poll.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/inotify.h>
+#include <sys/stat.h>
+
+/* A serial port is a tty in /sys/class/tty that has a "device" link (virtual
+   consoles and pseudo-terminals have none). For ports of the serial core
+   (such as ttyS*), the "type" attribute is 0 when there is no UART at the
+   port. The device itself is not opened for the check. */
+static bool IsSerialPort(const char *name)
+{
+  char path[300];
+  struct stat st;
+  snprintf(path, sizeof path, "/sys/class/tty/%s/device", name);
+  if (stat(path, &st) != 0)
+    return false;
+  snprintf(path, sizeof path, "/sys/class/tty/%s/type", name);
+  FILE *fp = fopen(path, "r");
+  if (fp != NULL) {
+    int type = 0;
+    int count = fscanf(fp, "%d", &type);
+    fclose(fp);
+    if (count == 1 && type == 0)
+      return false;
+  }
+  snprintf(path, sizeof path, "/dev/%s", name);
+  return stat(path, &st) == 0;
+}
 
 HPORT BeginEnumeratePorts(void)
 {
-  /* assume LINUX, FreeBSD, OpenBSD, or some other variant */
-  DIR *dir = opendir("/dev/");
+  DIR *dir = opendir("/sys/class/tty/");
   if (dir == NULL)
     return (HPORT)-1;
   return dir;
@@ -163,26 +192,14 @@ HPORT BeginEnumeratePorts(void)
 
 bool EnumeratePortsNext(HPORT DeviceInfoSet, wxString &PortName)
 {
-  bool ok = false;
   struct dirent *entry;
-  while ((entry=readdir(DeviceInfoSet)) != NULL && !ok) {
-    if (strncmp(entry->d_name, "ttyS", 4) == 0 || strncmp(entry->d_name, "ttyUSB", 6) == 0) {
-      /* verify whether this port really works */
-      struct serial_struct serinfo;
-      memset(&serinfo, 0, sizeof (serinfo));
-      char path[64];
-      sprintf(path, "/dev/%s", entry->d_name);
-      int fd = open(path, O_RDWR | O_NONBLOCK | O_NOCTTY);
-      if (fd >= 0) {
-        if (ioctl(fd, TIOCGSERIAL, &serinfo) >= 0 && serinfo.type != 0 && serinfo.baud_base != 0) {
-          PortName = wxString::FromUTF8(entry->d_name);
-          ok = true;
-        }
-        close(fd);
-      }
+  while ((entry=readdir(DeviceInfoSet)) != NULL) {
+    if (entry->d_name[0] != '.' && IsSerialPort(entry->d_name)) {
+      PortName = wxString::FromUTF8(entry->d_name);
+      return true;
     }
   }
-  return ok;
+  return false;
 }
 
 bool EndEnumeratePorts(HPORT DeviceInfoSet)
@@ -194,7 +211,30 @@ bool EndEnumeratePorts(HPORT DeviceInfoSet)
 #endif // WIN32
 
 
-wxArrayString EnumeratePortsList(void)
+/* ports with a numeric suffix are sorted on the number (so COM10 comes after
+   COM2); the legacy ttyS* ports go last */
+static int ComparePortNames(const wxString& name1, const wxString& name2)
+{
+  bool legacy1 = name1.StartsWith("ttyS");
+  bool legacy2 = name2.StartsWith("ttyS");
+  if (legacy1 != legacy2)
+    return legacy1 ? 1 : -1;
+  size_t pos1, pos2;
+  for (pos1 = 0; pos1 < name1.length() && wxIsalpha(name1[pos1]); pos1++)
+    {}
+  for (pos2 = 0; pos2 < name2.length() && wxIsalpha(name2[pos2]); pos2++)
+    {}
+  if (pos1 == pos2 && name1.Left(pos1).Cmp(name2.Left(pos2)) == 0) {
+    long seq1 = 0, seq2 = 0;
+    name1.Mid(pos1).ToLong(&seq1);
+    name2.Mid(pos2).ToLong(&seq2);
+    if (seq1 != seq2)
+      return (seq1 < seq2) ? -1 : 1;
+  }
+  return name1.Cmp(name2);
+}
+
+static wxArrayString ProbePorts(void)
 {
   wxArrayString list;
   HPORT hp = BeginEnumeratePorts();
@@ -204,5 +244,172 @@ wxArrayString EnumeratePortsList(void)
       list.Add(name);
     EndEnumeratePorts(hp);
   } /* if */
+  list.Sort(ComparePortNames);
   return list;
 }
+
+#if defined __WIN32__ || defined _WIN32 || defined WIN32
+
+wxArrayString EnumeratePortsList(void)
+{
+  return ProbePorts();
+}
+
+void EnumeratePortsWatch(wxEvtHandler* /* handler */, int /* id */)
+{
+  /* no watcher in Windows, the list is built on every call */
+}
+
+void EnumeratePortsStop(void)
+{
+}
+
+#else
+
+static wxMutex PortCacheLock;       /* protects the fields below */
+static wxArrayString PortCache;
+static bool PortCacheValid = false;
+static bool PortWatching = false;   /* watcher thread is active */
+static bool PortWatchFailed = false;/* inotify is unavailable, do not retry */
+static wxEvtHandler *PortHandler = NULL;
+static int PortHandlerId = wxID_ANY;
+
+static void UpdatePortCache(void)
+{
+  wxArrayString list = ProbePorts();
+  wxMutexLocker lock(PortCacheLock);
+  bool changed = !PortCacheValid || list != PortCache;
+  PortCache = list;
+  PortCacheValid = true;
+  if (changed && PortHandler != NULL)
+    wxQueueEvent(PortHandler, new wxThreadEvent(wxEVT_THREAD, PortHandlerId));
+}
+
+/* The watcher probes the ports once, then waits for devices to be added to
+   or removed from /dev, and probes again after each change. */
+class PortWatcher : public wxThread
+{
+public:
+  PortWatcher() : wxThread(wxTHREAD_JOINABLE) {}
+protected:
+  virtual ExitCode Entry();
+};
+
+static PortWatcher *PortWatcherThread = NULL;
+
+wxThread::ExitCode PortWatcher::Entry()
+{
+  UpdatePortCache();
+  int fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+  if (fd < 0 || inotify_add_watch(fd, "/dev", IN_CREATE | IN_DELETE | IN_ATTRIB) < 0) {
+    if (fd >= 0)
+      close(fd);
+    wxMutexLocker lock(PortCacheLock);
+    PortWatching = false; /* fall back to probing on every call */
+    PortWatchFailed = true;
+    return (ExitCode)1;
+  }
+  while (!TestDestroy()) {
+    /* wait with a time-out, so that a request to stop is seen */
+    struct pollfd pfd;
+    pfd.fd = fd;
+    pfd.events = POLLIN;
+    pfd.revents = 0;
+    if (poll(&pfd, 1, 500) <= 0)
+      continue;
+    bool changed = false;
+    char buffer[4096] __attribute__ ((aligned(__alignof__(struct inotify_event))));
+    ssize_t len;
+    while ((len = read(fd, buffer, sizeof buffer)) > 0) {
+      for (char *ptr = buffer; ptr < buffer + len; ) {
+        const struct inotify_event *event = (const struct inotify_event*)ptr;
+        if (event->len > 0 && strncmp(event->name, "tty", 3) == 0)
+          changed = true;
+        ptr += sizeof(struct inotify_event) + event->len;
+      }
+    }
+    if (changed) {
+      /* give udev a moment to finish setting up the device, then collect
+         the events of the same hotplug action */
+      Sleep(250);
+      while (read(fd, buffer, sizeof buffer) > 0)
+        {}
+      UpdatePortCache();
+    }
+  }
+  close(fd);
+  return (ExitCode)0;
+}
+
+static void StartPortWatcher(void)
+{
+  {
+    wxMutexLocker lock(PortCacheLock);
+    if (PortWatching || PortWatchFailed)
+      return;
+    PortWatching = true;
+  }
+  /* a watcher that stopped on a failure is cleaned up before a new start */
+  if (PortWatcherThread != NULL) {
+    PortWatcherThread->Wait();
+    delete PortWatcherThread;
+    PortWatcherThread = NULL;
+  }
+  PortWatcher *watcher = new PortWatcher;
+  if (watcher->Run() != wxTHREAD_NO_ERROR) {
+    delete watcher;
+    wxMutexLocker lock(PortCacheLock);
+    PortWatching = false;
+    PortWatchFailed = true;
+    return;
+  }
+  PortWatcherThread = watcher;
+}
+
+/** EnumeratePortsList() returns the list of serial ports. The list is
+ *  cached and kept current by a watcher thread, so the call does not block
+ *  (except on the first call, if the watcher has not finished yet).
+ */
+wxArrayString EnumeratePortsList(void)
+{
+  StartPortWatcher();
+  {
+    wxMutexLocker lock(PortCacheLock);
+    if (PortCacheValid && PortWatching)
+      return PortCache;
+  }
+  UpdatePortCache();
+  wxMutexLocker lock(PortCacheLock);
+  return PortCache;
+}
+
+/** EnumeratePortsWatch() starts the watcher thread (if not already running)
+ *  and sets a handler that receives a wxEVT_THREAD event with the given id
+ *  when the list of ports changes. Pass NULL to remove the handler.
+ */
+void EnumeratePortsWatch(wxEvtHandler *handler, int id)
+{
+  {
+    wxMutexLocker lock(PortCacheLock);
+    PortHandler = handler;
+    PortHandlerId = id;
+  }
+  StartPortWatcher();
+}
+
+/** EnumeratePortsStop() stops the watcher thread (and waits for it to
+ *  finish); call it on exit.
+ */
+void EnumeratePortsStop(void)
+{
+  if (PortWatcherThread == NULL)
+    return;
+  PortWatcherThread->Delete();
+  delete PortWatcherThread;
+  PortWatcherThread = NULL;
+  wxMutexLocker lock(PortCacheLock);
+  PortWatching = false;
+  PortHandler = NULL;
+}
+
+#endif
@@ -34,5 +34,7 @@ bool  EnumeratePortsNext(HPORT DeviceInfoSet, wxString &PortName);
 bool  EndEnumeratePorts(HPORT DeviceInfoSet);
 
 wxArrayString EnumeratePortsList(void);
+void EnumeratePortsWatch(wxEvtHandler *handler = NULL, int id = wxID_ANY);
+void EnumeratePortsStop(void);
 
 #endif /* _PORTSCAN_H */
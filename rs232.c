@@ -28,6 +28,7 @@
 # include <stdio.h>
 # include <string.h>
 # include <termios.h>
+# include <poll.h>
 # include <unistd.h>
 # include <sys/ioctl.h>
 #endif
@@ -45,14 +46,14 @@
 #if !defined sizearray
 # define sizearray(a)    (sizeof(a) / sizeof((a)[0]))
 #endif
-#define MAX_COMPORTS  4
+#define MAX_COMPORTS  32  /* enough for flashing many devices at once */
 
 static HCOM comport[MAX_COMPORTS];
 static int initialized = 0;
 
 #if !defined _WIN32
 # define INVALID_HANDLE_VALUE (-1)
-  static struct termios oldtio;
+  static struct termios oldtio[MAX_COMPORTS];  /* saved settings, per port */
 #endif /* _WIN32 */
 
 
@@ -176,7 +177,7 @@ HCOM* rs232_open(const char *port, unsigned baud, int databits, int stopbits, in
       }
     }
 
-    tcgetattr(*hCom, &oldtio); /* save current port settings */
+    tcgetattr(*hCom, &oldtio[hCom - comport]); /* save current port settings */
     memset(&newtio, 0, sizeof newtio);
 
     /* CREAD  - receiver enabled
@@ -196,6 +197,15 @@ HCOM* rs232_open(const char *port, unsigned baud, int databits, int stopbits, in
       newtio.c_cflag |= CRTSCTS;
 #   define NEWTERMIOS_SETBAUDARTE(bps) newtio.c_cflag |= bps;
     switch (baud) {
+    #ifdef B1000000
+      case 1000000: NEWTERMIOS_SETBAUDARTE( B1000000 ); break;
+    #endif // B1000000
+    #ifdef B921600
+      case  921600: NEWTERMIOS_SETBAUDARTE( B921600 ); break;
+    #endif // B921600
+    #ifdef B460800
+      case  460800: NEWTERMIOS_SETBAUDARTE( B460800 ); break;
+    #endif // B460800
     #ifdef B1152000
       case 1152000: NEWTERMIOS_SETBAUDARTE( B1152000 ); break;
     #endif // B1152000
@@ -259,7 +269,7 @@ HCOM *rs232_close(HCOM *hCom)
 #   else /* _WIN32 */
       tcflush(*hCom, TCOFLUSH);
       tcflush(*hCom, TCIFLUSH);
-      tcsetattr(*hCom, TCSANOW, &oldtio);
+      tcsetattr(*hCom, TCSANOW, &oldtio[hCom - comport]);
       close(*hCom);
 #   endif /* _WIN32 */
     *hCom = INVALID_HANDLE_VALUE;
@@ -279,6 +289,12 @@ bool rs232_isopen(const HCOM *hCom)
   return false;
 }
 
+/** rs232_xmit() writes the buffer to the port. The function returns when all
+ *  data is queued for transmission; it does not wait for the data to be
+ *  transmitted (call rs232_flush() for that).
+ *
+ *  \return The number of bytes written (which is less than the size on error).
+ */
 size_t rs232_xmit(HCOM *hCom, const unsigned char *buffer, size_t size)
 {
   if (rs232_isopen(hCom)) {
@@ -288,8 +304,23 @@ size_t rs232_xmit(HCOM *hCom, const unsigned char *buffer, size_t size)
         written = 0;
       return (size_t)written;
 #   else /* _WIN32 */
-      size_t written = write(*hCom, buffer, size);
-      tcdrain(*hCom);
+      /* the port is opened as non-blocking, so a write may be partial when the
+         output queue is full; wait for space in that case */
+      size_t written = 0;
+      while (written < size) {
+        ssize_t num = write(*hCom, buffer + written, size - written);
+        if (num < 0) {
+          if (errno != EAGAIN && errno != EINTR)
+            break;
+          struct pollfd fds;
+          fds.fd = *hCom;
+          fds.events = POLLOUT;
+          if (poll(&fds, 1, 1000) <= 0)
+            break;
+          continue;
+        }
+        written += (size_t)num;
+      }
       return written;
 #   endif /* _WIN32 */
   }
@@ -340,6 +371,49 @@ void rs232_flush(HCOM *hCom)
   }
 }
 
+/** rs232_wait() waits until data is available on the port, or until the
+ *  timeout expires, whichever comes first.
+ *
+ *  \param hCom    Port handle.
+ *  \param timeout The maximum time to wait, in milliseconds.
+ *
+ *  \return 1 if data is available, 0 on a time-out, -1 if the port was closed
+ *          or the device was removed.
+ */
+int rs232_wait(HCOM *hCom, int timeout)
+{
+  if (!rs232_isopen(hCom))
+    return -1;
+# if defined _WIN32
+    /* the port is not opened for overlapped I/O, so WaitCommEvent() cannot
+       time out; poll the input queue instead */
+    DWORD start = GetTickCount();
+    for ( ;; ) {
+      DWORD errflags = 0;
+      COMSTAT comstat;
+      if (!ClearCommError(*hCom, &errflags, &comstat))
+        return -1;
+      if (comstat.cbInQue > 0)
+        return 1;
+      if ((int)(GetTickCount() - start) >= timeout)
+        return 0;
+      Sleep(1);
+    }
+# else
+    struct pollfd fds;
+    fds.fd = *hCom;
+    fds.events = POLLIN;
+    int result = poll(&fds, 1, timeout);
+    if (result < 0)
+      return (errno == EINTR) ? 0 : -1;
+    if (result == 0)
+      return 0;
+    if ((fds.revents & (POLLHUP | POLLERR | POLLNVAL)) != 0 && (fds.revents & POLLIN) == 0)
+      return -1;
+    return 1;
+# endif
+}
+
 size_t rs232_peek(HCOM *hCom)
 {
   if (rs232_isopen(hCom)) {
@@ -59,6 +59,7 @@ HCOM*    rs232_close(HCOM *hCom);
 bool     rs232_isopen(const HCOM *hCom);
 size_t   rs232_xmit(HCOM *hCom, const unsigned char *buffer, size_t size);
 size_t   rs232_recv(HCOM *hCom, unsigned char *buffer, size_t size);
+int      rs232_wait(HCOM *hCom, int timeout);
 void     rs232_flush(HCOM *hCom);
 size_t   rs232_peek(HCOM *hCom);
 void     rs232_setstatus(HCOM *hCom, int code, int status);
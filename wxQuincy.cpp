@@ -97,6 +97,8 @@ bool QuincyApp::OnInit()
     Shortcuts.Add("Replace", "&Replace", "Ctrl+H", "Edit");
     Shortcuts.Add("GotoLine", "&Go to line...", "Ctrl+G", "Edit");
     Shortcuts.Add("GotoSymbol", "Go to &symbol definition", "Ctrl+F6", "Edit");
+    Shortcuts.Add("FindReferences", "Find &references", "Shift+F6", "Edit");
+    Shortcuts.Add("GotoAnything", "Go to &anything...", "Ctrl+Shift+P", "Edit");
     Shortcuts.Add("MatchBrace", "&Match brace", "Ctrl+]", "Edit");
     Shortcuts.Add("FillColumn", "Fill/insert columns", wxEmptyString, "Edit");
     Shortcuts.Add("Autocomplete", "&Autocomplete", "Ctrl+Space", "Edit");
@@ -107,6 +109,7 @@ bool QuincyApp::OnInit()
     Shortcuts.Add("ViewIndentGuides", "Indentation &Guides", wxEmptyString, "View");
     Shortcuts.Add("Compile", "&Compile", "F7", "Build / Run");
     Shortcuts.Add("Transfer", "&Transfer", "Ctrl+F7", "Build / Run");
+    Shortcuts.Add("TransferMulti", "Transfer to &multiple devices...", wxEmptyString, "Build / Run");
     Shortcuts.Add("Debug", "Start &Debugging", "F5", "Build / Run");
     Shortcuts.Add("Run", "&Run without debugging", "Ctrl+F5", "Build / Run");
     Shortcuts.Add("Stop", "&Stop", "Shift-F5", "Build / Run");
@@ -116,6 +119,11 @@ bool QuincyApp::OnInit()
     Shortcuts.Add("RunToCursor", "Run to &Cursor", "Ctrl+F10", "Build / Run");
     Shortcuts.Add("ToggleBreakpoint", "Toggle &Breakpoint", "F9", "Breakpoints");
     Shortcuts.Add("ClearBreakpoints", "Clear all breakpoints", wxEmptyString, "Breakpoints");
+    Shortcuts.Add("BreakpointProperties", "Breakpoint &properties...", "Alt+F9", "Breakpoints");
+    Shortcuts.Add("Inspect", "I&nspect variable", "Shift+F9", "Build / Run");
+    Shortcuts.Add("Profile", "&Profile", "Alt+F5", "Build / Run");
+    Shortcuts.Add("ProfileExport", "Export profile...", wxEmptyString, "Build / Run");
+    Shortcuts.Add("ProfileClear", "Clear profile", wxEmptyString, "Build / Run");
     Shortcuts.Add("Options", "&Options...", "Alt+F7", "Tools");
     Shortcuts.Add("SampleBrowser", "&Sample browser...", "Alt+F1", "Tools");
     Shortcuts.Add("TabToSpace", "Tabs to Spaces", wxEmptyString, "Whitespace");
@@ -123,6 +131,8 @@ bool QuincyApp::OnInit()
     Shortcuts.Add("SpaceToTab", "Spaces to Tabs (all)", wxEmptyString, "Whitespace");
     Shortcuts.Add("TrimTrailing", "Trim trailing whitespace", wxEmptyString, "Whitespace");
     Shortcuts.Add("DeviceTool", "Configure Device", wxEmptyString, "Tools");
+    Shortcuts.Add("DeviceSimulator", "Device si&mulator...", wxEmptyString, "Tools");
+    Shortcuts.Add("SerialBenchmark", "Serial &benchmark", wxEmptyString, "Tools");
     Shortcuts.Add("GeneralHelp", "&IDE User Guide", "Shift+F1", "Help");
     Shortcuts.Add("ContextHelp", "Context help", "F1", "Help");
 